@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stddef.h>
+#include <stdint.h>
+#include "alloc.h"
+
+/*
+ *secvarctl and secvarctl-bench are linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+ *so these count every allocation made by secvarctl's own code. Those made inside the crypto
+ *library are not seen, it calls the allocator directly. Not part of libsecvarctl.
+ *Until allocationCountStart() is called the wrappers only pass the call on
+ */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static uint64_t allocations;
+// set once before any thread is started, so it is read without atomics
+static int counting;
+
+void *__wrap_malloc(size_t size)
+{
+	if (counting)
+		__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	if (counting)
+		__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	if (counting)
+		__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	return __real_realloc(ptr, size);
+}
+
+// starts counting, call before starting any thread
+void allocationCountStart(void)
+{
+	counting = 1;
+}
+
+// @return number of malloc, calloc and realloc calls made by secvarctl so far
+uint64_t allocationCount(void)
+{
+	return __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+}
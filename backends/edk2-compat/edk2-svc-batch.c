@@ -0,0 +1,674 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h> // isspace
+#include <pthread.h>
+#include <argp.h>
+#include "secvarctl.h"
+#include "backends/edk2-compat/include/edk2-svc.h"
+
+enum jobState { JOB_PENDING = 0, JOB_RUNNING, JOB_DONE, JOB_SKIPPED };
+
+struct job {
+	int argc, lineNum, depCount, afterCount, readCount;
+	// every job with an index below barrier must finish before this one starts
+	int barrier;
+	// previous job that writes update files, these run in manifest order, -1 if none
+	int orderAfter;
+	// jobs from here up to this one that only verify must finish first, set for writers
+	int readersFrom;
+	char **argv;
+	// arguments that may be files the job reads, and the file it writes, see findFiles()
+	const char **reads;
+	const char *writes;
+	// earlier jobs that write a file this one reads, it is skipped if one of them failed
+	int *deps;
+	// earlier jobs that read or write the file this one writes, they only have to finish
+	int *after;
+	const struct command *cmd;
+	enum jobState state;
+	int rc;
+};
+
+struct jobQueue {
+	struct job *jobs;
+	int jobCount, finished;
+	// more than one worker takes jobs, see joinPool()
+	int parallel;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	// context of the batch command, every job runs in a context of its own with its log level
+	struct secvarctl_ctx *ctx;
+	// every job maps the files it reads through this, a file is only read once per batch
+	struct fileCache *files;
+};
+
+struct Arguments {
+	int helpFlag, threads;
+	const char *inFile;
+	struct secvarctl_ctx *ctx;
+};
+
+static int parse_opt(int key, char *arg, struct argp_state *state);
+static int parseManifest(struct jobQueue *q, char *manifest);
+static int addJob(struct jobQueue *q, char *line, int lineNum, int barrier);
+static int findFiles(struct job *job);
+static int findDependencies(struct jobQueue *q);
+static int runJobs(struct jobQueue *q, int threads);
+static void *jobWorker(void *arg);
+static void printJobResults(struct jobQueue *q);
+static void freeJobs(struct jobQueue *q);
+
+/*
+ *called from main()
+ *runs every job in a manifest file through the command table in a single process
+ *@param ctx, context the command runs in, holds its log level
+ *@param argc, number of argument
+ *@param arv, array of params
+ *@return SUCCESS if every job succeeded, else the error of the first job that failed
+ */
+int performBatchCommand(struct secvarctl_ctx *ctx, int argc, char *argv[])
+{
+	int rc;
+	size_t size;
+	char *manifest = NULL;
+	struct jobQueue q = { .jobs = NULL, .jobCount = 0, .finished = 0, .ctx = ctx };
+	struct Arguments args = { .helpFlag = 0, .threads = 1, .inFile = NULL, .ctx = ctx };
+	// combine command and subcommand for usage/help messages
+	argv[0] = "secvarctl batch";
+
+	struct argp_option options[] = {
+		{ "verbose", 'v', 0, 0, "print more verbose process information" },
+		{ "jobs", 'j', "N", 0,
+		  "run up to N independent jobs at the same time, default is 1 (sequential)" },
+		{ "help", '?', 0, 0, "Give this help list", 1 },
+		{ "usage", ARGP_OPT_USAGE_KEY, 0, 0, "Give a short usage message", -1 },
+		{ 0 }
+	};
+
+	struct argp argp = {
+		options, parse_opt, "<MANIFEST>",
+		"This command runs a list of secvarctl commands in a single process, saving the cost"
+		" of starting secvarctl and initializing the crypto library for every command."
+		" Files used by several jobs are read once and the certificates of a PK or KEK are"
+		" parsed once per worker."
+		" Each job gets its own result code and a summary is printed once every job is done\v"
+		"MANIFEST:\nA text file with one job per line, written the same as the arguments"
+		" following 'secvarctl', ex: 'validate -e db.esl'. Arguments are seperated by"
+		" whitespace, blank lines and lines starting with '#' are ignored."
+		" Jobs may be one of {'read','write','validate','verify','generate'}.\n"
+		"A job that uses a file created by an earlier 'generate -o' job waits for that"
+		" job and is skipped if it failed. A 'generate -o' job waits for the jobs above it"
+		" that use or create the same file. 'write' and 'verify -w' jobs are run one at a"
+		" time in the order they are given, other 'verify' jobs wait for the ones above them"
+		" and run alongside each other. A line containing only 'wait' makes every"
+		" following job wait until all jobs above it are done."
+	};
+
+	rc = argp_parse(&argp, argc, argv, ARGP_NO_EXIT | ARGP_IN_ORDER | ARGP_NO_HELP, 0, &args);
+	if (rc || args.helpFlag)
+		goto out;
+
+	// returned data is '\0' terminated so it can be parsed as a string
+	manifest = getDataFromFile(args.inFile, &size);
+	if (!manifest) {
+		prlog(PR_ERR, "ERROR: failed to get data from %s\n", args.inFile);
+		rc = INVALID_FILE;
+		goto out;
+	}
+
+	rc = parseManifest(&q, manifest);
+	if (rc)
+		goto out;
+	if (q.jobCount == 0) {
+		prlog(PR_ERR, "ERROR: no jobs found in %s\n", args.inFile);
+		rc = ARG_PARSE_FAIL;
+		goto out;
+	}
+	rc = findDependencies(&q);
+	if (rc)
+		goto out;
+	q.files = newFileCache();
+	if (!q.files) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+
+	rc = runJobs(&q, args.threads);
+	if (rc)
+		goto out;
+
+	printJobResults(&q);
+	// overall result is the first failure in manifest order
+	for (int i = 0; i < q.jobCount; i++) {
+		if (q.jobs[i].rc) {
+			rc = q.jobs[i].rc;
+			break;
+		}
+	}
+
+out:
+	freeJobs(&q);
+	freeFileCache(q.files);
+	if (manifest)
+		free(manifest);
+	if (!args.helpFlag)
+		printf("RESULT: %s\n", rc ? "FAILURE" : "SUCCESS");
+
+	return rc;
+}
+
+/**
+ *@param key , every option that is parsed has a value to identify it
+ *@param arg, if key is an option than arg will hold its value ex: -<key> <arg>
+ *@param state,  argp_state struct that contains useful information about the current parsing state
+ *@return success or errno
+ */
+static int parse_opt(int key, char *arg, struct argp_state *state)
+{
+	struct Arguments *args = state->input;
+	char *end = NULL;
+	int rc = SUCCESS;
+
+	switch (key) {
+	case '?':
+		args->helpFlag = 1;
+		argp_state_help(state, stdout, ARGP_HELP_STD_HELP);
+		break;
+	case ARGP_OPT_USAGE_KEY:
+		args->helpFlag = 1;
+		argp_state_help(state, stdout, ARGP_HELP_USAGE);
+		break;
+	case 'v':
+		args->ctx->verbose = PR_DEBUG;
+		break;
+	case 'j':
+		args->threads = strtol(arg, &end, 10);
+		if (*arg == '\0' || *end != '\0' || args->threads < 1 ||
+		    args->threads > MAX_WORKER_THREADS) {
+			prlog(PR_ERR, "ERROR: -j expects a number between 1 and %d, found %s\n",
+			      MAX_WORKER_THREADS, arg);
+			rc = ARG_PARSE_FAIL;
+		}
+		break;
+	case ARGP_KEY_ARG:
+		if (args->inFile == NULL)
+			args->inFile = arg;
+		break;
+	case ARGP_KEY_SUCCESS:
+		// check that all essential args are given and valid
+		if (args->helpFlag)
+			break;
+		if (!args->inFile || isFile(args->inFile))
+			prlog(PR_ERR, "ERROR: missing or invalid manifest file, see usage...\n");
+		else
+			break;
+		argp_usage(state);
+		rc = ARG_PARSE_FAIL;
+		break;
+	}
+
+	if (rc)
+		prlog(PR_ERR, "Failed during argument parsing\n");
+
+	return rc;
+}
+
+/*
+ *splits the manifest into lines and creates a job for each one
+ *@param q, job queue to fill, jobs point into manifest so it must outlive q
+ *@param manifest, NULL terminated manifest data, modified in place
+ *@return SUCCESS or err number
+ */
+static int parseManifest(struct jobQueue *q, char *manifest)
+{
+	int rc, lineNum = 0, barrier = 0;
+	char *line, *next = manifest;
+
+	while (next) {
+		line = next;
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		lineNum++;
+
+		while (isspace((unsigned char)*line))
+			line++;
+		if (*line == '\0' || *line == '#')
+			continue;
+		if (!strncmp(line, "wait", 4) &&
+		    (line[4] == '\0' || isspace((unsigned char)line[4]))) {
+			barrier = q->jobCount;
+			continue;
+		}
+		rc = addJob(q, line, lineNum, barrier);
+		if (rc)
+			return rc;
+	}
+
+	return SUCCESS;
+}
+
+/*
+ *tokenizes one manifest line into an argv array and finds its command
+ *@param q, job queue to append the job to
+ *@param line, NULL terminated line, modified in place
+ *@param lineNum, line number in manifest, used for messages
+ *@param barrier, number of jobs that must be finished before this one starts
+ *@return SUCCESS or err number
+ */
+static int addJob(struct jobQueue *q, char *line, int lineNum, int barrier)
+{
+	int rc;
+	char *save = NULL, *token;
+	struct job *job;
+
+	rc = reallocArray((void **)&q->jobs, q->jobCount + 1, sizeof(*q->jobs));
+	if (rc) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		q->jobs = NULL;
+		q->jobCount = 0;
+		return rc;
+	}
+	job = &q->jobs[q->jobCount];
+	memset(job, 0, sizeof(*job));
+	job->lineNum = lineNum;
+	job->barrier = barrier;
+	job->orderAfter = -1;
+	job->readersFrom = q->jobCount;
+	q->jobCount++;
+
+	for (token = strtok_r(line, " \t\r", &save); token;
+	     token = strtok_r(NULL, " \t\r", &save)) {
+		// keep room for the NULL that ends argv
+		rc = reallocArray((void **)&job->argv, job->argc + 2, sizeof(*job->argv));
+		if (rc) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			job->argv = NULL;
+			job->argc = 0;
+			return rc;
+		}
+		job->argv[job->argc++] = token;
+		job->argv[job->argc] = NULL;
+	}
+	if (job->argc == 0) {
+		prlog(PR_ERR, "ERROR: line %d: no command found\n", lineNum);
+		return ARG_PARSE_FAIL;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(edk2_compat_command_table); i++) {
+		// a manifest cannot start another batch
+		if (edk2_compat_command_table[i].func == performBatchCommand)
+			continue;
+		if (!strncmp(job->argv[0], edk2_compat_command_table[i].name, 32)) {
+			job->cmd = &edk2_compat_command_table[i];
+			break;
+		}
+	}
+	if (!job->cmd) {
+		prlog(PR_ERR, "ERROR: line %d: unknown command %s\n", lineNum, job->argv[0]);
+		return UNKNOWN_COMMAND;
+	}
+
+	return findFiles(job);
+}
+
+/*
+ *fills in the files a job reads and writes. Only 'generate -o' creates a file, every other
+ *argument that is not an option may be a file that is read, ex: a variable name, comparing
+ *it with the files of other jobs is what matters and a name that is not a file never matches
+ *@param job, job with its argv and command
+ *@return SUCCESS or err number
+ */
+static int findFiles(struct job *job)
+{
+	int rc, isGenerate = !strcmp(job->cmd->name, "generate");
+
+	for (int i = 1; i < job->argc; i++) {
+		if (isGenerate && !strcmp(job->argv[i], "-o") && i + 1 < job->argc) {
+			job->writes = job->argv[++i];
+			continue;
+		}
+		if (job->argv[i][0] == '-')
+			continue;
+		rc = reallocArray((void **)&job->reads, job->readCount + 1, sizeof(*job->reads));
+		if (rc) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			job->reads = NULL;
+			job->readCount = 0;
+			return rc;
+		}
+		job->reads[job->readCount++] = job->argv[i];
+	}
+
+	return SUCCESS;
+}
+
+/*
+ *determines if a job writes to a variable's update file, these jobs cannot run alongside
+ *each other. Every job has a context of its own, so verifying alone has no side effects
+ *@param job, job to check
+ *@return 1 if the job has side effects on the variables, 0 otherwise
+ */
+static int isVariableJob(const struct job *job)
+{
+	if (!strcmp(job->cmd->name, "write"))
+		return 1;
+	if (strcmp(job->cmd->name, "verify"))
+		return 0;
+	for (int i = 1; i < job->argc; i++) {
+		if (!strcmp(job->argv[i], "-w") || !strcmp(job->argv[i], "--write"))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ *compares two paths as they are written in the manifest, "./" and repeated '/' are skipped
+ *so "./out//db.esl" and "out/db.esl" are the same file
+ *@return 1 if both name the same file, 0 otherwise
+ */
+static int samePath(const char *a, const char *b)
+{
+	while (1) {
+		while (a[0] == '.' && a[1] == '/')
+			a += 2;
+		while (b[0] == '.' && b[1] == '/')
+			b += 2;
+		while (*a && *a == *b && *a != '/') {
+			a++;
+			b++;
+		}
+		if (*a != *b)
+			return 0;
+		if (!*a)
+			return 1;
+		while (*a == '/')
+			a++;
+		while (*b == '/')
+			b++;
+	}
+}
+
+// @return 1 if file is one of the files job reads, 0 otherwise
+static int readsFile(const struct job *job, const char *file)
+{
+	for (int i = 0; i < job->readCount; i++) {
+		if (samePath(job->reads[i], file))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ *adds an index to a list of jobs
+ *@param list, list to grow, freed and set to NULL on failure
+ *@param count, length of list
+ *@param index, job to add
+ *@return SUCCESS or err number
+ */
+static int addJobIndex(int **list, int *count, int index)
+{
+	int rc = reallocArray((void **)list, *count + 1, sizeof(**list));
+
+	if (rc) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		*list = NULL;
+		*count = 0;
+		return rc;
+	}
+	(*list)[(*count)++] = index;
+
+	return SUCCESS;
+}
+
+// @return 1 if the job reads the variables without writing to them
+static int isReaderJob(const struct job *job)
+{
+	return !strcmp(job->cmd->name, "verify") && !isVariableJob(job);
+}
+
+/*
+ *fills in the dependencies of every job, a dependency is always an earlier job so
+ *running jobs in order can never deadlock
+ *@param q, job queue
+ *@return SUCCESS or err number
+ */
+static int findDependencies(struct jobQueue *q)
+{
+	int rc, lastVariableJob = -1;
+	struct job *job, *earlier;
+
+	for (int i = 0; i < q->jobCount; i++) {
+		job = &q->jobs[i];
+		// jobs below the barrier are finished first anyway
+		for (int k = job->barrier; k < i; k++) {
+			earlier = &q->jobs[k];
+			rc = SUCCESS;
+			if (earlier->writes && readsFile(job, earlier->writes))
+				rc = addJobIndex(&job->deps, &job->depCount, k);
+			else if (job->writes &&
+				 (readsFile(earlier, job->writes) ||
+				  (earlier->writes && samePath(earlier->writes, job->writes))))
+				rc = addJobIndex(&job->after, &job->afterCount, k);
+			if (rc)
+				return rc;
+		}
+		if (isVariableJob(job)) {
+			job->orderAfter = lastVariableJob;
+			// verify jobs since the last writer may still be reading what this changes
+			job->readersFrom = lastVariableJob + 1;
+			lastVariableJob = i;
+		} else if (isReaderJob(job)) {
+			// it reads the variables, so it still runs after the writes above it
+			job->orderAfter = lastVariableJob;
+		}
+	}
+
+	return SUCCESS;
+}
+
+static int isFinished(const struct job *job)
+{
+	return job->state == JOB_DONE || job->state == JOB_SKIPPED;
+}
+
+/*
+ *checks if all jobs the given job waits on are finished, must hold q->lock
+ *@param q, job queue
+ *@param index, index of job to check
+ *@param depRc, set to the error of a failed input job, the job should then be skipped
+ *@return 1 if the job can be started, 0 otherwise
+ */
+static int isReady(struct jobQueue *q, int index, int *depRc)
+{
+	struct job *job = &q->jobs[index], *dep;
+
+	*depRc = SUCCESS;
+	for (int k = 0; k < job->barrier; k++) {
+		if (!isFinished(&q->jobs[k]))
+			return 0;
+	}
+	if (job->orderAfter >= 0 && !isFinished(&q->jobs[job->orderAfter]))
+		return 0;
+	for (int k = job->readersFrom; k < index; k++) {
+		if (isReaderJob(&q->jobs[k]) && !isFinished(&q->jobs[k]))
+			return 0;
+	}
+	for (int i = 0; i < job->afterCount; i++) {
+		if (!isFinished(&q->jobs[job->after[i]]))
+			return 0;
+	}
+	for (int i = 0; i < job->depCount; i++) {
+		dep = &q->jobs[job->deps[i]];
+		if (!isFinished(dep))
+			return 0;
+		if (dep->rc && *depRc == SUCCESS)
+			*depRc = dep->rc;
+	}
+
+	return 1;
+}
+
+/*
+ *worker loop, takes the first job in manifest order that is ready and runs it. The
+ *certificates a job parses are kept for the next job of the same worker, they are not
+ *shared between workers as a crypto library may change a parsed key while it is used
+ *@param arg, pointer to the struct jobQueue
+ *@return NULL
+ */
+static void *jobWorker(void *arg)
+{
+	struct jobQueue *q = arg;
+	struct secvarctl_ctx ctx, kept, *prev = bindCtx(q->ctx);
+	struct job *job;
+	int depRc, rc, wasWorker = joinPool(q->parallel);
+
+	initCtx(&kept, q->ctx->verbose);
+	kept.keep_cert_cache = true;
+
+	pthread_mutex_lock(&q->lock);
+	while (q->finished < q->jobCount) {
+		job = NULL;
+		for (int i = 0; i < q->jobCount; i++) {
+			if (q->jobs[i].state != JOB_PENDING || !isReady(q, i, &depRc))
+				continue;
+			job = &q->jobs[i];
+			break;
+		}
+		if (!job) {
+			pthread_cond_wait(&q->changed, &q->lock);
+			continue;
+		}
+		if (depRc) {
+			job->state = JOB_SKIPPED;
+			job->rc = depRc;
+			q->finished++;
+			pthread_cond_broadcast(&q->changed);
+			continue;
+		}
+		job->state = JOB_RUNNING;
+		pthread_mutex_unlock(&q->lock);
+
+		prlog(PR_INFO, "Starting job on line %d: %s\n", job->lineNum, job->cmd->name);
+		initCtx(&ctx, q->ctx->verbose);
+		ctx.files = q->files;
+		ctx.keep_cert_cache = true;
+		move_cert_cache(&ctx, &kept);
+		bindCtx(&ctx);
+		rc = job->cmd->func(&ctx, job->argc, job->argv);
+		bindCtx(q->ctx);
+		move_cert_cache(&kept, &ctx);
+		clearCtx(&ctx);
+
+		pthread_mutex_lock(&q->lock);
+		job->rc = rc;
+		job->state = JOB_DONE;
+		q->finished++;
+		pthread_cond_broadcast(&q->changed);
+	}
+	pthread_mutex_unlock(&q->lock);
+	clearCtx(&kept);
+	leavePool(wasWorker);
+	bindCtx(prev);
+
+	return NULL;
+}
+
+/*
+ *runs every job in the queue with the given amount of worker threads
+ *@param q, job queue with dependencies filled in
+ *@param threads, number of workers, one means jobs are run in manifest order on this thread
+ *@return SUCCESS or err number if the workers could not be started
+ */
+static int runJobs(struct jobQueue *q, int threads)
+{
+	int rc = SUCCESS, started = 0;
+	pthread_t *workers = NULL;
+
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->changed, NULL);
+
+	if (threads > q->jobCount)
+		threads = q->jobCount;
+	q->parallel = threads > 1;
+	if (threads == 1) {
+		jobWorker(q);
+		goto out;
+	}
+
+	workers = calloc(threads, sizeof(*workers));
+	if (!workers) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	for (; started < threads; started++) {
+		if (pthread_create(&workers[started], NULL, jobWorker, q))
+			break;
+	}
+	// this thread still works through the queue if no worker could be started
+	if (started == 0) {
+		prlog(PR_WARNING, "WARNING: could not start worker threads, running jobs in order\n");
+		jobWorker(q);
+	}
+	for (int i = 0; i < started; i++)
+		pthread_join(workers[i], NULL);
+
+out:
+	if (workers)
+		free(workers);
+	pthread_cond_destroy(&q->changed);
+	pthread_mutex_destroy(&q->lock);
+
+	return rc;
+}
+
+/*
+ *prints one line per job with its result code, in manifest order
+ *@param q, job queue that has been run
+ */
+static void printJobResults(struct jobQueue *q)
+{
+	struct job *job;
+
+	printf("BATCH RESULTS:\n");
+	for (int i = 0; i < q->jobCount; i++) {
+		job = &q->jobs[i];
+		printf("\tJOB %d (line %d) %s: ", i + 1, job->lineNum, job->cmd->name);
+		if (job->state == JOB_SKIPPED)
+			printf("SKIPPED, input from an earlier job failed\n");
+		else if (job->rc)
+			printf("FAILURE (%d)\n", job->rc);
+		else
+			printf("SUCCESS\n");
+	}
+}
+
+/*
+ *frees all memory owned by the job queue
+ *@param q, job queue
+ */
+static void freeJobs(struct jobQueue *q)
+{
+	if (!q->jobs)
+		return;
+	for (int i = 0; i < q->jobCount; i++) {
+		if (q->jobs[i].argv)
+			free(q->jobs[i].argv);
+		if (q->jobs[i].reads)
+			free(q->jobs[i].reads);
+		if (q->jobs[i].deps)
+			free(q->jobs[i].deps);
+		if (q->jobs[i].after)
+			free(q->jobs[i].after);
+	}
+	free(q->jobs);
+	q->jobs = NULL;
+	q->jobCount = 0;
+}
@@ -8,6 +8,7 @@
 #include <time.h> // for timestamp
 #include <ctype.h> // for isspace
 #include <argp.h>
+#include <pthread.h>
 #include "libstb/secvar/crypto/crypto.h"
 #include <ccan/endian/endian.h>
 #include "backends/edk2-compat/include/edk2-svc.h"
@@ -22,22 +23,55 @@ enum pkcs7_generation_method {
 	NO_PKCS7_GEN_METHOD
 };
 
+// long only options, --current <file>, --compact and --batch <manifest>
+#define ARGP_OPT_CURRENT_KEY 0x101
+#define ARGP_OPT_COMPACT_KEY 0x102
+#define ARGP_OPT_BATCH_KEY 0x103
+
 struct Arguments {
 	// the pkcs7_gen_meth is to determine if signKeys stores a private key file(0) or signed data (1)
-	int helpFlag, inpValid, signKeyCount, signCertCount;
-	const char *inFile, *outFile, **signCerts, **signKeys, *inForm, *outForm, *varName,
-		*hashAlg;
+	int helpFlag, inpValid, signKeyCount, signCertCount, inFileCount, compact, threads;
+	const char *inFile, *outFile, **inFiles, **signCerts, **signKeys, *inForm, *outForm,
+		*varName, *hashAlg, *pathToSecVars, *currentFile, *batchFile;
+	// attributes signed with the new data, get the append write bit for delta updates
+	uint32_t attributes;
 	struct efi_time *time;
 	enum pkcs7_generation_method pkcs7_gen_meth;
+	// keys loaded once by --batch and shared by every job, NULL otherwise
+	crypto_pkcs7_signers *signers;
+	struct secvarctl_ctx *ctx;
+};
+
+// one line of a --batch manifest
+struct batchJob {
+	int lineNum, argc, rc;
+	char **argv;
+	struct Arguments args;
+};
+
+struct batchQueue {
+	struct batchJob *jobs;
+	int count, next;
+	// more than one worker takes jobs, see joinPool()
+	int parallel;
+	pthread_mutex_t lock;
+	// context of the generate command, the workers only print with it
+	struct secvarctl_ctx *ctx;
 };
 
 static int parse_opt(int key, char *arg, struct argp_state *state);
+static int generateFromArgs(struct Arguments *args);
+static int generateBatch(struct Arguments *args, const struct argp *argp);
 static int generateHash(const unsigned char *data, size_t size, struct Arguments *args,
 			const struct hash_funct *alg, unsigned char **outHash, size_t *outHashSize);
 static int validateHashAndAlg(size_t size, const struct hash_funct *alg);
-static int toESL(const unsigned char *data, size_t size, const uuid_t guid, unsigned char **outESL,
-		 size_t *outESLSize);
+static int validateHashList(size_t size, const struct hash_funct *alg);
+static int readHashInputs(const struct Arguments *args, const struct hash_funct *alg,
+			  unsigned char **outBuff, size_t *outBuffSize);
+static int allInputsAreFiles(const struct Arguments *args);
 static int getHashFunction(const char *name, struct hash_funct **returnFunct);
+static int hashFile(const char *file, const struct hash_funct *alg, unsigned char **outHash,
+		    size_t *outHashSize);
 static int toPKCS7ForSecVar(const unsigned char *newData, size_t dataSize, struct Arguments *args,
 			    int hashFunct, unsigned char **outBuff, size_t *outBuffSize);
 static int toAuth(const unsigned char *newESL, size_t eslSize, struct Arguments *args,
@@ -48,6 +82,11 @@ static int generateESL(const unsigned char *buff, size_t size, struct Arguments
 static int generateAuthOrPKCS7(const unsigned char *buff, size_t size, struct Arguments *args,
 			       const struct hash_funct *hashFunct, unsigned char **outBuff,
 			       size_t *outBuffSize);
+static int compactESL(const unsigned char *ESL, size_t ESLSize, unsigned char **outBuff,
+		      size_t *outBuffSize);
+static int readCurrentVariable(const struct Arguments *args, struct secvar **var);
+static int toDeltaUpdate(const unsigned char *ESL, size_t ESLSize, const struct secvar *current,
+			 struct Arguments *args, unsigned char **outBuff, size_t *outBuffSize);
 static int getTimestamp(struct efi_time *ts);
 static int getOutputData(const unsigned char *buff, size_t size, struct Arguments *args,
 			 const struct hash_funct *hashFunction, unsigned char **outBuff,
@@ -55,37 +94,46 @@ static int getOutputData(const unsigned char *buff, size_t size, struct Argument
 static int authToESL(const unsigned char *in, size_t inSize, unsigned char **out, size_t *outSize);
 static int toHashForSecVarSigning(const unsigned char *ESL, size_t ESL_size, struct Arguments *args,
 				  unsigned char **outBuff, size_t *outBuffSize);
-static int getPreHashForSecVar(unsigned char **outData, size_t *outSize, const unsigned char *ESL,
-			       size_t ESL_size, struct Arguments *args);
+static int getHashForSecVar(unsigned char *hash, const unsigned char *ESL, size_t ESL_size,
+			    struct Arguments *args);
 static int parseCustomTimestamp(struct efi_time *strct, const char *str);
 static void convert_tm_to_efi_time(struct efi_time *efi_t, struct tm *tm_t);
+static time_t efiTimeToEpoch(const struct efi_time *efi_t);
 /*
  *called from main()
  *handles argument parsing for generate command
+ *@param ctx, context the command runs in, holds its log level
  *@param argc, number of argument
  *@param arv, array of params
  *@return SUCCESS or err number 
  */
-int performGenerateCommand(int argc, char *argv[])
+int performGenerateCommand(struct secvarctl_ctx *ctx, int argc, char *argv[])
 {
 	int rc;
-	size_t outBuffSize, size;
-	struct hash_funct *hashFunction;
-	unsigned char *buff = NULL, *outBuff = NULL;
 	struct Arguments args = { .helpFlag = 0,
 				  .inpValid = 0,
 				  .signKeyCount = 0,
 				  .signCertCount = 0,
+				  .inFileCount = 0,
+				  .compact = 0,
+				  .threads = 0,
 				  .inFile = NULL,
 				  .outFile = NULL,
+				  .inFiles = NULL,
 				  .signCerts = NULL,
 				  .signKeys = NULL,
 				  .inForm = NULL,
 				  .outForm = NULL,
 				  .varName = NULL,
 				  .hashAlg = NULL,
+				  .pathToSecVars = NULL,
+				  .currentFile = NULL,
+				  .batchFile = NULL,
+				  .attributes = SECVAR_ATTRIBUTES,
 				  .time = NULL,
-				  .pkcs7_gen_meth = NO_PKCS7_GEN_METHOD };
+				  .pkcs7_gen_meth = NO_PKCS7_GEN_METHOD,
+				  .signers = NULL,
+				  .ctx = ctx };
 	// combine command and subcommand for usage/help messages
 	argv[0] = "secvarctl generate";
 
@@ -116,6 +164,19 @@ int performGenerateCommand(int argc, char *argv[])
 		  "digest, default is currrent time in UTC, format defined by ISO 8601, note 'T' is literally in the string, see manpage for value info/ranges" },
 		{ "force", 'f', 0, 0,
 		  "does not do prevalidation on the input file, assumes format is correct" },
+		{ "path", 'p', "PATH", 0,
+		  "diff the new ESL against the current <varName> in PATH when generating an"
+		  " Auth/presigned digest, see 'Delta updates' below" },
+		{ "current", ARGP_OPT_CURRENT_KEY, "FILE", 0,
+		  "like '-p' but the current contents of the variable are read from the ESL in FILE" },
+		{ "compact", ARGP_OPT_COMPACT_KEY, 0, 0,
+		  "when generating an ESL from an ESL or Auth, drop duplicate entries and merge entries"
+		  " of the same type and size into one list, in a fixed order" },
+		{ "batch", ARGP_OPT_BATCH_KEY, "MANIFEST", 0,
+		  "generate every file listed in MANIFEST, signing them all with the '-k <> -c <>'"
+		  " pairs given here, see 'Batch generation' below" },
+		{ "jobs", 'j', "N", 0,
+		  "with '--batch', generate up to N files at the same time, default is 1 (sequential)" },
 		// these are hidden because they are mandatory and are described in the help message instead of in the options
 		{ 0, 'i', "FILE", OPTION_HIDDEN, "input file" },
 		{ 0, 'o', "FILE", OPTION_HIDDEN, "output file" },
@@ -126,7 +187,8 @@ int performGenerateCommand(int argc, char *argv[])
 
 	struct argp argp = {
 		options, parse_opt,
-		"<inputFormat>:<outputFormat> -i <inputFile> -o <outputFile>\nreset -i <inputFile> -o <outputFile>",
+		"<inputFormat>:<outputFormat> -i <inputFile> -o <outputFile>\nreset -i <inputFile> -o <outputFile>\n"
+		"--batch <manifest> -k <key> -c <crt> [-j N]",
 		"This command generates various files related to updating secure boot variables"
 		" It requires an input file that is formatted according to <inputFormat> (see below)"
 		" and produces an output file that is formatted according to <outputFormat> (see below).\v"
@@ -136,7 +198,9 @@ int performGenerateCommand(int argc, char *argv[])
 		"\t[e]sl\tAn EFI Signature List, if dbx must specify '-n dbx'\n"
 		"\t[p]kcs7\tA PKCS7 file\n"
 		"\t[a]uth\ta properly generated authenticated variable fileI\n"
-		"\t[f]ile\tAny file type, Warning: no format validation will be done\n\n"
+		"\t[f]ile\tAny file type, Warning: no format validation will be done\n"
+		"\tSeveral [h]ash or [f]ile inputs can be given with repeated '-i <file>', their"
+		" hashes are sorted and share one ESL\n\n"
 		"Accepted <outputFormat>:\n"
 		"\t[h]ash\tA file containing only hashed data\n"
 		"\t[e]sl\tAn EFI Signature List\n"
@@ -146,6 +210,17 @@ int performGenerateCommand(int argc, char *argv[])
 		"Using with `reset` instead of `<inputFormat>:<outputFormat>' generates a valid variable reset file."
 		" this file is just an auth file with an empty ESL. `reset` requires arguments: output file, signer"
 		" crt/key pair and variable name, no input file is required. use this flag to delete a variable.\n\n"
+		"Delta updates: given the current contents of the variable with '-p <path>' or"
+		" '--current <file>', the new ESL is compared to them entry by entry. If it only adds entries,"
+		" an append write update holding just the added entries is signed. If it also removes"
+		" entries, the whole new ESL is signed as usual. PK is never appended to.\n\n"
+		"Batch generation: each line of the '--batch' MANIFEST holds the arguments of one"
+		" generate command, ex: 'e:a -n db -i db.esl -o db.auth'. Blank lines and lines starting"
+		" with '#' are ignored. The keys and certificates given with '--batch' are loaded once and"
+		" sign every file, lines cannot name signers of their own. Lines without '-t' are"
+		" timestamped with the '-t' given with '--batch', or the current time, and later lines for"
+		" the same variable get timestamps one second apart so their updates can be applied in"
+		" manifest order. Input files must exist before the batch starts.\n\n"
 		"Typical commands:\n"
 		"  -create valid dbx ESL from binary file with SHA512:\n"
 		"\t'... f:e -i <file> -o <file> -h SHA512'\n"
@@ -157,10 +232,18 @@ int performGenerateCommand(int argc, char *argv[])
 		"\t'... c:a -k <file> -c <file> -n <varName> -i <file> -o <file>'\n"
 		"  -create a valid dbx update (auth) file from a binary file:\n"
 		"\t'... f:a -h <hashAlg> -k <file> -c <file> -n dbx -i <file> -o <file>'\n"
+		"  -create one dbx ESL holding the hashes of several binary files:\n"
+		"\t'... f:e -i <file> -i <file> -i <file> -o <file>'\n"
+		"  -create a dbx update holding only the hashes the current dbx is missing:\n"
+		"\t'... e:a -p <path> -k <file> -c <file> -n dbx -i <file> -o <file>'\n"
+		"  -drop duplicate entries and merge the lists of a dbx ESL:\n"
+		"\t'... e:e --compact -n dbx -i <file> -o <file>'\n"
 		"  -retrieve the ESL from an auth file:\n"
 		"\t'... a:e -i <file> -o <file>'\n"
 		"  -create an auth file for a key reset:\n"
 		"\t'... reset -k <file> -c <file> -n <varName> -o <file>'\n"
+		"  -create every auth file listed in a manifest, 4 at a time, signing with one key:\n"
+		"\t'... --batch <manifest> -k <file> -c <file> -j 4'\n"
 		"  -create an auth file using an external signing framework:\n"
 		"\t'... c:x -n <varName> -t <y-m-dTh:m:s> -i <file> -o <file>'\n"
 		"\tthen user gets output signed through server (<sigFile>):\n"
@@ -185,55 +268,98 @@ int performGenerateCommand(int argc, char *argv[])
 		rc = ARG_PARSE_FAIL;
 		goto out;
 	}
-	prlog(PR_INFO, "Input file is %s of type %s , output file is %s of type %s\n", args.inFile,
-	      args.inForm, args.outFile, args.outForm);
+	if (args.batchFile)
+		rc = generateBatch(&args, &argp);
+	else
+		rc = generateFromArgs(&args);
+
+out:
+	if (args.inFiles)
+		free(args.inFiles);
+	if (args.signKeys)
+		free(args.signKeys);
+	if (args.signCerts)
+		free(args.signCerts);
+	if (args.time)
+		free(args.time);
+	if (!args.helpFlag)
+		printf("RESULT: %s\n", rc ? "FAILURE" : "SUCCESS");
+
+	return rc;
+}
+
+/*
+ *generates the output file for one set of parsed arguments, used by a single generate and by every --batch job
+ *@param args, validated arguments, only its timestamp may be added
+ *@return SUCCESS or err number
+ */
+static int generateFromArgs(struct Arguments *args)
+{
+	int rc;
+	size_t outBuffSize;
+	struct hash_funct *hashFunction;
+	struct fileView view = { .data = NULL, .size = 0, .mapped = 0 };
+	const unsigned char *inpData = NULL;
+	size_t inpSize = 0;
+	unsigned char *outBuff = NULL, *fileHash = NULL;
+
+	prlog(PR_INFO, "Input file is %s of type %s , output file is %s of type %s\n", args->inFile,
+	      args->inForm, args->outFile, args->outForm);
 
+	// default alg is sha256
+	if (args->hashAlg == NULL)
+		args->hashAlg = "SHA256";
+	// get hash function
+	rc = getHashFunction(args->hashAlg, &hashFunction);
+	if (rc)
+		goto out;
+	// several hashes are packed together and put into one ESL later on
+	if (args->inFileCount > 1) {
+		rc = readHashInputs(args, hashFunction, &fileHash, &inpSize);
+		if (rc)
+			goto out;
+		inpData = fileHash;
+	}
+	// files of any size are only ever hashed, so do that in chunks while reading them
+	else if (args->inForm[0] == 'f') {
+		rc = hashFile(args->inFile, hashFunction, &fileHash, &inpSize);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: Could not hash data in file %s\n", args->inFile);
+			goto out;
+		}
+		inpData = fileHash;
+	}
 	// if reset key than don't look for an input file
-	if (args.inForm[0] == 'r')
-		size = 0;
-	else {
+	else if (args->inForm[0] != 'r') {
 		// get data from input file
-		buff = (unsigned char *)getDataFromFile(args.inFile, &size);
-		if (buff == NULL) {
-			prlog(PR_ERR, "ERROR: Could not find data in file %s\n", args.inFile);
-			rc = INVALID_FILE;
+		rc = openFileView(&view, args->inFile);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: Could not find data in file %s\n", args->inFile);
 			goto out;
 		}
+		inpData = view.data;
+		inpSize = view.size;
 	}
-	// default alg is sha256
-	if (args.hashAlg == NULL)
-		args.hashAlg = "SHA256";
-	// get hash function
-	rc = getHashFunction(args.hashAlg, &hashFunction);
-	if (rc)
-		goto out;
 	// now we can try to generate the desired output format
-	rc = getOutputData(buff, size, &args, hashFunction, &outBuff, &outBuffSize);
+	rc = getOutputData(inpData, inpSize, args, hashFunction, &outBuff, &outBuffSize);
 	if (rc) {
-		prlog(PR_ERR, "Failed to generate into output format: %s\n", args.outForm);
+		prlog(PR_ERR, "Failed to generate into output format: %s\n", args->outForm);
 		goto out;
 	}
 
-	prlog(PR_INFO, "Writing %zd bytes to %s\n", outBuffSize, args.outFile);
+	prlog(PR_INFO, "Writing %zd bytes to %s\n", outBuffSize, args->outFile);
 	// write data to new file
-	rc = createFile(args.outFile, (char *)outBuff, outBuffSize);
+	rc = createFile(args->outFile, (char *)outBuff, outBuffSize);
 	if (rc) {
-		prlog(PR_ERR, "ERROR: Could not write new data to output file %s\n", args.outFile);
+		prlog(PR_ERR, "ERROR: Could not write new data to output file %s\n", args->outFile);
 	}
 
 out:
-	if (buff)
-		free(buff);
+	closeFileView(&view);
+	if (fileHash)
+		free(fileHash);
 	if (outBuff)
 		free(outBuff);
-	if (args.signKeys)
-		free(args.signKeys);
-	if (args.signCerts)
-		free(args.signCerts);
-	if (args.time)
-		free(args.time);
-	if (!args.helpFlag)
-		printf("RESULT: %s\n", rc ? "FAILURE" : "SUCCESS");
 
 	return rc;
 }
@@ -247,6 +373,7 @@ out:
 static int parse_opt(int key, char *arg, struct argp_state *state)
 {
 	struct Arguments *args = state->input;
+	char *save = NULL, *end;
 	int rc = SUCCESS;
 
 	switch (key) {
@@ -290,7 +417,7 @@ static int parse_opt(int key, char *arg, struct argp_state *state)
 		args->inpValid = 1;
 		break;
 	case 'v':
-		verbose = PR_DEBUG;
+		args->ctx->verbose = PR_DEBUG;
 		break;
 	case 's':
 		// if already storing private keys, then don't allow for signed data
@@ -311,7 +438,17 @@ static int parse_opt(int key, char *arg, struct argp_state *state)
 		args->signKeys[args->signKeyCount - 1] = arg;
 		break;
 	case 'i':
-		args->inFile = arg;
+		args->inFileCount++;
+		rc = reallocArray((void **)&args->inFiles, args->inFileCount,
+				  sizeof(*args->inFiles));
+		if (rc) {
+			prlog(PR_ERR, "Failed to realloc input file (-i <>) array\n");
+			break;
+		}
+		args->inFiles[args->inFileCount - 1] = arg;
+		// the first input names the job in messages
+		if (!args->inFile)
+			args->inFile = arg;
 		break;
 	case 'o':
 		args->outFile = arg;
@@ -322,6 +459,27 @@ static int parse_opt(int key, char *arg, struct argp_state *state)
 	case 'n':
 		args->varName = arg;
 		break;
+	case 'p':
+		args->pathToSecVars = arg;
+		break;
+	case ARGP_OPT_CURRENT_KEY:
+		args->currentFile = arg;
+		break;
+	case ARGP_OPT_COMPACT_KEY:
+		args->compact = 1;
+		break;
+	case ARGP_OPT_BATCH_KEY:
+		args->batchFile = arg;
+		break;
+	case 'j':
+		args->threads = strtol(arg, &end, 10);
+		if (*arg == '\0' || *end != '\0' || args->threads < 1 ||
+		    args->threads > MAX_WORKER_THREADS) {
+			prlog(PR_ERR, "ERROR: -j expects a number between 1 and %d, found %s\n",
+			      MAX_WORKER_THREADS, arg);
+			rc = ARG_PARSE_FAIL;
+		}
+		break;
 	case 't':
 		args->time = calloc(1, sizeof(*args->time));
 		if (!args->time) {
@@ -345,23 +503,55 @@ static int parse_opt(int key, char *arg, struct argp_state *state)
 			break;
 		}
 		// else set input and output formats
-		args->inForm = strtok(arg, ":");
-		args->outForm = strtok(NULL, ":");
+		args->inForm = strtok_r(arg, ":", &save);
+		args->outForm = strtok_r(NULL, ":", &save);
 		break;
 	case ARGP_KEY_SUCCESS:
 		// check that all essential args are given and valid
 		if (args->helpFlag)
 			break;
-		else if (args->inForm == NULL || args->outForm == NULL)
+		else if (!args->batchFile && (args->inForm == NULL || args->outForm == NULL))
 			prlog(PR_ERR,
 			      "ERROR: Incorrect '<inputFormat>:<outputFormat>', see usage...\n");
 		else if (args->time && validateTime(args->time))
 			prlog(PR_ERR,
 			      "Invalid timestamp flag '-t YYYY-MM-DDThh:mm:ss' , see usage...\n");
+		else if (args->batchFile &&
+			 (args->inForm || args->inFileCount || args->outFile || args->varName ||
+			  args->hashAlg || args->pathToSecVars || args->currentFile ||
+			  args->compact || args->inpValid))
+			prlog(PR_ERR,
+			      "ERROR: With '--batch' only '-k', '-c', '-t' and '-j' are given on the command line, the rest is given by each line of the manifest\n");
+		else if (args->batchFile && args->pkcs7_gen_meth == W_EXTERNAL_GEN_SIG)
+			prlog(PR_ERR, "ERROR: '--batch' only signs with private keys, '-s' cannot be used\n");
+		else if (args->batchFile)
+			break;
+		else if (args->threads)
+			prlog(PR_ERR, "ERROR: '-j' only works with '--batch'\n");
 		else if (args->inForm[0] != 'r' && (args->inFile == NULL || isFile(args->inFile)))
 			prlog(PR_ERR, "ERROR: Input File is invalid, see usage below...\n");
+		else if (args->inFileCount > 1 &&
+			 ((args->inForm[0] != 'h' && args->inForm[0] != 'f') ||
+			  args->outForm[0] == 'h'))
+			prlog(PR_ERR,
+			      "ERROR: Only hash or file inputs can be combined from several input files into an ESL/PKCS7/Auth\n");
+		else if (args->inFileCount > 1 && !allInputsAreFiles(args))
+			prlog(PR_ERR, "ERROR: Input File is invalid, see usage below...\n");
 		else if (args->varName && isVariable(args->varName))
 			prlog(PR_ERR, "ERROR: %s is not a valid variable name\n", args->varName);
+		else if ((args->pathToSecVars || args->currentFile) &&
+			 (args->inForm[0] == 'r' ||
+			  (args->outForm[0] != 'a' && args->outForm[0] != 'x')))
+			prlog(PR_ERR,
+			      "ERROR: The current variable ('-p' or '--current') is only used when generating an Auth or presigned digest from new data\n");
+		else if (args->compact && (args->outForm[0] != 'e' ||
+					   (args->inForm[0] != 'e' && args->inForm[0] != 'a')))
+			prlog(PR_ERR, "ERROR: '--compact' only works on [e]sl or [a]uth input and [e]sl output\n");
+		else if (args->pathToSecVars && args->currentFile)
+			prlog(PR_ERR, "ERROR: Use one of '-p' or '--current', not both\n");
+		else if ((args->pathToSecVars || args->currentFile) && args->varName == NULL)
+			prlog(PR_ERR,
+			      "ERROR: A delta update needs the variable name, use -n <varName>\n");
 		else if (args->outFile == NULL)
 			prlog(PR_ERR, "ERROR: No output file given, see usage below...\n");
 		else
@@ -469,8 +659,9 @@ static int generateAuthOrPKCS7(const unsigned char *buff, size_t size, struct Ar
 			       size_t *outBuffSize)
 {
 	int rc;
-	size_t intermediateBuffSize, inpSize = size;
-	unsigned char *intermediateBuff = NULL, **inpPtr;
+	size_t intermediateBuffSize, deltaBuffSize, inpSize = size;
+	unsigned char *intermediateBuff = NULL, *deltaBuff = NULL, **inpPtr;
+	struct secvar *current = NULL;
 	inpPtr = (unsigned char **)&buff;
 
 	switch (args->inForm[0]) {
@@ -518,6 +709,22 @@ static int generateAuthOrPKCS7(const unsigned char *buff, size_t size, struct Ar
 		goto out;
 	}
 
+	// only sign the entries the variable does not hold yet
+	if (args->pathToSecVars || args->currentFile) {
+		rc = readCurrentVariable(args, &current);
+		if (rc)
+			goto out;
+		rc = toDeltaUpdate(*inpPtr, inpSize, current, args, &deltaBuff, &deltaBuffSize);
+		if (rc) {
+			prlog(PR_ERR, "Failed to generate a delta update\n");
+			goto out;
+		}
+		if (deltaBuff) {
+			inpPtr = &deltaBuff;
+			inpSize = deltaBuffSize;
+		}
+	}
+
 	if (args->outForm[0] == 'a')
 		rc = toAuth(*inpPtr, inpSize, args, hashFunct->crypto_md_funct, outBuff,
 			    outBuffSize);
@@ -537,6 +744,251 @@ static int generateAuthOrPKCS7(const unsigned char *buff, size_t size, struct Ar
 out:
 	if (intermediateBuff)
 		free(intermediateBuff);
+	if (deltaBuff)
+		free(deltaBuff);
+	if (current)
+		dealloc_secvar(current);
+	return rc;
+}
+
+/*
+ *orders ESL entries like esl_entry_cmp, with the owner last, so the first of a run of duplicates
+ *is always the same one
+ */
+static int compareCompactEntries(const void *a, const void *b)
+{
+	const struct esl_entry *x = a, *y = b;
+	int rc;
+
+	rc = esl_entry_cmp(a, b);
+	if (rc)
+		return rc;
+
+	return memcmp(x->owner, y->owner, sizeof(uuid_t));
+}
+
+/*
+ *rewrites an ESL without duplicate entries and with one list per signature type and size. Entries
+ *are sorted so the same set of entries always gives the same bytes, of duplicates with different
+ *owners the smallest owner is kept. The savings are printed
+ *@param ESL, the ESL to compact, may hold several lists
+ *@param ESLSize, length of ESL
+ *@param outBuff, the compacted ESL, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param outBuffSize, the length of outBuff, never more than ESLSize
+ *@return SUCCESS or err number
+ */
+static int compactESL(const unsigned char *ESL, size_t ESLSize, unsigned char **outBuff,
+		      size_t *outBuffSize)
+{
+	int rc, count, lists = 0, newLists = 0, duplicates = 0;
+	size_t offset = 0, listStart = 0;
+	const EFI_SIGNATURE_LIST *list;
+	EFI_SIGNATURE_LIST *newList = NULL;
+	struct esl_entry *entries = NULL, *prev = NULL;
+	struct esl_iter iter;
+
+	*outBuff = NULL;
+	*outBuffSize = 0;
+
+	// a list header is only understood by its own type, so those lists can not be merged
+	esl_iter_init(&iter, (const char *)ESL, ESLSize);
+	while ((rc = esl_iter_next_list(&iter, &list)) == OPAL_SUCCESS) {
+		if (list->SignatureHeaderSize) {
+			prlog(PR_ERR, "ERROR: ESL #%d has a signature header, it can not be compacted\n",
+			      lists);
+			return ESL_FAIL;
+		}
+		lists++;
+	}
+	if (rc != OPAL_EMPTY)
+		return ESL_FAIL;
+
+	// every entry is parsed once, sorting puts duplicates next to each other
+	count = get_esl_entries((const char *)ESL, ESLSize, &entries);
+	if (count <= 0) {
+		prlog(PR_ERR, "ERROR: ESL has no entries to compact\n");
+		rc = ESL_FAIL;
+		goto out;
+	}
+	qsort(entries, count, sizeof(*entries), compareCompactEntries);
+
+	// nothing is added, so the result fits in the size of the input
+	*outBuff = malloc(ESLSize);
+	if (!*outBuff) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (prev && !esl_entry_cmp(prev, &entries[i])) {
+			duplicates++;
+			continue;
+		}
+		// a list holds entries of one type and size
+		if (!prev || prev->data_size != entries[i].data_size ||
+		    !uuid_equals(prev->type, entries[i].type)) {
+			if (newList)
+				newList->SignatureListSize = cpu_to_le32(offset - listStart);
+			listStart = offset;
+			newList = (EFI_SIGNATURE_LIST *)(*outBuff + offset);
+			newList->SignatureType = *entries[i].type;
+			newList->SignatureHeaderSize = 0;
+			newList->SignatureSize = cpu_to_le32(sizeof(uuid_t) + entries[i].data_size);
+			offset += sizeof(EFI_SIGNATURE_LIST);
+			newLists++;
+		}
+		memcpy(*outBuff + offset, entries[i].owner, sizeof(uuid_t));
+		offset += sizeof(uuid_t);
+		memcpy(*outBuff + offset, entries[i].data, entries[i].data_size);
+		offset += entries[i].data_size;
+		prev = &entries[i];
+	}
+	newList->SignatureListSize = cpu_to_le32(offset - listStart);
+	*outBuffSize = offset;
+	rc = SUCCESS;
+
+	printf("Compacted ESL from %zd to %zd bytes, saved %zd bytes: dropped %d duplicate entries, %d lists became %d\n",
+	       ESLSize, offset, ESLSize - offset, duplicates, lists, newLists);
+
+out:
+	if (entries)
+		free(entries);
+	return rc;
+}
+
+/*
+ *reads the current contents of args->varName, either from the ESL in args->currentFile or from
+ *<args->pathToSecVars>/<varName>/data
+ *@param args, struct containing command line info
+ *@param var, the current variable, NOTE: REMEMBER TO DEALLOC THIS WITH dealloc_secvar
+ *@return SUCCESS or err number
+ */
+static int readCurrentVariable(const struct Arguments *args, struct secvar **var)
+{
+	int rc;
+	char *fullPath = NULL;
+	struct fileView view = { .data = NULL, .size = 0, .mapped = 0 };
+
+	if (args->currentFile) {
+		rc = openFileView(&view, args->currentFile);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: Could not read the current %s from %s\n", args->varName,
+			      args->currentFile);
+			return rc;
+		}
+		*var = fileViewToSecVar(&view, args->varName, view.size, NULL);
+		if (*var == NULL) {
+			prlog(PR_ERR, "ERROR: Could not convert data to secvar\n");
+			return INVALID_FILE;
+		}
+		return SUCCESS;
+	}
+
+	// <path>/<varName>/data
+	fullPath = malloc(strlen(args->pathToSecVars) + strlen(args->varName) +
+			  strlen("/data") + 2);
+	if (!fullPath) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	strcpy(fullPath, args->pathToSecVars);
+	if (fullPath[strlen(fullPath) - 1] != '/')
+		strcat(fullPath, "/");
+	strcat(fullPath, args->varName);
+	strcat(fullPath, "/data");
+
+	rc = getSecVar(var, args->varName, fullPath, NULL);
+	if (rc)
+		prlog(PR_ERR, "ERROR: Could not read the current %s from %s\n", args->varName,
+		      fullPath);
+	free(fullPath);
+
+	return rc;
+}
+
+/*
+ *compares the new ESL to the current contents of the variable entry by entry. If the new ESL only
+ *adds entries, it is cut down to the added ones which are then signed as an append write. If any
+ *current entry is missing from the new ESL, or the variable is PK or empty, the whole ESL is kept
+ *and replaces the variable as usual
+ *@param ESL, the desired contents of the variable
+ *@param ESLSize, length of ESL
+ *@param current, the current variable
+ *@param args, struct containing command line info, attributes gets the append write bit
+ *@param outBuff, the entries to append, NULL if the whole ESL is to be signed
+ * NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param outBuffSize, the length of outBuff
+ *@return SUCCESS or err number, ESL_FAIL if the variable already holds every new entry
+ */
+static int toDeltaUpdate(const unsigned char *ESL, size_t ESLSize, const struct secvar *current,
+			 struct Arguments *args, unsigned char **outBuff, size_t *outBuffSize)
+{
+	int rc, currentCount, newCount, removed = 0;
+	struct esl_entry *currentEntries = NULL, *newEntries = NULL;
+
+	*outBuff = NULL;
+	*outBuffSize = 0;
+
+	currentCount = get_esl_entries(current->data, current->data_size, &currentEntries);
+	if (currentCount < 0) {
+		prlog(PR_ERR, "ERROR: Could not parse the current %s\n", args->varName);
+		rc = ESL_FAIL;
+		goto out;
+	}
+	newCount = get_esl_entries((const char *)ESL, ESLSize, &newEntries);
+	if (newCount < 0) {
+		prlog(PR_ERR, "ERROR: Could not parse the new ESL\n");
+		rc = ESL_FAIL;
+		goto out;
+	}
+
+	// an append write can not take anything away
+	for (int i = 0; i < currentCount; i++) {
+		if (!newCount || !bsearch(&currentEntries[i], newEntries, newCount,
+					  sizeof(*newEntries), esl_entry_cmp))
+			removed++;
+	}
+
+	if (key_equals(args->varName, "PK") || !currentCount || removed) {
+		if (removed)
+			prlog(PR_NOTICE,
+			      "%d entries of the current %s are not in the new ESL, signing the whole ESL\n",
+			      removed, args->varName);
+		rc = SUCCESS;
+		goto out;
+	}
+
+	// the added entries are never more than the new ESL
+	*outBuff = malloc(ESLSize);
+	if (!*outBuff) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	rc = copy_new_esl_entries(currentEntries, currentCount, (const char *)ESL, ESLSize,
+				  (char *)*outBuff);
+	if (rc <= 0) {
+		if (rc == 0)
+			prlog(PR_ERR,
+			      "ERROR: The current %s already holds every entry of the new ESL, there is nothing to update\n",
+			      args->varName);
+		free(*outBuff);
+		*outBuff = NULL;
+		rc = ESL_FAIL;
+		goto out;
+	}
+	*outBuffSize = rc;
+	rc = SUCCESS;
+	args->attributes |= EFI_VARIABLE_APPEND_WRITE;
+	prlog(PR_NOTICE, "Signing an append write of %zd bytes instead of the whole %zd byte ESL\n",
+	      *outBuffSize, ESLSize);
+
+out:
+	if (currentEntries)
+		free(currentEntries);
+	if (newEntries)
+		free(newEntries);
 	return rc;
 }
 
@@ -562,19 +1014,14 @@ static int generateESL(const unsigned char *buff, size_t size, struct Arguments
 
 	switch (args->inForm[0]) {
 	case 'f':
-		rc = crypto_md_generate_hash(buff, size, hashFunct->crypto_md_funct,
-					     &intermediateBuff, &intermediateBuffSize);
-		if (rc) {
-			prlog(PR_ERR, "Failed to generate hash from file\n");
-			break;
-		}
-		// new input is the hash file
-		inpPtr = &intermediateBuff;
-		inpSize = intermediateBuffSize;
+		// the file was already hashed while it was read, see hashFile()
 		// intentionally flow into hash validation
 	case 'h':
 		if (!args->inpValid) {
-			rc = validateHashAndAlg(inpSize, hashFunct);
+			if (args->inFileCount > 1)
+				rc = validateHashList(inpSize, hashFunct);
+			else
+				rc = validateHashAndAlg(inpSize, hashFunct);
 			if (rc) {
 				prlog(PR_ERR, "Failed to validate input hash data\n");
 				break;
@@ -616,6 +1063,14 @@ static int generateESL(const unsigned char *buff, size_t size, struct Arguments
 		}
 		rc = SUCCESS;
 		break;
+	case 'e':
+		// an ESL is only ever turned into another ESL when compacting it. Duplicates can
+		// break the rules of the variable (one PK), so the compacted ESL is validated instead
+		if (args->compact) {
+			rc = SUCCESS;
+			break;
+		}
+		// intentional flow into the error
 	default:
 		prlog(PR_ERR,
 		      "ERROR: unknown input format %s for generating an ESL, use `--help` for more info\n",
@@ -627,8 +1082,17 @@ static int generateESL(const unsigned char *buff, size_t size, struct Arguments
 		goto out;
 	}
 	// if input file is auth than extract it
-	if (args->inForm[0] == 'a')
+	if (args->inForm[0] == 'a' && args->compact) {
+		rc = authToESL(*inpPtr, inpSize, &intermediateBuff, &intermediateBuffSize);
+		if (!rc)
+			rc = compactESL(intermediateBuff, intermediateBuffSize, outBuff, outBuffSize);
+	} else if (args->inForm[0] == 'a')
 		rc = authToESL(*inpPtr, inpSize, outBuff, outBuffSize);
+	else if (args->inForm[0] == 'e')
+		rc = compactESL(*inpPtr, inpSize, outBuff, outBuffSize);
+	// hashes all have the same size so any number of them fit into one list
+	else if (args->inFileCount > 1)
+		rc = toHashESL(*inpPtr, inpSize, hashFunct, outBuff, outBuffSize);
 	else
 		// now we have either a hash or x509 in der and is ready to be put into an ESL
 		rc = toESL(*inpPtr, inpSize, *eslGUID, outBuff, outBuffSize);
@@ -636,6 +1100,19 @@ static int generateESL(const unsigned char *buff, size_t size, struct Arguments
 		prlog(PR_ERR, "Failed to generate ESL file\n");
 		goto out;
 	}
+	// the entries were only moved around, the rules of the variable must still hold
+	if (args->compact && !args->inpValid) {
+		rc = validateESL(*outBuff, *outBuffSize, args->varName);
+		// the firmware checks the number of entries too, there is only one PK
+		if (!rc && args->varName &&
+		    validate_esl_list(args->varName, (const char *)*outBuff, *outBuffSize) < 0)
+			rc = ESL_FAIL;
+		if (rc) {
+			prlog(PR_ERR, "ERROR: Compacted ESL is not valid\n");
+			free(*outBuff);
+			*outBuff = NULL;
+		}
+	}
 out:
 	if (intermediateBuff)
 		free(intermediateBuff);
@@ -686,14 +1163,84 @@ static int generateHash(const unsigned char *data, size_t size, struct Arguments
 			return rc;
 		}
 	}
-	rc = crypto_md_generate_hash(data, size, alg->crypto_md_funct, outHash, outHashSize);
-	if (rc) {
-		prlog(PR_ERR, "Failed to generate hash\n");
-		return rc;
+	// the file was already hashed while it was read, see hashFile()
+	if (args->inForm[0] == 'f') {
+		*outHash = malloc(size);
+		if (!*outHash) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			return ALLOC_FAIL;
+		}
+		memcpy(*outHash, data, size);
+		*outHashSize = size;
+	} else {
+		rc = crypto_md_generate_hash(data, size, alg->crypto_md_funct, outHash,
+					     outHashSize);
+		if (rc) {
+			prlog(PR_ERR, "Failed to generate hash\n");
+			return rc;
+		}
 	}
 	return validateHashAndAlg(*outHashSize, alg);
 }
 
+// streamFile() callback, adds one chunk of the file to the hashing context
+static int hashChunk(const unsigned char *data, size_t size, void *ctx)
+{
+	if (crypto_md_update((crypto_md_ctx *)ctx, data, size)) {
+		prlog(PR_ERR, "ERROR: Failed to add %zd bytes to hashing context\n", size);
+		return HASH_FAIL;
+	}
+
+	return SUCCESS;
+}
+
+/*
+ *hashes a file in fixed size chunks, memory use stays the same no matter how big the file is
+ *@param file, path to the file to hash
+ *@param alg, hash function information
+ *@param outHash, the resulting hash, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param outHashSize, the length of outHash
+ *@return SUCCESS or err number
+ */
+static int hashFile(const char *file, const struct hash_funct *alg, unsigned char **outHash,
+		    size_t *outHashSize)
+{
+	int rc;
+	size_t fileSize;
+	crypto_md_ctx *ctx = NULL;
+
+	*outHash = NULL;
+	rc = crypto_md_ctx_init(&ctx, alg->crypto_md_funct);
+	if (rc) {
+		prlog(PR_ERR, "ERROR: Could not setup hashing context\n");
+		goto out;
+	}
+	rc = streamFile(file, hashChunk, ctx, &fileSize);
+	if (rc)
+		goto out;
+	*outHash = malloc(alg->size);
+	if (!*outHash) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	if (crypto_md_finish(ctx, *outHash)) {
+		prlog(PR_ERR, "ERROR: Generation of %s hash failed\n", alg->name);
+		free(*outHash);
+		*outHash = NULL;
+		rc = HASH_FAIL;
+		goto out;
+	}
+	*outHashSize = alg->size;
+	prlog(PR_INFO, "Created %s hash of %zd bytes of data\n", alg->name, fileSize);
+
+out:
+	if (ctx)
+		crypto_md_free(ctx);
+
+	return rc;
+}
+
 /*
  *validates that the size of the hash buffer is equal to the expected, only real check we can do on a hash
  *@param size , length of hash to be validated
@@ -711,6 +1258,184 @@ static int validateHashAndAlg(size_t size, const struct hash_funct *alg)
 	return SUCCESS;
 }
 
+/*
+ *validates that the hash buffer holds one or more whole hashes of the expected algorithm
+ *@param size, length of hash buffer
+ *@param alg, hash function information, see hash_functions in edk2-svc.h
+ *@return SUCCESS or HASH_FAIL
+ */
+static int validateHashList(size_t size, const struct hash_funct *alg)
+{
+	if (!size || size % alg->size) {
+		prlog(PR_ERR,
+		      "ERROR: length of hash data is not a multiple of the size of hash %s, expected %zd bytes per hash found %zd bytes\n",
+		      alg->name, alg->size, size);
+		return HASH_FAIL;
+	}
+	return SUCCESS;
+}
+
+/*
+ *checks that every '-i <file>' given is a readable file
+ *@param args, parsed command line info
+ *@return 1 if all are files, 0 otherwise
+ */
+static int allInputsAreFiles(const struct Arguments *args)
+{
+	for (int i = 0; i < args->inFileCount; i++) {
+		if (isFile(args->inFiles[i])) {
+			prlog(PR_ERR, "ERROR: %s is not a valid file\n", args->inFiles[i]);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ *reads every '-i <file>' into one buffer of back to back hashes, [f]ile inputs are hashed on the way,
+ *[h]ash inputs must hold exactly one hash each
+ *@param args, parsed command line info, inForm is either 'h' or 'f'
+ *@param alg, hash function information
+ *@param outBuff, the packed hashes, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param outBuffSize, the length of outBuff
+ *@return SUCCESS or err number
+ */
+static int readHashInputs(const struct Arguments *args, const struct hash_funct *alg,
+			  unsigned char **outBuff, size_t *outBuffSize)
+{
+	int rc = SUCCESS;
+	size_t used = 0, hashSize = 0;
+	unsigned char *buff, *hash = NULL;
+	const unsigned char *data;
+	struct fileView view = { .data = NULL, .size = 0, .mapped = 0 };
+
+	buff = malloc(args->inFileCount * alg->size);
+	if (!buff) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	for (int i = 0; i < args->inFileCount; i++) {
+		if (args->inForm[0] == 'f') {
+			rc = hashFile(args->inFiles[i], alg, &hash, &hashSize);
+			data = hash;
+		} else {
+			rc = openFileView(&view, args->inFiles[i]);
+			data = view.data;
+			hashSize = view.size;
+		}
+		if (rc) {
+			prlog(PR_ERR, "ERROR: Could not get hash data from file %s\n",
+			      args->inFiles[i]);
+			goto out;
+		}
+		// even with '-f', entries could not be told apart if the sizes differed
+		if (validateHashAndAlg(hashSize, alg)) {
+			prlog(PR_ERR, "ERROR: %s does not hold a %s hash\n", args->inFiles[i],
+			      alg->name);
+			rc = HASH_FAIL;
+			goto out;
+		}
+		memcpy(buff + used, data, hashSize);
+		used += hashSize;
+		closeFileView(&view);
+		if (hash) {
+			free(hash);
+			hash = NULL;
+		}
+	}
+	*outBuff = buff;
+	*outBuffSize = used;
+	buff = NULL;
+	prlog(PR_INFO, "Read %zd bytes of %s hashes from %d files\n", used, alg->name,
+	      args->inFileCount);
+out:
+	closeFileView(&view);
+	if (hash)
+		free(hash);
+	if (buff)
+		free(buff);
+
+	return rc;
+}
+
+// one hash of the buffer given to toHashESL
+struct hash_entry {
+	const unsigned char *data;
+	size_t size;
+};
+
+// qsort() comparison, orders hashes bytewise
+static int compareHashEntries(const void *a, const void *b)
+{
+	const struct hash_entry *x = a, *y = b;
+
+	return memcmp(x->data, y->data, x->size);
+}
+
+/*
+ *generates one ESL holding every hash of the buffer, sorted so the output does not depend on
+ *input order, repeated hashes are only added once
+ *@param hashes, back to back hashes of type alg
+ *@param size, length of hashes, must be a multiple of alg->size
+ *@param alg, hash function information, gives the entry size and the ESL GUID
+ *@param outESL, the resulting ESL File, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param outESLSize, the length of outESL
+ *@return SUCCESS or err number
+ */
+int toHashESL(const unsigned char *hashes, size_t size, const struct hash_funct *alg,
+	      unsigned char **outESL, size_t *outESLSize)
+{
+	EFI_SIGNATURE_LIST esl;
+	struct hash_entry *entries;
+	size_t count = size / alg->size, unique = 0, offset = sizeof(esl);
+
+	entries = malloc(count * sizeof(*entries));
+	if (!entries) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	for (size_t i = 0; i < count; i++) {
+		entries[i].data = hashes + i * alg->size;
+		entries[i].size = alg->size;
+	}
+	qsort(entries, count, sizeof(*entries), compareHashEntries);
+
+	/*ESL Structure:
+		-ESL header - 28 bytes
+		-for each hash: owner uuid - 16 bytes, then the hash
+	 sized for every entry up front, duplicates only leave unused space at the end
+	*/
+	*outESL = calloc(1, sizeof(esl) + count * (sizeof(uuid_t) + alg->size));
+	if (!*outESL) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		free(entries);
+		return ALLOC_FAIL;
+	}
+	for (size_t i = 0; i < count; i++) {
+		if (i && !compareHashEntries(&entries[i - 1], &entries[i])) {
+			prlog(PR_WARNING, "WARNING: Skipping repeated %s hash\n", alg->name);
+			continue;
+		}
+		// owner guid is left blank like in toESL
+		offset += sizeof(uuid_t);
+		memcpy(*outESL + offset, entries[i].data, alg->size);
+		offset += alg->size;
+		unique++;
+	}
+	free(entries);
+
+	esl.SignatureType = *alg->guid;
+	esl.SignatureListSize = offset;
+	esl.SignatureHeaderSize = 0;
+	esl.SignatureSize = sizeof(uuid_t) + alg->size;
+	memcpy(*outESL, &esl, sizeof(esl));
+	*outESLSize = offset;
+	prlog(PR_INFO, "Created %s ESL with %zd entries in %zd bytes\n", alg->name, unique,
+	      offset);
+
+	return SUCCESS;
+}
+
 /* 
  *generates ESL from input data, esl will have GUID specified by guid
  *@param data, data to be added to ESL
@@ -720,15 +1445,15 @@ static int validateHashAndAlg(size_t size, const struct hash_funct *alg)
  *@param outESLSize, the length of outBuff
  *@return SUCCESS or err number 
  */
-static int toESL(const unsigned char *data, size_t size, const uuid_t guid, unsigned char **outESL,
-		 size_t *outESLSize)
+int toESL(const unsigned char *data, size_t size, const uuid_t guid, unsigned char **outESL,
+	  size_t *outESLSize)
 {
 	EFI_SIGNATURE_LIST esl;
 	size_t offset = 0;
 
 	prlog(PR_INFO, "Creating ESL from %s... Adding:\n", getSigType(guid));
 	esl.SignatureType = guid;
-	if (verbose >= PR_INFO) {
+	if (logLevel() >= PR_INFO) {
 		prlog(PR_INFO, "\t%s Guid - ", getSigType(guid));
 		printGuidSig(&guid);
 	}
@@ -866,15 +1591,32 @@ static void convert_tm_to_efi_time(struct efi_time *efi_t, struct tm *tm_t)
 static int getTimestamp(struct efi_time *ts)
 {
 	time_t epochTime;
-	struct tm *t;
+	struct tm t;
 
 	time(&epochTime);
-	t = gmtime(&epochTime);
-	convert_tm_to_efi_time(ts, t);
+	gmtime_r(&epochTime, &t);
+	convert_tm_to_efi_time(ts, &t);
 
 	return validateTime(ts);
 }
 
+/*
+ *converts an efi_time back to seconds since the epoch, it is always in UTC
+ *@param efi_t , the efi_time to convert
+ *@return the time in seconds
+ */
+static time_t efiTimeToEpoch(const struct efi_time *efi_t)
+{
+	struct tm t = { .tm_year = efi_t->year - 1900,
+			.tm_mon = efi_t->month - 1,
+			.tm_mday = efi_t->day,
+			.tm_hour = efi_t->hour,
+			.tm_min = efi_t->minute,
+			.tm_sec = efi_t->second };
+
+	return timegm(&t);
+}
+
 /*
  *generates presigned hashed data, this accepts an ESL and all metadata, it performs a SHA hash
  *@param ESL, ESL data buffer
@@ -888,28 +1630,20 @@ static int toHashForSecVarSigning(const unsigned char *ESL, size_t ESL_size, str
 				  unsigned char **outBuff, size_t *outBuffSize)
 {
 	int rc;
-	unsigned char *preHash = NULL;
-	size_t preHash_size;
 
-	rc = getPreHashForSecVar(&preHash, &preHash_size, ESL, ESL_size, args);
-	if (rc) {
-		prlog(PR_ERR, "Failed to generate pre-hash data\n");
-		goto out;
+	*outBuff = malloc(32);
+	if (!*outBuff) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
 	}
-	rc = crypto_md_generate_hash(preHash, preHash_size, CRYPTO_MD_SHA256, outBuff, outBuffSize);
+	rc = getHashForSecVar(*outBuff, ESL, ESL_size, args);
 	if (rc) {
 		prlog(PR_ERR, "Failed to generate hash\n");
-		goto out;
-	}
-	if (*outBuffSize != 32) {
-		prlog(PR_ERR, "ERROR: size of SHA256 is not 32 bytes, found %zd bytes\n",
-		      *outBuffSize);
-		rc = HASH_FAIL;
+		free(*outBuff);
+		*outBuff = NULL;
+		return rc;
 	}
-
-out:
-	if (preHash)
-		free(preHash);
+	*outBuffSize = 32;
 
 	return rc;
 }
@@ -937,24 +1671,25 @@ static char *char_to_wchar(const char *key, const size_t keylen)
 }
 
 /*
- *generates data that is ready to be hashed and eventually signed for secure variables
- *more specifically this accepts an ESL and preprends metadata 
- *@param outData, the outputted data with prepended data / REMEMBER TO UNALLOC 
- *@param outSize, length of output data
- *@param ESL, the new ESL data 
+ *generates the SHA256 digest that is signed for secure variables, name || guid || attributes ||
+ *timestamp || ESL. The pieces are fed to the hashing context one after another, the same way
+ *get_hash_to_verify in edk2-compat-process.c checks them, so the ESL is never copied. The
+ *attributes come from args, delta updates set the append write bit there
+ *@param hash, the resulting digest, must have room for 32 bytes
+ *@param ESL, the new ESL data
  *@param ESL_size, length of ESL buffer
  *@param args, struct containing imprtant metadata info
  *@return, success or error number
  */
-static int getPreHashForSecVar(unsigned char **outData, size_t *outSize, const unsigned char *ESL,
-			       size_t ESL_size, struct Arguments *args)
+static int getHashForSecVar(unsigned char *hash, const unsigned char *ESL, size_t ESL_size,
+			    struct Arguments *args)
 {
 	int rc = SUCCESS;
-	unsigned char *ptr = NULL;
 	char *wkey = NULL;
 	size_t varlen;
-	le32 attr = cpu_to_le32(SECVAR_ATTRIBUTES);
+	le32 attr = cpu_to_le32(args->attributes);
 	uuid_t guid;
+	crypto_md_ctx *ctx = NULL;
 
 	if (!args->varName) {
 		prlog(PR_ERR, "ERROR: No secure variable name given... use -n <varName> option\n");
@@ -962,7 +1697,7 @@ static int getPreHashForSecVar(unsigned char **outData, size_t *outSize, const u
 		goto out;
 	}
 
-	if (verbose >= PR_INFO) {
+	if (logLevel() >= PR_INFO) {
 		prlog(PR_INFO, "Timestamp is : ");
 		printTimestamp(*args->time);
 	}
@@ -981,26 +1716,36 @@ static int getPreHashForSecVar(unsigned char **outData, size_t *outSize, const u
 	/* Expand char name to wide character width */
 	varlen = strlen(args->varName) * 2;
 	wkey = char_to_wchar(args->varName, strlen(args->varName));
-	// with timestamp and all this funky bussiniss, we can  make the correct data to be hashed
-	*outSize = varlen + sizeof(guid) + sizeof(attr) + sizeof(struct efi_time) + ESL_size;
-	*outData = malloc(*outSize);
-	if (!*outData) {
+	if (!wkey) {
 		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
 		rc = ALLOC_FAIL;
 		goto out;
 	}
-	ptr = *outData;
-	memcpy(ptr, wkey, varlen);
-	ptr += varlen;
-	memcpy(ptr, &guid, sizeof(guid));
-	ptr += sizeof(guid);
-	memcpy(ptr, &attr, sizeof(attr));
-	ptr += sizeof(attr);
-	memcpy(ptr, args->time, sizeof(struct efi_time));
-	ptr += sizeof(*args->time);
-	memcpy(ptr, ESL, ESL_size);
+
+	rc = crypto_md_ctx_init(&ctx, CRYPTO_MD_SHA256);
+	if (rc)
+		goto out;
+	// with timestamp and all this funky bussiniss, we can hash the correct data
+	rc = crypto_md_update(ctx, (const unsigned char *)wkey, varlen);
+	if (!rc)
+		rc = crypto_md_update(ctx, (const unsigned char *)&guid, sizeof(guid));
+	if (!rc)
+		rc = crypto_md_update(ctx, (const unsigned char *)&attr, sizeof(attr));
+	if (!rc)
+		rc = crypto_md_update(ctx, (const unsigned char *)args->time,
+				      sizeof(struct efi_time));
+	if (!rc)
+		rc = crypto_md_update(ctx, ESL, ESL_size);
+	if (!rc)
+		rc = crypto_md_finish(ctx, hash);
+	if (rc) {
+		prlog(PR_ERR, "ERROR: failed to hash data for signing\n");
+		rc = HASH_FAIL;
+	}
 
 out:
+	if (ctx)
+		crypto_md_free(ctx);
 	if (wkey)
 		free(wkey);
 	return rc;
@@ -1020,35 +1765,32 @@ static int toPKCS7ForSecVar(const unsigned char *newData, size_t dataSize, struc
 			    int hashFunct, unsigned char **outBuff, size_t *outBuffSize)
 {
 	int rc;
-	size_t totalSize;
-	unsigned char *actualData = NULL;
+	unsigned char hash[32];
 
-	rc = getPreHashForSecVar(&actualData, &totalSize, newData, dataSize, args);
+	rc = getHashForSecVar(hash, newData, dataSize, args);
 	if (rc) {
-		prlog(PR_ERR, "Failed to generate pre-hash data for PKCS7\n");
-		goto out;
+		prlog(PR_ERR, "Failed to generate hash of pre-signed data for PKCS7\n");
+		return rc;
 	}
 	// get pkcs7 and size, if we are already given ths signatures then call appropriate funcion
-	if (args->pkcs7_gen_meth) {
+	if (args->signers)
+		rc = crypto_pkcs7_generate_w_signers((unsigned char **)outBuff, outBuffSize, hash,
+						     sizeof(hash), args->signers);
+	else if (args->pkcs7_gen_meth) {
 		prlog(PR_INFO, "Generating PKCS7 with already signed data\n");
 		rc = crypto_pkcs7_generate_w_already_signed_data(
-			(unsigned char **)outBuff, outBuffSize, actualData, totalSize,
+			(unsigned char **)outBuff, outBuffSize, hash, sizeof(hash),
 			args->signCerts, args->signKeys, args->signKeyCount, CRYPTO_MD_SHA256);
 	} else
 		rc = crypto_pkcs7_generate_w_signature((unsigned char **)outBuff, outBuffSize,
-						       actualData, totalSize, args->signCerts,
+						       hash, sizeof(hash), args->signCerts,
 						       args->signKeys, args->signKeyCount,
 						       CRYPTO_MD_SHA256);
 	if (rc) {
 		prlog(PR_ERR, "ERROR: making PKCS7 failed\n");
-		rc = PKCS7_FAIL;
-		goto out;
+		return PKCS7_FAIL;
 	}
 
-out:
-	if (actualData)
-		free(actualData);
-
 	return rc;
 }
 
@@ -1110,4 +1852,322 @@ out:
 
 	return rc;
 }
+
+/*
+ *signs an ESL into an auth without going through the command line, for callers that make many
+ *auths with the same keys, see crypto_pkcs7_signers_load
+ *@param ESL, data of the update
+ *@param ESLSize, length of ESL
+ *@param varName, variable the update is for {"PK","KEK","db","dbx"}
+ *@param time, timestamp of the update
+ *@param attributes, attributes that are signed with the data, SECVAR_ATTRIBUTES or with append write
+ *@param signers, keys and certificates to sign with
+ *@param outBuff, the resulting auth, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param outBuffSize, the length of outBuff
+ *@return SUCCESS or err number
+ */
+int generateSignedAuth(const unsigned char *ESL, size_t ESLSize, const char *varName,
+		       struct efi_time *time, uint32_t attributes, crypto_pkcs7_signers *signers,
+		       unsigned char **outBuff, size_t *outBuffSize)
+{
+	struct Arguments args = { .varName = varName,
+				  .time = time,
+				  .attributes = attributes,
+				  .pkcs7_gen_meth = W_PRIVATE_KEYS,
+				  .signers = signers };
+
+	return toAuth(ESL, ESLSize, &args, CRYPTO_MD_SHA256, outBuff, outBuffSize);
+}
+
+/*
+ *tokenizes one manifest line and parses it like the arguments of a generate command
+ *@param q, job queue to append the job to
+ *@param line, NULL terminated line, modified in place and referenced by the job
+ *@param lineNum, line number in manifest, used for messages
+ *@param argp, the argp of the generate command
+ *@return SUCCESS or err number
+ */
+static int addBatchJob(struct batchQueue *q, char *line, int lineNum, const struct argp *argp)
+{
+	int rc;
+	char *save = NULL, *token;
+	struct batchJob *job;
+
+	rc = reallocArray((void **)&q->jobs, q->count + 1, sizeof(*q->jobs));
+	if (rc) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		q->jobs = NULL;
+		q->count = 0;
+		return rc;
+	}
+	job = &q->jobs[q->count];
+	memset(job, 0, sizeof(*job));
+	job->lineNum = lineNum;
+	job->args.attributes = SECVAR_ATTRIBUTES;
+	job->args.pkcs7_gen_meth = NO_PKCS7_GEN_METHOD;
+	job->args.ctx = q->ctx;
+	q->count++;
+
+	// argv[0] names the command in usage messages, the arguments follow
+	token = "secvarctl generate";
+	do {
+		// keep room for the NULL that ends argv
+		rc = reallocArray((void **)&job->argv, job->argc + 2, sizeof(*job->argv));
+		if (rc) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			job->argv = NULL;
+			job->argc = 0;
+			return rc;
+		}
+		job->argv[job->argc++] = token;
+		job->argv[job->argc] = NULL;
+		token = strtok_r(job->argc == 1 ? line : NULL, " \t\r", &save);
+	} while (token);
+
+	rc = argp_parse(argp, job->argc, job->argv, ARGP_NO_EXIT | ARGP_IN_ORDER | ARGP_NO_HELP, 0,
+			&job->args);
+	if (!rc && (job->args.helpFlag || job->args.batchFile || job->args.signKeyCount ||
+		    job->args.signCertCount)) {
+		prlog(PR_ERR,
+		      "ERROR: '--batch', '--help', '-k', '-c' and '-s' are not allowed in a manifest line\n");
+		rc = ARG_PARSE_FAIL;
+	}
+	if (rc)
+		prlog(PR_ERR, "ERROR: line %d: not a valid generate command\n", lineNum);
+
+	return rc;
+}
+
+/*
+ *parses every line of a manifest into a job
+ *@param q, job queue to fill
+ *@param manifest, NULL terminated contents of the manifest, modified in place
+ *@param argp, the argp of the generate command
+ *@return SUCCESS or err number
+ */
+static int parseBatchManifest(struct batchQueue *q, char *manifest, const struct argp *argp)
+{
+	int rc, lineNum = 0;
+	char *line, *next = manifest;
+
+	while (next) {
+		line = next;
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		lineNum++;
+
+		while (isspace((unsigned char)*line))
+			line++;
+		if (*line == '\0' || *line == '#')
+			continue;
+		rc = addBatchJob(q, line, lineNum, argp);
+		if (rc)
+			return rc;
+	}
+
+	return SUCCESS;
+}
+
+/*
+ *@return nonzero if the output of args is signed, and so carries a timestamp
+ */
+static int isSignedOutput(const struct Arguments *args)
+{
+	return args->outForm[0] == 'a' || args->outForm[0] == 'x' || args->outForm[0] == 'p';
+}
+
+/*
+ *@return nonzero if both arguments sign updates for the same variable
+ */
+static int isSameVariable(const struct Arguments *a, const struct Arguments *b)
+{
+	if (!a->varName || !b->varName)
+		return a->varName == b->varName;
+
+	return !strcmp(a->varName, b->varName);
+}
+
+/*
+ *timestamps every signed job without a '-t' of its own. A job gets base, or one second
+ *past the latest timestamp of an earlier job for the same variable, so that the updates
+ *of one variable are accepted in manifest order
+ *@param q, parsed jobs
+ *@param base, earliest timestamp to give out
+ *@return SUCCESS or err number
+ */
+static int setBatchTimestamps(struct batchQueue *q, const struct efi_time *base)
+{
+	struct Arguments *args, *prev;
+	time_t baseTime = efiTimeToEpoch(base), next, prevTime;
+	struct tm t;
+
+	for (int i = 0; i < q->count; i++) {
+		args = &q->jobs[i].args;
+		if (args->time || !isSignedOutput(args))
+			continue;
+		next = baseTime;
+		for (int j = 0; j < i; j++) {
+			prev = &q->jobs[j].args;
+			if (!prev->time || !isSignedOutput(prev) || !isSameVariable(args, prev))
+				continue;
+			prevTime = efiTimeToEpoch(prev->time);
+			if (prevTime >= next)
+				next = prevTime + 1;
+		}
+		args->time = calloc(1, sizeof(*args->time));
+		if (!args->time) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			return ALLOC_FAIL;
+		}
+		gmtime_r(&next, &t);
+		convert_tm_to_efi_time(args->time, &t);
+	}
+
+	return SUCCESS;
+}
+
+/*
+ *worker loop for generate --batch, takes the next job in the queue until all are done
+ *@param arg, pointer to struct batchQueue
+ *@return NULL
+ */
+static void *batchWorker(void *arg)
+{
+	struct batchQueue *q = arg;
+	struct secvarctl_ctx *prev = bindCtx(q->ctx);
+	int i, wasWorker = joinPool(q->parallel);
+
+	for (;;) {
+		pthread_mutex_lock(&q->lock);
+		i = q->next++;
+		pthread_mutex_unlock(&q->lock);
+		if (i >= q->count)
+			break;
+		q->jobs[i].rc = generateFromArgs(&q->jobs[i].args);
+	}
+	leavePool(wasWorker);
+	bindCtx(prev);
+
+	return NULL;
+}
+
+/*
+ *generates every file in a manifest, the signing keys are loaded once and shared by
+ *every job, jobs are run on up to args->threads workers
+ *@param args, arguments of the generate command, with batchFile set
+ *@param argp, the argp of the generate command, used to parse each line
+ *@return SUCCESS if every file was generated, else the error of the first job that failed
+ */
+static int generateBatch(struct Arguments *args, const struct argp *argp)
+{
+	struct batchQueue q = { .jobs = NULL, .count = 0, .next = 0, .ctx = args->ctx };
+	struct efi_time base = { 0 };
+	pthread_t *workers = NULL;
+	char *manifest = NULL;
+	size_t size;
+	int rc, threads = args->threads ? args->threads : 1, started = 0, failed = 0;
+
+	// returned data is '\0' terminated so it can be parsed as a string
+	manifest = getDataFromFile(args->batchFile, &size);
+	if (!manifest) {
+		prlog(PR_ERR, "ERROR: failed to get data from %s\n", args->batchFile);
+		rc = INVALID_FILE;
+		goto out;
+	}
+	rc = parseBatchManifest(&q, manifest, argp);
+	if (rc)
+		goto out;
+	if (q.count == 0) {
+		prlog(PR_ERR, "ERROR: no jobs found in %s\n", args->batchFile);
+		rc = ARG_PARSE_FAIL;
+		goto out;
+	}
+	if (args->time)
+		base = *args->time;
+	else {
+		rc = getTimestamp(&base);
+		if (rc)
+			goto out;
+	}
+	rc = setBatchTimestamps(&q, &base);
+	if (rc)
+		goto out;
+	// every job signs with the same keys, parse them once
+	if (args->signKeyCount) {
+		rc = crypto_pkcs7_signers_load(&args->signers, args->signCerts, args->signKeys,
+					       args->signKeyCount, CRYPTO_MD_SHA256);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: failed to load the signing keys\n");
+			goto out;
+		}
+	}
+	for (int i = 0; i < q.count; i++) {
+		// a presigned digest is the only signed output that needs no key
+		if (!args->signers && isSignedOutput(&q.jobs[i].args) &&
+		    q.jobs[i].args.outForm[0] != 'x') {
+			prlog(PR_ERR,
+			      "ERROR: line %d: signing needs '-k <key> -c <crt>' given with '--batch'\n",
+			      q.jobs[i].lineNum);
+			rc = ARG_PARSE_FAIL;
+			goto out;
+		}
+		q.jobs[i].args.signers = args->signers;
+		q.jobs[i].args.pkcs7_gen_meth = args->pkcs7_gen_meth;
+	}
+
+	pthread_mutex_init(&q.lock, NULL);
+	if (threads > q.count)
+		threads = q.count;
+	q.parallel = threads > 1;
+	if (threads > 1) {
+		// this thread is the last of them
+		workers = calloc(threads - 1, sizeof(*workers));
+		if (!workers) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			pthread_mutex_destroy(&q.lock);
+			goto out;
+		}
+		for (; started < threads - 1; started++) {
+			if (pthread_create(&workers[started], NULL, batchWorker, &q))
+				break;
+		}
+	}
+	// generate on this thread as well so jobs get done even if no worker could start
+	batchWorker(&q);
+	for (int i = 0; i < started; i++)
+		pthread_join(workers[i], NULL);
+	pthread_mutex_destroy(&q.lock);
+
+	printf("GENERATED %d FILES FROM %s:\n", q.count, args->batchFile);
+	for (int i = 0; i < q.count; i++) {
+		printf("\tline %d: %s %s\n", q.jobs[i].lineNum, q.jobs[i].args.outFile,
+		       q.jobs[i].rc ? "FAILURE" : "SUCCESS");
+		if (q.jobs[i].rc) {
+			if (!failed)
+				rc = q.jobs[i].rc;
+			failed++;
+		}
+	}
+	printf("%d/%d files were generated\n", q.count - failed, q.count);
+
+out:
+	if (workers)
+		free(workers);
+	for (int i = 0; i < q.count; i++) {
+		free(q.jobs[i].args.inFiles);
+		free(q.jobs[i].args.signKeys);
+		free(q.jobs[i].args.signCerts);
+		free(q.jobs[i].args.time);
+		free(q.jobs[i].argv);
+	}
+	free(q.jobs);
+	crypto_pkcs7_signers_free(args->signers);
+	args->signers = NULL;
+	if (manifest)
+		free(manifest);
+
+	return rc;
+}
 #endif
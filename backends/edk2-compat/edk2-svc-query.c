@@ -0,0 +1,489 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h> // isxdigit, isspace
+#include <argp.h>
+#include "backends/edk2-compat/include/edk2-svc.h"
+
+#define NUM_HASH_FUNCTS ARRAY_SIZE(hash_functions)
+
+// one dbx entry, hash points into the dbx data
+struct dbxEntry {
+	const unsigned char *hash;
+	size_t size;
+};
+
+// sorted dbx entries, one array for each algorithm, indexed like hash_functions[]
+struct dbxIndex {
+	struct dbxEntry *entries[NUM_HASH_FUNCTS];
+	size_t count[NUM_HASH_FUNCTS];
+};
+
+struct query {
+	const char *value;
+	int isFile;
+};
+
+struct Arguments {
+	int helpFlag, queryCount;
+	const char *pathToSecVars, *inFile, *varName;
+	struct query *queries;
+	struct secvarctl_ctx *ctx;
+};
+
+static int parse_opt(int key, char *arg, struct argp_state *state);
+static int buildIndex(struct dbxIndex *index, const char *data, size_t size);
+static void freeIndex(struct dbxIndex *index);
+static int findHashFunct(const uuid_t *guid, size_t size);
+static int compareEntries(const void *a, const void *b);
+static int isRevoked(const struct dbxIndex *index, int alg, const unsigned char *hash);
+static int queryHash(const struct dbxIndex *index, const char *hex);
+static int queryFile(const struct dbxIndex *index, const char *file);
+static int hexToBytes(const char *hex, unsigned char *out, size_t outSize, size_t *outLen);
+
+/*
+ *called from main()
+ *handles argument parsing for query command
+ *@param ctx, context the command runs in, holds its log level
+ *@param argc, number of argument
+ *@param arv, array of params
+ *@return SUCCESS if nothing queried is in the dbx, HASH_REVOKED if anything is, else err number
+ */
+int performQueryCommand(struct secvarctl_ctx *ctx, int argc, char *argv[])
+{
+	int rc, result = SUCCESS, revoked = 0;
+	char *fullPath = NULL;
+	struct secvar *var = NULL;
+	struct fileView view = { .data = NULL, .size = 0, .mapped = 0 };
+	struct dbxIndex index;
+	const char *data;
+	size_t size;
+	struct Arguments args = { .helpFlag = 0,
+				  .queryCount = 0,
+				  .pathToSecVars = NULL,
+				  .inFile = NULL,
+				  .varName = NULL,
+				  .queries = NULL,
+				  .ctx = ctx };
+	// combine command and subcommand for usage/help messages
+	argv[0] = "secvarctl query";
+
+	memset(&index, 0, sizeof(index));
+
+	struct argp_option options[] = {
+		{ "hash", 'h', "HEX", 0,
+		  "hash to look for, written in hexadecimal. '/', ':' and spaces between bytes are"
+		  " ignored so output of `secvarctl read` can be used. the algorithm is chosen by"
+		  " the length of the hash" },
+		{ "file", 'i', "FILE", 0,
+		  "any file, it is hashed with every algorithm found in the dbx and each hash is"
+		  " looked for" },
+		{ "esl", 'f', "FILE", 0, "use the dbx ESL in FILE instead of the current variable" },
+		{ "path", 'p', "PATH", 0,
+		  "looks for the dbx directory in PATH, default is " SECVARPATH },
+		{ "verbose", 'v', 0, 0, "print more verbose process information" },
+		{ "help", '?', 0, 0, "Give this help list", 1 },
+		{ "usage", ARGP_OPT_USAGE_KEY, 0, 0, "Give a short usage message", -1 },
+		{ 0 }
+	};
+
+	struct argp argp = {
+		options, parse_opt, "dbx --hash <HEX> | --file <FILE> ...",
+		"This command checks whether hashes or files are revoked by the dbx. Several"
+		" '--hash' and '--file' arguments can be given, the dbx is only read and indexed"
+		" once for all of them. One line is printed for each of them\v"
+		"Returns 0 if none of them are in the dbx, otherwise a nonzero value"
+	};
+
+	rc = argp_parse(&argp, argc, argv, ARGP_NO_EXIT | ARGP_IN_ORDER | ARGP_NO_HELP, 0, &args);
+	if (rc || args.helpFlag)
+		goto out;
+
+	if (args.inFile) {
+		rc = openFileView(&view, args.inFile);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: Could not read dbx ESL from %s\n", args.inFile);
+			goto out;
+		}
+		data = (const char *)view.data;
+		size = view.size;
+	} else {
+		if (!args.pathToSecVars)
+			args.pathToSecVars = SECVARPATH;
+		fullPath = malloc(strlen(args.pathToSecVars) + strlen("dbx/data") + 2);
+		if (!fullPath) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			goto out;
+		}
+		strcpy(fullPath, args.pathToSecVars);
+		if (fullPath[strlen(fullPath) - 1] != '/')
+			strcat(fullPath, "/");
+		strcat(fullPath, "dbx/data");
+		rc = getSecVar(&var, "dbx", fullPath, NULL);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: Could not read dbx from %s\n", fullPath);
+			goto out;
+		}
+		data = var->data;
+		size = var->data_size;
+	}
+
+	rc = buildIndex(&index, data, size);
+	if (rc)
+		goto out;
+
+	for (int i = 0; i < args.queryCount; i++) {
+		if (args.queries[i].isFile)
+			rc = queryFile(&index, args.queries[i].value);
+		else
+			rc = queryHash(&index, args.queries[i].value);
+		// keep answering the other queries, an error is reported over a revoked hash
+		if (rc == HASH_REVOKED)
+			revoked = 1;
+		else if (rc && result == SUCCESS)
+			result = rc;
+	}
+	rc = result ? result : revoked ? HASH_REVOKED : SUCCESS;
+
+out:
+	freeIndex(&index);
+	closeFileView(&view);
+	if (var)
+		dealloc_secvar(var);
+	if (fullPath)
+		free(fullPath);
+	if (args.queries)
+		free(args.queries);
+
+	return rc;
+}
+
+/**
+ *@param key , every option that is parsed has a value to identify it
+ *@param arg, if key is an option than arg will hold its value ex: -<key> <arg>
+ *@param state,  argp_state struct that contains useful information about the current parsing state
+ *@return success or errno
+ */
+static int parse_opt(int key, char *arg, struct argp_state *state)
+{
+	struct Arguments *args = state->input;
+	int rc = SUCCESS;
+
+	switch (key) {
+	case '?':
+		args->helpFlag = 1;
+		argp_state_help(state, stdout, ARGP_HELP_STD_HELP);
+		break;
+	case ARGP_OPT_USAGE_KEY:
+		args->helpFlag = 1;
+		argp_state_help(state, stdout, ARGP_HELP_USAGE);
+		break;
+	case 'h':
+		// intentional flow
+	case 'i':
+		args->queryCount++;
+		rc = reallocArray((void **)&args->queries, args->queryCount,
+				  sizeof(*args->queries));
+		if (rc) {
+			prlog(PR_ERR, "Failed to realloc query array\n");
+			break;
+		}
+		args->queries[args->queryCount - 1].value = arg;
+		args->queries[args->queryCount - 1].isFile = (key == 'i');
+		break;
+	case 'f':
+		args->inFile = arg;
+		break;
+	case 'p':
+		args->pathToSecVars = arg;
+		break;
+	case 'v':
+		args->ctx->verbose = PR_DEBUG;
+		break;
+	case ARGP_KEY_ARG:
+		args->varName = arg;
+		break;
+	case ARGP_KEY_SUCCESS:
+		// check that all essential args are given and valid
+		if (args->helpFlag)
+			break;
+		else if (args->varName == NULL || strcmp(args->varName, "dbx"))
+			prlog(PR_ERR, "ERROR: Only the dbx can be queried, see usage...\n");
+		else if (!args->queryCount)
+			prlog(PR_ERR, "ERROR: No '--hash' or '--file' given, see usage...\n");
+		else
+			break;
+		argp_usage(state);
+		rc = ARG_PARSE_FAIL;
+		break;
+	}
+
+	if (rc)
+		prlog(PR_ERR, "Failed during argument parsing\n");
+
+	return rc;
+}
+
+/*
+ *sorts every hash of the dbx by algorithm, nothing is copied, entries point into data
+ *@param index, zeroed index to fill, free with freeIndex()
+ *@param data, dbx ESL's
+ *@param size, length of data
+ *@return SUCCESS or err number
+ */
+static int buildIndex(struct dbxIndex *index, const char *data, size_t size)
+{
+	int alg, rc;
+	size_t filled[NUM_HASH_FUNCTS] = { 0 };
+	struct esl_iter iter;
+	struct esl_entry entry;
+	const EFI_SIGNATURE_LIST *sigList;
+
+	// first pass only reads the list headers to size each array
+	esl_iter_init(&iter, data, size);
+	while ((rc = esl_iter_next_list(&iter, &sigList)) == OPAL_SUCCESS) {
+		alg = findHashFunct(&sigList->SignatureType,
+				    sigList->SignatureSize - sizeof(uuid_t));
+		if (alg < 0) {
+			prlog(PR_WARNING, "WARNING: Skipping %s ESL in dbx, not a known hash\n",
+			      getSigType(sigList->SignatureType));
+			continue;
+		}
+		index->count[alg] += (sigList->SignatureListSize - sizeof(*sigList) -
+				      sigList->SignatureHeaderSize) /
+				     sigList->SignatureSize;
+	}
+	if (rc != OPAL_EMPTY) {
+		prlog(PR_ERR, "ERROR: dbx is not a valid ESL\n");
+		return ESL_FAIL;
+	}
+
+	for (alg = 0; alg < NUM_HASH_FUNCTS; alg++) {
+		if (!index->count[alg])
+			continue;
+		index->entries[alg] = malloc(index->count[alg] * sizeof(struct dbxEntry));
+		if (!index->entries[alg]) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			return ALLOC_FAIL;
+		}
+	}
+
+	esl_iter_init(&iter, data, size);
+	while (esl_iter_next_list(&iter, &sigList) == OPAL_SUCCESS) {
+		alg = findHashFunct(&sigList->SignatureType,
+				    sigList->SignatureSize - sizeof(uuid_t));
+		if (alg < 0)
+			continue;
+		while (esl_iter_next_entry(&iter, &entry) == OPAL_SUCCESS) {
+			index->entries[alg][filled[alg]].hash = entry.data;
+			index->entries[alg][filled[alg]].size = entry.data_size;
+			filled[alg]++;
+		}
+	}
+
+	for (alg = 0; alg < NUM_HASH_FUNCTS; alg++) {
+		if (!index->count[alg])
+			continue;
+		qsort(index->entries[alg], index->count[alg], sizeof(struct dbxEntry),
+		      compareEntries);
+		prlog(PR_INFO, "Indexed %zd %s hashes of dbx\n", index->count[alg],
+		      hash_functions[alg].name);
+	}
+
+	return SUCCESS;
+}
+
+static void freeIndex(struct dbxIndex *index)
+{
+	for (int i = 0; i < NUM_HASH_FUNCTS; i++) {
+		if (index->entries[i])
+			free(index->entries[i]);
+		index->entries[i] = NULL;
+		index->count[i] = 0;
+	}
+}
+
+/*
+ *finds the hash function of an ESL
+ *@param guid, SignatureType of the ESL, if NULL any algorithm of the right size matches
+ *@param size, size of each hash
+ *@return index into hash_functions or -1 if unknown
+ */
+static int findHashFunct(const uuid_t *guid, size_t size)
+{
+	for (int i = 0; i < NUM_HASH_FUNCTS; i++) {
+		if ((!guid || uuid_equals(guid, hash_functions[i].guid)) &&
+		    size == hash_functions[i].size)
+			return i;
+	}
+
+	return -1;
+}
+
+// qsort() and bsearch() comparison, orders hashes bytewise
+static int compareEntries(const void *a, const void *b)
+{
+	const struct dbxEntry *x = a, *y = b;
+
+	return memcmp(x->hash, y->hash, x->size);
+}
+
+// binary search of the entries of one algorithm, returns 1 if hash is in the dbx
+static int isRevoked(const struct dbxIndex *index, int alg, const unsigned char *hash)
+{
+	struct dbxEntry key = { .hash = hash, .size = hash_functions[alg].size };
+
+	if (!index->count[alg])
+		return 0;
+
+	return bsearch(&key, index->entries[alg], index->count[alg], sizeof(struct dbxEntry),
+		       compareEntries) != NULL;
+}
+
+/*
+ *looks for a hash given on the command line in the dbx
+ *@param index, sorted dbx entries
+ *@param hex, hash as hexadecimal string
+ *@return SUCCESS if not in dbx, HASH_REVOKED if it is, else err number
+ */
+static int queryHash(const struct dbxIndex *index, const char *hex)
+{
+	int alg, rc;
+	size_t len;
+	unsigned char hash[64];
+
+	rc = hexToBytes(hex, hash, sizeof(hash), &len);
+	if (rc) {
+		prlog(PR_ERR, "ERROR: %s is not a hexadecimal hash\n", hex);
+		return rc;
+	}
+	alg = findHashFunct(NULL, len);
+	if (alg < 0) {
+		prlog(PR_ERR, "ERROR: %s has %zd bytes, which is not the size of a known hash\n",
+		      hex, len);
+		return HASH_FAIL;
+	}
+
+	if (isRevoked(index, alg, hash)) {
+		printf("%s: REVOKED, %s hash is in dbx\n", hex, hash_functions[alg].name);
+		return HASH_REVOKED;
+	}
+	printf("%s: not in dbx\n", hex);
+
+	return SUCCESS;
+}
+
+// streamFile() callback, adds one chunk of the file to every hashing context
+static int hashChunk(const unsigned char *data, size_t size, void *ctx)
+{
+	crypto_md_ctx **mdCtx = ctx;
+
+	for (int i = 0; i < NUM_HASH_FUNCTS; i++) {
+		if (mdCtx[i] && crypto_md_update(mdCtx[i], data, size)) {
+			prlog(PR_ERR, "ERROR: Failed to add %zd bytes to %s hashing context\n",
+			      size, hash_functions[i].name);
+			return HASH_FAIL;
+		}
+	}
+
+	return SUCCESS;
+}
+
+/*
+ *hashes a file once with every algorithm in the dbx, reading it a single time, then
+ *looks for each hash
+ *@param index, sorted dbx entries
+ *@param file, path to the file to check
+ *@return SUCCESS if not in dbx, HASH_REVOKED if it is, else err number
+ */
+static int queryFile(const struct dbxIndex *index, const char *file)
+{
+	int rc = SUCCESS, revoked = -1;
+	size_t fileSize;
+	unsigned char hash[64];
+	crypto_md_ctx *mdCtx[NUM_HASH_FUNCTS] = { NULL };
+
+	// only algorithms the dbx holds are worth computing
+	for (int i = 0; i < NUM_HASH_FUNCTS; i++) {
+		if (!index->count[i])
+			continue;
+		rc = crypto_md_ctx_init(&mdCtx[i], hash_functions[i].crypto_md_funct);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: Could not setup %s hashing context\n",
+			      hash_functions[i].name);
+			rc = HASH_FAIL;
+			goto out;
+		}
+	}
+
+	rc = streamFile(file, hashChunk, mdCtx, &fileSize);
+	if (rc) {
+		prlog(PR_ERR, "ERROR: Could not hash data in file %s\n", file);
+		goto out;
+	}
+
+	for (int i = 0; i < NUM_HASH_FUNCTS; i++) {
+		if (!mdCtx[i])
+			continue;
+		if (crypto_md_finish(mdCtx[i], hash)) {
+			prlog(PR_ERR, "ERROR: Generation of %s hash failed\n",
+			      hash_functions[i].name);
+			rc = HASH_FAIL;
+			goto out;
+		}
+		if (logLevel() >= PR_INFO) {
+			prlog(PR_INFO, "%s hash of %s: ", hash_functions[i].name, file);
+			printHex(hash, hash_functions[i].size);
+		}
+		if (revoked < 0 && isRevoked(index, i, hash))
+			revoked = i;
+	}
+
+	if (revoked >= 0) {
+		printf("%s: REVOKED, %s hash is in dbx\n", file, hash_functions[revoked].name);
+		rc = HASH_REVOKED;
+	} else
+		printf("%s: not in dbx\n", file);
+
+out:
+	for (int i = 0; i < NUM_HASH_FUNCTS; i++) {
+		if (mdCtx[i])
+			crypto_md_free(mdCtx[i]);
+	}
+
+	return rc;
+}
+
+/*
+ *converts a hexadecimal string into bytes, '/', ':' and whitespace between bytes are skipped
+ *@param hex, NULL terminated string
+ *@param out, buffer for the bytes
+ *@param outSize, size of out
+ *@param outLen, number of bytes written to out
+ *@return SUCCESS or ARG_PARSE_FAIL
+ */
+static int hexToBytes(const char *hex, unsigned char *out, size_t outSize, size_t *outLen)
+{
+	size_t len = 0;
+	char byte[3] = { 0 };
+
+	while (*hex) {
+		if (*hex == '/' || *hex == ':' || isspace((unsigned char)*hex)) {
+			hex++;
+			continue;
+		}
+		if (!isxdigit((unsigned char)hex[0]) || !isxdigit((unsigned char)hex[1]) ||
+		    len == outSize)
+			return ARG_PARSE_FAIL;
+		byte[0] = hex[0];
+		byte[1] = hex[1];
+		out[len++] = strtoul(byte, NULL, 16);
+		hex += 2;
+	}
+	*outLen = len;
+
+	return SUCCESS;
+}
@@ -13,32 +13,42 @@
 #include "external/skiboot/libstb/secvar/secvar.h" // for secvar struct
 #include "backends/edk2-compat/include/edk2-svc.h"
 
-static int readFiles(const char *var, const char *file, int hrFlag, const char *path);
-static int printReadable(const char *c, size_t size, const char *key);
-static int readFileFromSecVar(const char *path, const char *variable, int hrFlag);
-static int readFileFromPath(const char *path, int hrFlag);
+static int readFiles(const char *var, const char *file, int hrFlag, const char *path,
+		     struct jsonWriter *json);
+static int readFileFromSecVar(const char *path, const char *variable, int hrFlag,
+			      struct jsonWriter *json);
+static int readFileFromPath(const char *path, int hrFlag, struct jsonWriter *json);
 static int getSizeFromSizeFile(size_t *returnSize, const char *path);
 static int readTS(const char *data, size_t size);
+static int writeTSJSON(struct jsonWriter *json, const char *data, size_t size);
 
 struct Arguments {
 	int helpFlag, printRaw;
+	enum outputFormat output;
 	const char *pathToSecVars, *varName, *inFile;
+	struct secvarctl_ctx *ctx;
 };
 static int parse_opt(int key, char *arg, struct argp_state *state);
 
 /*
  *called from main()
  *handles argument parsing for read command
+ *@param ctx, context the command runs in, holds its log level
  *@param argc, number of argument
  *@param arv, array of params
  *@return SUCCESS or err number 
  */
-int performReadCommand(int argc, char *argv[])
+int performReadCommand(struct secvarctl_ctx *ctx, int argc, char *argv[])
 {
 	int rc;
-	struct Arguments args = {
-		.helpFlag = 0, .printRaw = 0, .pathToSecVars = NULL, .inFile = NULL, .varName = NULL
-	};
+	struct jsonWriter json;
+	struct Arguments args = { .helpFlag = 0,
+				  .printRaw = 0,
+				  .output = OUTPUT_TEXT,
+				  .pathToSecVars = NULL,
+				  .inFile = NULL,
+				  .varName = NULL,
+				  .ctx = ctx };
 	// combine command and subcommand for usage/help messages
 	argv[0] = "secvarctl read";
 
@@ -48,6 +58,8 @@ int performReadCommand(int argc, char *argv[])
 		{ "file", 'f', "FILE", 0, "navigates to ESL file from working directiory" },
 		{ "path", 'p', "PATH", 0,
 		  "looks for key directories {'PK','KEK','db','dbx', 'TS'} in PATH, default is " SECVARPATH },
+		{ "output", ARGP_OPT_OUTPUT_KEY, "FORMAT", 0,
+		  "print as 'text' (default) or 'json', one JSON object with a record for every variable" },
 		{ "help", '?', 0, 0, "Give this help list", 1 },
 		{ "usage", ARGP_OPT_USAGE_KEY, 0, 0, "Give a short usage message", -1 },
 		{ 0 }
@@ -66,7 +78,20 @@ int performReadCommand(int argc, char *argv[])
 	if (rc || args.helpFlag)
 		goto out;
 
-	rc = readFiles(args.varName, args.inFile, !args.printRaw, args.pathToSecVars);
+	if (args.output == OUTPUT_JSON) {
+		jsonInit(&json, stdout);
+		jsonObjectStart(&json, NULL);
+		jsonString(&json, "command", "read");
+		rc = readFiles(args.varName, args.inFile, 1, args.pathToSecVars, &json);
+		jsonResult(&json, rc);
+		jsonObjectEnd(&json);
+	} else {
+		// a large dbx is thousands of lines, they are written a buffer at a time
+		outHold();
+		rc = readFiles(args.varName, args.inFile, !args.printRaw, args.pathToSecVars,
+			       NULL);
+		outRelease();
+	}
 
 out:
 	return rc;
@@ -102,7 +127,10 @@ static int parse_opt(int key, char *arg, struct argp_state *state)
 		args->inFile = arg;
 		break;
 	case 'v':
-		verbose = PR_DEBUG;
+		args->ctx->verbose = PR_DEBUG;
+		break;
+	case ARGP_OPT_OUTPUT_KEY:
+		rc = parseOutputFormat(arg, &args->output);
 		break;
 	case ARGP_KEY_ARG:
 		args->varName = arg;
@@ -110,6 +138,12 @@ static int parse_opt(int key, char *arg, struct argp_state *state)
 		if (rc)
 			prlog(PR_ERR, "ERROR: Invalid variable name %s\n", args->varName);
 		break;
+	case ARGP_KEY_SUCCESS:
+		if (args->printRaw && args->output == OUTPUT_JSON) {
+			prlog(PR_ERR, "ERROR: -r cannot be used with --output json\n");
+			rc = ARG_PARSE_FAIL;
+		}
+		break;
 	}
 
 	if (rc)
@@ -124,9 +158,11 @@ static int parse_opt(int key, char *arg, struct argp_state *state)
  *@param file string to filename with path if -f option, NULL if not
  *@param hrFLag 1 if -hr for human readable output, 0 for raw data
  *@param path string to path where {PK,KEK,db,dbx,TS} subdirectories are, default SECVARPATH if none given
+ *@param json writer inside the object of the command for --output json, NULL for text
  *@return succcess if at least one file was successfully read
  */
-static int readFiles(const char *var, const char *file, int hrFlag, const char *path)
+static int readFiles(const char *var, const char *file, int hrFlag, const char *path,
+		     struct jsonWriter *json)
 {
 	// program is successful if at least one var was able to be read
 	int rc, successCount = 0;
@@ -142,22 +178,27 @@ static int readFiles(const char *var, const char *file, int hrFlag, const char *
 		path = SECVARPATH;
 	}
 
+	if (json)
+		jsonArrayStart(json, "variables");
 	if (!file) {
 		for (int i = 0; i < ARRAY_SIZE(variables); i++) {
 			// if var is defined and it is not the current one then skip
 			if (var && strcmp(var, variables[i]) != 0) {
 				continue;
 			}
-			printf("READING %s :\n", variables[i]);
-			rc = readFileFromSecVar(path, variables[i], hrFlag);
+			if (!json)
+				outPrintf("READING %s :\n", variables[i]);
+			rc = readFileFromSecVar(path, variables[i], hrFlag, json);
 			if (rc == SUCCESS)
 				successCount++;
 		}
 	} else {
-		rc = readFileFromPath(file, hrFlag);
+		rc = readFileFromPath(file, hrFlag, json);
 		if (rc == SUCCESS)
 			successCount++;
 	}
+	if (json)
+		jsonArrayEnd(json);
 	// if no good files read then count it as a failure
 	if (successCount < 1) {
 		prlog(PR_ERR, "No valid files to print, returning failure\n");
@@ -172,9 +213,11 @@ static int readFiles(const char *var, const char *file, int hrFlag, const char *
  *@param path , the path to the file with ending '/'
  *@param variable , variable name one of {db,dbx,KEK,PK,TS}
  *@param hrFlag, 1 for human readable 0 for raw data
+ *@param json, writer for --output json, NULL for text
  *@return SUCCESS or error number
  */
-static int readFileFromSecVar(const char *path, const char *variable, int hrFlag)
+static int readFileFromSecVar(const char *path, const char *variable, int hrFlag,
+			      struct jsonWriter *json)
 {
 	int extra = 10, rc;
 	struct secvar *var = NULL;
@@ -190,16 +233,29 @@ static int readFileFromSecVar(const char *path, const char *variable, int hrFlag
 	strcat(fullPath, variable);
 	strcat(fullPath, "/data");
 
-	rc = getSecVar(&var, variable, fullPath);
+	rc = getSecVar(&var, variable, fullPath, NULL);
 
 	free(fullPath);
 
+	if (json) {
+		jsonObjectStart(json, NULL);
+		jsonString(json, "variable", variable);
+	}
 	if (rc) {
 		goto out;
 	}
-	if (hrFlag) {
+	if (json) {
+		jsonInt(json, "size", var->data_size);
 		if (var->data_size == 0) {
-			printf("%s is empty\n", var->key);
+			jsonArrayStart(json, strcmp(var->key, "TS") ? "esls" : "timestamps");
+			jsonArrayEnd(json);
+		} else if (strcmp(var->key, "TS") == 0)
+			rc = writeTSJSON(json, var->data, var->data_size);
+		else
+			rc = writeESLsJSON(json, var->data, var->data_size);
+	} else if (hrFlag) {
+		if (var->data_size == 0) {
+			outPrintf("%s is empty\n", var->key);
 			rc = SUCCESS;
 		} else if (strcmp(var->key, "TS") == 0)
 			rc = readTS(var->data, var->data_size);
@@ -214,6 +270,10 @@ static int readFileFromSecVar(const char *path, const char *variable, int hrFlag
 	}
 
 out:
+	if (json) {
+		jsonResult(json, rc);
+		jsonObjectEnd(json);
+	}
 	dealloc_secvar(var);
 
 	return rc;
@@ -223,46 +283,94 @@ out:
  *Does the appropriate read command depending on hrFlag on the file 
  *@param file , the path to the file 
  *@param hrFlag, 1 for human readable 0 for raw data
+ *@param json, writer for --output json, NULL for text
  *@return SUCCESS or error number
  */
-static int readFileFromPath(const char *file, int hrFlag)
+static int readFileFromPath(const char *file, int hrFlag, struct jsonWriter *json)
 {
 	int rc;
-	size_t size = 0;
-	char *c = NULL;
-	c = getDataFromFile(file, &size);
-	if (!c) {
-		return INVALID_FILE;
+	struct fileView view;
+
+	if (json) {
+		jsonObjectStart(json, NULL);
+		jsonString(json, "file", file);
 	}
-	if (hrFlag) {
-		rc = printReadable(c, size, NULL);
+	rc = openFileView(&view, file);
+	if (rc) {
+		if (json) {
+			jsonResult(json, rc);
+			jsonObjectEnd(json);
+		}
+		return rc;
+	}
+	if (json) {
+		jsonInt(json, "size", view.size);
+		rc = writeESLsJSON(json, (const char *)view.data, view.size);
+		jsonResult(json, rc);
+		jsonObjectEnd(json);
+	} else if (hrFlag) {
+		rc = printReadable((const char *)view.data, view.size, NULL);
 		if (rc)
 			prlog(PR_WARNING, "ERROR: Could not parse file\n");
 		else
 			rc = SUCCESS;
 	} else {
-		printRaw(c, size);
+		printRaw((const char *)view.data, view.size);
 		rc = SUCCESS;
 	}
-	free(c);
+	closeFileView(&view);
 
 	return rc;
 }
 
+/**
+ *turns the data of a file view into a secvar and closes the view. Data that was read into a
+ *buffer is handed over to the secvar, mapped data is copied once into the secvar allocation
+ *@param view , view opened with openFileView(), always closed
+ *@param name , secure variable name {db,dbx,KEK,PK}
+ *@param size , number of bytes of the view to use
+ *@param arena , arena to allocate the secvar from, NULL for its own allocation
+ *@return the new secvar or NULL if allocation fails
+ *NOTE: THIS IS ALLOCATING DATA AND THE RESULT STILL NEEDS TO BE DEALLOCATED
+ */
+struct secvar *fileViewToSecVar(struct fileView *view, const char *name, size_t size,
+				struct secvar_arena *arena)
+{
+	struct secvar *var;
+	char *data;
+
+	if (view->mapped || !view->data) {
+		var = new_secvar_in(arena, name, strlen(name) + 1, (const char *)view->data, size,
+				    0);
+		closeFileView(view);
+		return var;
+	}
+
+	data = (char *)view->data;
+	var = new_secvar_move(arena, name, strlen(name) + 1, &data, size, 0);
+	// only forget the buffer if the secvar took it
+	if (var)
+		view->data = NULL;
+	closeFileView(view);
+
+	return var;
+}
+
 /**
  *gets the secvar struct from a file
  *@param var , returned secvar
  *@param name , secure variable name {db,dbx,KEK,PK}
  *@param fullPath, file and path <path>/<varname>/data
+ *@param arena , arena to allocate the secvar from, NULL for its own allocation
  *NOTE: THIS IS ALLOCATING DATA AND var STILL NEEDS TO BE DEALLOCATED
  */
-int getSecVar(struct secvar **var, const char *name, const char *fullPath)
+int getSecVar(struct secvar **var, const char *name, const char *fullPath,
+	      struct secvar_arena *arena)
 {
-	int rc, fptr;
+	int rc;
 	size_t size;
-	ssize_t read_size;
-	char *sizePath = NULL, *c = NULL;
-	struct stat fileInfo;
+	char *sizePath = NULL;
+	struct fileView view;
 	rc = isFile(fullPath);
 	if (rc) {
 		return rc;
@@ -294,48 +402,25 @@ int getSecVar(struct secvar **var, const char *name, const char *fullPath)
 		return rc;*/
 	}
 
-	fptr = open(fullPath, O_RDONLY);
-	if (fptr < 0) {
-		prlog(PR_WARNING, "-----opening %s failed: %s-------\n\n", fullPath,
-		      strerror(errno));
-		return INVALID_FILE;
-	}
-	if (fstat(fptr, &fileInfo) < 0) {
-		return INVALID_FILE;
+	rc = openFileView(&view, fullPath);
+	if (rc) {
+		prlog(PR_WARNING, "-----opening %s failed-------\n\n", fullPath);
+		return rc;
 	}
 	// if file size is less than expeced size, error
-	if (fileInfo.st_size < size) {
-		prlog(PR_ERR, "ERROR: expected size (%zd) is less than actual size (%ld)\n", size,
-		      fileInfo.st_size);
+	if (view.size < size) {
+		prlog(PR_ERR, "ERROR: expected size (%zd) is less than actual size (%zd)\n", size,
+		      view.size);
+		closeFileView(&view);
 		return INVALID_FILE;
 	}
-	prlog(PR_NOTICE, "---opening %s is success: reading %zd bytes---- \n", fullPath, size);
-	c = malloc(size);
-	if (!c) {
-		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
-		return ALLOC_FAIL;
-	}
+	prlog(PR_NOTICE, "---opening %s is success: using %zd bytes---- \n", fullPath, size);
 
-	read_size = read(fptr, c, size);
-	if (read_size != size) {
-		prlog(PR_ERR, "ERROR: did not read all data of %s in one go\n", fullPath);
-		free(c);
-		close(fptr);
-		return INVALID_FILE;
-	}
-	close(fptr);
-	if (!c) {
-		prlog(PR_ERR, "ERROR: no data in file");
-		return INVALID_FILE;
-	}
-
-	*var = new_secvar(name, strlen(name) + 1, c, size, 0);
+	*var = fileViewToSecVar(&view, name, size, arena);
 	if (*var == NULL) {
 		prlog(PR_ERR, "ERROR: Could not convert data to secvar\n");
-		free(c);
 		return INVALID_FILE;
 	}
-	free(c);
 
 	return SUCCESS;
 }
@@ -347,79 +432,40 @@ int getSecVar(struct secvar **var, const char *name, const char *fullPath)
  *@param key, variable name {"db","dbx","KEK", "PK"} b/c dbx is a different format
  *@return SUCCESS or error number if failure
  */
-static int printReadable(const char *c, size_t size, const char *key)
+int printReadable(const char *c, size_t size, const char *key)
 {
-	ssize_t eslvarsize = size, cert_size;
-	size_t eslsize = 0;
-	int count = 0, offset = 0, rc;
-	unsigned char *cert = NULL;
-	EFI_SIGNATURE_LIST *sigList;
+	int count = 0, rc = SUCCESS;
+	struct esl_iter iter;
+	struct esl_entry entry;
+	const EFI_SIGNATURE_LIST *sigList;
 	crypto_x509 *x509 = NULL;
 
-	while (eslvarsize > 0) {
-		if (eslvarsize < sizeof(EFI_SIGNATURE_LIST)) {
-			prlog(PR_ERR,
-			      "ERROR: ESL has %zd bytes and is smaller than an ESL (%zd bytes), remaining data not parsed\n",
-			      eslvarsize, sizeof(EFI_SIGNATURE_LIST));
-			break;
-		}
-		// Get sig list
-		sigList = get_esl_signature_list(c + offset, eslvarsize);
-		// check size info is logical
-		if (sigList->SignatureListSize > 0) {
-			if ((sigList->SignatureSize <= 0 && sigList->SignatureHeaderSize <= 0) ||
-			    sigList->SignatureListSize <
-				    sigList->SignatureHeaderSize + sigList->SignatureSize) {
-				/*printf("Sig List : %d , sig Header: %d, sig Size: %d\n",list.SignatureListSize,list.SignatureHeaderSize,list.SignatureSize);*/
-				prlog(PR_ERR,
-				      "ERROR: Sig List is not structured correctly, defined size and actual sizes are mismatched\n");
-				break;
-			}
-		}
-		if (sigList->SignatureListSize > eslvarsize ||
-		    sigList->SignatureHeaderSize > eslvarsize ||
-		    sigList->SignatureSize > eslvarsize) {
-			prlog(PR_ERR,
-			      "ERROR: Expected Sig List Size %d + Header size %d + Signature Size is %d larger than actual size %zd\n",
-			      sigList->SignatureListSize, sigList->SignatureHeaderSize,
-			      sigList->SignatureSize, eslvarsize);
-			break;
-		}
-		eslsize = sigList->SignatureListSize;
+	// entries are borrowed from c, nothing is copied while walking the ESL's
+	esl_iter_init(&iter, c, size);
+	while (!rc && esl_iter_next_list(&iter, &sigList) == OPAL_SUCCESS) {
 		printESLInfo(sigList);
-		// puts sig data in cert
-		cert_size = get_esl_cert(c + offset, eslvarsize, (char **)&cert);
-		if (cert_size <= 0) {
-			prlog(PR_ERR, "\tERROR: Signature Size was too small, no data \n");
-			break;
-		}
-		if (key && !strcmp(key, "dbx")) {
-			printf("\tHash: ");
-			printHex(cert, cert_size);
-		} else {
-			rc = parseX509(&x509, cert, (size_t)cert_size);
+		// every entry of the list, each one is SignatureSize bytes past the last
+		while (esl_iter_next_entry(&iter, &entry) == OPAL_SUCCESS) {
+			if (key && !strcmp(key, "dbx")) {
+				outPrintf("\tHash: ");
+				printHex(entry.data, entry.data_size);
+				continue;
+			}
+			rc = parseX509(&x509, entry.data, entry.data_size);
 			if (rc)
 				break;
 			rc = printCertInfo(x509);
-			if (rc)
-				break;
-			free(cert);
-			cert = NULL;
 			crypto_x509_free(x509);
 			x509 = NULL;
+			if (rc)
+				break;
 		}
+		if (rc)
+			break;
 
 		count++;
-		// we read all eslsize bytes so iterate to next esl
-		offset += eslsize;
-		// size left of total file
-		eslvarsize -= eslsize;
 	}
-	printf("\tFound %d ESL's\n\n", count);
-	if (x509)
-		crypto_x509_free(x509);
-	if (cert)
-		free(cert);
+	outPrintf("\tFound %d ESL's\n\n", count);
 
 	if (!count)
 		return ESL_FAIL;
@@ -427,13 +473,120 @@ static int printReadable(const char *c, size_t size, const char *key)
 	return SUCCESS;
 }
 
+/*
+ *writes the ESL's of an ESL buffer as the array "esls", certificates are written by their
+ *fields, hashes and any other entries as hex
+ *@param json, writer inside an object
+ *@param c , buffer containing ESL data
+ *@param size , length of buffer
+ *@return SUCCESS or error number if failure
+ */
+int writeESLsJSON(struct jsonWriter *json, const char *c, size_t size)
+{
+	int count = 0, index, rc = SUCCESS;
+	struct esl_iter iter;
+	struct esl_entry entry;
+	const EFI_SIGNATURE_LIST *sigList;
+	crypto_x509 *x509 = NULL;
+
+	jsonArrayStart(json, "esls");
+	esl_iter_init(&iter, c, size);
+	while (!rc && esl_iter_next_list(&iter, &sigList) == OPAL_SUCCESS) {
+		jsonObjectStart(json, NULL);
+		jsonInt(json, "index", count);
+		jsonInt(json, "size", sigList->SignatureListSize);
+		jsonHex(json, "guid", (const unsigned char *)&sigList->SignatureType, UUID_SIZE);
+		jsonString(json, "type", getSigType(sigList->SignatureType));
+		jsonArrayStart(json, "entries");
+		for (index = 0; esl_iter_next_entry(&iter, &entry) == OPAL_SUCCESS; index++) {
+			jsonObjectStart(json, NULL);
+			jsonInt(json, "index", index);
+			jsonHex(json, "owner", (const unsigned char *)entry.owner, UUID_SIZE);
+			if (uuid_equals(entry.type, &EFI_CERT_X509_GUID)) {
+				rc = parseX509(&x509, entry.data, entry.data_size);
+				if (!rc) {
+					rc = writeCertJSON(json, "certificate", x509);
+					crypto_x509_free(x509);
+					x509 = NULL;
+				}
+			} else if (strcmp(getSigType(*entry.type), "UNKNOWN"))
+				jsonHex(json, "hash", entry.data, entry.data_size);
+			else
+				jsonHex(json, "data", entry.data, entry.data_size);
+			jsonObjectEnd(json);
+			if (rc)
+				break;
+		}
+		jsonArrayEnd(json);
+		jsonObjectEnd(json);
+		count++;
+	}
+	jsonArrayEnd(json);
+
+	if (!count)
+		return ESL_FAIL;
+
+	return rc;
+}
+
+/*
+ *writes the fields of an x509 as an object
+ *@param json, writer
+ *@param name, name of the object, NULL inside an array
+ *@param x509, certificate to write
+ *@return SUCCESS or CERT_FAIL if a field could not be read
+ */
+int writeCertJSON(struct jsonWriter *json, const char *name, crypto_x509 *x509)
+{
+	int rc = SUCCESS, bits;
+	char buf[CERT_BUFFER_SIZE], notBefore[32], notAfter[32];
+	const unsigned char *serial;
+	size_t serialLen;
+	struct tm before, after;
+
+	jsonObjectStart(json, name);
+	if (crypto_x509_get_name(x509, 0, buf, sizeof(buf)) >= 0)
+		jsonString(json, "subject", buf);
+	else
+		rc = CERT_FAIL;
+	if (crypto_x509_get_name(x509, 1, buf, sizeof(buf)) >= 0)
+		jsonString(json, "issuer", buf);
+	else
+		rc = CERT_FAIL;
+	if (!crypto_x509_get_serial(x509, &serial, &serialLen))
+		jsonHex(json, "serial", serial, serialLen);
+	else
+		rc = CERT_FAIL;
+	if (!crypto_x509_get_validity(x509, &before, &after)) {
+		strftime(notBefore, sizeof(notBefore), "%Y-%m-%dT%H:%M:%SZ", &before);
+		strftime(notAfter, sizeof(notAfter), "%Y-%m-%dT%H:%M:%SZ", &after);
+		jsonString(json, "not_before", notBefore);
+		jsonString(json, "not_after", notAfter);
+	} else
+		rc = CERT_FAIL;
+	buf[0] = '\0';
+	crypto_x509_get_short_info(x509, buf, sizeof(buf));
+	jsonString(json, "signature_algorithm", buf);
+	bits = crypto_x509_get_pk_bit_len(x509);
+	if (bits > 0)
+		jsonInt(json, "key_bits", bits);
+	jsonObjectEnd(json);
+
+	return rc;
+}
+
 // prints info on ESL, nothing on ESL data
-void printESLInfo(EFI_SIGNATURE_LIST *sigList)
+void printESLInfo(const EFI_SIGNATURE_LIST *sigList)
 {
-	printf("\tESL SIG LIST SIZE: %d\n", sigList->SignatureListSize);
-	printf("\tGUID is : ");
+	outPrintf("\tESL SIG LIST SIZE: %d\n", sigList->SignatureListSize);
+	// sizes were checked by esl_iter_next_list, SignatureSize is never 0
+	outPrintf("\tSignature entries: %d\n",
+		  (sigList->SignatureListSize - (int)sizeof(*sigList) -
+		   sigList->SignatureHeaderSize) /
+			  sigList->SignatureSize);
+	outPrintf("\tGUID is : ");
 	printGuidSig(&sigList->SignatureType);
-	printf("\tSignature type is: %s\n", getSigType(sigList->SignatureType));
+	outPrintf("\tSignature type is: %s\n", getSigType(sigList->SignatureType));
 }
 
 // prints info on x509
@@ -455,7 +608,7 @@ int printCertInfo(crypto_x509 *x509)
 		      failures);
 		return CERT_FAIL;
 	}
-	printf("\tFound certificate info:\n %s \n", x509_info);
+	outPrintf("\tFound certificate info:\n %s \n", x509_info);
 	free(x509_info);
 
 	return SUCCESS;
@@ -482,14 +635,43 @@ static int readTS(const char *data, size_t size)
 	     tmpStamp = (void *)tmpStamp + sizeof(struct efi_time),
 	    size -= sizeof(struct efi_time)) {
 		// print variable name
-		printf("\t%s:\t",
-		       variables[(ARRAY_SIZE(variables) - 1) - (size / sizeof(struct efi_time))]);
+		outPrintf("\t%s:\t", variables[(ARRAY_SIZE(variables) - 1) -
+					       (size / sizeof(struct efi_time))]);
 		printTimestamp(*tmpStamp);
 	}
 
 	return SUCCESS;
 }
 
+/**
+ *writes the timestamps of the TS variable as the array "timestamps", see readTS()
+ *@param json, writer inside an object
+ *@param data, timestamps of normal variables {pk, db, kek, dbx}
+ *@param size, size of timestamp data, should be 16*4
+ *@return SUCCESS or error depending if ts data is understandable
+ */
+static int writeTSJSON(struct jsonWriter *json, const char *data, size_t size)
+{
+	const struct efi_time *stamps = (const struct efi_time *)data;
+
+	if (size != sizeof(struct efi_time) * (ARRAY_SIZE(variables) - 1)) {
+		prlog(PR_ERR,
+		      "ERROR: TS variable does not contain data on all the variables, expected %ld bytes of data, found %zd\n",
+		      sizeof(struct efi_time) * (ARRAY_SIZE(variables) - 1), size);
+		return INVALID_TIMESTAMP;
+	}
+	jsonArrayStart(json, "timestamps");
+	for (int i = 0; i < ARRAY_SIZE(variables) - 1; i++) {
+		jsonObjectStart(json, NULL);
+		jsonString(json, "variable", variables[i]);
+		writeTimestampJSON(json, "time", stamps[i]);
+		jsonObjectEnd(json);
+	}
+	jsonArrayEnd(json);
+
+	return SUCCESS;
+}
+
 /**
  *finds format type given by guid
  *@param type uuid_t of guid of file
@@ -519,10 +701,10 @@ const char *getSigType(const uuid_t type)
  */
 void printGuidSig(const void *sig)
 {
-	const unsigned char *p = sig;
-	for (int i = 0; i < 16; i++)
-		printf("%02hhx", p[i]);
-	printf("\n");
+	outHold();
+	outHex(sig, 16, '\0');
+	outWrite("\n", 1);
+	outRelease();
 }
 
 /*
@@ -585,6 +767,8 @@ struct command edk2_compat_command_table[] = {
 	{ .name = "write", .func = performWriteCommand },
 	{ .name = "validate", .func = performValidation },
 	{ .name = "verify", .func = performVerificationCommand },
+	{ .name = "batch", .func = performBatchCommand },
+	{ .name = "query", .func = performQueryCommand },
 #ifndef NO_CRYPTO
 	{ .name = "generate", .func = performGenerateCommand }
 #endif
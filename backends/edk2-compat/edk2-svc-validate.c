@@ -3,39 +3,80 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h> // for exit
+#include <dirent.h> // scandir
+#include <pthread.h>
+#include <sys/stat.h>
 #include <argp.h>
 #include "libstb/secvar/crypto/crypto.h"
 #include "include/edk2-svc.h"
+#include "include/stats.h"
 
 struct Arguments {
-	int helpFlag;
-	const char *inFile, *varName;
+	int helpFlag, threads;
+	enum outputFormat output;
+	const char *inFile, *varName, *dirPath;
 	char inForm;
+	struct secvarctl_ctx *ctx;
 };
 
 static bool validate_hash(uuid_t type, size_t size);
+static int validateESLs(const unsigned char *eslBuf, size_t buflen, const char *key);
+static int parseX509Data(crypto_x509 **x509, const unsigned char *certBuf, size_t buflen);
 static int parse_opt(int key, char *arg, struct argp_state *state);
-static int validateSingularESL(size_t *bytesRead, const unsigned char *esl, size_t eslvarsize,
+static int validateSingularESL(struct esl_iter *iter, const EFI_SIGNATURE_LIST *sigList,
 			       const char *varName);
 static int validateCertStruct(crypto_x509 *x509, const char *varName);
+static int validateDirectory(struct secvarctl_ctx *ctx, const char *dirPath, int threads,
+			     const char *varName, struct jsonWriter *json);
+static int writeFileJSON(struct jsonWriter *json, const unsigned char *data, size_t size,
+			 char inForm);
+static const char *fileTypeName(char inForm);
 
-enum fileTypes { AUTH_FILE = 'a', PKCS7_FILE = 'p', ESL_FILE = 'e', CERT_FILE = 'c' };
+enum fileTypes {
+	UNKNOWN_FILE = 0,
+	AUTH_FILE = 'a',
+	PKCS7_FILE = 'p',
+	ESL_FILE = 'e',
+	CERT_FILE = 'c'
+};
+
+// one file found by validate --dir
+struct dirFile {
+	char *path;
+	char inForm;
+	int rc;
+};
+
+struct dirQueue {
+	struct dirFile *files;
+	int count, next;
+	const char *varName;
+	pthread_mutex_t lock;
+	// context of the validate command, the workers only print with it
+	struct secvarctl_ctx *ctx;
+};
 
 /*
  *called from main()
  *handles argument parsing for validate command
+ *@param ctx, context the command runs in, holds its log level
  *@param argc, number of argument
  *@param arv, array of params
  *@return SUCCESS or err number 
  */
-int performValidation(int argc, char *argv[])
+int performValidation(struct secvarctl_ctx *ctx, int argc, char *argv[])
 {
-	unsigned char *buff = NULL;
-	size_t size;
+	struct fileView view = { .data = NULL, .size = 0, .mapped = 0 };
+	struct jsonWriter json;
 	int rc;
-	struct Arguments args = {
-		.helpFlag = 0, .inFile = NULL, .inForm = AUTH_FILE, .varName = NULL
-	};
+	struct Arguments args = { .helpFlag = 0,
+				  .threads = 1,
+				  .output = OUTPUT_TEXT,
+				  .inFile = NULL,
+				  .inForm = AUTH_FILE,
+				  .varName = NULL,
+				  .dirPath = NULL,
+				  .ctx = ctx };
 	// combine command and subcommand for usage/help messages
 	argv[0] = "secvarctl validate";
 
@@ -48,6 +89,11 @@ int performValidation(int argc, char *argv[])
 		  "file is a properly generated authenticated variable, DEFAULT" },
 		{ "dbx", 'x', 0, 0,
 		  "file is for the dbx (allows for data to contain a hash not an x509), Note: user still should specify the file type" },
+		{ "dir", 'd', "DIR", 0,
+		  "validate every file in DIR, the type of each file is detected from its contents" },
+		{ "jobs", 'j', "N", 0, "with --dir, validate up to N files at the same time" },
+		{ "output", ARGP_OPT_OUTPUT_KEY, "FORMAT", 0,
+		  "print as 'text' (default) or 'json', the verdict and contents of a valid file or the verdict of every file with --dir" },
 		{ "help", '?', 0, 0, "Give this help list", 1 },
 		{ "usage", ARGP_OPT_USAGE_KEY, 0, 0, "Give a short usage message", -1 },
 		{ 0 }
@@ -57,40 +103,67 @@ int performValidation(int argc, char *argv[])
 		options, parse_opt, "<FILE>",
 		"The purpose of this command is to help ensure that the format of the file is correct"
 		" and is able to be parsed for data. NOTE: This command mainly performs formatting checks, invalid content/signatures can still exist"
-		" use 'secvarctl verify' to see if content and file signature (if PKCS7/auth) are valid"
+		" use 'secvarctl verify' to see if content and file signature (if PKCS7/auth) are valid\v"
+		"With --dir, each file is detected as an auth, ESL, PKCS7 or certificate from its"
+		" contents and a result is printed for every file. ESL's and auth files holding hashes"
+		" are validated as dbx data."
 	};
 
 	rc = argp_parse(&argp, argc, argv, ARGP_NO_EXIT | ARGP_IN_ORDER | ARGP_NO_HELP, 0, &args);
+	outHold();
+	if (args.output == OUTPUT_JSON && !args.helpFlag) {
+		jsonInit(&json, stdout);
+		jsonObjectStart(&json, NULL);
+		jsonString(&json, "command", "validate");
+	}
 	if (rc || args.helpFlag)
 		goto out;
 
-	buff = (unsigned char *)getDataFromFile(args.inFile, &size);
-	if (!buff) {
+	if (args.dirPath) {
+		rc = validateDirectory(ctx, args.dirPath, args.threads, args.varName,
+				       args.output == OUTPUT_JSON ? &json : NULL);
+		goto out;
+	}
+
+	if (args.output == OUTPUT_JSON) {
+		jsonString(&json, "file", args.inFile);
+		jsonString(&json, "type", fileTypeName(args.inForm));
+		jsonString(&json, "variable", args.varName);
+	}
+	rc = openFileView(&view, args.inFile);
+	if (rc) {
 		prlog(PR_ERR, "ERROR: failed to get data from %s\n", args.inFile);
-		rc = INVALID_FILE;
 		goto out;
 	}
 
 	switch (args.inForm) {
 	case CERT_FILE:
-		rc = validateCert(buff, size, args.varName);
+		rc = validateCert(view.data, view.size, args.varName);
 		break;
 	case ESL_FILE:
-		rc = validateESL(buff, size, args.varName);
+		rc = validateESL(view.data, view.size, args.varName);
 		break;
 	case PKCS7_FILE:
-		rc = validatePKCS7(buff, size);
+		rc = validatePKCS7(view.data, view.size);
 		break;
 	case AUTH_FILE:
 	default:
-		rc = validateAuth(buff, size, args.varName);
+		rc = validateAuth(view.data, view.size, args.varName);
 		break;
 	}
+	// only a valid file is parsed again to write what it holds
+	if (!rc && args.output == OUTPUT_JSON)
+		rc = writeFileJSON(&json, view.data, view.size, args.inForm);
 out:
-	if (buff)
-		free(buff);
-	if (!args.helpFlag)
-		printf("RESULT: %s\n", rc ? "FAILURE" : "SUCCESS");
+	closeFileView(&view);
+	outRelease();
+	if (args.helpFlag)
+		return rc;
+	if (args.output == OUTPUT_JSON) {
+		jsonResult(&json, rc);
+		jsonObjectEnd(&json);
+	} else
+		outPrintf("RESULT: %s\n", rc ? "FAILURE" : "SUCCESS");
 
 	return rc;
 }
@@ -104,6 +177,7 @@ out:
 static int parse_opt(int key, char *arg, struct argp_state *state)
 {
 	struct Arguments *args = state->input;
+	char *end = NULL;
 	int rc = SUCCESS;
 
 	switch (key) {
@@ -116,7 +190,22 @@ static int parse_opt(int key, char *arg, struct argp_state *state)
 		argp_state_help(state, stdout, ARGP_HELP_USAGE);
 		break;
 	case 'v':
-		verbose = PR_DEBUG;
+		args->ctx->verbose = PR_DEBUG;
+		break;
+	case 'd':
+		args->dirPath = arg;
+		break;
+	case ARGP_OPT_OUTPUT_KEY:
+		rc = parseOutputFormat(arg, &args->output);
+		break;
+	case 'j':
+		args->threads = strtol(arg, &end, 10);
+		if (*arg == '\0' || *end != '\0' || args->threads < 1 ||
+		    args->threads > MAX_WORKER_THREADS) {
+			prlog(PR_ERR, "ERROR: -j expects a number between 1 and %d, found %s\n",
+			      MAX_WORKER_THREADS, arg);
+			rc = ARG_PARSE_FAIL;
+		}
 		break;
 	// set varname as dbx, important for validating ESL
 	case 'x':
@@ -142,8 +231,10 @@ static int parse_opt(int key, char *arg, struct argp_state *state)
 		// check that all essential args are given and valid
 		if (args->helpFlag)
 			break;
-		if (!args->inFile)
+		if (!args->inFile && !args->dirPath)
 			prlog(PR_ERR, "ERROR: missing input file, see usage...\n");
+		else if (args->inFile && args->dirPath)
+			prlog(PR_ERR, "ERROR: cannot use an input file with --dir, see usage...\n");
 		else
 			break;
 		argp_usage(state);
@@ -192,7 +283,7 @@ int validateAuth(const unsigned char *authBuf, size_t buflen, const char *key)
 		return AUTH_FAIL;
 	}
 
-	if (verbose >= PR_INFO) {
+	if (logLevel() >= PR_INFO) {
 		prlog(PR_INFO, "\tGuid code is : ");
 		printGuidSig(&auth->auth_info.cert_type);
 	}
@@ -214,7 +305,7 @@ int validateAuth(const unsigned char *authBuf, size_t buflen, const char *key)
 	      "\tAuth File Size = %zd\n\t  -Auth/PKCS7 Data Size = %zd\n\t  -ESL Size = %zd\n",
 	      buflen, authSize, buflen - authSize);
 
-	if (verbose >= PR_INFO) {
+	if (logLevel() >= PR_INFO) {
 		prlog(PR_INFO, "\tTimestamp: ");
 		printTimestamp(auth->timestamp);
 	}
@@ -303,12 +394,30 @@ out:
  */
 int validateESL(const unsigned char *eslBuf, size_t buflen, const char *key)
 {
-	ssize_t eslvarsize = buflen;
-	size_t eslsize = 0;
-	int count = 0, offset = 0, rc;
+	int rc;
+	uint64_t start = statsStart();
+
+	rc = validateESLs(eslBuf, buflen, key);
+	statsEnd(STATS_VALIDATE_ESL, start);
+
+	return rc;
+}
+
+// validateESL() without the timing of --stats
+static int validateESLs(const unsigned char *eslBuf, size_t buflen, const char *key)
+{
+	int count = 0, rc;
+	struct esl_iter iter;
+	const EFI_SIGNATURE_LIST *sigList;
+
 	prlog(PR_INFO, "VALIDATING ESL:\n");
-	while (eslvarsize > 0) {
-		rc = validateSingularESL(&eslsize, eslBuf + offset, eslvarsize, key);
+	// entries are borrowed from eslBuf, nothing is copied while walking the ESL's
+	esl_iter_init(&iter, (const char *)eslBuf, buflen);
+	while ((rc = esl_iter_next_list(&iter, &sigList)) != OPAL_EMPTY) {
+		if (rc == OPAL_SUCCESS)
+			rc = validateSingularESL(&iter, sigList, key);
+		else
+			rc = ESL_FAIL;
 		// verify current esl to ensure it is a valid sigList, if 1 is returned break or error
 		if (rc) {
 			prlog(PR_ERR, "ERROR: Sig List #%d is not structured correctly\n", count);
@@ -320,10 +429,6 @@ int validateESL(const unsigned char *eslBuf, size_t buflen, const char *key)
 		}
 
 		count++;
-		// we read all eslsize bytes so iterate to next esl
-		offset += eslsize;
-		// size left of total file
-		eslvarsize -= eslsize;
 	}
 	prlog(PR_INFO, "\tFound %d ESL's\n\n", count);
 	if (!count)
@@ -333,66 +438,20 @@ int validateESL(const unsigned char *eslBuf, size_t buflen, const char *key)
 }
 
 /*
- *checks fields of the struct to ensure that the buffer was correctly into a sig list
- *for now, only checks that sizes of field are valid
- *@param bytesRead will be filled with the number of bytes read during this function (eslsize)
- *@param esl, pointer to start of esl
- *@param eslvarsize, remaining size of eslbuf
+ *checks fields of the sig list and the data of every one of its entries
+ *@param iter, iterator positioned on sigList, it is moved past the last entry
+ *@param sigList, ESL header, sizes are already checked against the buffer
  *@param varName, variable name {"db","dbx","KEK", "PK"} b/c dbx is a different format
  *@return SUCCESS if cetificate and header info is valid, errno otherwise
  */
-static int validateSingularESL(size_t *bytesRead, const unsigned char *esl, size_t eslvarsize,
+static int validateSingularESL(struct esl_iter *iter, const EFI_SIGNATURE_LIST *sigList,
 			       const char *varName)
 {
-	ssize_t cert_size;
-	int rc;
-	size_t eslsize;
-	unsigned char *cert = NULL;
-	EFI_SIGNATURE_LIST *sigList;
+	int rc = SUCCESS, count = 0;
+	struct esl_entry entry;
 
-	*bytesRead = 0;
-	// verify struct to ensure it is a valid sigList, if 1 is returned break
-	if (eslvarsize < sizeof(EFI_SIGNATURE_LIST)) {
-		prlog(PR_ERR,
-		      "ERROR: ESL has %zd bytes and is smaller than an ESL (%zd bytes), remaining data not parsed\n",
-		      eslvarsize, sizeof(EFI_SIGNATURE_LIST));
-		return ESL_FAIL;
-	}
-	// Get sig list
-	sigList = get_esl_signature_list((const char *)esl, eslvarsize);
-	// check size info is logical
-	if (sigList->SignatureListSize > 0) {
-		if ((sigList->SignatureSize <= 0 && sigList->SignatureHeaderSize <= 0) ||
-		    sigList->SignatureListSize <
-			    sigList->SignatureHeaderSize + sigList->SignatureSize) {
-			/*printf("Sig List : %d , sig Header: %d, sig Size: %d\n",list.SignatureListSize,list.SignatureHeaderSize,list.SignatureSize);*/
-			prlog(PR_ERR,
-			      "ERROR: Sig List is not structured correctly, defined size and actual sizes are mismatched\n");
-			return ESL_FAIL;
-		}
-	}
-	if (verbose >= PR_INFO)
+	if (logLevel() >= PR_INFO)
 		printESLInfo(sigList);
-	if (sigList->SignatureListSize > eslvarsize || sigList->SignatureHeaderSize > eslvarsize ||
-	    sigList->SignatureSize > eslvarsize) {
-		prlog(PR_ERR,
-		      "ERROR: Expected Sig List Size %d + Header size %d + Signature Size is %d larger than actual size %zd\n",
-		      sigList->SignatureListSize, sigList->SignatureHeaderSize,
-		      sigList->SignatureSize, eslvarsize);
-		return ESL_FAIL;
-	} else if ((int)sigList->SignatureListSize <= 0) {
-		prlog(PR_ERR, "ERROR: Sig List has incorrect size %d \n",
-		      sigList->SignatureListSize);
-		return ESL_FAIL;
-	}
-	eslsize = sigList->SignatureListSize;
-	// if eslsize is greater than remaining buffer size, error
-	if (eslsize > eslvarsize) {
-		prlog(PR_ERR,
-		      "ERROR: Sig list size is greater than remaining data size: %zd > %zd\n",
-		      eslsize, eslvarsize);
-		return ESL_FAIL;
-	}
 
 	// if dbx expect some type of SHA
 	if (varName && !strcmp(varName, "dbx")) {
@@ -408,32 +467,27 @@ static int validateSingularESL(size_t *bytesRead, const unsigned char *esl, size
 		prlog(PR_ERR, "ERROR: Sig list is not X509 format\n");
 		return ESL_FAIL;
 	}
-	// get certificate
-	cert_size = get_esl_cert((const char *)esl, eslvarsize,
-				 (char **)&cert); // puts sig data in cert
-	if (cert_size <= 0) {
-		prlog(PR_ERR, "\tERROR: Signature Size was too small, no data \n");
-		return ESL_FAIL;
-	}
-	// if dbx, make sure it is 32 bytes if SHA256, 64 for SHA512 etc, and skip x509 validation
-	if (varName && !strcmp(varName, "dbx")) {
-		if (!validate_hash(sigList->SignatureType, cert_size)) {
-			prlog(PR_ERR,
-			      "ERROR: dbx data of type %s and number of bytes %zd, is invalid\n",
-			      getSigType(sigList->SignatureType), cert_size);
-			rc = HASH_FAIL;
-		} else
-			rc = SUCCESS;
+	while (!rc && esl_iter_next_entry(iter, &entry) == OPAL_SUCCESS) {
+		// if dbx, make sure it is 32 bytes if SHA256, 64 for SHA512 etc, and skip x509 validation
+		if (varName && !strcmp(varName, "dbx")) {
+			if (!validate_hash(sigList->SignatureType, entry.data_size)) {
+				prlog(PR_ERR,
+				      "ERROR: dbx data of type %s and number of bytes %zd, is invalid\n",
+				      getSigType(sigList->SignatureType), entry.data_size);
+				rc = HASH_FAIL;
+			}
 
-		if (verbose >= PR_INFO) {
-			prlog(PR_INFO, "\tHash: ");
-			printHex(cert, cert_size);
+			if (logLevel() >= PR_INFO) {
+				outPrintf("\tHash: ");
+				printHex(entry.data, entry.data_size);
+			}
+		} else {
+			rc = validateCert(entry.data, entry.data_size, varName);
 		}
-	} else {
-		rc = validateCert(cert, cert_size, varName);
+		if (rc)
+			prlog(PR_ERR, "ERROR: Entry #%d of Sig List is invalid\n", count);
+		count++;
 	}
-	free(cert);
-	*bytesRead = eslsize;
 
 	return rc;
 }
@@ -556,7 +610,7 @@ static int validateCertStruct(crypto_x509 *x509, const char *varName)
 	}
 
 	// This part is to print out certificate info
-	if (verbose >= PR_INFO) {
+	if (logLevel() >= PR_INFO) {
 		rc = printCertInfo(x509);
 		if (rc) {
 			return CERT_FAIL;
@@ -577,6 +631,18 @@ static int validateCertStruct(crypto_x509 *x509, const char *varName)
  *NOTE: Remember to unallocate the returned x509 struct!
  */
 int parseX509(crypto_x509 **x509, const unsigned char *certBuf, size_t buflen)
+{
+	int rc;
+	uint64_t start = statsStart();
+
+	rc = parseX509Data(x509, certBuf, buflen);
+	statsEnd(STATS_PARSE_X509, start);
+
+	return rc;
+}
+
+// parseX509() without the timing of --stats
+static int parseX509Data(crypto_x509 **x509, const unsigned char *certBuf, size_t buflen)
 {
 	unsigned char *generatedDER = NULL;
 	size_t generatedDERSize;
@@ -633,7 +699,7 @@ int validateTS(const unsigned char *data, size_t size)
 		rc = validateTime(tmpStamp);
 		if (rc)
 			goto out;
-		if (verbose >= PR_INFO) {
+		if (logLevel() >= PR_INFO) {
 			prlog(PR_INFO, "\t%s:\t",
 			      variables[(ARRAY_SIZE(variables) - 1) -
 					(size / sizeof(struct efi_time))]);
@@ -694,6 +760,389 @@ void printTimestamp(struct efi_time t)
 {
 	// NOTE: if auth is made with sign-efi-sig-list, year will be actual year+1 (see https:// blog.hansenpartnership.com/updating-pk-kek-db-and-x-in-user-mode/),
 	// also month could be one less bc months are 0-11 not 1-12
-	printf("%04d-%02d-%02d %02d:%02d:%02d UTC\n", t.year, t.month, t.day, t.hour, t.minute,
-	       t.second);
+	outPrintf("%04d-%02d-%02d %02d:%02d:%02d UTC\n", t.year, t.month, t.day, t.hour, t.minute,
+		  t.second);
+}
+
+/*
+ *writes a timestamp as an ISO 8601 string, see printTimestamp()
+ *@param json, writer
+ *@param name, name of the value
+ *@param t, timestamp to write
+ */
+void writeTimestampJSON(struct jsonWriter *json, const char *name, struct efi_time t)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02dZ", t.year, t.month, t.day,
+		 t.hour, t.minute, t.second);
+	jsonString(json, name, buf);
+}
+
+/*
+ *works out the type of a file from its first bytes
+ *@param buff, file data
+ *@param size, length of buff
+ *@return one of enum fileTypes, UNKNOWN_FILE if it does not look like anything secvarctl knows
+ */
+static char getFileType(const unsigned char *buff, size_t size)
+{
+	// DER encoding of OID 1.2.840.113549.1.7.2 (pkcs7-signedData)
+	static const unsigned char pkcs7SignedDataOID[] = { 0x06, 0x09, 0x2a, 0x86, 0x48, 0x86,
+							    0xf7, 0x0d, 0x01, 0x07, 0x02 };
+	static const char pemCert[] = "-----BEGIN CERTIFICATE-----";
+	const struct efi_variable_authentication_2 *auth =
+		(const struct efi_variable_authentication_2 *)buff;
+	const EFI_SIGNATURE_LIST *sigList = (const EFI_SIGNATURE_LIST *)buff;
+	size_t hdrLen, offset = 0;
+
+	// auth file is a timestamp followed by a PKCS7 WIN_CERTIFICATE_UEFI_GUID
+	if (size >= sizeof(*auth) &&
+	    uuid_equals(&auth->auth_info.cert_type, &EFI_CERT_TYPE_PKCS7_GUID) &&
+	    auth->auth_info.hdr.dw_length + sizeof(auth->timestamp) <= size)
+		return AUTH_FILE;
+	// ESL starts with a known signature type and a list size that fits in the file
+	if (size >= sizeof(*sigList) && sigList->SignatureListSize >= sizeof(*sigList) &&
+	    sigList->SignatureListSize <= size &&
+	    strcmp(getSigType(sigList->SignatureType), "UNKNOWN"))
+		return ESL_FILE;
+
+	while (offset < size && (buff[offset] == ' ' || buff[offset] == '\t' ||
+				 buff[offset] == '\r' || buff[offset] == '\n'))
+		offset++;
+	if (size - offset >= sizeof(pemCert) - 1 &&
+	    !memcmp(buff + offset, pemCert, sizeof(pemCert) - 1))
+		return CERT_FILE;
+
+	// both certificates and PKCS7 are a DER SEQUENCE, PKCS7 begins with its content type OID
+	if (size < 2 || buff[0] != 0x30)
+		return UNKNOWN_FILE;
+	hdrLen = 2;
+	if (buff[1] & 0x80)
+		hdrLen += buff[1] & 0x7f;
+	if (hdrLen >= size)
+		return UNKNOWN_FILE;
+	if (size - hdrLen >= sizeof(pkcs7SignedDataOID) &&
+	    !memcmp(buff + hdrLen, pkcs7SignedDataOID, sizeof(pkcs7SignedDataOID)))
+		return PKCS7_FILE;
+	if (buff[hdrLen] == 0x30)
+		return CERT_FILE;
+
+	return UNKNOWN_FILE;
+}
+
+/*
+ *determines if an ESL holds hashes, in which case it can only be dbx data
+ *@param esl, pointer to start of esl
+ *@param size, length of esl data
+ *@return true if signature type is a known hash
+ */
+static bool eslHoldsHash(const unsigned char *esl, size_t size)
+{
+	const EFI_SIGNATURE_LIST *sigList = (const EFI_SIGNATURE_LIST *)esl;
+
+	if (size < sizeof(*sigList))
+		return false;
+
+	return !strncmp(getSigType(sigList->SignatureType), "SHA", 3);
+}
+
+static const char *fileTypeName(char inForm)
+{
+	switch (inForm) {
+	case AUTH_FILE:
+		return "AUTH";
+	case ESL_FILE:
+		return "ESL";
+	case PKCS7_FILE:
+		return "PKCS7";
+	case CERT_FILE:
+		return "CERT";
+	default:
+		return "UNKNOWN";
+	}
+}
+
+/*
+ *reads one file, detects its type and validates it, result is stored in file->rc
+ *@param file, file to validate
+ *@param varName, variable name given by user, NULL if none
+ */
+static void validateDirFile(struct dirFile *file, const char *varName)
+{
+	struct fileView view;
+	const unsigned char *buff;
+	const struct efi_variable_authentication_2 *auth;
+	size_t size, authSize;
+
+	file->rc = openFileView(&view, file->path);
+	if (file->rc) {
+		prlog(PR_ERR, "ERROR: failed to get data from %s\n", file->path);
+		return;
+	}
+	buff = view.data;
+	size = view.size;
+
+	file->inForm = getFileType(buff, size);
+	switch (file->inForm) {
+	case CERT_FILE:
+		file->rc = validateCert(buff, size, varName);
+		break;
+	case ESL_FILE:
+		if (!varName && eslHoldsHash(buff, size))
+			varName = "dbx";
+		file->rc = validateESL(buff, size, varName);
+		break;
+	case PKCS7_FILE:
+		file->rc = validatePKCS7(buff, size);
+		break;
+	case AUTH_FILE:
+		auth = (const struct efi_variable_authentication_2 *)buff;
+		authSize = auth->auth_info.hdr.dw_length + sizeof(auth->timestamp);
+		if (!varName && eslHoldsHash(buff + authSize, size - authSize))
+			varName = "dbx";
+		file->rc = validateAuth(buff, size, varName);
+		break;
+	default:
+		prlog(PR_ERR, "ERROR: could not determine the type of %s\n", file->path);
+		file->rc = INVALID_FILE;
+		break;
+	}
+	closeFileView(&view);
+}
+
+/*
+ *worker loop for validate --dir, takes the next file in the queue until all are done
+ *@param arg, pointer to struct dirQueue
+ *@return NULL
+ */
+static void *dirWorker(void *arg)
+{
+	struct dirQueue *q = arg;
+	struct secvarctl_ctx *prev = bindCtx(q->ctx);
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&q->lock);
+		i = q->next++;
+		pthread_mutex_unlock(&q->lock);
+		if (i >= q->count)
+			break;
+		validateDirFile(&q->files[i], q->varName);
+	}
+	bindCtx(prev);
+
+	return NULL;
+}
+
+/*
+ *collects all regular files in a directory, sorted by name
+ *@param q, queue to fill with files
+ *@param dirPath, directory to look in
+ *@return SUCCESS or err number
+ */
+static int getDirFiles(struct dirQueue *q, const char *dirPath)
+{
+	struct dirent **entries = NULL;
+	struct stat fileInfo;
+	int entryCount, rc = SUCCESS;
+	size_t pathLen;
+	char *path;
+
+	entryCount = scandir(dirPath, &entries, NULL, alphasort);
+	if (entryCount < 0) {
+		prlog(PR_ERR, "ERROR: could not open directory %s\n", dirPath);
+		return INVALID_FILE;
+	}
+	q->files = calloc(entryCount ? entryCount : 1, sizeof(*q->files));
+	if (!q->files) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	for (int i = 0; i < entryCount; i++) {
+		pathLen = strlen(dirPath) + strlen(entries[i]->d_name) + 2;
+		path = malloc(pathLen);
+		if (!path) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			goto out;
+		}
+		snprintf(path, pathLen, "%s/%s", dirPath, entries[i]->d_name);
+		// skip subdirectories, '.', '..' and anything else that is not a file
+		if (stat(path, &fileInfo) || !S_ISREG(fileInfo.st_mode)) {
+			free(path);
+			continue;
+		}
+		q->files[q->count++].path = path;
+	}
+
+out:
+	for (int i = 0; i < entryCount; i++)
+		free(entries[i]);
+	free(entries);
+
+	return rc;
+}
+
+/*
+ *validates every file in a directory, detecting the type of each, on up to threads workers
+ *@param ctx, context of the command, the workers print with its log level
+ *@param dirPath, directory holding the files
+ *@param threads, number of files to validate at once
+ *@param varName, variable name given by user, NULL if none
+ *@param json, writer inside the object of the command for --output json, NULL for text
+ *@return SUCCESS if every file is valid, else the error of the first invalid file
+ */
+static int validateDirectory(struct secvarctl_ctx *ctx, const char *dirPath, int threads,
+			     const char *varName, struct jsonWriter *json)
+{
+	struct dirQueue q = {
+		.files = NULL, .count = 0, .next = 0, .varName = varName, .ctx = ctx
+	};
+	pthread_t *workers = NULL;
+	int rc, started = 0, failed = 0;
+
+	rc = getDirFiles(&q, dirPath);
+	if (rc)
+		goto out;
+	if (q.count == 0) {
+		prlog(PR_ERR, "ERROR: no files found in %s\n", dirPath);
+		rc = INVALID_FILE;
+		goto out;
+	}
+
+	pthread_mutex_init(&q.lock, NULL);
+	if (threads > q.count)
+		threads = q.count;
+	if (threads > 1) {
+		// this thread is the last of them
+		workers = calloc(threads - 1, sizeof(*workers));
+		if (!workers) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			pthread_mutex_destroy(&q.lock);
+			goto out;
+		}
+		for (; started < threads - 1; started++) {
+			if (pthread_create(&workers[started], NULL, dirWorker, &q))
+				break;
+		}
+	}
+	// validate on this thread as well so files get done even if no worker could start
+	dirWorker(&q);
+	for (int i = 0; i < started; i++)
+		pthread_join(workers[i], NULL);
+	pthread_mutex_destroy(&q.lock);
+
+	if (json) {
+		jsonString(json, "dir", dirPath);
+		jsonArrayStart(json, "files");
+	} else
+		outPrintf("VALIDATED %d FILES IN %s:\n", q.count, dirPath);
+	for (int i = 0; i < q.count; i++) {
+		if (json) {
+			jsonObjectStart(json, NULL);
+			jsonString(json, "file", q.files[i].path);
+			jsonString(json, "type", fileTypeName(q.files[i].inForm));
+			jsonResult(json, q.files[i].rc);
+			jsonObjectEnd(json);
+		} else
+			outPrintf("\t%s: %s %s\n", q.files[i].path, fileTypeName(q.files[i].inForm),
+				  q.files[i].rc ? "FAILURE" : "SUCCESS");
+		if (q.files[i].rc) {
+			if (!failed)
+				rc = q.files[i].rc;
+			failed++;
+		}
+	}
+	if (json) {
+		jsonArrayEnd(json);
+		jsonInt(json, "valid", q.count - failed);
+	} else
+		outPrintf("%d/%d files are valid\n", q.count - failed, q.count);
+
+out:
+	if (workers)
+		free(workers);
+	if (q.files) {
+		for (int i = 0; i < q.count; i++)
+			free(q.files[i].path);
+		free(q.files);
+	}
+
+	return rc;
+}
+
+/*
+ *writes the signing certificates of a PKCS7 as the array "signers"
+ *@param json, writer inside an object
+ *@param data, PKCS7 in DER
+ *@param size, length of data
+ *@return SUCCESS or error number
+ */
+static int writeSignersJSON(struct jsonWriter *json, const unsigned char *data, size_t size)
+{
+	crypto_pkcs7 *pkcs7;
+	crypto_x509 *cert;
+	int rc = SUCCESS;
+
+	pkcs7 = crypto_pkcs7_parse_der(data, size);
+	if (!pkcs7)
+		return PKCS7_FAIL;
+	jsonArrayStart(json, "signers");
+	// the certificates belong to the pkcs7
+	for (int i = 0; !rc && (cert = crypto_pkcs7_get_signing_cert(pkcs7, i)); i++)
+		rc = writeCertJSON(json, NULL, cert);
+	jsonArrayEnd(json);
+	crypto_pkcs7_free(pkcs7);
+
+	return rc;
+}
+
+/*
+ *writes what a file that was validated holds, see performValidation()
+ *@param json, writer inside the object of the command
+ *@param data, file data
+ *@param size, length of data
+ *@param inForm, type of file, one of enum fileTypes
+ *@return SUCCESS or error number
+ */
+static int writeFileJSON(struct jsonWriter *json, const unsigned char *data, size_t size,
+			 char inForm)
+{
+	const struct efi_variable_authentication_2 *auth;
+	crypto_x509 *x509 = NULL;
+	size_t authSize;
+	int rc;
+
+	switch (inForm) {
+	case CERT_FILE:
+		rc = parseX509(&x509, data, size);
+		if (rc)
+			return rc;
+		rc = writeCertJSON(json, "certificate", x509);
+		crypto_x509_free(x509);
+		return rc;
+	case ESL_FILE:
+		return writeESLsJSON(json, (const char *)data, size);
+	case PKCS7_FILE:
+		return writeSignersJSON(json, data, size);
+	case AUTH_FILE:
+	default:
+		// sizes were checked by validateAuth()
+		auth = (const struct efi_variable_authentication_2 *)data;
+		authSize = auth->auth_info.hdr.dw_length + sizeof(auth->timestamp);
+		writeTimestampJSON(json, "timestamp", auth->timestamp);
+		rc = writeSignersJSON(json, auth->auth_info.cert_data, get_pkcs7_len(auth));
+		if (rc)
+			return rc;
+		// an empty ESL is a key reset
+		if (authSize == size) {
+			jsonArrayStart(json, "esls");
+			jsonArrayEnd(json);
+			return SUCCESS;
+		}
+		return writeESLsJSON(json, (const char *)data + authSize, size - authSize);
+	}
 }
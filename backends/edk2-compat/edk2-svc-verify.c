@@ -9,44 +9,53 @@
 #include "external/skiboot/include/opal-api.h"
 #include "external/skiboot/libstb/secvar/secvar.h"
 #include "backends/edk2-compat/include/edk2-svc.h"
+#include "include/stats.h"
 
 struct Arguments {
 	int helpFlag, writeFlag, currVarCount, updateVarCount;
+	enum outputFormat output;
 	const char *pathToSecVars, **updateVars;
 	char **currentVars;
+	struct secvarctl_ctx *ctx;
 };
 
 extern struct secvar_backend_driver edk2_compatible_v1;
 
-static int verify(char **currentVars, int currCount, const char **updateVars, int updateCount,
-		  const char *path, int writeFlag);
+static int verify(struct secvarctl_ctx *ctx, char **currentVars, int currCount,
+		  const char **updateVars, int updateCount, const char *path, int writeFlag,
+		  struct jsonWriter *json);
 static int validateVarsArg(const char *vars[], int size);
 static int getCurrentVars(char **newCurr, int *size, const char *path);
 static char *opalErrToString(int rc);
 static int parse_opt(int key, char *arg, struct argp_state *state);
-static int validateBanks(struct list_head *update_bank, struct list_head *variable_bank);
-static int setupBanks(struct list_head *variable_bank, struct list_head *update_bank,
-		      char *currentVars[], int currCount, const char *updateVars[], int updateCount,
-		      const char *path);
+static int setupBanks(struct secvar_arena *arena, struct list_head *variable_bank,
+		      struct list_head *update_bank, char *currentVars[], int currCount,
+		      const char *updateVars[], int updateCount, const char *path);
 static void printBanks(struct list_head *variable_bank, struct list_head *update_bank);
+static void writeSignerJSON(void *ctx, const char *key, const char *authority, int esl,
+			    bool append);
 static int commitUpdateBank(struct list_head *update_bank, const char *path);
 
 /**
 *performs verification command, called from main
+*@param ctx context the command runs in, holds its log level and processing state
 *@param argc number of items in arg command
 *@param argv arguments array
 *@return SUCCESS if everything works, error code if not
 */
-int performVerificationCommand(int argc, char *argv[])
+int performVerificationCommand(struct secvarctl_ctx *ctx, int argc, char *argv[])
 {
 	int rc;
+	struct jsonWriter json;
 	struct Arguments args = { .helpFlag = 0,
 				  .writeFlag = 0,
+				  .output = OUTPUT_TEXT,
 				  .currVarCount = 0,
 				  .updateVarCount = 0,
 				  .pathToSecVars = NULL,
 				  .updateVars = NULL,
-				  .currentVars = 0 };
+				  .currentVars = 0,
+				  .ctx = ctx };
 	// combine command and subcommand for usage/help messages
 	argv[0] = "secvarctl verify";
 
@@ -61,6 +70,8 @@ int performVerificationCommand(int argc, char *argv[])
 		  "if successful, submit the update to be commited upon reboot. Equivalent to `secvarctl write`" },
 		{ 0, 'u', "{UPDATE LIST}", OPTION_HIDDEN,
 		  "set update variables (see below for format)" },
+		{ "output", ARGP_OPT_OUTPUT_KEY, "FORMAT", 0,
+		  "print as 'text' (default) or 'json', the updates, who signed each one and the verdict" },
 		{ "help", '?', 0, 0, "Give this help list", 1 },
 		{ "usage", ARGP_OPT_USAGE_KEY, 0, 0, "Give a short usage message", -1 },
 		{ 0 }
@@ -85,19 +96,29 @@ int performVerificationCommand(int argc, char *argv[])
 	};
 
 	rc = argp_parse(&argp, argc, argv, ARGP_NO_EXIT | ARGP_IN_ORDER | ARGP_NO_HELP, 0, &args);
+	if (args.output == OUTPUT_JSON && !args.helpFlag) {
+		jsonInit(&json, stdout);
+		jsonObjectStart(&json, NULL);
+		jsonString(&json, "command", "verify");
+	}
 	if (rc || args.helpFlag) {
 		goto out;
 	}
 
-	rc = verify(args.currentVars, args.currVarCount, args.updateVars, args.updateVarCount,
-		    args.pathToSecVars, args.writeFlag);
+	rc = verify(ctx, args.currentVars, args.currVarCount, args.updateVars, args.updateVarCount,
+		    args.pathToSecVars, args.writeFlag, args.output == OUTPUT_JSON ? &json : NULL);
 
 out:
 	if (args.currentVars)
 		free(args.currentVars);
 	if (args.updateVars)
 		free(args.updateVars);
-	if (!args.helpFlag)
+	if (args.helpFlag)
+		return rc;
+	if (args.output == OUTPUT_JSON) {
+		jsonResult(&json, rc);
+		jsonObjectEnd(&json);
+	} else
 		printf("RESULT: %s\n", rc ? "FAILURE" : "SUCCESS");
 
 	return rc;
@@ -130,7 +151,10 @@ static int parse_opt(int key, char *arg, struct argp_state *state)
 		args->writeFlag = 1;
 		break;
 	case 'v':
-		verbose = PR_DEBUG;
+		args->ctx->verbose = PR_DEBUG;
+		break;
+	case ARGP_OPT_OUTPUT_KEY:
+		rc = parseOutputFormat(arg, &args->output);
 		break;
 	case 'u':
 		if (args->updateVars) {
@@ -215,19 +239,23 @@ static int parse_opt(int key, char *arg, struct argp_state *state)
 
 /**
  *runs actual verification process
+ *@param ctx context of the command, process keeps its state in it
  *@param currentVars holds content of -c argument/or null if no -c
  *@param currCount length of currentVars
  *@param updateVars holds content of -u argument
  *@param updateCount length of updateVars
  *@param path holds path if -p option or null if no -p
  *@param writeFlag 0 if -w no given, 1 if given
+ *@param json writer inside the object of the command for --output json, NULL for text
  *@return SUCCESS or error value
  */
-static int verify(char *currentVars[], int currCount, const char *updateVars[], int updateCount,
-		  const char *path, int writeFlag)
+static int verify(struct secvarctl_ctx *ctx, char *currentVars[], int currCount,
+		  const char *updateVars[], int updateCount, const char *path, int writeFlag,
+		  struct jsonWriter *json)
 {
 	int rc;
 	struct list_head update_bank, variable_bank, update_bank_copy;
+	uint64_t start;
 	list_head_init(&variable_bank);
 	list_head_init(&update_bank);
 	list_head_init(&update_bank_copy);
@@ -235,8 +263,14 @@ static int verify(char *currentVars[], int currCount, const char *updateVars[],
 	if (!path) {
 		path = SECVARPATH;
 	}
-	rc = setupBanks(&variable_bank, &update_bank, currentVars, currCount, updateVars,
-			updateCount, path);
+	// every variable of this run comes from the arena of the context, copies of them too
+	ctx->arena = new_secvar_arena();
+	if (!ctx->arena) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	rc = setupBanks(ctx->arena, &variable_bank, &update_bank, currentVars, currCount,
+			updateVars, updateCount, path);
 	if (rc) {
 		prlog(PR_ERR, "ERROR:Could not initialize banks\n");
 		goto out;
@@ -247,27 +281,53 @@ static int verify(char *currentVars[], int currCount, const char *updateVars[],
 		goto out;
 	}
 	// run preprocess
-	rc = edk2_compatible_v1.pre_process(&variable_bank, &update_bank);
+	rc = edk2_compatible_v1.pre_process(ctx, &variable_bank, &update_bank);
 	if (rc) {
 		prlog(PR_ERR, "ERROR: Failed in preprocessing OPAL ERR = %d = %s\n", rc,
 		      opalErrToString(rc));
 		goto out;
 	}
-	if (verbose >= PR_INFO) {
+	if (ctx->verbose >= PR_INFO) {
 		prlog(PR_INFO, "PRE PROCESSING BANKS:\n");
 		printBanks(&variable_bank, &update_bank);
 	}
 	// create copy of update_bank (it changes after process) and if we write, we are going to want to have original auth's
-	if (writeFlag)
-		copy_bank_list(&update_bank_copy, &update_bank);
+	if (writeFlag) {
+		rc = copy_bank_list(&update_bank_copy, &update_bank);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			goto out;
+		}
+	}
+	if (json) {
+		jsonArrayStart(json, "updates");
+		for (int i = 0; i < updateCount; i += 2) {
+			jsonObjectStart(json, NULL);
+			jsonString(json, "variable", updateVars[i]);
+			jsonString(json, "file", updateVars[i + 1]);
+			jsonObjectEnd(json);
+		}
+		jsonArrayEnd(json);
+		// filled in by writeSignerJSON() as the updates are verified
+		jsonArrayStart(json, "signatures");
+		ctx->signer_listener = writeSignerJSON;
+		ctx->signer_listener_ctx = json;
+	}
 	// run process
-	rc = edk2_compatible_v1.process(&variable_bank, &update_bank);
+	start = statsStart();
+	rc = edk2_compatible_v1.process(ctx, &variable_bank, &update_bank);
+	statsEnd(STATS_PROCESS, start);
+	if (json) {
+		ctx->signer_listener = NULL;
+		jsonArrayEnd(json);
+	}
 	if (rc) {
 		prlog(PR_ERR, "ERROR: Failed in processing OPAL ERR = %d = %s\n", rc,
 		      opalErrToString(rc));
 		goto out;
 	}
-	if (verbose >= PR_INFO) {
+	if (ctx->verbose >= PR_INFO) {
 		prlog(PR_INFO, "POST PROCESSING BANKS:\n");
 		printBanks(&variable_bank, &update_bank);
 	}
@@ -278,17 +338,23 @@ static int verify(char *currentVars[], int currCount, const char *updateVars[],
 			prlog(PR_ERR, "ERROR: Failed in submitting update #%d\n", rc);
 			goto out;
 		}
+		if (json)
+			jsonBool(json, "written", 1);
 	}
 
 out:
 	clear_bank_list(&variable_bank);
 	clear_bank_list(&update_bank);
 	clear_bank_list(&update_bank_copy);
+	// the variables held the arena too, it is freed with the last reference
+	put_secvar_arena(ctx->arena);
+	ctx->arena = NULL;
 	return rc;
 }
 
 /**
  *parses arrays into banks with appropriate data
+ *@param arena the variables are allocated from
  *@param variable_bank will be filled with data depending on currentVars
  *@param update_bank will be filled with data dependent on updateVars
  *@param currentVars holds content of -c argument/or null if no -c
@@ -298,14 +364,13 @@ out:
  *@param path holds path to current vars
  *@return SUCCESS or error value
  */
-static int setupBanks(struct list_head *variable_bank, struct list_head *update_bank,
-		      char *currentVars[], int currCount, const char *updateVars[], int updateCount,
-		      const char *path)
+static int setupBanks(struct secvar_arena *arena, struct list_head *variable_bank,
+		      struct list_head *update_bank, char *currentVars[], int currCount,
+		      const char *updateVars[], int updateCount, const char *path)
 {
-	int defaultVarsFlag = 0;
-	size_t len;
+	int defaultVarsFlag = 0, rc = SUCCESS;
 	struct secvar *tmp = NULL;
-	char *c;
+	struct fileView view;
 
 	// if current vars string is given, check it. if not, get default/path vars
 	if (!currentVars) {
@@ -326,12 +391,14 @@ static int setupBanks(struct list_head *variable_bank, struct list_head *update_
 	// once here, strings should be ready, it is time to fill banks
 	// fill update bank with all updates
 	for (int i = 0; i < updateCount; i += 2) {
-		c = getDataFromFile((char *)updateVars[i + 1], &len);
-		if (c) {
-			list_add_tail(update_bank, &new_secvar(updateVars[i],
-							       strlen(updateVars[i]) + 1, c, len, 0)
-							    ->link);
-			free(c);
+		if (!openFileView(&view, updateVars[i + 1])) {
+			tmp = fileViewToSecVar(&view, updateVars[i], view.size, arena);
+			if (!tmp) {
+				prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+				rc = ALLOC_FAIL;
+				goto out;
+			}
+			list_add_tail(update_bank, &tmp->link);
 		} else
 			prlog(PR_INFO, "Failed to open %s, not adding it to list\n",
 			      updateVars[i + 1]);
@@ -340,22 +407,24 @@ static int setupBanks(struct list_head *variable_bank, struct list_head *update_
 	for (int i = 0; i < currCount; i += 2) {
 		if (defaultVarsFlag) {
 			// if getting secvar successful add tmp to list
-			if (!getSecVar(&tmp, currentVars[i], currentVars[i + 1]))
+			if (!getSecVar(&tmp, currentVars[i], currentVars[i + 1], arena))
 				list_add_tail(variable_bank, &tmp->link);
 
 		} else {
-			c = getDataFromFile((char *)currentVars[i + 1], &len);
-			if (c) {
-				list_add_tail(variable_bank,
-					      &new_secvar(currentVars[i],
-							  strlen(currentVars[i]) + 1, c, len, 0)
-						       ->link);
-				free(c);
+			if (!openFileView(&view, currentVars[i + 1])) {
+				tmp = fileViewToSecVar(&view, currentVars[i], view.size, arena);
+				if (!tmp) {
+					prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+					rc = ALLOC_FAIL;
+					goto out;
+				}
+				list_add_tail(variable_bank, &tmp->link);
 			} else
 				prlog(PR_INFO, "Failed to open %s, not adding it to list\n",
 				      currentVars[i + 1]);
 		}
 	}
+out:
 	// cleanup because of dynamically allocated memory of default paths, need to cleanup pointer to array and pointer to strings
 	if (defaultVarsFlag) {
 		for (int i = 0; i < currCount; i++)
@@ -364,7 +433,7 @@ static int setupBanks(struct list_head *variable_bank, struct list_head *update_
 		currentVars = NULL;
 	}
 
-	return SUCCESS;
+	return rc;
 }
 
 /**
@@ -373,7 +442,7 @@ static int setupBanks(struct list_head *variable_bank, struct list_head *update_
  *@param update_bank list of secvar's of update variables
  *@return SUCCESS or error value if any files fail
  */
-static int validateBanks(struct list_head *update_bank, struct list_head *variable_bank)
+int validateBanks(struct list_head *update_bank, struct list_head *variable_bank)
 {
 	int rc = SUCCESS;
 	struct secvar *var = NULL;
@@ -418,7 +487,7 @@ static int validateBanks(struct list_head *update_bank, struct list_head *variab
 		      "WARNING: No PK, entering setup mode, no validation on current keys will be done\n");
 
 	// print current contents of banks
-	if (verbose >= PR_INFO) {
+	if (logLevel() >= PR_INFO) {
 		prlog(PR_INFO, "Current Variables are : ");
 		list_for_each (variable_bank, var, link) {
 			prlog(PR_INFO, "%s ", var->key);
@@ -529,14 +598,16 @@ static int getCurrentVars(char *newCurr[], int *size, const char *path)
 static void printBanks(struct list_head *variable_bank, struct list_head *update_bank)
 {
 	struct secvar *var = NULL;
-	printf("----CONTENTS OF UPDATE BANK----\n");
+	prlog(PR_INFO, "----CONTENTS OF UPDATE BANK----\n");
 	list_for_each (update_bank, var, link) {
-		printf("SecVar for %s contains %zd bytes of data\n", var->key, var->data_size);
+		prlog(PR_INFO, "SecVar for %s contains %zd bytes of data\n", var->key,
+		      var->data_size);
 	}
 
-	printf("----CONTENTS OF VARIABLE BANK----\n");
+	prlog(PR_INFO, "----CONTENTS OF VARIABLE BANK----\n");
 	list_for_each (variable_bank, var, link) {
-		printf("SecVar for %s contains %zd bytes of data\n", var->key, var->data_size);
+		prlog(PR_INFO, "SecVar for %s contains %zd bytes of data\n", var->key,
+		      var->data_size);
 	}
 }
 
@@ -564,6 +635,39 @@ static int commitUpdateBank(struct list_head *update_bank, const char *path)
 	return rc;
 }
 
+/*
+ *called by process_update() for every update whose signature is verified
+ *@param ctx, context of the verification, its signer_listener gets the update if it is set
+ *@param key, variable the update is for
+ *@param authority, variable holding the certificate that signed the update
+ *@param esl, number of the ESL in authority holding the certificate
+ *@param append, 1 if the update was verified as an append write
+ */
+void reportUpdateSigner(struct secvarctl_ctx *ctx, const char *key, const char *authority, int esl,
+			bool append)
+{
+	if (ctx->signer_listener) {
+		ctx->signer_listener(ctx->signer_listener_ctx, key, authority, esl, append);
+		return;
+	}
+	printf("Update for %s is correctly signed by ESL #%d of current %s%s\n", key, esl,
+	       authority, append ? " as an append write" : "");
+}
+
+// updateSignerListener of --output json, ctx is the writer inside the "signatures" array
+static void writeSignerJSON(void *ctx, const char *key, const char *authority, int esl,
+			    bool append)
+{
+	struct jsonWriter *json = ctx;
+
+	jsonObjectStart(json, NULL);
+	jsonString(json, "variable", key);
+	jsonString(json, "signed_by", authority);
+	jsonInt(json, "esl", esl);
+	jsonBool(json, "append", append);
+	jsonObjectEnd(json);
+}
+
 /*
  *will return a string describing the returned opal return code 
  *@rc, the return code
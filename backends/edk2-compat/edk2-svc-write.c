@@ -15,21 +15,24 @@ static int updateSecVar(const char *var, const char *authFile, const char *path,
 struct Arguments {
 	int helpFlag, inpValid;
 	const char *pathToSecVars, *varName, *inFile;
+	struct secvarctl_ctx *ctx;
 };
 static int parse_opt(int key, char *arg, struct argp_state *state);
 
 /*
  *called from main()
  *handles argument parsing for write command
+ *@param ctx, context the command runs in, holds its log level
  *@param argc, number of argument
  *@param arv, array of params
  *@return SUCCESS or err number
 */
-int performWriteCommand(int argc, char *argv[])
+int performWriteCommand(struct secvarctl_ctx *ctx, int argc, char *argv[])
 {
 	int rc;
 	struct Arguments args = {
-		.helpFlag = 0, .inpValid = 0, .pathToSecVars = NULL, .inFile = NULL, .varName = NULL
+		.helpFlag = 0, .inpValid = 0, .pathToSecVars = NULL, .inFile = NULL, .varName = NULL,
+		.ctx = ctx
 	};
 	// combine command and subcommand for usage/help messages
 	argv[0] = "secvarctl write";
@@ -93,7 +96,7 @@ static int parse_opt(int key, char *arg, struct argp_state *state)
 		args->inpValid = 1;
 		break;
 	case 'v':
-		verbose = PR_DEBUG;
+		args->ctx->verbose = PR_DEBUG;
 		break;
 	case ARGP_KEY_ARG:
 		if (args->varName == NULL)
@@ -154,30 +157,33 @@ int isVariable(const char *var)
 static int updateSecVar(const char *varName, const char *authFile, const char *path, int force)
 {
 	int rc;
-	unsigned char *buff = NULL;
-	size_t size;
+	struct fileView view;
 
 	if (!path) {
 		path = SECVARPATH;
 	}
 
 	// get data to write, if force flag then validate the data is an auth file
-	buff = (unsigned char *)getDataFromFile(authFile, &size);
+	rc = openFileView(&view, authFile);
+	if (rc) {
+		prlog(PR_ERR, "ERROR: failed to get data from %s\n", authFile);
+		return rc;
+	}
 	// if we are validating and validating fails, quit
 	if (!force) {
-		rc = validateAuth(buff, size, varName);
+		rc = validateAuth(view.data, view.size, varName);
 		if (rc) {
 			prlog(PR_ERR,
 			      "ERROR: validating update file (Signed Auth) failed, not updating\n");
-			free(buff);
+			closeFileView(&view);
 			return rc;
 		}
 	}
-	rc = updateVar(path, varName, buff, size);
+	rc = updateVar(path, varName, view.data, view.size);
 
 	if (rc)
 		prlog(PR_ERR, "ERROR: issue writing to file: %s\n", strerror(errno));
-	free(buff);
+	closeFileView(&view);
 
 	return rc;
 }
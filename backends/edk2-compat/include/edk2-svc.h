@@ -8,6 +8,9 @@
 #include "err.h"
 #include "prlog.h"
 #include "generic.h"
+#include "json.h"
+#include "output.h"
+#include "context.h"
 #include "libstb/secvar/crypto/crypto.h"
 #include "external/skiboot/libstb/secvar/backend/edk2.h"
 #include "external/skiboot/libstb/secvar/backend/edk2-compat-process.h"
@@ -15,6 +18,8 @@
 // all argp options must have a single character option
 // so we set --usage to have a single character option that is out of range
 #define ARGP_OPT_USAGE_KEY 0x100
+// --output has no single character option either
+#define ARGP_OPT_OUTPUT_KEY 0x101
 #define CERT_BUFFER_SIZE 2048
 
 #ifndef SECVARPATH
@@ -58,24 +63,35 @@ static const struct hash_funct {
 	  .guid = &EFI_CERT_SHA512_GUID },
 };
 
-int performReadCommand(int argc, char *argv[]);
-int performVerificationCommand(int argc, char *argv[]);
-int performWriteCommand(int argc, char *argv[]);
-int performValidation(int argc, char *argv[]);
-int performGenerateCommand(int argc, char *argv[]);
+int performReadCommand(struct secvarctl_ctx *ctx, int argc, char *argv[]);
+int performVerificationCommand(struct secvarctl_ctx *ctx, int argc, char *argv[]);
+int performWriteCommand(struct secvarctl_ctx *ctx, int argc, char *argv[]);
+int performValidation(struct secvarctl_ctx *ctx, int argc, char *argv[]);
+int performGenerateCommand(struct secvarctl_ctx *ctx, int argc, char *argv[]);
+int performBatchCommand(struct secvarctl_ctx *ctx, int argc, char *argv[]);
+int performQueryCommand(struct secvarctl_ctx *ctx, int argc, char *argv[]);
 
 int printCertInfo(crypto_x509 *x509);
-void printESLInfo(EFI_SIGNATURE_LIST *sigList);
+void printESLInfo(const EFI_SIGNATURE_LIST *sigList);
+int printReadable(const char *c, size_t size, const char *key);
 void printTimestamp(struct efi_time t);
 void printGuidSig(const void *sig);
+int writeESLsJSON(struct jsonWriter *json, const char *c, size_t size);
+int writeCertJSON(struct jsonWriter *json, const char *name, crypto_x509 *x509);
+void writeTimestampJSON(struct jsonWriter *json, const char *name, struct efi_time t);
 
 int parseX509(crypto_x509 **x509, const unsigned char *certBuf, size_t buflen);
 const char *getSigType(const uuid_t);
 
-int getSecVar(struct secvar **var, const char *name, const char *fullPath);
+int getSecVar(struct secvar **var, const char *name, const char *fullPath,
+	      struct secvar_arena *arena);
+struct secvar *fileViewToSecVar(struct fileView *view, const char *name, size_t size,
+				struct secvar_arena *arena);
 int updateVar(const char *path, const char *var, const unsigned char *buff, size_t size);
 int isVariable(const char *var);
 
+int validateBanks(struct list_head *update_bank, struct list_head *variable_bank);
+
 int validateAuth(const unsigned char *authBuf, size_t buflen, const char *key);
 int validateESL(const unsigned char *eslBuf, size_t buflen, const char *key);
 int validateCert(const unsigned char *authBuf, size_t buflen, const char *varName);
@@ -83,5 +99,13 @@ int validatePKCS7(const unsigned char *cert_data, size_t len);
 int validateTS(const unsigned char *data, size_t size);
 int validateTime(struct efi_time *time);
 
-extern struct command edk2_compat_command_table[5];
+int toESL(const unsigned char *data, size_t size, const uuid_t guid, unsigned char **outESL,
+	  size_t *outESLSize);
+int toHashESL(const unsigned char *hashes, size_t size, const struct hash_funct *alg,
+	      unsigned char **outESL, size_t *outESLSize);
+int generateSignedAuth(const unsigned char *ESL, size_t ESLSize, const char *varName,
+		       struct efi_time *time, uint32_t attributes, crypto_pkcs7_signers *signers,
+		       unsigned char **outBuff, size_t *outBuffSize);
+
+extern struct command edk2_compat_command_table[7];
 #endif
@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <string.h>
+#include "prlog.h"
+#include "context.h"
+#include "external/skiboot/libstb/secvar/secvar.h"
+#include "external/skiboot/libstb/secvar/backend/edk2-compat-process.h"
+
+// context of the command or libsecvarctl call running on this thread, NULL if none
+static __thread struct secvarctl_ctx *threadCtx;
+
+/*
+ *@param ctx, context to set up for a new command or call
+ *@param verbose, highest prlog() level it prints
+ */
+void initCtx(struct secvarctl_ctx *ctx, int verbose)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->verbose = verbose;
+	list_head_init(&ctx->staging_bank);
+	list_head_init(&ctx->cert_cache);
+}
+
+// frees everything ctx holds, it can be used again afterwards
+void clearCtx(struct secvarctl_ctx *ctx)
+{
+	clear_bank_list(&ctx->staging_bank);
+	clear_cert_cache(ctx);
+	put_secvar_arena(ctx->arena);
+	ctx->arena = NULL;
+}
+
+/*
+ *makes ctx the context of the calling thread, prlog() then uses its log level
+ *@param ctx, context of what runs on this thread next, NULL for none
+ *@return the context bound before, to bind again once done
+ */
+struct secvarctl_ctx *bindCtx(struct secvarctl_ctx *ctx)
+{
+	struct secvarctl_ctx *prev = threadCtx;
+
+	threadCtx = ctx;
+
+	return prev;
+}
+
+// @return the context bound to the calling thread, NULL if none
+struct secvarctl_ctx *boundCtx(void)
+{
+	return threadCtx;
+}
+
+/*
+ *@return the log level of the context bound to the calling thread, PR_WARNING, the default
+ *	  of secvarctl, for threads without one
+ */
+int logLevel(void)
+{
+	return threadCtx ? threadCtx->verbose : PR_WARNING;
+}
+
+// @return nonzero if prlog() prints every level to stderr on the calling thread
+int logToStderr(void)
+{
+	return threadCtx && threadCtx->log_to_stderr;
+}
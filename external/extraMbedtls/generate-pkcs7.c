@@ -9,6 +9,7 @@
 #ifndef NO_CRYPTO
 
 #include <stdio.h>
+#include <pthread.h>
 
 #include <mbedtls/asn1write.h> // for building pkcs7
 #include <mbedtls/md.h>     //  generic interface 
@@ -17,10 +18,10 @@
 #include <mbedtls/pk_internal.h>
 #include <mbedtls/x509_crt.h>
 #include "generic.h"
+#include "stats.h"
 
 #include "external/skiboot/libstb/secvar/backend/edk2-compat-process.h" //  work on factoring this out
 
-extern int verbose;
 /* STRUCTURE OF PKCS7 AND CORRESPONDING FUNCTIONS THAT HANDLE THEM:
  *PKCS7 {
  *	CONSTRUCTED | SEQUENCE 										->setPKCS7OID
@@ -44,21 +45,21 @@ extern int verbose;
  *							OID (hash Alg)						->^
  *						CONSTRUCTED | SEQUENCE 					->^
  *							OID (Signature Alg (RSA)) 			->^
- *						OCTET STRING (signature) 				->setSignature
+ *						OCTET STRING (signature) 				->setAlgorithmIDs (signed by getSignature beforehand)
  * }
  */
 
 typedef struct PKCS7Info {
-	unsigned char **crts; // signing crt DER
-	size_t *crtSizes;
-	unsigned char **keys; // signing key DER or signatures (depends on alreadySignedFlag)
-	size_t *keySizes;
+	mbedtls_x509_crt *x509s; // signing crts, see parseSigners
+	mbedtls_pk_context *keys; // signing keys checked against x509s, NULL if alreadySignedFlag
 	int keyPairs;
-	const unsigned char *newData; 
-	int newDataSize;
+	const unsigned char *newHash; // digest of the signed data, made with hashFunct
+	size_t newHashSize;
 	mbedtls_md_type_t hashFunct;
 	const char * hashFunctOID; 
-	int alreadySignedFlag; // if this is 1 then then PKCS7Info.keys contains signatures, if 0 then contains siging key in DER format 
+	int alreadySignedFlag; // if this is 1 then PKCS7Info.sigs are given, if 0 they are made with keys, see prepareSigners
+	unsigned char **sigs; // signature of each signer
+	size_t *sigSizes;
 
 } PKCS7Info;
 #endif
@@ -189,7 +190,7 @@ int toHash(const unsigned char* data, size_t size, int hashFunct, unsigned char*
 	}
 
 	*outHashSize = md_info->size;
-	if (verbose){ 
+	if (logLevel() >= PR_WARNING){ 
 		printf("Hash generation successful, %s: ", md_info->name);
 		printHex(*outHash, *outHashSize);
 	}
@@ -200,98 +201,131 @@ out:
 	return rc;
 }
 
-static int allocateMoreMemory(unsigned char **start, size_t *size, unsigned char **ptr){
-	unsigned char *newStart = NULL, *newPtr = NULL;
-	size_t currentlyWritten;
-	// new buffer is double the size of the old buffer, cant realloc bc new data must be infront of old data
-	newStart = calloc(1, *size*2);
-	if (!newStart){
-		prlog(PR_ERR, "ERROR: failed to allocate %zd bytes more memory\n", *size * 2);
-		return ALLOC_FAIL;
-	} 
-	// number of bytes to copy is the number of bytes between ptr and the end of the buffer
-	currentlyWritten = (*start) + (*size) - (*ptr);
-	// new buffer will be the same as the old one only there will be 'size' number of bytes padded to the front, 
-	// remember we are writing the buffer from highest memory address to lowest so new data will go in the front
-	// thank you mbedtls! >:(
-	newPtr = newStart + (*size) + ((*ptr) - (*start));
-	memcpy(newPtr, *ptr, currentlyWritten);
-	// free old buffer
-	free(*start);
-	// update values
-	*start = newStart;
-	*ptr = newPtr;
-	*size = 2 * (*size);
-	return SUCCESS;
+/*
+ *bytes taken by a DER element (tag, length and content) with len bytes of content
+ *@param len, length of the content
+ *@return size of the whole element
+ */
+static size_t getTLVSize(size_t len)
+{
+	// tag, short form length and content
+	size_t size = 1 + 1 + len;
+
+	// long form length takes one more byte per byte of len
+	if (len > 0x7F)
+		for (; len; len >>= 8)
+			size++;
+
+	return size;
+}
+
+// size of what mbedtls_asn1_write_int writes for a non negative value
+static size_t getIntegerSize(int value)
+{
+	size_t len = 0;
+	int top;
+
+	do {
+		top = value & 0xFF;
+		value >>= 8;
+		len++;
+	} while (value > 0);
+	// leading zero keeps the integer positive
+	if (top & 0x80)
+		len++;
+
+	return getTLVSize(len);
+}
+
+// size of what mbedtls_asn1_write_algorithm_identifier writes with par_len = 0, the OID and a NULL parameter
+static size_t getAlgorithmIDSize(size_t oidLen)
+{
+	return getTLVSize(getTLVSize(oidLen) + getTLVSize(0));
+}
+
+/*
+ *computes the exact size of the PKCS7 setPKCS7OID writes, every signature must already be in pkcs7Info
+ *@param pkcs7Info, information about the PKCS7, see prepareSigners
+ *@return size of the PKCS7 in bytes
+ */
+static size_t getPKCS7Size(PKCS7Info *pkcs7Info)
+{
+	size_t hashAlgoSize, signerInfoSize, signersSize = 0, crtsSize = 0, signedDataSize;
+
+	hashAlgoSize = getAlgorithmIDSize(strlen(pkcs7Info->hashFunctOID));
+	for (int i = 0; i < pkcs7Info->keyPairs; i++) {
+		// see setSignerCertData
+		signerInfoSize = getIntegerSize(1) +
+				 getTLVSize(pkcs7Info->x509s[i].issuer_raw.len +
+					    getTLVSize(pkcs7Info->x509s[i].serial.len)) +
+				 hashAlgoSize + getAlgorithmIDSize(strlen(MBEDTLS_OID_PKCS1_RSA)) +
+				 getTLVSize(pkcs7Info->sigSizes[i]);
+		signersSize += getTLVSize(signerInfoSize);
+		crtsSize += pkcs7Info->x509s[i].raw.len;
+	}
+	// see setVersion and the functions it calls
+	signedDataSize = getIntegerSize(1) + getTLVSize(hashAlgoSize) +
+			 getTLVSize(getTLVSize(strlen(MBEDTLS_OID_PKCS7_DATA))) + getTLVSize(crtsSize) +
+			 getTLVSize(signersSize);
+	// see setPKCS7OID
+	return getTLVSize(getTLVSize(strlen(MBEDTLS_OID_PKCS7_SIGNED_DATA)) +
+			  getTLVSize(getTLVSize(signedDataSize)));
 }
 
 /*
  *A general way to add data to the pkcs7 buffer from a given tag (data type)
- *@param start, start of the pkcs7 data buffer
- *@param size, size allocated to start
+ *@param start, start of the pkcs7 data buffer, it was sized with getPKCS7Size so it never runs out
  *@param ptr, points to the current location of where the data has been written to. memory from start to pointer should be unused. REMEMBER mbedtls writes their buffers from the end of a buffer to the start
  *@param tag, the type of data that is trying to be written, not necessarily the same tag that will be added to the pkcs7
  *@param value, the new data to be added to the pkcs7
  *@param valueSize, the length of the new value
  *@param param, extra argument if adding algorthm identifier (tag = MBEDTLS_ASN1_OID | MBEDTLS_ASN1_CONTEXT_SPECIFIC) to show the size of the buffer, often 0
 */
-static int setPKCS7Data(unsigned char **start, size_t *size, unsigned char **ptr, int tag, const void* value, size_t valueSize, int param) {
-	int rc; 
-	// pointer for current spot in data, in case it fails but ptr changes
-	unsigned char *ptrTmp = *ptr; 
-	do {
+static int setPKCS7Data(unsigned char *start, unsigned char **ptr, int tag, const void* value, size_t valueSize, int param) {
+	int rc = MBEDTLS_ERR_ASN1_INVALID_DATA;
+	// pointer for current spot in data, the OID case needs to know how much it wrote
+	unsigned char *ptrTmp = *ptr;
+
 	// do funtion for tag
-		if (tag == MBEDTLS_ASN1_INTEGER)
-			rc = mbedtls_asn1_write_int(ptr, *start, *(int *) value);
-		// if 0x30 or 0xA0then write length and write tag in next iteration
-		else if (tag == (MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE)  	|| 
-		tag == (MBEDTLS_ASN1_CONTEXT_SPECIFIC | MBEDTLS_ASN1_CONSTRUCTED)		||
-		tag == (MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SET)) {
-			rc = mbedtls_asn1_write_len(ptr, *start, valueSize);
-				if (rc >= 0)
-					rc = mbedtls_asn1_write_tag(ptr, *start,  tag);
-		}
-		// for OID + constructed|sequence + len
-		else if (tag == (MBEDTLS_ASN1_OID | MBEDTLS_ASN1_CONTEXT_SPECIFIC))
-			rc = mbedtls_asn1_write_algorithm_identifier(ptr, *start, value, valueSize, param);
-		// for just oid 
-		else if (tag == MBEDTLS_ASN1_OID) {
-			rc = mbedtls_asn1_write_oid(ptr, *start, value, valueSize);
-			if (rc >= 0) {
-				rc = mbedtls_asn1_write_len(ptr, *start, ptrTmp - *ptr); 
-				if (rc >= 0 ) {
-					rc = mbedtls_asn1_write_tag(ptr, *start,(MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE) );
-				}
-			}
-		}
-		// for signature
-		else if (tag == MBEDTLS_ASN1_OCTET_STRING) {
-			rc = mbedtls_asn1_write_octet_string(ptr, *start, value, valueSize);
-		}
-		// for raw data, idk kinda makes sense bit string = raw data you know maybe...
-		else if (tag == MBEDTLS_ASN1_BIT_STRING)
-			rc = mbedtls_asn1_write_raw_buffer(ptr, *start, value, valueSize);
-		// for long integers of any length, ex:serial #, I am getting creative with these combos!
-		else if (tag == (MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_INTEGER))
-			rc = mbedtls_asn1_write_tagged_string(ptr, *start, MBEDTLS_ASN1_INTEGER, value, valueSize);
-		// if setting data failed, allocate more data
-		if (rc == MBEDTLS_ERR_ASN1_BUF_TOO_SMALL) {
-			*ptr = ptrTmp; // set ptr back to old one, could have changed when funciton failed
-			
-			if (allocateMoreMemory(start, size, ptr)){
-				prlog(PR_ERR, "Failed to allocate more memory (total %zd) for PKCS7\n", *size * 2);
-				return FILE_WRITE_FAIL;
+	if (tag == MBEDTLS_ASN1_INTEGER)
+		rc = mbedtls_asn1_write_int(ptr, start, *(int *) value);
+	// if 0x30 or 0xA0then write length and write tag
+	else if (tag == (MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE)  	||
+	tag == (MBEDTLS_ASN1_CONTEXT_SPECIFIC | MBEDTLS_ASN1_CONSTRUCTED)		||
+	tag == (MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SET)) {
+		rc = mbedtls_asn1_write_len(ptr, start, valueSize);
+			if (rc >= 0)
+				rc = mbedtls_asn1_write_tag(ptr, start,  tag);
+	}
+	// for OID + constructed|sequence + len
+	else if (tag == (MBEDTLS_ASN1_OID | MBEDTLS_ASN1_CONTEXT_SPECIFIC))
+		rc = mbedtls_asn1_write_algorithm_identifier(ptr, start, value, valueSize, param);
+	// for just oid
+	else if (tag == MBEDTLS_ASN1_OID) {
+		rc = mbedtls_asn1_write_oid(ptr, start, value, valueSize);
+		if (rc >= 0) {
+			rc = mbedtls_asn1_write_len(ptr, start, ptrTmp - *ptr);
+			if (rc >= 0 ) {
+				rc = mbedtls_asn1_write_tag(ptr, start,(MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE) );
 			}
-			// reset ptrTmp because ptr was allacated to some other place in memory
-			ptrTmp = *ptr; 
-		}
-		else if (rc < 0) {
-			prlog(PR_ERR, "ERROR: Issue with writing data for tag %d, mbedtls error #%d\n", tag, rc);
-			return FILE_WRITE_FAIL;
 		}
+	}
+	// for signature
+	else if (tag == MBEDTLS_ASN1_OCTET_STRING) {
+		rc = mbedtls_asn1_write_octet_string(ptr, start, value, valueSize);
+	}
+	// for raw data, idk kinda makes sense bit string = raw data you know maybe...
+	else if (tag == MBEDTLS_ASN1_BIT_STRING)
+		rc = mbedtls_asn1_write_raw_buffer(ptr, start, value, valueSize);
+	// for long integers of any length, ex:serial #, I am getting creative with these combos!
+	else if (tag == (MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_INTEGER))
+		rc = mbedtls_asn1_write_tagged_string(ptr, start, MBEDTLS_ASN1_INTEGER, value, valueSize);
 
+	// running out of room means getPKCS7Size does not match what is written here
+	if (rc < 0) {
+		prlog(PR_ERR, "ERROR: Issue with writing data for tag %d, mbedtls error #%d\n", tag, rc);
+		return FILE_WRITE_FAIL;
 	}
-	while (rc == MBEDTLS_ERR_ASN1_BUF_TOO_SMALL);
 
 	return SUCCESS;
 }
@@ -300,47 +334,34 @@ static int setPKCS7Data(unsigned char **start, size_t *size, unsigned char **ptr
 
 
 
-static int setSignature(unsigned char **start, size_t *size, unsigned char **ptr, PKCS7Info *pkcs7Info, 
-			mbedtls_x509_crt *pub, unsigned char *priv, size_t privSize) {
+#if !defined(MBEDTLS_THREADING_C)
+/*
+ *without MBEDTLS_THREADING_C an RSA context stores the values it computes on first use with no
+ *lock, so threads signing with the same parsed key (generate --batch -j) take turns
+ */
+static pthread_mutex_t signLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/*
+ *signs the digest in pkcs7Info with the private key
+ *@param pkcs7Info, information about the PKCS7 being generated
+ *@param privKey, private key, already checked against its certificate by parseSigners
+ *@param sig, the resulting signature, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param sigSize, length of sig
+ *@return SUCCESS or err number
+ */
+static int getSignature(PKCS7Info *pkcs7Info, mbedtls_pk_context *privKey, unsigned char **sig, size_t *sigSize) {
 	int rc;
-	size_t sigSize, hashSize, sigSizeBits;
-	unsigned char *hash = NULL, *signature = NULL;
-	char *sigType = NULL;
-	mbedtls_pk_context *privKey;
-	
+	size_t sigSizeBits;
+	unsigned char *signature = NULL;
 
-	privKey = malloc(sizeof(*privKey));
-	if (!privKey){
-		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
-		return ALLOC_FAIL;
-	}
-	mbedtls_pk_init(privKey);
-	// make sure private key parses into private key format
-	rc = mbedtls_pk_parse_key(privKey, priv, privSize, NULL, 0);
-	if (rc) {
-		prlog(PR_ERR, "ERROR: Failed to get context of private key, mbedtls error #%d\n", rc);
-		goto out;
-	}
-	// make sure private key is matched with public key
-	rc = mbedtls_pk_check_pair(&(pub->pk), privKey);
-	if (rc) {
-		prlog(PR_ERR, "Public and private key are not matched, mbedtls err#%d\n", rc);
-		goto out;
-	}
-	// make sure private key is RSA, otherwise quit
-	sigType = (char *) privKey->pk_info->name;
-	if (strcmp(sigType, "RSA")) {
-		rc = CERT_FAIL;
-		prlog(PR_ERR, "ERROR: Key is of type %s expected RSA\n", sigType);
-		goto out;
-	}
 	// get size of RSA signature, ex 2048, 4096 ...
 	sigSizeBits = privKey->pk_info->get_bitlen(privKey->pk_ctx);
 
-	// at this point we know pub and priv are valid, now we need the data to sign
-	rc = toHash(pkcs7Info->newData, pkcs7Info->newDataSize, pkcs7Info->hashFunct, &hash, &hashSize);
-	if (rc) {
-		prlog(PR_ERR, "ERROR: Failed to generate hash of new data for signing\n");
+	// the digest to sign was made by the caller
+	if (pkcs7Info->newHashSize != mbedtls_md_get_size(mbedtls_md_info_from_type(pkcs7Info->hashFunct))) {
+		prlog(PR_ERR, "ERROR: Digest of %zd bytes does not match the hash function\n", pkcs7Info->newHashSize);
+		rc = HASH_FAIL;
 		goto out;
 	}
 	signature = malloc(sigSizeBits/8);
@@ -351,72 +372,121 @@ static int setSignature(unsigned char **start, size_t *size, unsigned char **ptr
 	}
 
 	// sign
-	if (verbose)
-		printf("Signing digest of %zd bytes with %s into %zd bits \n", hashSize, sigType, sigSizeBits);
-	rc = mbedtls_pk_sign(privKey, pkcs7Info->hashFunct, hash, 0, signature, &sigSize, 0, NULL);
+	if (logLevel() >= PR_WARNING)
+		printf("Signing digest of %zd bytes with %s into %zd bits \n", pkcs7Info->newHashSize, privKey->pk_info->name, sigSizeBits);
+#if !defined(MBEDTLS_THREADING_C)
+	pthread_mutex_lock(&signLock);
+#endif
+	rc = mbedtls_pk_sign(privKey, pkcs7Info->hashFunct, pkcs7Info->newHash, 0, signature, sigSize, 0, NULL);
+#if !defined(MBEDTLS_THREADING_C)
+	pthread_mutex_unlock(&signLock);
+#endif
 	if (rc) {
 		prlog(PR_ERR, "Failed to generate signature, mbedtls err #%d\n", rc);
 		goto out;
 	}
-	rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_OCTET_STRING, signature, sigSize, 0);
-	if (rc) {
-		prlog(PR_ERR, "Failed to add signature to PKCS7 (signature generation was successful however)\n");
-	}
+	statsAdd(STATS_RSA_SIGNS, 1);
+	*sig = signature;
+	signature = NULL;
 out:
-	mbedtls_pk_free(privKey);
-	if (privKey) free(privKey);
-	if (hash) free(hash);
 	if (signature) free(signature);
 	return rc;
 
 }
 
-static int setAlgorithmIDs(unsigned char **start, size_t *size, unsigned char **ptr, PKCS7Info *pkcs7Info, mbedtls_x509_crt *pub, unsigned char *priv, size_t privSize) {
+// the signatures of one PKCS7, made by signSigner
+struct signerJobs {
+	PKCS7Info *pkcs7Info;
+	int *rcs;
+};
+
+// runInParallel callback, signs the digest for signer i
+static void signSigner(void *ctx, int i) {
+	struct signerJobs *jobs = ctx;
+	PKCS7Info *pkcs7Info = jobs->pkcs7Info;
+
+	jobs->rcs[i] = getSignature(pkcs7Info, &pkcs7Info->keys[i], &pkcs7Info->sigs[i], &pkcs7Info->sigSizes[i]);
+}
+
+/*
+ *gets the signature of every signer by signing the digest, unless pkcs7Info already holds them,
+ *after this everything that is needed to know the size of the PKCS7 before writing it is known
+ *@param pkcs7Info, information about the PKCS7, sigs and sigSizes are allocated and filled in if alreadySignedFlag is 0
+ *@return SUCCESS or err number
+ */
+static int prepareSigners(PKCS7Info *pkcs7Info) {
+	int rc = SUCCESS;
+	struct signerJobs jobs = { .pkcs7Info = pkcs7Info, .rcs = NULL };
+	// if no signers than quit
+	if (pkcs7Info->keyPairs < 1) {
+		prlog(PR_ERR, "ERROR: No keys given to sign with\n");
+		return ARG_PARSE_FAIL;
+	}
+	// the signatures were given (see definition of pkcs7Info.sigs), no generation is needed
+	if (pkcs7Info->alreadySignedFlag)
+		return SUCCESS;
+	pkcs7Info->sigs = calloc(pkcs7Info->keyPairs, sizeof(*pkcs7Info->sigs));
+	pkcs7Info->sigSizes = calloc(pkcs7Info->keyPairs, sizeof(*pkcs7Info->sigSizes));
+	// the private key operations are independent, do them all at once
+	jobs.rcs = calloc(pkcs7Info->keyPairs, sizeof(*jobs.rcs));
+	if (!pkcs7Info->sigs || !pkcs7Info->sigSizes || !jobs.rcs) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		free(jobs.rcs);
+		return ALLOC_FAIL;
+	}
+	runInParallel(pkcs7Info->keyPairs, signSigner, &jobs);
+	// report the first failure in signer order, as signing one at a time would
+	for (int i = 0; i < pkcs7Info->keyPairs && !rc; i++)
+		rc = jobs.rcs[i];
+	free(jobs.rcs);
+
+	return rc;
+}
+
+// frees the signatures prepareSigners made
+static void freeSigners(PKCS7Info *pkcs7Info) {
+	if (pkcs7Info->alreadySignedFlag)
+		return;
+	for (int i = 0; pkcs7Info->sigs && i < pkcs7Info->keyPairs; i++)
+		free(pkcs7Info->sigs[i]);
+	free(pkcs7Info->sigs);
+	free(pkcs7Info->sigSizes);
+	pkcs7Info->sigs = NULL;
+	pkcs7Info->sigSizes = NULL;
+}
+
+static int setAlgorithmIDs(unsigned char *start, unsigned char **ptr, PKCS7Info *pkcs7Info, int signer) {
 	int rc;
-	char *sigType = NULL;
-	
-	// if the private key already holds signature (see definition of pkcs7Info.keys)
-	// then just write the signature, no generation is needed
-	if (pkcs7Info->alreadySignedFlag) {
-		rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_OCTET_STRING, priv, privSize, 0);
-		if (rc)
-			prlog(PR_ERR, "Failed to add signature to PKCS7\n");
+
+	rc = setPKCS7Data(start, ptr, MBEDTLS_ASN1_OCTET_STRING, pkcs7Info->sigs[signer], pkcs7Info->sigSizes[signer], 0);
+	if (rc) {
+		prlog(PR_ERR, "Failed to add signature to PKCS7\n");
+		return rc;
 	}
-	else
-		rc = setSignature(start, size, ptr, pkcs7Info, pub, priv, privSize);
-	if (!rc){
-		// make sure it is rsa encryption, that is all we support right now
-		sigType = (char *) pub->pk.pk_info->name;
-		if (strcmp(sigType, "RSA")) {
-			rc = CERT_FAIL;
-			prlog(PR_ERR, "ERROR: Public Key is of type %s expected RSA\n", sigType);
-			return rc;
-		}
-		rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_OID | MBEDTLS_ASN1_CONTEXT_SPECIFIC, (void *) MBEDTLS_OID_PKCS1_RSA, strlen(MBEDTLS_OID_PKCS1_RSA), 0);
-		if (!rc) {
-			rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_OID | MBEDTLS_ASN1_CONTEXT_SPECIFIC, (void *) pkcs7Info->hashFunctOID, strlen(pkcs7Info->hashFunctOID), 0);
-		}
+	rc = setPKCS7Data(start, ptr, MBEDTLS_ASN1_OID | MBEDTLS_ASN1_CONTEXT_SPECIFIC, (void *) MBEDTLS_OID_PKCS1_RSA, strlen(MBEDTLS_OID_PKCS1_RSA), 0);
+	if (!rc) {
+		rc = setPKCS7Data(start, ptr, MBEDTLS_ASN1_OID | MBEDTLS_ASN1_CONTEXT_SPECIFIC, (void *) pkcs7Info->hashFunctOID, strlen(pkcs7Info->hashFunctOID), 0);
 	}
 	return rc;
 }
 
-static int setSignerCertData(unsigned char **start, size_t *size, unsigned char **ptr, PKCS7Info *pkcs7Info, mbedtls_x509_crt *pub, unsigned char *priv, size_t privSize) {
+static int setSignerCertData(unsigned char *start, unsigned char **ptr, PKCS7Info *pkcs7Info, int signer) {
 	int rc, signedInfoVersion = 1; 
-	size_t bytesWrittenInStep, currentlyUsedBytes;
-	rc = setAlgorithmIDs(start, size, ptr, pkcs7Info, pub, priv, privSize);
+	unsigned char *stepStart;
+	mbedtls_x509_crt *pub = &pkcs7Info->x509s[signer];
+	rc = setAlgorithmIDs(start, ptr, pkcs7Info, signer);
 	if (!rc) {
 		// add serial
-		currentlyUsedBytes = *size - (*ptr - *start);
-		rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_INTEGER, pub->serial.p, pub->serial.len, 0);
+		stepStart = *ptr;
+		rc = setPKCS7Data(start, ptr, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_INTEGER, pub->serial.p, pub->serial.len, 0);
 		if (!rc) {
-			rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_BIT_STRING, pub->issuer_raw.p, pub->issuer_raw.len, 0);
+			rc = setPKCS7Data(start, ptr, MBEDTLS_ASN1_BIT_STRING, pub->issuer_raw.p, pub->issuer_raw.len, 0);
 			if (!rc){
 				// add info
-				bytesWrittenInStep = *size - (*ptr - *start) - currentlyUsedBytes;
-				rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE, NULL, bytesWrittenInStep, 0);
+				rc = setPKCS7Data(start, ptr, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE, NULL, stepStart - *ptr, 0);
 				if (!rc) {
 					// add signed info version, see https:// tools.ietf.org/html/rfc2315 section 9.2
-					rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_INTEGER, &signedInfoVersion, sizeof(signedInfoVersion), 0);
+					rc = setPKCS7Data(start, ptr, MBEDTLS_ASN1_INTEGER, &signedInfoVersion, sizeof(signedInfoVersion), 0);
 				}
 				if (rc) {
 						prlog(PR_ERR, "ERROR: Failed to add owner flag to Signer Info of PKCS7\n");
@@ -429,58 +499,29 @@ static int setSignerCertData(unsigned char **start, size_t *size, unsigned char
 	return rc;
 }
 
-static int setSignerDataForEachSigner(unsigned char **start, size_t *size, unsigned char **ptr, PKCS7Info *pkcs7Info){
-	int rc;
-	size_t bytesWrittenInStep, currentlyUsedBytes;
-	mbedtls_x509_crt *x509 = NULL;
-	// if no signers than quit
-	if (pkcs7Info->keyPairs < 1) {
-		rc = ARG_PARSE_FAIL;
-		prlog(PR_ERR, "ERROR: No keys given to sign with\n");
-	}
+static int setSignerDataForEachSigner(unsigned char *start, unsigned char **ptr, PKCS7Info *pkcs7Info){
+	int rc = SUCCESS;
+	unsigned char *stepStart;
 	for(int i = 0; i < pkcs7Info->keyPairs ; i++) {
-		x509 = malloc(sizeof(*x509));
-		if (!x509){
-			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
-			rc = ALLOC_FAIL;
-			goto out;
-		}
-		mbedtls_x509_crt_init(x509);
-		// puts cert data into x509_Crt struct and returns number of failed parses
-		rc = mbedtls_x509_crt_parse(x509, pkcs7Info->crts[i], pkcs7Info->crtSizes[i]); 
-		if (rc) {
-			prlog(PR_ERR, "ERROR: While extracting signer info, parsing x509 failed with MBEDTLS exit code: %d \n", rc);
-			goto out;
-		}
-		currentlyUsedBytes = *size - (*ptr - *start);
-		rc = setSignerCertData(start, size, ptr, pkcs7Info, x509, pkcs7Info->keys[i], pkcs7Info->keySizes[i]);
-		if (rc) goto out;
-		bytesWrittenInStep = *size - (*ptr - *start) - currentlyUsedBytes;
-		rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE, NULL, bytesWrittenInStep, 0);
+		stepStart = *ptr;
+		rc = setSignerCertData(start, ptr, pkcs7Info, i);
+		if (rc) break;
+		rc = setPKCS7Data(start, ptr, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE, NULL, stepStart - *ptr, 0);
 		if (rc) {
 			prlog(PR_ERR,"ERROR: Failed to add header seqeuence header for signer data\n");
-			goto out;
+			break;
 		}
-
-		mbedtls_x509_crt_free(x509);
-		if (x509) free(x509);
-		x509 = NULL;
 	}
-	out:
-	if (x509) mbedtls_x509_crt_free(x509);
-	if (x509) free(x509);
 	return rc;
 }
 
-static int setSignersData(unsigned char **start, size_t *size, unsigned char **ptr, PKCS7Info *pkcs7Info) {
+static int setSignersData(unsigned char *start, unsigned char **ptr, PKCS7Info *pkcs7Info) {
 	int rc;
-	size_t bytesWrittenInStep, currentlyUsedBytes;
-	currentlyUsedBytes = *size - (*ptr - *start);
-	rc = setSignerDataForEachSigner(start, size, ptr, pkcs7Info);
+	unsigned char *stepStart = *ptr;
+	rc = setSignerDataForEachSigner(start, ptr, pkcs7Info);
 	if (!rc) {
-		bytesWrittenInStep = *size - (*ptr - *start) - currentlyUsedBytes;
 		// add 0x31 with length to end of signers info 
-		rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SET, NULL, bytesWrittenInStep, 0); 
+		rc = setPKCS7Data(start, ptr, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SET, NULL, stepStart - *ptr, 0);
 	}
 	if (rc) {
 		prlog(PR_ERR, "ERROR: Failed to add signers data header info to PKCS7\n");
@@ -488,20 +529,19 @@ static int setSignersData(unsigned char **start, size_t *size, unsigned char **p
 	return rc;
 }
 
-static int setSignerCertRaw(unsigned char **start, size_t *size, unsigned char **ptr, PKCS7Info *pkcs7Info) {
+static int setSignerCertRaw(unsigned char *start, unsigned char **ptr, PKCS7Info *pkcs7Info) {
 	int rc;
-	size_t bytesWrittenInStep, currentlyUsedBytes;
-	rc = setSignersData(start, size, ptr, pkcs7Info);
+	unsigned char *stepStart;
+	rc = setSignersData(start, ptr, pkcs7Info);
 
 	if (!rc) {
-		currentlyUsedBytes = *size - (*ptr - *start);
+		stepStart = *ptr;
 		for (int i =0; i < pkcs7Info->keyPairs; i++) {
-			rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_BIT_STRING, pkcs7Info->crts[i], pkcs7Info->crtSizes[i], 0);
+			rc = setPKCS7Data(start, ptr, MBEDTLS_ASN1_BIT_STRING, pkcs7Info->x509s[i].raw.p, pkcs7Info->x509s[i].raw.len, 0);
 			if (rc) break;
 		}
 		if (!rc){
-			bytesWrittenInStep = *size - (*ptr - *start) - currentlyUsedBytes;
-			rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_CONTEXT_SPECIFIC | MBEDTLS_ASN1_CONSTRUCTED, NULL, bytesWrittenInStep, 0);
+			rc = setPKCS7Data(start, ptr, MBEDTLS_ASN1_CONTEXT_SPECIFIC | MBEDTLS_ASN1_CONSTRUCTED, NULL, stepStart - *ptr, 0);
 		}
 		if (rc) {
 			prlog(PR_ERR, "ERROR: Failed to add raw signing certificate to PKCS7\n");
@@ -510,11 +550,11 @@ static int setSignerCertRaw(unsigned char **start, size_t *size, unsigned char *
 	return rc;
 }
 
-static int setSignedDataOID(unsigned char **start, size_t *size, unsigned char **ptr, PKCS7Info *pkcs7Info) {
+static int setSignedDataOID(unsigned char *start, unsigned char **ptr, PKCS7Info *pkcs7Info) {
 	int rc;
-	rc = setSignerCertRaw(start, size, ptr, pkcs7Info);
+	rc = setSignerCertRaw(start, ptr, pkcs7Info);
 	if (!rc) {
-		rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_OID , (void *)MBEDTLS_OID_PKCS7_DATA, strlen(MBEDTLS_OID_PKCS7_DATA), 0);
+		rc = setPKCS7Data(start, ptr, MBEDTLS_ASN1_OID , (void *)MBEDTLS_OID_PKCS7_DATA, strlen(MBEDTLS_OID_PKCS7_DATA), 0);
 		if (rc){
 			prlog(PR_ERR, "ERROR: Failed to add OID, PKCS7_DATA, for Signed Data of PKCS7\n");
 		}
@@ -522,19 +562,17 @@ static int setSignedDataOID(unsigned char **start, size_t *size, unsigned char *
 	return rc;
 }
 
-static int setAlgoID(unsigned char **start, size_t *size, unsigned char **ptr, PKCS7Info *pkcs7Info) {
+static int setAlgoID(unsigned char *start, unsigned char **ptr, PKCS7Info *pkcs7Info) {
 	int rc;
-	size_t bytesWrittenInStep, currentlyUsedBytes;
-	rc = setSignedDataOID(start, size, ptr, pkcs7Info);
+	unsigned char *stepStart;
+	rc = setSignedDataOID(start, ptr, pkcs7Info);
 	
 	if (!rc){
-		currentlyUsedBytes = *size - (*ptr - *start);
+		stepStart = *ptr;
 
-		rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_OID | MBEDTLS_ASN1_CONTEXT_SPECIFIC, (void *) pkcs7Info->hashFunctOID, strlen(pkcs7Info->hashFunctOID), 0);
+		rc = setPKCS7Data(start, ptr, MBEDTLS_ASN1_OID | MBEDTLS_ASN1_CONTEXT_SPECIFIC, (void *) pkcs7Info->hashFunctOID, strlen(pkcs7Info->hashFunctOID), 0);
 		if (!rc){
-		// bytes in step = new currently written bytes - old currently written bytes
-			bytesWrittenInStep = *size - (*ptr - *start) - currentlyUsedBytes; 
-			rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SET, NULL, bytesWrittenInStep, 0);
+			rc = setPKCS7Data(start, ptr, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SET, NULL, stepStart - *ptr, 0);
 		}
 		if (rc) 
 		prlog(PR_ERR, "ERROR: Failed to add algorithm ID to PKCS7\n");
@@ -543,13 +581,13 @@ static int setAlgoID(unsigned char **start, size_t *size, unsigned char **ptr, P
 	return rc;
 }
 
-static int setVersion(unsigned char **start, size_t *size, unsigned char **ptr, PKCS7Info *pkcs7Info){
+static int setVersion(unsigned char *start, unsigned char **ptr, PKCS7Info *pkcs7Info){
 	int rc;
 	int version = 1;
 	// for now only version 1
-	rc = setAlgoID(start, size, ptr, pkcs7Info);
+	rc = setAlgoID(start, ptr, pkcs7Info);
 	if (!rc){
-		rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_INTEGER, &version, sizeof(version), 0);
+		rc = setPKCS7Data(start, ptr, MBEDTLS_ASN1_INTEGER, &version, sizeof(version), 0);
 		if (rc)
 			prlog(PR_ERR, "ERROR: Failed to add version to PKCS7\n");
 	}
@@ -557,13 +595,12 @@ static int setVersion(unsigned char **start, size_t *size, unsigned char **ptr,
 	return rc;
 }
 
-static int setSignedData(unsigned char **start, size_t *size, unsigned char **ptr, PKCS7Info *pkcs7Info){
+static int setSignedData(unsigned char *start, unsigned char **ptr, PKCS7Info *pkcs7Info){
 	int rc;
-	size_t currentlyUsedBytes;
-	rc = setVersion(start, size, ptr, pkcs7Info);
+	unsigned char *stepStart = *ptr;
+	rc = setVersion(start, ptr, pkcs7Info);
 	if (!rc){
-		currentlyUsedBytes = *size - (*ptr - *start);
-		rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE, NULL, currentlyUsedBytes, 0);
+		rc = setPKCS7Data(start, ptr, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE, NULL, stepStart - *ptr, 0);
 		if (rc)
 			prlog(PR_ERR,"ERROR: Failed to add signed data's SEQUENCE header to PKCS7\n");
 	}
@@ -572,18 +609,16 @@ static int setSignedData(unsigned char **start, size_t *size, unsigned char **pt
 
 }
 
-static int setPKCS7OID(unsigned char **start, size_t *size, unsigned char **ptr, PKCS7Info *pkcs7Info){
+static int setPKCS7OID(unsigned char *start, unsigned char **ptr, PKCS7Info *pkcs7Info){
 	int rc;
-	size_t currentlyUsedBytes;
+	unsigned char *stepStart = *ptr;
 
-	rc = setSignedData(start, size, ptr, pkcs7Info);
+	rc = setSignedData(start, ptr, pkcs7Info);
 	
 	if (!rc){
-		currentlyUsedBytes = *size - (*ptr - *start);
-		rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_CONTEXT_SPECIFIC | MBEDTLS_ASN1_CONSTRUCTED, NULL, currentlyUsedBytes, 0);
+		rc = setPKCS7Data(start, ptr, MBEDTLS_ASN1_CONTEXT_SPECIFIC | MBEDTLS_ASN1_CONSTRUCTED, NULL, stepStart - *ptr, 0);
 		if (!rc){
-			currentlyUsedBytes = *size - (*ptr - *start);
-			rc = setPKCS7Data(start, size, ptr, MBEDTLS_ASN1_OID | MBEDTLS_ASN1_CONTEXT_SPECIFIC, (void *) MBEDTLS_OID_PKCS7_SIGNED_DATA, strlen(MBEDTLS_OID_PKCS7_SIGNED_DATA), currentlyUsedBytes );	
+			rc = setPKCS7Data(start, ptr, MBEDTLS_ASN1_OID | MBEDTLS_ASN1_CONTEXT_SPECIFIC, (void *) MBEDTLS_OID_PKCS7_SIGNED_DATA, strlen(MBEDTLS_OID_PKCS7_SIGNED_DATA), stepStart - *ptr);
 		}
 		if (rc)
 			prlog(PR_ERR, "ERROR: Failed to add PKCS7 OID/SEQUENCE header to PKCS7\n");
@@ -591,39 +626,14 @@ static int setPKCS7OID(unsigned char **start, size_t *size, unsigned char **ptr,
 	return rc;
 }
 
-static int toPKCS7(unsigned char **pkcs7, size_t *pkcs7Size, const char** crtFiles,
-		   int keyPairs, int hashFunct, PKCS7Info *info) 
+static int toPKCS7(unsigned char **pkcs7, size_t *pkcs7Size, int hashFunct, PKCS7Info *info) 
 {
-	unsigned char *crtPEM = NULL,**crts = NULL,*pkcs7Buff = NULL;
+	unsigned char *pkcs7Buff = NULL;
 	unsigned char *ptr;
 	const char *hashFunctOID;
-	size_t crtSizePEM,*crtSizes = NULL, pkcs7BuffSize, whiteSpace, oidLen; 
+	size_t pkcs7BuffSize, oidLen; 
 	int rc;
 
-	crts = calloc (1, sizeof(unsigned char*) * keyPairs);
-	crtSizes = calloc(1, sizeof(size_t) * keyPairs);
-	if (!crts || !crtSizes) {
-		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
-		rc = ALLOC_FAIL;
-		goto out;
-	}
-	for (int i = 0; i < keyPairs; i++) {
-		// get data from public keys
-		crtPEM = (unsigned char *)getDataFromFile(crtFiles[i], &crtSizePEM);
-		if (!crtPEM) {
-			prlog(PR_ERR, "ERROR: failed to get data from pub key file %s\n", crtFiles[i]);
-			rc = INVALID_FILE;
-			goto out;
-		}
-		// get der format of that crt
-		rc = convert_pem_to_der(crtPEM, crtSizePEM, (unsigned char **) &crts[i], &crtSizes[i]);
-		if (rc) {
-			prlog(PR_ERR, "Conversion for %s from PEM to DER failed\n", crtFiles[i]);
-			goto out;
-		}
-		if (crtPEM) free(crtPEM);
-		crtPEM = NULL;
-	}
 	// get hashFunct OID
 	if (hashFunct < MBEDTLS_MD_NONE || hashFunct > MBEDTLS_MD_RIPEMD160) {
 		prlog(PR_ERR, "ERROR: Invalid hash function %d, see mbedtls_md_type_t\n", hashFunct);
@@ -633,18 +643,20 @@ static int toPKCS7(unsigned char **pkcs7, size_t *pkcs7Size, const char** crtFil
 	rc = mbedtls_oid_get_oid_by_md( hashFunct, (const char **)&hashFunctOID, &oidLen);
 	if (rc) {
 		prlog(PR_ERR, "Message Digest value %d could not be converted to an OID, mbedtls err #%d\n",hashFunct, rc);
+		goto out;
 	}
 
-	info->crts = (unsigned char **)crts;
-	info->crtSizes = crtSizes;
-	info->keyPairs = keyPairs;
 	info->hashFunct = hashFunct;
 	info->hashFunctOID = hashFunctOID;
 
-	prlog(PR_INFO, "Generating Pkcs7 with %d pair(s) of signers...\n", keyPairs);
-	
-	// buffer size for pkcs7 will grow exponentially 2^n depending on space needed
-	pkcs7BuffSize = 2;
+	prlog(PR_INFO, "Generating Pkcs7 with %d pair(s) of signers...\n", info->keyPairs);
+
+	// signatures first, after them every length in the PKCS7 is known
+	rc = prepareSigners(info);
+	if (rc)
+		goto out;
+
+	pkcs7BuffSize = getPKCS7Size(info);
 	pkcs7Buff = malloc(pkcs7BuffSize);
 	if (!pkcs7Buff){
 		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
@@ -654,131 +666,289 @@ static int toPKCS7(unsigned char **pkcs7, size_t *pkcs7Size, const char** crtFil
 	// set ptr to the end of the buffer, mbedtls functions write backwards 
 	ptr = pkcs7Buff + pkcs7BuffSize;	
 	// this will call all other functions
-	rc = setPKCS7OID((unsigned char **) &pkcs7Buff, &pkcs7BuffSize, &ptr, info);
+	rc = setPKCS7OID(pkcs7Buff, &ptr, info);
 	if (rc){
 		prlog(PR_ERR, "Failed to generate PKCS7\n");
 		goto out;
 	}
-	// trim pkcs7
-	whiteSpace = getLeadingWhitespace(pkcs7Buff, pkcs7BuffSize);
-	prlog(PR_INFO, "Trimmed PKCS7 of buffer size: %zd to actual size = %zd\n", pkcs7BuffSize, pkcs7BuffSize - whiteSpace);
-	pkcs7BuffSize -= whiteSpace; // factor off leading whitespace from pkcs7
+	if (ptr != pkcs7Buff) {
+		prlog(PR_ERR, "ERROR: PKCS7 of %zd bytes does not fill the %zd bytes computed for it\n",
+		      pkcs7BuffSize - (ptr - pkcs7Buff), pkcs7BuffSize);
+		rc = FILE_WRITE_FAIL;
+		goto out;
+	}
+	prlog(PR_INFO, "Generated PKCS7 of size %zd\n", pkcs7BuffSize);
 
-	// copy into new buffer with only necessary allocated memory
 	*pkcs7Size = pkcs7BuffSize;
-	*pkcs7 = malloc(*pkcs7Size);
-	if (!*pkcs7){
+	*pkcs7 = pkcs7Buff;
+	pkcs7Buff = NULL;
+
+out:
+	freeSigners(info);
+	if (pkcs7Buff) free(pkcs7Buff);
+
+	return rc;
+}
+
+/*
+ *reads every PEM file and converts it to DER
+ *@param files, array of file paths (PEM)
+ *@param count, array length of files
+ *@param ders, the resulting DER buffs, NOTE: REMEMBER TO UNALLOC WITH freeDERs
+ *@param derSizes, the length of each DER buff
+ *@return SUCCESS or err number
+ */
+int getDERFromPEMFiles(const char **files, int count, unsigned char ***ders, size_t **derSizes)
+{
+	unsigned char *pem = NULL, **outDers = NULL;
+	size_t pemSize, *outSizes = NULL;
+	int rc = SUCCESS;
+
+	outDers = calloc(1, sizeof(unsigned char*) * count);
+	outSizes = calloc(1, sizeof(size_t) * count);
+	if (!outDers || !outSizes) {
 		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
 		rc = ALLOC_FAIL;
 		goto out;
 	}
-	memcpy(*pkcs7, pkcs7Buff + whiteSpace, *pkcs7Size);
+	for (int i = 0; i < count; i++) {
+		pem = (unsigned char *)getDataFromFile(files[i], &pemSize);
+		if (!pem) {
+			prlog(PR_ERR, "ERROR: failed to get data from file %s\n", files[i]);
+			rc = INVALID_FILE;
+			goto out;
+		}
+		rc = convert_pem_to_der(pem, pemSize, &outDers[i], &outSizes[i]);
+		if (rc) {
+			prlog(PR_ERR, "Conversion for %s from PEM to DER failed\n", files[i]);
+			goto out;
+		}
+		free(pem);
+		pem = NULL;
+	}
+	*ders = outDers;
+	*derSizes = outSizes;
+	outDers = NULL;
+	outSizes = NULL;
 
 out:
-	if (crtPEM) free(crtPEM);
+	if (pem) free(pem);
+	freeDERs(outDers, outSizes, count);
+
+	return rc;
+}
+
+/*
+ *frees the DER buffs from getDERFromPEMFiles, NULL arrays are ignored
+ */
+void freeDERs(unsigned char **ders, size_t *derSizes, int count)
+{
+	for (int i = 0; ders && i < count; i++) {
+		if (ders[i]) free(ders[i]);
+	}
+	if (ders) free(ders);
+	if (derSizes) free(derSizes);
+}
+
+/*
+ *parses the certificate and private key of every signer and checks that they match, once, so the
+ *signers can make any number of PKCS7s with to_pkcs7_generate_signature_parsed
+ *@param crts, array of DER certificates
+ *@param crtSizes, length of each crt
+ *@param keys, array of DER private keys matching crts, NULL to only parse the certificates
+ *@param keySizes, length of each key
+ *@param keyPairs, array length of crts/keys
+ *@param x509s, the resulting certificates, NOTE: REMEMBER TO UNALLOC WITH freeParsedSigners
+ *@param pks, the resulting private keys, not set if keys is NULL
+ *@return SUCCESS or err number
+ */
+int parseSigners(unsigned char **crts, size_t *crtSizes, unsigned char **keys, size_t *keySizes, int keyPairs,
+		 mbedtls_x509_crt **x509s, mbedtls_pk_context **pks)
+{
+	mbedtls_x509_crt *outX509s = NULL;
+	mbedtls_pk_context *outPks = NULL;
+	const char *sigType;
+	int rc = SUCCESS;
+
+	outX509s = calloc(keyPairs, sizeof(*outX509s));
+	if (keys)
+		outPks = calloc(keyPairs, sizeof(*outPks));
+	if (!outX509s || (keys && !outPks)) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
 	for (int i = 0; i < keyPairs; i++) {
-		if (crts[i]) free(crts[i]);
+		mbedtls_x509_crt_init(&outX509s[i]);
+		if (outPks)
+			mbedtls_pk_init(&outPks[i]);
 	}
-	if (crts) free(crts);
-	if (crtSizes) free(crtSizes);
-	if (pkcs7Buff) free(pkcs7Buff);
+	for (int i = 0; i < keyPairs; i++) {
+		// puts cert data into x509_Crt struct and returns number of failed parses
+		rc = mbedtls_x509_crt_parse(&outX509s[i], crts[i], crtSizes[i]);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: While extracting signer info, parsing x509 failed with MBEDTLS exit code: %d \n", rc);
+			goto out;
+		}
+		// make sure it is rsa encryption, that is all we support right now
+		sigType = outX509s[i].pk.pk_info->name;
+		if (strcmp(sigType, "RSA")) {
+			rc = CERT_FAIL;
+			prlog(PR_ERR, "ERROR: Public Key is of type %s expected RSA\n", sigType);
+			goto out;
+		}
+		if (!keys)
+			continue;
+		// make sure private key parses into private key format
+		rc = mbedtls_pk_parse_key(&outPks[i], keys[i], keySizes[i], NULL, 0);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: Failed to get context of private key, mbedtls error #%d\n", rc);
+			goto out;
+		}
+		// make sure private key is matched with public key, this signs with the key once which
+		// also fills in the values mbedtls caches in it, signing only reads the key after this
+		rc = mbedtls_pk_check_pair(&outX509s[i].pk, &outPks[i]);
+		if (rc) {
+			prlog(PR_ERR, "Public and private key are not matched, mbedtls err#%d\n", rc);
+			goto out;
+		}
+		// make sure private key is RSA, otherwise quit
+		sigType = outPks[i].pk_info->name;
+		if (strcmp(sigType, "RSA")) {
+			rc = CERT_FAIL;
+			prlog(PR_ERR, "ERROR: Key is of type %s expected RSA\n", sigType);
+			goto out;
+		}
+	}
+	*x509s = outX509s;
+	outX509s = NULL;
+	if (keys) {
+		*pks = outPks;
+		outPks = NULL;
+	}
+
+out:
+	freeParsedSigners(outX509s, outPks, keyPairs);
 
 	return rc;
 }
 
+/*
+ *frees the certificates and keys from parseSigners, NULL arrays are ignored
+ */
+void freeParsedSigners(mbedtls_x509_crt *x509s, mbedtls_pk_context *pks, int count)
+{
+	for (int i = 0; i < count; i++) {
+		if (x509s)
+			mbedtls_x509_crt_free(&x509s[i]);
+		if (pks)
+			mbedtls_pk_free(&pks[i]);
+	}
+	if (x509s) free(x509s);
+	if (pks) free(pks);
+}
+
 /*
  *generates a PKCS7 and create signature with private and public keys
  *@param pkcs7, the resulting PKCS7, newData not appended, NOTE: REMEMBER TO UNALLOC THIS MEMORY
  *@param pkcs7Size, the length of pkcs7
- *@param newData, data to be added to be used in digest
- *@param dataSize , length of newData
+ *@param newHash, digest of the data to be signed, made with hashFunct
+ *@param newHashSize , length of newHash
  *@param crtFiles, array of file paths to public keys to sign with(PEM)
  *@param keyFiles, array of file paths to private keys to sign with
  *@param keyPairs, array length of key/crtFiles
  *@param hashFunct, hash function to use in digest, see mbedtls_md_type_t for values in mbedtls/md.h
  *@return SUCCESS or err number 
  */
-int to_pkcs7_generate_signature(unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newData, size_t newDataSize, 
+int to_pkcs7_generate_signature(unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newHash, size_t newHashSize, 
 	const char** crtFiles, const char** keyFiles,  int keyPairs, int hashFunct)
 {
-	unsigned char *keyPEM = NULL, **keys = NULL;
-	size_t keySizePEM,  *keySizes = NULL;
+	unsigned char **keys = NULL, **crts = NULL;
+	size_t *keySizes = NULL, *crtSizes = NULL;
+	mbedtls_x509_crt *x509s = NULL;
+	mbedtls_pk_context *pks = NULL;
 	int rc;
-	PKCS7Info info;
 	// if no keys given
 	if (keyPairs == 0) {
 		prlog(PR_ERR, "ERROR: missing private key / certificate... use -k <privateKeyFile> -c <certificateFile>\n");
-		rc = ARG_PARSE_FAIL;
-		goto out;
-	}
-	keys = calloc(1, sizeof(unsigned char*) * keyPairs);
-	keySizes = calloc(1, sizeof(size_t) * keyPairs);
-	if (!keys || !keySizes) {
-		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
-		rc = ALLOC_FAIL;
-		goto out;	
+		return ARG_PARSE_FAIL;
 	}
+	rc = getDERFromPEMFiles(keyFiles, keyPairs, &keys, &keySizes);
+	if (rc)
+		goto out;
+	rc = getDERFromPEMFiles(crtFiles, keyPairs, &crts, &crtSizes);
+	if (rc)
+		goto out;
 
-	for (int i = 0; i < keyPairs; i++) {
-		// get data of private keys
-		keyPEM = (unsigned char *)getDataFromFile(keyFiles[i], &keySizePEM);
+	rc = parseSigners(crts, crtSizes, keys, keySizes, keyPairs, &x509s, &pks);
+	if (rc)
+		goto out;
 
-		if (!keyPEM) {
-			prlog(PR_ERR, "ERROR: failed to get data from priv key file %s\n", keyFiles[i]);
-			rc = INVALID_FILE;
-			goto out;
-		}
-		rc = convert_pem_to_der(keyPEM, keySizePEM, (unsigned char **) &keys[i], &keySizes[i]);
-		if (rc) {
-			prlog(PR_ERR, "Conversion for %s from PEM to DER failed\n", keyFiles[i]);
-			goto out;
-		}
-		if (keyPEM) free(keyPEM);
-		keyPEM = NULL;
+	rc = to_pkcs7_generate_signature_parsed(pkcs7, pkcs7Size, newHash, newHashSize, x509s, pks,
+						keyPairs, hashFunct);
+out:
+	freeParsedSigners(x509s, pks, keyPairs);
+	freeDERs(keys, keySizes, keyPairs);
+	freeDERs(crts, crtSizes, keyPairs);
+
+	return rc;
+}
+
+/*
+ *same as to_pkcs7_generate_signature with the keys and certificates already parsed by parseSigners
+ *@param x509s, array of certificates to sign with
+ *@param keys, array of private keys matching x509s
+ *@return SUCCESS or err number
+ */
+int to_pkcs7_generate_signature_parsed(unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newHash, size_t newHashSize, 
+	mbedtls_x509_crt *x509s, mbedtls_pk_context *keys, int keyPairs, int hashFunct)
+{
+	int rc;
+	PKCS7Info info;
+
+	if (keyPairs == 0) {
+		prlog(PR_ERR, "ERROR: missing private key / certificate... use -k <privateKeyFile> -c <certificateFile>\n");
+		return ARG_PARSE_FAIL;
 	}
-	
-	info.keys = (unsigned char **)keys;
-	info.keySizes = keySizes;
+	info.x509s = x509s;
+	info.keys = keys;
 	info.keyPairs = keyPairs;
-	info.newData = newData;
-	info.newDataSize = newDataSize;
+	info.newHash = newHash;
+	info.newHashSize = newHashSize;
 	info.alreadySignedFlag = 0;
+	info.sigs = NULL;
+	info.sigSizes = NULL;
 
-	rc = toPKCS7(pkcs7, pkcs7Size, crtFiles, keyPairs, hashFunct, &info);
+	rc = toPKCS7(pkcs7, pkcs7Size, hashFunct, &info);
 	if (rc)
-		goto out;
+		return rc;
 
-	if (verbose){
+	if (logLevel() >= PR_WARNING){
 		printf( "PKCS7 generation successful...\n");
 	}
-out:
-	if (keyPEM) free(keyPEM);
-	for (int i = 0; i < keyPairs; i++) {
-		if (keys[i]) free(keys[i]);
-	}
-	if (keys) free (keys);
-	if (keySizes) free(keySizes);
 
-	return rc;
+	return SUCCESS;
 }
 
 /*
  *generates a PKCS7 with given signed data
  *@param pkcs7, the resulting PKCS7, newData not appended, NOTE: REMEMBER TO UNALLOC THIS MEMORY
  *@param pkcs7Size, the length of pkcs7
- *@param newData, data to be added to be used in digest
- *@param dataSize , length of newData
+ *@param newHash, digest of the data to be signed, made with hashFunct
+ *@param newHashSize , length of newHash
  *@param crtFiles, array of file paths to public keys that were used in signing with(PEM)
  *@param sigFiles, array of file paths to raw signed data files 
  *@param keyPairs, array length of crt/signatures
  *@param hashFunct, hash function to use in digest, see mbedtls_md_type_t for values in mbedtls/md.h
  *@return SUCCESS or err number 
  */
-int to_pkcs7_already_signed_data(unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newData, size_t newDataSize, 
+int to_pkcs7_already_signed_data(unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newHash, size_t newHashSize, 
 	const char** crtFiles, const char** sigFiles,  int keyPairs, int hashFunct)
 {
 	char **sigs = NULL;
-	size_t  *sig_sizes = NULL;
+	unsigned char **crts = NULL;
+	size_t  *sig_sizes = NULL, *crtSizes = NULL;
+	mbedtls_x509_crt *x509s = NULL;
 	int rc;
 	PKCS7Info info;
 	// if no keys given
@@ -805,27 +975,33 @@ int to_pkcs7_already_signed_data(unsigned char **pkcs7, size_t *pkcs7Size, const
 			goto out;
 		}
 	}
+	rc = getDERFromPEMFiles(crtFiles, keyPairs, &crts, &crtSizes);
+	if (rc)
+		goto out;
+	rc = parseSigners(crts, crtSizes, NULL, NULL, keyPairs, &x509s, NULL);
+	if (rc)
+		goto out;
 	
-	info.keys = (unsigned char **)sigs;
-	info.keySizes = sig_sizes;
+	info.x509s = x509s;
+	info.keys = NULL;
 	info.keyPairs = keyPairs;
-	info.newData = newData;
-	info.newDataSize = newDataSize;
+	info.newHash = newHash;
+	info.newHashSize = newHashSize;
 	info.alreadySignedFlag = 1;
+	info.sigs = (unsigned char **)sigs;
+	info.sigSizes = sig_sizes;
 
-	rc = toPKCS7(pkcs7, pkcs7Size, crtFiles, keyPairs, hashFunct, &info);
+	rc = toPKCS7(pkcs7, pkcs7Size, hashFunct, &info);
 	if (rc)
 		goto out;
 
-	if (verbose){
+	if (logLevel() >= PR_WARNING){
 		printf( "PKCS7 generation successful...\n");
 	}
 out:
-	for (int i = 0; i < keyPairs; i++) {
-		if (sigs[i]) free(sigs[i]);
-	}
-	if (sigs) free (sigs);
-	if (sig_sizes) free(sig_sizes);
+	freeParsedSigners(x509s, NULL, keyPairs);
+	freeDERs((unsigned char **)sigs, sig_sizes, keyPairs);
+	freeDERs(crts, crtSizes, keyPairs);
 	return rc;
 }
 #endif
@@ -1,10 +1,17 @@
 #ifndef GENERATE_PKCS7_H
 #define GENERATE_PKCS7_H
 #include "pkcs7.h"
-int to_pkcs7_already_signed_data(unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newData, size_t newDataSize, 
+int to_pkcs7_already_signed_data(unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newHash, size_t newHashSize, 
     const char** crtFiles, const char** sigFiles,  int keyPairs, int hashFunct);
-int to_pkcs7_generate_signature(unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newData, size_t newDataSize, 
+int to_pkcs7_generate_signature(unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newHash, size_t newHashSize, 
     const char** crtFiles, const char** keyFiles,  int keyPairs, int hashFunct);
+int to_pkcs7_generate_signature_parsed(unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newHash, size_t newHashSize, 
+    mbedtls_x509_crt *x509s, mbedtls_pk_context *keys, int keyPairs, int hashFunct);
+int getDERFromPEMFiles(const char **files, int count, unsigned char ***ders, size_t **derSizes);
+void freeDERs(unsigned char **ders, size_t *derSizes, int count);
+int parseSigners(unsigned char **crts, size_t *crtSizes, unsigned char **keys, size_t *keySizes, int keyPairs,
+    mbedtls_x509_crt **x509s, mbedtls_pk_context **pks);
+void freeParsedSigners(mbedtls_x509_crt *x509s, mbedtls_pk_context *pks, int count);
 int convert_pem_to_der( const unsigned char *input, size_t ilen, unsigned char **output, size_t *olen );
 int toHash(const unsigned char* data, size_t size, int hashFunct, unsigned char** outHash, size_t* outHashSize);
 #endif
@@ -49,6 +49,7 @@
 #define MBEDTLS_ERR_PKCS7_BAD_INPUT_DATA                   -0x8400  /**< Input invalid. */
 #define MBEDTLS_ERR_PKCS7_ALLOC_FAILED                     -0x8480  /**< Allocation of memory failed. */
 #define MBEDTLS_ERR_PKCS7_FILE_IO_ERROR                    -0x8500  /**< File Read/Write Error */
+#define MBEDTLS_ERR_PKCS7_NO_MATCHING_SIGNER               -0x8580  /**< No signer identifies the certificate */
 /* \} name */
 
 /**
@@ -152,6 +153,9 @@ int mbedtls_pkcs7_signed_data_verify(mbedtls_pkcs7 *pkcs7,
                                      const unsigned char *data,
                                      size_t datalen);
 
+int mbedtls_pkcs7_has_signer( const mbedtls_pkcs7 *pkcs7,
+                              const mbedtls_x509_crt *cert );
+
 int mbedtls_pkcs7_signed_hash_verify( mbedtls_pkcs7 *pkcs7,
                                       mbedtls_x509_crt *cert,
                                       const unsigned char *hash, int hashlen);
@@ -582,6 +582,58 @@ int mbedtls_pkcs7_signed_data_verify( mbedtls_pkcs7 *pkcs7,
     return( ret );
 }
 
+/*
+ * Check if the signer names the certificate by issuer and serial number, or
+ * if the signing certificate carried in the PKCS7 for it holds the same
+ * public key (a reissued certificate keeps its key).
+ */
+static int pkcs7_signer_identifies_cert( const mbedtls_pkcs7 *pkcs7,
+                                         const mbedtls_pkcs7_signer_info *signer,
+                                         const mbedtls_x509_crt *cert )
+{
+    const mbedtls_x509_crt *signer_cert;
+
+    if( signer->issuer_raw.len == cert->issuer_raw.len &&
+        signer->serial.len == cert->serial.len &&
+        memcmp( signer->issuer_raw.p, cert->issuer_raw.p, cert->issuer_raw.len ) == 0 &&
+        memcmp( signer->serial.p, cert->serial.p, cert->serial.len ) == 0 )
+        return( 1 );
+
+    for( signer_cert = &pkcs7->signed_data.certs; signer_cert != NULL;
+         signer_cert = signer_cert->next )
+    {
+        if( signer_cert->raw.p == NULL ||
+            signer->issuer_raw.len != signer_cert->issuer_raw.len ||
+            signer->serial.len != signer_cert->serial.len ||
+            memcmp( signer->issuer_raw.p, signer_cert->issuer_raw.p,
+                    signer_cert->issuer_raw.len ) != 0 ||
+            memcmp( signer->serial.p, signer_cert->serial.p,
+                    signer_cert->serial.len ) != 0 )
+            continue;
+
+        return( signer_cert->pk_raw.len == cert->pk_raw.len &&
+                memcmp( signer_cert->pk_raw.p, cert->pk_raw.p,
+                        cert->pk_raw.len ) == 0 );
+    }
+
+    return( 0 );
+}
+
+int mbedtls_pkcs7_has_signer( const mbedtls_pkcs7 *pkcs7,
+                              const mbedtls_x509_crt *cert )
+{
+    const mbedtls_pkcs7_signer_info *signer;
+
+    for( signer = pkcs7->signed_data.signers; signer != NULL;
+         signer = signer->next )
+    {
+        if( pkcs7_signer_identifies_cert( pkcs7, signer, cert ) )
+            return( 1 );
+    }
+
+    return( 0 );
+}
+
 int mbedtls_pkcs7_signed_hash_verify( mbedtls_pkcs7 *pkcs7,
                                       mbedtls_x509_crt *cert,
                                       const unsigned char *hash, int hashlen)
@@ -598,24 +650,23 @@ int mbedtls_pkcs7_signed_hash_verify( mbedtls_pkcs7 *pkcs7,
     pk_cxt = cert->pk;
 
     /*
-     * Potential TODO
-     * Currently we iterate over all signers and return success if any of them
-     * verify.
-     *
-     * However, we could make this better by checking against the certificate's
-     * identification and SignerIdentifier fields first. That would also allow
-     * us to distinguish between 'no signature for key' and 'signature for key
-     * failed to validate'.
+     * Only the signers whose SignerIdentifier matches the certificate are
+     * verified, that way 'no signature for key' is reported without any
+     * public key operation and differs from 'signature for key failed to
+     * validate'.
      */
-
+    ret = MBEDTLS_ERR_PKCS7_NO_MATCHING_SIGNER;
     signer = pkcs7->signed_data.signers;
     while( signer != NULL )
     {
-        ret = mbedtls_pk_verify( &pk_cxt, md_alg, hash, hashlen,
-                                 signer->sig.p,
-                                 signer->sig.len );
-        if( ret == 0 )
-            return( ret );
+        if( pkcs7_signer_identifies_cert( pkcs7, signer, cert ) )
+        {
+            ret = mbedtls_pk_verify( &pk_cxt, md_alg, hash, hashlen,
+                                     signer->sig.p,
+                                     signer->sig.len );
+            if( ret == 0 )
+                return( ret );
+        }
         signer = signer->next;
     }
     return ( ret );
@@ -7,6 +7,8 @@
 #include <stdint.h>
 
 struct secvar;
+/* State of one run of processing, see secvarctl's include/context.h */
+struct secvarctl_ctx;
 
 struct secvar_storage_driver {
 	int (*load_bank)(struct list_head *bank, int section);
@@ -18,15 +20,18 @@ struct secvar_storage_driver {
 
 struct secvar_backend_driver {
 	/* Perform any pre-processing stuff (e.g. determine secure boot state) */
-	int (*pre_process)(struct list_head *variable_bank,
+	int (*pre_process)(struct secvarctl_ctx *ctx,
+			   struct list_head *variable_bank,
 			   struct list_head *update_bank);
 
 	/* Process all updates */
-	int (*process)(struct list_head *variable_bank,
+	int (*process)(struct secvarctl_ctx *ctx,
+		       struct list_head *variable_bank,
 		       struct list_head *update_bank);
 
 	/* Perform any post-processing stuff (e.g. derive/update variables)*/
-	int (*post_process)(struct list_head *variable_bank,
+	int (*post_process)(struct secvarctl_ctx *ctx,
+			    struct list_head *variable_bank,
 			    struct list_head *update_bank);
 
 	/* Validate a single variable, return boolean */
@@ -24,14 +24,118 @@
 #include "prlog.h"
 #include "libstb/secvar/crypto/crypto.h"
 #include "edk2.h"
+#include "stats.h"
+#include "context.h"
+
+/*
+ * Authority certificates parsed while verifying updates, in the cert_cache
+ * of the context. The certificates of an authority variable are all parsed
+ * the first time it is used and indexed by serial number and public key, so
+ * the signers of a PKCS7 are looked up instead of checked against every
+ * certificate, no matter how many updates are verified.
+ *
+ * If the context keeps its cache, process only detaches the certificates
+ * from the variables when it is done. A later run finds them again by the
+ * contents of its authority variables, so the jobs of a batch parse the
+ * certificates of the same PK and KEK once.
+ */
+struct cached_cert {
+	crypto_x509 *x509;
+	int esl;
+	const unsigned char *serial, *pk;
+	size_t serial_len, pk_len;
+};
+
+struct cert_cache_entry {
+	struct list_node link;
+	/* NULL once released */
+	const struct secvar *var;
+	/* copy of the variable if the context keeps its cache */
+	char *data;
+	uint64_t data_size;
+	int count;
+	/* in the order of the variable */
+	struct cached_cert *certs;
+	/* the same certificates sorted by serial number and by public key */
+	struct cached_cert **by_serial;
+	struct cached_cert **by_pk;
+};
+
+static void free_cert_cache_entry(struct cert_cache_entry *entry)
+{
+	for (int i = 0; i < entry->count; i++)
+		crypto_x509_free(entry->certs[i].x509);
+	free(entry->certs);
+	free(entry->by_serial);
+	free(entry->by_pk);
+	free(entry->data);
+	free(entry);
+}
+
+void clear_cert_cache(struct secvarctl_ctx *ctx)
+{
+	struct cert_cache_entry *entry, *next;
+
+	list_for_each_safe(&ctx->cert_cache, entry, next, link) {
+		list_del(&entry->link);
+		free_cert_cache_entry(entry);
+	}
+	ctx->cert_cache_bank = NULL;
+}
+
+/* Authority variables a kept cache holds the certificates of, the least
+ * recently used ones are freed beyond that */
+#define CERT_CACHE_KEEP	8
+
+void release_cert_cache(struct secvarctl_ctx *ctx)
+{
+	struct cert_cache_entry *entry, *next;
+	int count = 0;
+
+	if (!ctx->keep_cert_cache) {
+		clear_cert_cache(ctx);
+		return;
+	}
+
+	list_for_each(&ctx->cert_cache, entry, link) {
+		entry->var = NULL;
+		count++;
+	}
+	/* Used entries are moved to the tail, so the head is the oldest */
+	list_for_each_safe(&ctx->cert_cache, entry, next, link) {
+		if (count-- <= CERT_CACHE_KEEP)
+			break;
+		list_del(&entry->link);
+		free_cert_cache_entry(entry);
+	}
+	ctx->cert_cache_bank = NULL;
+}
 
+void move_cert_cache(struct secvarctl_ctx *to, struct secvarctl_ctx *from)
+{
+	struct cert_cache_entry *entry, *next;
 
+	release_cert_cache(from);
+	list_for_each_safe(&from->cert_cache, entry, next, link) {
+		list_del(&entry->link);
+		list_add_tail(&to->cert_cache, &entry->link);
+	}
+}
 
+/* Drop the cache if an authority variable of the bank it came from changes */
+static void invalidate_cert_cache(struct secvarctl_ctx *ctx, const char *key,
+				  const struct list_head *bank)
+{
+	if (bank != ctx->cert_cache_bank)
+		return;
 
-bool setup_mode;
+	if (key_equals(key, "PK") || key_equals(key, "KEK"))
+		release_cert_cache(ctx);
+}
 
-int update_variable_in_bank(struct secvar *update_var, const char *data,
-			    const uint64_t dsize, struct list_head *bank)
+int update_variable_in_bank(struct secvarctl_ctx *ctx, struct secvar *update_var,
+			    const char *data, const uint64_t dsize,
+			    struct list_head *bank)
 {
 	struct secvar *var;
 
@@ -39,10 +143,9 @@ int update_variable_in_bank(struct secvar *update_var, const char *data,
 	if (!var)
 		return OPAL_EMPTY;
 
-        /* Reallocate the data memory, if there is change in data size */
-	if (var->data_size < dsize)
-		if (realloc_secvar(var, dsize))
-			return OPAL_NO_MEM;
+        /* Reallocate the data memory, if there is change in data size or it is shared */
+	if (unshare_secvar(var, dsize, false))
+		return OPAL_NO_MEM;
 
 	if (dsize && data)
 		memcpy(var->data, data, dsize);
@@ -57,6 +160,8 @@ int update_variable_in_bank(struct secvar *update_var, const char *data,
 	if (key_equals(update_var->key, "PK") || key_equals(update_var->key, "HWKH"))
 		var->flags |= SECVAR_FLAG_PROTECTED;
 
+	invalidate_cert_cache(ctx, update_var->key, bank);
+
 	return 0;
 }
 
@@ -109,59 +214,223 @@ EFI_SIGNATURE_LIST* get_esl_signature_list(const char *buf, size_t buflen)
 	return list;
 }
 
-/* Returns the size of the complete ESL. */
-static int32_t get_esl_signature_list_size(const char *buf, const size_t buflen)
+/* 
+ * Copies the certificate of the first entry of the ESL into cert buffer and
+ * returns the size of the certificate
+ */
+int get_esl_cert(const char *buf, const size_t buflen, char **cert)
 {
-	EFI_SIGNATURE_LIST *list = get_esl_signature_list(buf, buflen);
+	struct esl_iter iter;
+	struct esl_entry entry;
 
-	if (!list)
+	assert(cert != NULL);
+
+	/* The iterator checks the entry lies within buf */
+	esl_iter_init(&iter, buf, buflen);
+	if (esl_iter_next_list(&iter, NULL) != OPAL_SUCCESS
+	    || esl_iter_next_entry(&iter, &entry) != OPAL_SUCCESS)
 		return OPAL_PARAMETER;
 
-	/*prlog(PR_DEBUG, "size of signature list size is %u\n",
-			le32_to_cpu(list->SignatureListSize));*/ //NICK WAS HERE
+	*cert = zalloc(entry.data_size);
+	if (!(*cert))
+		return OPAL_NO_MEM;
 
-	return le32_to_cpu(list->SignatureListSize);
+	/* Since buf can have more than one ESL, copy only the size calculated
+	 * to return single ESL */
+	memcpy(*cert, entry.data, entry.data_size);
+
+	return entry.data_size;
 }
 
-/* 
- * Copies the certificate from the ESL into cert buffer and returns the size
- * of the certificate
- */
-int get_esl_cert(const char *buf, const size_t buflen, char **cert)
+void esl_iter_init(struct esl_iter *iter, const char *buf, size_t buflen)
 {
-	size_t sig_data_offset;
-	size_t size;
-	EFI_SIGNATURE_LIST *list = get_esl_signature_list(buf, buflen);
+	assert(iter != NULL);
+
+	memset(iter, 0, sizeof(*iter));
+	iter->buf = buf;
+	iter->buflen = buf ? buflen : 0;
+}
 
-	if (!list)
+int esl_iter_next_list(struct esl_iter *iter, const EFI_SIGNATURE_LIST **list)
+{
+	const EFI_SIGNATURE_LIST *next;
+	size_t remaining, list_size, header_size, sig_size;
+
+	assert(iter != NULL);
+
+	iter->list = NULL;
+	remaining = iter->buflen - iter->next_list;
+	if (!remaining)
+		return OPAL_EMPTY;
+
+	if (remaining < sizeof(EFI_SIGNATURE_LIST)) {
+		prlog(PR_ERR, "ERROR: ESL has %zd bytes and is smaller than an ESL (%zd bytes), "
+		      "remaining data not parsed\n", remaining, sizeof(EFI_SIGNATURE_LIST));
 		return OPAL_PARAMETER;
+	}
 
-	assert(cert != NULL);
+	next = (const EFI_SIGNATURE_LIST *)(iter->buf + iter->next_list);
+	list_size = le32_to_cpu(next->SignatureListSize);
+	header_size = le32_to_cpu(next->SignatureHeaderSize);
+	sig_size = le32_to_cpu(next->SignatureSize);
 
-	size = le32_to_cpu(list->SignatureSize) - sizeof(uuid_t);
+	if (list_size > remaining) {
+		prlog(PR_ERR, "ERROR: Sig list size is greater than remaining data size: "
+		      "%zd > %zd\n", list_size, remaining);
+		return OPAL_PARAMETER;
+	}
 
-	/*prlog(PR_DEBUG,"size of signature list size is %u\n",
-			le32_to_cpu(list->SignatureListSize));
-	prlog(PR_DEBUG, "size of signature header size is %u\n",
-			le32_to_cpu(list->SignatureHeaderSize));
-	prlog(PR_DEBUG, "size of signature size is %u\n",
-			le32_to_cpu(list->SignatureSize));*/ //NICK WAS HERE
+	/* Every entry holds an owner GUID followed by at least one byte of data */
+	if (sig_size <= sizeof(uuid_t)) {
+		prlog(PR_ERR, "ERROR: Signature Size was too small, no data\n");
+		return OPAL_PARAMETER;
+	}
 
-	sig_data_offset = sizeof(EFI_SIGNATURE_LIST)
-			  + le32_to_cpu(list->SignatureHeaderSize)
-			  + 16 * sizeof(uint8_t);
-	if (sig_data_offset > buflen)
+	/* Compare step by step so the header fields can not overflow the sum */
+	if (list_size < sizeof(EFI_SIGNATURE_LIST)
+	    || header_size > list_size - sizeof(EFI_SIGNATURE_LIST)
+	    || sig_size > list_size - sizeof(EFI_SIGNATURE_LIST) - header_size) {
+		prlog(PR_ERR, "ERROR: Sig List is not structured correctly, defined size "
+		      "and actual sizes are mismatched\n");
 		return OPAL_PARAMETER;
+	}
 
-	*cert = zalloc(size);
-	if (!(*cert))
+	/* The entries must fill the list, bytes left after the last one are not skipped */
+	if ((list_size - sizeof(EFI_SIGNATURE_LIST) - header_size) % sig_size) {
+		prlog(PR_ERR, "ERROR: Sig List size is not a multiple of Signature Size, "
+		      "%zd bytes after the last entry\n",
+		      (list_size - sizeof(EFI_SIGNATURE_LIST) - header_size) % sig_size);
+		return OPAL_PARAMETER;
+	}
+
+	iter->list = next;
+	iter->next_entry = iter->next_list + sizeof(EFI_SIGNATURE_LIST) + header_size;
+	iter->list_end = iter->next_list + list_size;
+	iter->next_list = iter->list_end;
+
+	if (list)
+		*list = next;
+
+	return OPAL_SUCCESS;
+}
+
+int esl_iter_next_entry(struct esl_iter *iter, struct esl_entry *entry)
+{
+	size_t sig_size;
+
+	assert(iter != NULL && entry != NULL);
+
+	if (!iter->list)
+		return OPAL_EMPTY;
+
+	sig_size = le32_to_cpu(iter->list->SignatureSize);
+	if (sig_size > iter->list_end - iter->next_entry)
+		return OPAL_EMPTY;
+
+	entry->type = &iter->list->SignatureType;
+	entry->owner = (const uuid_t *)(iter->buf + iter->next_entry);
+	entry->data = (const unsigned char *)(iter->buf + iter->next_entry
+					      + sizeof(uuid_t));
+	entry->data_size = sig_size - sizeof(uuid_t);
+	iter->next_entry += sig_size;
+
+	return OPAL_SUCCESS;
+}
+
+int esl_entry_cmp(const void *a, const void *b)
+{
+	const struct esl_entry *x = a, *y = b;
+	int rc;
+
+	if (x->data_size != y->data_size)
+		return x->data_size < y->data_size ? -1 : 1;
+
+	rc = memcmp(x->type, y->type, UUID_SIZE);
+	if (rc)
+		return rc;
+
+	return memcmp(x->data, y->data, x->data_size);
+}
+
+int get_esl_entries(const char *buf, size_t buflen, struct esl_entry **entries)
+{
+	struct esl_iter iter;
+	struct esl_entry entry;
+	int count = 0, i = 0;
+	int rc;
+
+	*entries = NULL;
+
+	/* Count first so the array is allocated once */
+	esl_iter_init(&iter, buf, buflen);
+	while ((rc = esl_iter_next_list(&iter, NULL)) == OPAL_SUCCESS)
+		while (esl_iter_next_entry(&iter, &entry) == OPAL_SUCCESS)
+			count++;
+
+	if (rc != OPAL_EMPTY)
+		return rc;
+
+	if (!count)
+		return 0;
+
+	*entries = zalloc(count * sizeof(**entries));
+	if (!*entries)
 		return OPAL_NO_MEM;
 
-	/* Since buf can have more than one ESL, copy only the size calculated
-	 * to return single ESL */
-	memcpy(*cert, buf + sig_data_offset, size);
+	esl_iter_init(&iter, buf, buflen);
+	while (esl_iter_next_list(&iter, NULL) == OPAL_SUCCESS)
+		while (esl_iter_next_entry(&iter, &(*entries)[i]) == OPAL_SUCCESS)
+			i++;
 
-	return size;
+	qsort(*entries, count, sizeof(**entries), esl_entry_cmp);
+
+	return count;
+}
+
+int copy_new_esl_entries(const struct esl_entry *known, int known_count,
+			 const char *esl, size_t esl_size, char *out)
+{
+	const EFI_SIGNATURE_LIST *list;
+	EFI_SIGNATURE_LIST *out_list;
+	struct esl_iter iter;
+	struct esl_entry entry;
+	size_t offset = 0, start, header_size;
+	int rc;
+
+	esl_iter_init(&iter, esl, esl_size);
+	while ((rc = esl_iter_next_list(&iter, &list)) == OPAL_SUCCESS) {
+		/* Keep the list and signature headers, the list size is fixed below */
+		start = offset;
+		header_size = sizeof(EFI_SIGNATURE_LIST)
+			      + le32_to_cpu(list->SignatureHeaderSize);
+		memcpy(out + offset, list, header_size);
+		offset += header_size;
+
+		while (esl_iter_next_entry(&iter, &entry) == OPAL_SUCCESS) {
+			if (known_count && bsearch(&entry, known, known_count,
+						   sizeof(*known), esl_entry_cmp))
+				continue;
+
+			/* An entry is its owner GUID followed by the data */
+			memcpy(out + offset, entry.owner,
+			       sizeof(uuid_t) + entry.data_size);
+			offset += sizeof(uuid_t) + entry.data_size;
+		}
+
+		/* Drop the list if every entry of it is known */
+		if (offset == start + header_size) {
+			offset = start;
+			continue;
+		}
+
+		out_list = (EFI_SIGNATURE_LIST *)(out + start);
+		out_list->SignatureListSize = cpu_to_le32(offset - start);
+	}
+
+	if (rc != OPAL_EMPTY)
+		return rc;
+
+	return offset;
 }
 
 /* 
@@ -216,7 +485,7 @@ int get_auth_descriptor2(const void *buf, const size_t buflen, void **auth_buffe
 	return auth_buffer_size;
 }
 
-static bool validate_cert(char *signing_cert, int signing_cert_size)
+static bool validate_cert(const char *signing_cert, int signing_cert_size)
 {
 	//NICK CHILD removed direct mbedtls call, use general crypto
 	// mbedtls_x509_crt x509;
@@ -230,7 +499,7 @@ static bool validate_cert(char *signing_cert, int signing_cert_size)
 	/* If failure in parsing the certificate, exit */
 	// if(rc) {
 	// 	prlog(PR_ERR, "X509 certificate parsing failed %04x\n", rc);
-	x509 = crypto_x509_parse_der((unsigned char *)signing_cert, signing_cert_size);
+	x509 = crypto_x509_parse_der((const unsigned char *)signing_cert, signing_cert_size);
 	if (!x509) {
 		prlog(PR_ERR, "X509 certificate parsing failed\n");
 
@@ -279,83 +548,56 @@ static bool validate_hash(uuid_t type, int size)
 int validate_esl_list(const char *key, const char *esl, const size_t size)
 {
 	int count = 0;
-	int dsize;
-	char *data = NULL;
-	int eslvarsize = size;
-	int eslsize;
-	int rc = OPAL_SUCCESS;
-	int offset = 0;
-	EFI_SIGNATURE_LIST *list = NULL;
-
-	while (eslvarsize > 0) {
-		prlog(PR_DEBUG, "esl var size size is %d offset is %d\n", eslvarsize, offset);
-		if (eslvarsize < sizeof(EFI_SIGNATURE_LIST))
-			break;
-
-		/* Check Supported ESL Type */
-		list = get_esl_signature_list(esl, eslvarsize);
-
-		if (!list)
-			return OPAL_PARAMETER;
+	int rc;
+	struct esl_iter iter;
+	struct esl_entry entry;
+	const EFI_SIGNATURE_LIST *list;
 
+	/* One pass over the buffer, every entry is checked where it lies */
+	esl_iter_init(&iter, esl, size);
+	while ((rc = esl_iter_next_list(&iter, &list)) == OPAL_SUCCESS) {
 		prlog(PR_DEBUG, "size of signature list size is %u\n",
 				le32_to_cpu(list->SignatureListSize));
 
-		/* Calculate the size of the ESL */
-		eslsize = le32_to_cpu(list->SignatureListSize);
-
-		/* If could not extract the size */
-		if (eslsize <= 0) {
-			prlog(PR_ERR, "Invalid size of the ESL\n");
-			rc = OPAL_PARAMETER;
-			break;
-		}
-
-		/* Extract the certificate from the ESL */
-		dsize = get_esl_cert(esl, eslvarsize, &data);
-		if (dsize < 0) {
-			rc = dsize;
-			break;
-		}
-
+		/*
+		 * Check Supported ESL Type. Type and entry size are shared by
+		 * the whole list, so a hash list is checked once
+		 */
 		if (key_equals(key, "dbx")) {
-			if (!validate_hash(list->SignatureType, dsize)) {
+			if (!validate_hash(list->SignatureType,
+					   le32_to_cpu(list->SignatureSize) - sizeof(uuid_t))) {
 				prlog(PR_ERR, "No valid hash is found\n");
-				rc = OPAL_PARAMETER;
-				break;
+				return OPAL_PARAMETER;
 			}
-		} else {
-		       if (!uuid_equals(&list->SignatureType, &EFI_CERT_X509_GUID)
-			   || !validate_cert(data, dsize)) {
-				prlog(PR_ERR, "No valid cert is found\n");
-				rc = OPAL_PARAMETER;
-				break;
-		       }
+			while (esl_iter_next_entry(&iter, &entry) == OPAL_SUCCESS)
+				count++;
+			continue;
 		}
 
-		count++;
-
-		/* Look for the next ESL */
-		offset = offset + eslsize;
-		eslvarsize = eslvarsize - eslsize;
-		free(data);
-		/* Since we are going to allocate again in the next iteration */
-		data = NULL;
-	}
-
-	if (rc == OPAL_SUCCESS) {
-		if (key_equals(key, "PK") && (count > 1)) {
-			prlog(PR_ERR, "PK can only be one\n");
-			rc = OPAL_PARAMETER;
-		} else {
-			rc = count;
+		if (!uuid_equals(&list->SignatureType, &EFI_CERT_X509_GUID)) {
+			prlog(PR_ERR, "No valid cert is found\n");
+			return OPAL_PARAMETER;
+		}
+		while (esl_iter_next_entry(&iter, &entry) == OPAL_SUCCESS) {
+			if (!validate_cert((const char *)entry.data, entry.data_size)) {
+				prlog(PR_ERR, "No valid cert is found\n");
+				return OPAL_PARAMETER;
+			}
+			count++;
 		}
 	}
 
-	free(data);
+	/* Anything but a clean end of the buffer is a malformed ESL */
+	if (rc != OPAL_EMPTY)
+		return rc;
 
-	prlog(PR_INFO, "Total ESLs are %d\n", rc);
-	return rc;
+	if (key_equals(key, "PK") && (count > 1)) {
+		prlog(PR_ERR, "PK can only be one\n");
+		return OPAL_PARAMETER;
+	}
+
+	prlog(PR_INFO, "Total ESL entries are %d\n", count);
+	return count;
 }
 
 /* Get the timestamp for the last update of the give key */
@@ -495,25 +737,251 @@ out:
 	return pkcs7;
 }
 
-/* Verify the PKCS7 signature on the signed data. */
-static int verify_signature(const struct efi_variable_authentication_2 *auth,
+/*
+ * Step to the next certificate of a variable, moving on to the next ESL when
+ * the current one runs out. esl_num is bumped for every ESL entered.
+ */
+static int next_esl_cert(struct esl_iter *iter, struct esl_entry *entry,
+			 int *esl_num)
+{
+	int rc;
+
+	while (esl_iter_next_entry(iter, entry) != OPAL_SUCCESS) {
+		rc = esl_iter_next_list(iter, NULL);
+		if (rc)
+			return rc;
+		(*esl_num)++;
+	}
+
+	return OPAL_SUCCESS;
+}
+
+/* Orders byte strings by length, then by content */
+static int compare_bytes(const unsigned char *a, size_t a_len,
+			 const unsigned char *b, size_t b_len)
+{
+	if (a_len != b_len)
+		return a_len < b_len ? -1 : 1;
+
+	return memcmp(a, b, a_len);
+}
+
+static int compare_serial(const void *a, const void *b)
+{
+	const struct cached_cert *x = *(struct cached_cert **)a;
+	const struct cached_cert *y = *(struct cached_cert **)b;
+
+	return compare_bytes(x->serial, x->serial_len, y->serial, y->serial_len);
+}
+
+static int compare_pk(const void *a, const void *b)
+{
+	const struct cached_cert *x = *(struct cached_cert **)a;
+	const struct cached_cert *y = *(struct cached_cert **)b;
+
+	return compare_bytes(x->pk, x->pk_len, y->pk, y->pk_len);
+}
+
+/*
+ * Parse every certificate of an authority variable and sort them by serial
+ * number and public key. Returns OPAL_SUCCESS, or an error if the variable
+ * holds a certificate that cannot be parsed.
+ */
+static int index_certs(struct cert_cache_entry *entry)
+{
+	struct cached_cert *cert, *certs;
+	struct esl_iter iter;
+	struct esl_entry esl_entry;
+	int esl_num, rc;
+
+	esl_iter_init(&iter, entry->var->data, entry->var->data_size);
+	for (esl_num = -1; (rc = next_esl_cert(&iter, &esl_entry, &esl_num)) == OPAL_SUCCESS;) {
+		certs = realloc(entry->certs, (entry->count + 1) * sizeof(*certs));
+		if (!certs)
+			return OPAL_NO_MEM;
+		entry->certs = certs;
+		cert = &certs[entry->count];
+		cert->esl = esl_num;
+		cert->x509 = crypto_x509_parse_der(esl_entry.data, esl_entry.data_size);
+		/* This should not happen, unless something corrupted in PNOR */
+		if (!cert->x509) {
+			prlog(PR_ERR, "X509 certificate parsing failed\n");
+			return OPAL_INTERNAL_ERROR;
+		}
+		entry->count++;
+		if (crypto_x509_get_serial(cert->x509, &cert->serial, &cert->serial_len) ||
+		    crypto_x509_get_pk_der(cert->x509, &cert->pk, &cert->pk_len))
+			return OPAL_INTERNAL_ERROR;
+	}
+	if (rc != OPAL_EMPTY)
+		return rc;
+
+	entry->by_serial = calloc(entry->count + 1, sizeof(*entry->by_serial));
+	entry->by_pk = calloc(entry->count + 1, sizeof(*entry->by_pk));
+	if (!entry->by_serial || !entry->by_pk)
+		return OPAL_NO_MEM;
+	for (int i = 0; i < entry->count; i++)
+		entry->by_serial[i] = entry->by_pk[i] = &entry->certs[i];
+	qsort(entry->by_serial, entry->count, sizeof(*entry->by_serial), compare_serial);
+	qsort(entry->by_pk, entry->count, sizeof(*entry->by_pk), compare_pk);
+
+	return OPAL_SUCCESS;
+}
+
+/*
+ * Returns the index of the certificates of an authority variable, building
+ * it on first use, or NULL on failure with the error in rc.
+ */
+static struct cert_cache_entry *get_cert_index(struct secvarctl_ctx *ctx,
+					       const struct list_head *bank,
+					       const struct secvar *avar, int *rc)
+{
+	struct cert_cache_entry *entry;
+
+	if (bank != ctx->cert_cache_bank) {
+		release_cert_cache(ctx);
+		ctx->cert_cache_bank = bank;
+	}
+
+	list_for_each(&ctx->cert_cache, entry, link) {
+		if (entry->var == avar)
+			return entry;
+	}
+
+	/* Certificates kept from an earlier run of the same variable */
+	list_for_each(&ctx->cert_cache, entry, link) {
+		if (!entry->var && entry->data_size == avar->data_size &&
+		    !memcmp(entry->data, avar->data, avar->data_size)) {
+			entry->var = avar;
+			list_del(&entry->link);
+			list_add_tail(&ctx->cert_cache, &entry->link);
+			return entry;
+		}
+	}
+
+	entry = zalloc(sizeof(struct cert_cache_entry));
+	if (!entry) {
+		*rc = OPAL_NO_MEM;
+		return NULL;
+	}
+	entry->var = avar;
+	*rc = index_certs(entry);
+	if (!*rc && ctx->keep_cert_cache) {
+		entry->data = malloc(avar->data_size + 1);
+		if (entry->data) {
+			memcpy(entry->data, avar->data, avar->data_size);
+			entry->data_size = avar->data_size;
+		} else {
+			*rc = OPAL_NO_MEM;
+		}
+	}
+	if (*rc) {
+		free_cert_cache_entry(entry);
+		return NULL;
+	}
+
+	list_add_tail(&ctx->cert_cache, &entry->link);
+
+	return entry;
+}
+
+/*
+ * Add the certificates of a sorted index whose serial number (or public key,
+ * with by_pk) is key to the candidates, given as positions in entry->certs.
+ */
+static int add_candidates(const struct cert_cache_entry *entry, bool by_pk,
+			  const unsigned char *key, size_t key_len,
+			  int **candidates, int *count)
+{
+	struct cached_cert **sorted = by_pk ? entry->by_pk : entry->by_serial;
+	const struct cached_cert *cert;
+	int low = 0, high = entry->count, mid, *grown;
+
+	/* first certificate that is not below key */
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		cert = sorted[mid];
+		if (by_pk ? compare_bytes(cert->pk, cert->pk_len, key, key_len) < 0
+			  : compare_bytes(cert->serial, cert->serial_len, key, key_len) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	for (; low < entry->count; low++) {
+		cert = sorted[low];
+		if (by_pk ? compare_bytes(cert->pk, cert->pk_len, key, key_len)
+			  : compare_bytes(cert->serial, cert->serial_len, key, key_len))
+			break;
+		grown = realloc(*candidates, (*count + 1) * sizeof(*grown));
+		if (!grown)
+			return OPAL_NO_MEM;
+		*candidates = grown;
+		(*candidates)[(*count)++] = cert - entry->certs;
+	}
+
+	return OPAL_SUCCESS;
+}
+
+static int compare_int(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * Find the certificates of the index a signer of the PKCS7 may name, in the
+ * order of the variable without duplicates. The caller frees candidates.
+ */
+static int find_signer_certs(const struct cert_cache_entry *entry,
+			     crypto_pkcs7 *pkcs7, int **candidates, int *count)
+{
+	const unsigned char *serial, *pk;
+	size_t serial_len, pk_len;
+	crypto_x509 *signer_cert;
+	int rc = OPAL_SUCCESS, unique = 0;
+
+	*candidates = NULL;
+	*count = 0;
+	for (int s = 0; !crypto_pkcs7_get_signer(pkcs7, s, &serial, &serial_len,
+						 &signer_cert); s++) {
+		rc = add_candidates(entry, false, serial, serial_len, candidates, count);
+		/* a reissued certificate keeps its key */
+		if (!rc && signer_cert && !crypto_x509_get_pk_der(signer_cert, &pk, &pk_len))
+			rc = add_candidates(entry, true, pk, pk_len, candidates, count);
+		if (rc)
+			return rc;
+	}
+
+	if (*count > 1)
+		qsort(*candidates, *count, sizeof(**candidates), compare_int);
+	for (int i = 0; i < *count; i++) {
+		if (!unique || (*candidates)[unique - 1] != (*candidates)[i])
+			(*candidates)[unique++] = (*candidates)[i];
+	}
+	*count = unique;
+
+	return OPAL_SUCCESS;
+}
+
+/*
+ * Verify the PKCS7 signature on the signed data. On success signer is set to
+ * the index of the ESL in avar holding the signing certificate.
+ */
+static int verify_signature(struct secvarctl_ctx *ctx,
+			    const struct efi_variable_authentication_2 *auth,
 			    const char *newcert, const size_t new_data_size,
-			    const struct secvar *avar)
+			    const struct secvar *avar,
+			    const struct list_head *bank, int *signer)
 {
 	//NICK CHILD removed direct mbedtls call, use general crypto
 	//mbedtls_pkcs7 *pkcs7 = NULL;
 	//mbedtls_x509_crt x509;
 	crypto_pkcs7 *pkcs7 = NULL;
-	crypto_x509 *x509 = NULL;
-
-	char *signing_cert = NULL;
-	char *x509_buf = NULL;
-	int signing_cert_size;
+	struct cert_cache_entry *index;
+	struct cached_cert *signing_cert;
 	int rc = 0;
-	char *errbuf;
-	int eslvarsize;
-	int eslsize;
-	int offset = 0;
+	int *candidates = NULL, count = 0;
+	char *errbuf, *desc;
+	uint64_t start;
 
 	if (!auth)
 		return OPAL_PARAMETER;
@@ -526,73 +994,46 @@ static int verify_signature(const struct efi_variable_authentication_2 *auth,
 
 	prlog(PR_INFO, "Load the signing certificate from the keystore\n");
 
-	eslvarsize = avar->data_size;
-
-	/* Variable is not empty */
-	while (eslvarsize > 0) {
-		if (eslvarsize < sizeof(EFI_SIGNATURE_LIST))
-			break;
-
-		/* Calculate the size of the ESL */
-		eslsize = get_esl_signature_list_size(avar->data + offset,
-						      eslvarsize);
-		/* If could not extract the size */
-		if (eslsize <= 0) {
-			rc = OPAL_PARAMETER;
-			break;
-		}
-
-		/* Extract the certificate from the ESL */
-		signing_cert_size = get_esl_cert(avar->data + offset,
-						 eslvarsize, &signing_cert);
-		if (signing_cert_size < 0) {
-			rc = signing_cert_size;
-			break;
-		}
+	index = get_cert_index(ctx, bank, avar, &rc);
+	if (!index)
+		goto out;
 
-		// NICK CHILD removed direct mbedtls call, use general crypto
-		// mbedtls_x509_crt_init(&x509);
-		// rc = mbedtls_x509_crt_parse(&x509,
-		// 			    (unsigned char *)signing_cert,
-		// 			    signing_cert_size);
-		// /* This should not happen, unless something corrupted in PNOR */
-		// if(rc) {
-		// 	prlog(PR_ERR, "X509 certificate parsing failed %04x\n", rc);
-		x509 = crypto_x509_parse_der((unsigned char *)signing_cert, signing_cert_size);
-		if (!x509) {
-			prlog(PR_ERR, "X509 certificate parsing failed\n");
+	/*
+	 * Only verify against the certificates a signer of the PKCS7 points
+	 * at, instead of one pk operation per ESL
+	 */
+	rc = find_signer_certs(index, pkcs7, &candidates, &count);
+	if (rc)
+		goto out;
 
-			rc = OPAL_INTERNAL_ERROR;
-			break;
+	rc = OPAL_PERMISSION;
+	for (int i = 0; i < count; i++) {
+		signing_cert = &index->certs[candidates[i]];
+		/* the serial number or key matched, the issuer may still differ */
+		if (!crypto_pkcs7_signer_matches(pkcs7, signing_cert->x509)) {
+			prlog(PR_DEBUG, "No signer in PKCS7 for ESL #%d\n",
+			      signing_cert->esl);
+			continue;
 		}
 
-		x509_buf = zalloc(CERT_BUFFER_SIZE);
-		// NICK CHILD removed direct mbedtls call, use general crypto
-		// rc = mbedtls_x509_crt_info(x509_buf,
-		// 			   CERT_BUFFER_SIZE,
-		// 			   "\tCRT:",
-		// 			   &x509);	//NICK ADDED \t
-		rc = crypto_x509_get_long_desc(x509_buf, CERT_BUFFER_SIZE, "\tCRT:", x509);
-		/* This should not happen, unless something corrupted in PNOR */
-		if (rc < 0) {
-			free(x509_buf);
-			rc = OPAL_INTERNAL_ERROR;
-			break;
+		if (logLevel() >= PR_INFO) {
+			desc = zalloc(CERT_BUFFER_SIZE);
+			if (desc && crypto_x509_get_long_desc(desc, CERT_BUFFER_SIZE, "\tCRT:",
+							      signing_cert->x509) >= 0)
+				prlog(PR_INFO, "%s \n", desc);
+			free(desc);
 		}
-
-		prlog(PR_INFO, "%s \n", x509_buf);
-		free(x509_buf);
-		x509_buf = NULL;
 		//NICK CHILD removed direct mbedtls call, use general crypto
 		// rc = mbedtls_pkcs7_signed_hash_verify(pkcs7, &x509, (unsigned char *)newcert, new_data_size);
-		rc = crypto_pkcs7_signed_hash_verify(pkcs7, x509, (unsigned char *)newcert, new_data_size);
+		start = statsStart();
+		rc = crypto_pkcs7_signed_hash_verify(pkcs7, signing_cert->x509,
+						     (unsigned char *)newcert, new_data_size);
+		statsEnd(STATS_PKCS7_VERIFY, start);
+		statsAdd(STATS_RSA_VERIFIES, 1);
 		/* If you find a signing certificate, you are done */
 		if (rc == 0) {
 			prlog(PR_INFO, "Signature Verification passed\n");
-			//NICK CHILD removed direct mbedtls call, use general crypto
-			// mbedtls_x509_crt_free(&x509);
-			crypto_x509_free(x509);
-
+			*signer = signing_cert->esl;
 			break;
 		} else {
 			//NICK CHILD removed direct mbedtls call, use general crypto
@@ -606,22 +1047,10 @@ static int verify_signature(const struct efi_variable_authentication_2 *auth,
 			free(errbuf);
 			rc = OPAL_PERMISSION;
 		}
-
-
-		/* Look for the next ESL */
-		offset = offset + eslsize;
-		eslvarsize = eslvarsize - eslsize;
-		//NICK CHILD removed direct mbedtls call, use general crypto
-		// mbedtls_x509_crt_free(&x509);
-		crypto_x509_free(x509);
-
-		free(signing_cert);
-		/* Since we are going to allocate again in the next iteration */
-		signing_cert = NULL;
-
 	}
 
-	free(signing_cert);
+out:
+	free(candidates);
 	//NICK CHILD removed direct mbedtls call, use general crypto
 	// mbedtls_pkcs7_free(pkcs7);
 	// free(pkcs7);
@@ -638,9 +1067,10 @@ static int verify_signature(const struct efi_variable_authentication_2 *auth,
  */
 static char *get_hash_to_verify(const char *key, const char *new_data,
 				const size_t new_data_size,
-				const struct efi_time *timestamp)
+				const struct efi_time *timestamp,
+				const uint32_t attributes)
 {
-	le32 attr = cpu_to_le32(SECVAR_ATTRIBUTES);
+	le32 attr = cpu_to_le32(attributes);
 	size_t varlen;
 	char *wkey;
 	uuid_t guid;
@@ -737,6 +1167,56 @@ out:
 	return (char *)hash;
 }
 
+/*
+ * An append write adds the entries of the update the variable does not hold
+ * yet to its current contents. newesl is replaced by the resulting data.
+ */
+static int append_to_variable(const struct secvar *update, char **newesl,
+			      int *new_data_size, struct list_head *bank)
+{
+	struct secvar *var;
+	struct esl_entry *known = NULL;
+	const char *current = NULL;
+	size_t current_size = 0;
+	char *merged;
+	int count, rc;
+
+	var = find_secvar(update->key, update->key_len, bank);
+	if (var) {
+		current = var->data;
+		current_size = var->data_size;
+	}
+
+	count = get_esl_entries(current, current_size, &known);
+	if (count < 0)
+		return count;
+
+	merged = zalloc(current_size + *new_data_size + 1);
+	if (!merged) {
+		free(known);
+		return OPAL_NO_MEM;
+	}
+
+	if (current_size)
+		memcpy(merged, current, current_size);
+	rc = copy_new_esl_entries(known, count, *newesl, *new_data_size,
+				  merged + current_size);
+	free(known);
+	if (rc < 0) {
+		free(merged);
+		return rc;
+	}
+
+	prlog(PR_INFO, "Append write adds %d of %d bytes to %s\n", rc,
+	      *new_data_size, update->key);
+
+	free(*newesl);
+	*newesl = merged;
+	*new_data_size = current_size + rc;
+
+	return OPAL_SUCCESS;
+}
+
 bool is_pkcs7_sig_format(const void *data)
 {
 	const struct efi_variable_authentication_2 *auth = data;
@@ -745,8 +1225,14 @@ bool is_pkcs7_sig_format(const void *data)
 	return !memcmp(&auth->auth_info.cert_type, &pkcs7_guid, 16);
 }
 
-int process_update(const struct secvar *update, char **newesl,
-		   int *new_data_size, struct efi_time *timestamp,
+/* Attributes an update can be signed with, in the order they are tried */
+static const uint32_t update_attributes[] = {
+	SECVAR_ATTRIBUTES,
+	SECVAR_ATTRIBUTES | EFI_VARIABLE_APPEND_WRITE,
+};
+
+int process_update(struct secvarctl_ctx *ctx, const struct secvar *update,
+		   char **newesl, int *new_data_size, struct efi_time *timestamp,
 		   struct list_head *bank, char *last_timestamp)
 {
 	struct efi_variable_authentication_2 *auth = NULL;
@@ -757,7 +1243,11 @@ int process_update(const struct secvar *update, char **newesl,
 	size_t tbhbuffersize = 0;
 	struct secvar *avar = NULL;
 	int rc = 0;
+	int signer;
 	int i;
+	size_t a;
+	uint64_t start;
+	bool append = false;
 
 	/* We need to split data into authentication descriptor and new ESL */
 	auth_buffer_size = get_auth_descriptor2(update->data,
@@ -808,46 +1298,69 @@ int process_update(const struct secvar *update, char **newesl,
 		goto out;
 	}
 
-	if (setup_mode) {
+	if (ctx->setup_mode) {
 		rc = OPAL_SUCCESS;
 		goto out;
 	}
 
-	/* Prepare the data to be verified */
-	tbhbuffer = get_hash_to_verify(update->key, *newesl, *new_data_size,
-				timestamp);
-	if (!tbhbuffer) {
-		rc = OPAL_INTERNAL_ERROR;
-		goto out;
-	}
-
 	/* Get the authority to verify the signature */
 	get_key_authority(key_authority, update->key);
 
 	/*
-	 * Try for all the authorities that are allowed to sign.
-	 * For eg. db/dbx can be signed by both PK or KEK
+	 * The attributes are not part of the update, only of the signed data.
+	 * Try a plain write first, then an append write for the variables that
+	 * can be appended to. In setup mode nothing is signed, so there an
+	 * update always replaces the variable.
 	 */
-	for (i = 0; key_authority[i] != NULL; i++) {
-		prlog(PR_DEBUG, "update key is %s\n", update->key); //changed by NICK for clarity
-		prlog(PR_DEBUG, "key authority is %s\n", key_authority[i]);
-		avar = find_secvar(key_authority[i],
-				    strlen(key_authority[i]) + 1,
-				    bank);
-		if (!avar || !avar->data_size)
-			continue;
+	for (a = 0; a < sizeof(update_attributes) / sizeof(update_attributes[0]); a++) {
+		append = update_attributes[a] & EFI_VARIABLE_APPEND_WRITE;
+		if (append && key_equals(update->key, "PK"))
+			break;
 
-		/* Verify the signature */
-		rc = verify_signature(auth, tbhbuffer, tbhbuffersize,
-				      avar);
+		/* Prepare the data to be verified */
+		start = statsStart();
+		tbhbuffer = get_hash_to_verify(update->key, *newesl, *new_data_size,
+					timestamp, update_attributes[a]);
+		statsEnd(STATS_HASH_TO_VERIFY, start);
+		if (!tbhbuffer) {
+			rc = OPAL_INTERNAL_ERROR;
+			goto out;
+		}
 
-		/* Break if signature verification is successful */
-		if (rc == OPAL_SUCCESS) {
-			printf("Update for %s is correctly signed by current %s\n", update->key, key_authority[i]); //changed by NICK for clarity
-			break;
+		/*
+		 * Try for all the authorities that are allowed to sign.
+		 * For eg. db/dbx can be signed by both PK or KEK
+		 */
+		for (i = 0; key_authority[i] != NULL; i++) {
+			prlog(PR_DEBUG, "update key is %s\n", update->key); //changed by NICK for clarity
+			prlog(PR_DEBUG, "key authority is %s\n", key_authority[i]);
+			avar = find_secvar(key_authority[i],
+					    strlen(key_authority[i]) + 1,
+					    bank);
+			if (!avar || !avar->data_size)
+				continue;
+
+			/* Verify the signature */
+			rc = verify_signature(ctx, auth, tbhbuffer,
+					      tbhbuffersize, avar, bank, &signer);
+
+			/* Break if signature verification is successful */
+			if (rc == OPAL_SUCCESS) {
+				reportUpdateSigner(ctx, update->key,
+						   key_authority[i], signer, append);
+				break;
+			}
 		}
+
+		free(tbhbuffer);
+		tbhbuffer = NULL;
+		if (rc == OPAL_SUCCESS)
+			break;
 	}
 
+	if (rc == OPAL_SUCCESS && append)
+		rc = append_to_variable(update, newesl, new_data_size, bank);
+
 out:
 	free(auth_buffer);
 	free(tbhbuffer);
@@ -46,12 +46,27 @@
 #define key_equals(a,b) (!strncmp(a, b, EDK2_MAX_KEY_LEN))
 #define uuid_equals(a,b) (!memcmp(a, b, UUID_SIZE))
 
-extern bool setup_mode;
-extern struct list_head staging_bank;
+/*
+ * The state of processing, setup mode, the staging bank and the certificate
+ * cache, lives in a context of secvarctl given to every function that needs
+ * it, see include/context.h
+ */
+struct secvarctl_ctx;
 
 /* Update the variable in the variable bank with the new value. */
-int update_variable_in_bank(struct secvar *update_var, const char *data,
-			    uint64_t dsize, struct list_head *bank);
+int update_variable_in_bank(struct secvarctl_ctx *ctx, struct secvar *update_var,
+			    const char *data, uint64_t dsize,
+			    struct list_head *bank);
+
+/* Free the authority certificates parsed while processing updates */
+void clear_cert_cache(struct secvarctl_ctx *ctx);
+
+/* Detach the certificates from the variables they were parsed from, they are
+ * freed unless the context keeps them */
+void release_cert_cache(struct secvarctl_ctx *ctx);
+
+/* Move the kept certificates of one context to another */
+void move_cert_cache(struct secvarctl_ctx *to, struct secvarctl_ctx *from);
 
 /* This function outputs the Authentication 2 Descriptor in the
  * auth_buffer and returns the size of the buffer. Please refer to
@@ -73,8 +88,8 @@ int check_timestamp(const char *key, const struct efi_time *timestamp, char *las
 bool is_pkcs7_sig_format(const void *data);
 
 /* Process the update */
-int process_update(const struct secvar *update, char **newesl,
-		   int *neweslsize, struct efi_time *timestamp,
+int process_update(struct secvarctl_ctx *ctx, const struct secvar *update,
+		   char **newesl, int *neweslsize, struct efi_time *timestamp,
 		   struct list_head *bank, char *last_timestamp);
 
 
@@ -90,8 +105,8 @@ int process_update(const struct secvar *update, char **newesl,
 EFI_SIGNATURE_LIST* get_esl_signature_list(const char *buf, size_t buflen);
 
 /**
- * Copies the certificate from the ESL into cert buffer and returns the size
- * of the certificate.
+ * Copies the certificate of the first entry of the ESL into cert buffer and
+ * returns the size of the certificate.
  * @param c Buffer containing an EFI Signature List
  * @param size size of buffer c
  * @param cert pointer to destination. Memory will be allocated for the certificate
@@ -99,10 +114,93 @@ EFI_SIGNATURE_LIST* get_esl_signature_list(const char *buf, size_t buflen);
  */
 int get_esl_cert(const char *buf, const size_t buflen, char **cert);
 
+/* Borrowed view of one EFI_SIGNATURE_DATA entry, points into the ESL buffer */
+struct esl_entry {
+	const uuid_t *type;		/* SignatureType of the enclosing list */
+	const uuid_t *owner;		/* SignatureOwner of the entry */
+	const unsigned char *data;	/* SignatureData of the entry */
+	size_t data_size;
+};
+
+/* Cursor over a buffer of appended ESL's, see esl_iter_init */
+struct esl_iter {
+	const char *buf;
+	size_t buflen;
+	size_t next_list;		/* offset of the next list in buf */
+	const EFI_SIGNATURE_LIST *list;	/* current list, NULL before the first */
+	size_t next_entry;		/* offset of the next entry of list in buf */
+	size_t list_end;		/* offset of the end of list in buf */
+};
+
+/**
+ * Prepare an iterator over a buffer of one or more appended ESL's.
+ * Nothing is copied, the buffer must outlive the iterator.
+ * @param iter iterator to initialize
+ * @param buf pointer to a buffer containing ESL's
+ * @param buflen length of buffer
+ */
+void esl_iter_init(struct esl_iter *iter, const char *buf, size_t buflen);
+
+/**
+ * Advance to the next ESL in the buffer. The header sizes are checked against
+ * the buffer so every entry of the list can be read without further checks.
+ * @param iter iterator set up with esl_iter_init
+ * @param list set to the new current list, may be NULL
+ * @return OPAL_SUCCESS if a list was found, OPAL_EMPTY at the end of the buffer
+ * @return OPAL_PARAMETER if the remaining data is not a well formed ESL
+ */
+int esl_iter_next_list(struct esl_iter *iter, const EFI_SIGNATURE_LIST **list);
+
+/**
+ * Advance to the next signature entry of the current ESL.
+ * @param iter iterator positioned on a list by esl_iter_next_list
+ * @param entry filled with pointers into the ESL buffer
+ * @return OPAL_SUCCESS if an entry was found, OPAL_EMPTY at the end of the list
+ */
+int esl_iter_next_entry(struct esl_iter *iter, struct esl_entry *entry);
+
+/**
+ * qsort/bsearch comparator for struct esl_entry. Entries are ordered by data
+ * size, type and data. The owner is ignored, an entry with the same type and
+ * data is a duplicate whoever owns it.
+ */
+int esl_entry_cmp(const void *a, const void *b);
+
+/**
+ * Collect every entry of a buffer of appended ESL's, sorted with esl_entry_cmp
+ * so they can be looked up with bsearch. The entries point into buf.
+ * @param buf pointer to a buffer containing ESL's, may be NULL if buflen is 0
+ * @param buflen length of buffer
+ * @param entries set to the allocated array, NULL if there are no entries
+ * @return number of entries or negative OPAL error code
+ */
+int get_esl_entries(const char *buf, size_t buflen, struct esl_entry **entries);
+
+/**
+ * Copy the ESL's of esl to out, leaving out every entry found in known.
+ * Lists left without entries are dropped. Entries of esl are not checked
+ * against each other.
+ * @param known sorted entries, see get_esl_entries
+ * @param known_count number of entries in known
+ * @param esl buffer containing ESL's
+ * @param esl_size length of esl
+ * @param out destination, must have room for esl_size bytes
+ * @return number of bytes written to out or negative OPAL error code
+ */
+int copy_new_esl_entries(const struct esl_entry *known, int known_count,
+			 const char *esl, size_t esl_size, char *out);
+
 /*
  * Extracts size of the PKCS7 signed data embedded in the
  * struct Authentication 2 Descriptor Header.
  */
 size_t get_pkcs7_len(const struct efi_variable_authentication_2 *auth);
 
+/*
+ * Reports the variable and ESL that signed an update, called once its
+ * signature is verified. Provided by secvarctl's verify command.
+ */
+void reportUpdateSigner(struct secvarctl_ctx *ctx, const char *key,
+			const char *authority, int esl, bool append);
+
 #endif
@@ -22,18 +22,17 @@
 //added by Nick Child, not official
 #include "edk2.h"
 #include "prlog.h"
+#include "context.h"
 #include <stdlib.h>
 
-
-struct list_head staging_bank;
-
 /*
  * Initializes supported variables as empty if not loaded from
  * storage. Variables are initialized as volatile if not found.
  * Updates should clear this flag.
  * Returns OPAL Error if anything fails in initialization
  */
-static int edk2_compat_pre_process(struct list_head *variable_bank,
+static int edk2_compat_pre_process(struct secvarctl_ctx *ctx,
+				   struct list_head *variable_bank,
 				   struct list_head *update_bank __unused)
 {
 	struct secvar *pkvar;
@@ -44,21 +43,22 @@ static int edk2_compat_pre_process(struct list_head *variable_bank,
 
 	pkvar = find_secvar("PK", 3, variable_bank);
 	if (!pkvar) {
-		pkvar = new_secvar("PK", 3, NULL, 0, SECVAR_FLAG_VOLATILE
-				| SECVAR_FLAG_PROTECTED);
+		pkvar = new_secvar_in(ctx->arena, "PK", 3, NULL, 0,
+				      SECVAR_FLAG_VOLATILE | SECVAR_FLAG_PROTECTED);
 		if (!pkvar)
 			return OPAL_NO_MEM;
 
 		list_add_tail(variable_bank, &pkvar->link);
 	}
 	if (pkvar->data_size == 0)
-		setup_mode = true;
+		ctx->setup_mode = true;
 	else
-		setup_mode = false;
+		ctx->setup_mode = false;
 
 	kekvar = find_secvar("KEK", 4, variable_bank);
 	if (!kekvar) {
-		kekvar = new_secvar("KEK", 4, NULL, 0, SECVAR_FLAG_VOLATILE);
+		kekvar = new_secvar_in(ctx->arena, "KEK", 4, NULL, 0,
+				       SECVAR_FLAG_VOLATILE);
 		if (!kekvar)
 			return OPAL_NO_MEM;
 
@@ -67,7 +67,8 @@ static int edk2_compat_pre_process(struct list_head *variable_bank,
 
 	dbvar = find_secvar("db", 3, variable_bank);
 	if (!dbvar) {
-		dbvar = new_secvar("db", 3, NULL, 0, SECVAR_FLAG_VOLATILE);
+		dbvar = new_secvar_in(ctx->arena, "db", 3, NULL, 0,
+				      SECVAR_FLAG_VOLATILE);
 		if (!dbvar)
 			return OPAL_NO_MEM;
 
@@ -76,7 +77,8 @@ static int edk2_compat_pre_process(struct list_head *variable_bank,
 
 	dbxvar = find_secvar("dbx", 4, variable_bank);
 	if (!dbxvar) {
-		dbxvar = new_secvar("dbx", 4, NULL, 0, SECVAR_FLAG_VOLATILE);
+		dbxvar = new_secvar_in(ctx->arena, "dbx", 4, NULL, 0,
+				       SECVAR_FLAG_VOLATILE);
 		if (!dbxvar)
 			return OPAL_NO_MEM;
 
@@ -103,7 +105,8 @@ static int edk2_compat_pre_process(struct list_head *variable_bank,
 	return OPAL_SUCCESS;
 };
 
-static int edk2_compat_process(struct list_head *variable_bank,
+static int edk2_compat_process(struct secvarctl_ctx *ctx,
+			       struct list_head *variable_bank,
 			       struct list_head *update_bank)
 {
 	struct secvar *var = NULL;
@@ -113,7 +116,7 @@ static int edk2_compat_process(struct list_head *variable_bank,
 	int neweslsize;
 	int rc = 0;
 
-	prlog(PR_INFO, "Setup mode = %d\n", setup_mode);
+	prlog(PR_INFO, "Setup mode = %d\n", ctx->setup_mode);
 
 	/* Check HW-KEY-HASH */ //NICK REMOVED THIS BC NO HW KEYS
 	/*if (!setup_mode) {
@@ -135,10 +138,13 @@ static int edk2_compat_process(struct list_head *variable_bank,
 
 	/*
 	 * Make a working copy of variable bank that is updated
-	 * during process
+	 * during process. The data is shared with variable bank
+	 * until an update replaces it.
 	 */
-	list_head_init(&staging_bank);
-	copy_bank_list(&staging_bank, variable_bank);
+	list_head_init(&ctx->staging_bank);
+	rc = copy_bank_list(&ctx->staging_bank, variable_bank);
+	if (rc)
+		goto cleanup;
 
 	/*
 	 * Loop through each command in the update bank.
@@ -147,14 +153,22 @@ static int edk2_compat_process(struct list_head *variable_bank,
 	 */
 
 	/* Read the TS variable first time and then keep updating it in-memory */
-	tsvar = find_secvar("TS", 3, &staging_bank);
+	tsvar = find_secvar("TS", 3, &ctx->staging_bank);
 
 	/*
 	 * We cannot find timestamp variable, did someone tamper it ?, return
 	 * OPAL_PERMISSION
 	 */
-	if (!tsvar)
-		return OPAL_PERMISSION;
+	if (!tsvar) {
+		rc = OPAL_PERMISSION;
+		goto cleanup;
+	}
+
+	/* The timestamps are written in place */
+	if (unshare_secvar(tsvar, tsvar->data_size, true)) {
+		rc = OPAL_NO_MEM;
+		goto cleanup;
+	}
 
 	list_for_each(update_bank, var, link) {
 
@@ -164,9 +178,9 @@ static int edk2_compat_process(struct list_head *variable_bank,
 		 */
 		prlog(PR_INFO, "Update for %s\n", var->key);
 
-		rc = process_update(var, &newesl,
+		rc = process_update(ctx, var, &newesl,
 				    &neweslsize, &timestamp,
-				    &staging_bank,
+				    &ctx->staging_bank,
 				    tsvar->data);
 		if (rc) {
 			prlog(PR_ERR, "Update processing failed with rc %04x\n", rc);
@@ -177,10 +191,10 @@ static int edk2_compat_process(struct list_head *variable_bank,
 		 * If reached here means, signature is verified so update the
 		 * value in the variable bank
 		 */
-		rc = update_variable_in_bank(var,
+		rc = update_variable_in_bank(ctx, var,
 					     newesl,
 					     neweslsize,
-					     &staging_bank);
+					     &ctx->staging_bank);
 		if (rc) {
 			prlog(PR_ERR, "Updating the variable data failed %04x\n", rc);
 			break;
@@ -221,13 +235,13 @@ static int edk2_compat_process(struct list_head *variable_bank,
 	if (rc == 0) {
 		/* Update the variable bank with updated working copy */
 		clear_bank_list(variable_bank);
-		copy_bank_list(variable_bank, &staging_bank);
+		move_bank_list(variable_bank, &ctx->staging_bank);
 	}
 
 	free(newesl);
-	clear_bank_list(&staging_bank);
+	release_cert_cache(ctx);
 
-	/* Set the global variable setup_mode as per final contents in variable_bank */
+	/* Set setup_mode of the context as per final contents in variable_bank */
 	var = find_secvar("PK", 3, variable_bank);
 	if (!var) {
 		/* This should not happen */
@@ -236,21 +250,23 @@ static int edk2_compat_process(struct list_head *variable_bank,
 	}
 
 	if (var->data_size == 0)
-		setup_mode = true;
+		ctx->setup_mode = true;
 	else
-		setup_mode = false;
+		ctx->setup_mode = false;
 
 cleanup:
 	/*
 	 * For any failure in processing update queue, we clear the update bank
 	 * and return failure
 	 */
+	clear_bank_list(&ctx->staging_bank);
 	clear_bank_list(update_bank);
 
 	return rc;
 }
 
-static int edk2_compat_post_process(struct list_head *variable_bank,
+static int edk2_compat_post_process(struct secvarctl_ctx *ctx __unused,
+				    struct list_head *variable_bank,
 				    struct list_head *update_bank __unused)
 {
 /*	struct secvar *hwvar; //NICK COMMENTED OUT, NO HW
@@ -11,10 +11,12 @@
 
 #include <mbedtls/pk_internal.h> // for validating cert pk data
 #include <mbedtls/error.h>
+#include <mbedtls/oid.h>
 #include "external/extraMbedtls/include/pkcs7.h"
 #include "external/extraMbedtls/include/generate-pkcs7.h"
 #include <mbedtls/platform.h>
 #include "generic.h"
+#include "include/stats.h"
 
 crypto_pkcs7 *crypto_pkcs7_parse_der(const unsigned char *buf, const int buflen)
 {
@@ -66,6 +68,44 @@ crypto_x509 *crypto_pkcs7_get_signing_cert(crypto_pkcs7 *pkcs7, int cert_num)
 	return pkcs7_cert;
 }
 
+int crypto_pkcs7_signer_matches(crypto_pkcs7 *pkcs7, crypto_x509 *x509)
+{
+	return mbedtls_pkcs7_has_signer(pkcs7, x509);
+}
+
+int crypto_pkcs7_get_signer(crypto_pkcs7 *pkcs7, int signer,
+			    const unsigned char **serial, size_t *serial_len,
+			    crypto_x509 **cert)
+{
+	const mbedtls_pkcs7_signer_info *info = pkcs7->signed_data.signers;
+	mbedtls_x509_crt *crt;
+
+	for (; info && signer > 0; signer--)
+		info = info->next;
+	if (!info || signer < 0)
+		return PKCS7_FAIL;
+
+	//the first certificate with the issuer and serial, as mbedtls_pkcs7_has_signer() picks it
+	*cert = NULL;
+	for (crt = &pkcs7->signed_data.certs; crt; crt = crt->next) {
+		if (crt->raw.p && crt->issuer_raw.len == info->issuer_raw.len &&
+		    crt->serial.len == info->serial.len &&
+		    !memcmp(crt->issuer_raw.p, info->issuer_raw.p, info->issuer_raw.len) &&
+		    !memcmp(crt->serial.p, info->serial.p, info->serial.len)) {
+			*cert = crt;
+			break;
+		}
+	}
+	*serial = info->serial.p;
+	*serial_len = info->serial.len;
+	if (*serial_len > 1 && **serial == 0) {
+		(*serial)++;
+		(*serial_len)--;
+	}
+
+	return SUCCESS;
+}
+
 int crypto_pkcs7_signed_hash_verify(crypto_pkcs7 *pkcs7, crypto_x509 *x509,
 				    unsigned char *hash, int hash_len)
 {
@@ -73,23 +113,91 @@ int crypto_pkcs7_signed_hash_verify(crypto_pkcs7 *pkcs7, crypto_x509 *x509,
 }
 
 int crypto_pkcs7_generate_w_signature(unsigned char **pkcs7, size_t *pkcs7Size,
-				      const unsigned char *newData,
-				      size_t newDataSize, const char **crtFiles,
+				      const unsigned char *newHash,
+				      size_t newHashSize, const char **crtFiles,
 				      const char **keyFiles, int keyPairs,
 				      int hashFunct)
 {
-	return to_pkcs7_generate_signature(pkcs7, pkcs7Size, newData,
-					   newDataSize, crtFiles, keyFiles,
+	return to_pkcs7_generate_signature(pkcs7, pkcs7Size, newHash,
+					   newHashSize, crtFiles, keyFiles,
 					   keyPairs, hashFunct);
 }
 
+struct crypto_pkcs7_signers {
+	int count;
+	int hashFunct;
+	mbedtls_x509_crt *x509s;
+	mbedtls_pk_context *keys;
+};
+
+int crypto_pkcs7_signers_load(crypto_pkcs7_signers **signers,
+			      const char **crtFiles, const char **keyFiles,
+			      int keyPairs, int hashFunct)
+{
+	int rc;
+	crypto_pkcs7_signers *ret;
+	unsigned char **keys = NULL, **crts = NULL;
+	size_t *keySizes = NULL, *crtSizes = NULL;
+
+	if (keyPairs == 0) {
+		prlog(PR_ERR,
+		      "ERROR: No signers given, cannot generate PKCS7\n");
+		return PKCS7_FAIL;
+	}
+	ret = calloc(1, sizeof(*ret));
+	if (!ret) {
+		prlog(PR_ERR, "ERROR: Failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	ret->count = keyPairs;
+	ret->hashFunct = hashFunct;
+	rc = getDERFromPEMFiles(keyFiles, keyPairs, &keys, &keySizes);
+	if (rc)
+		goto out;
+	rc = getDERFromPEMFiles(crtFiles, keyPairs, &crts, &crtSizes);
+	if (rc)
+		goto out;
+	//keys are parsed and checked against their certificates once, not per PKCS7
+	rc = parseSigners(crts, crtSizes, keys, keySizes, keyPairs, &ret->x509s,
+			  &ret->keys);
+	if (rc)
+		goto out;
+	*signers = ret;
+	ret = NULL;
+
+out:
+	freeDERs(keys, keySizes, keyPairs);
+	freeDERs(crts, crtSizes, keyPairs);
+	crypto_pkcs7_signers_free(ret);
+
+	return rc;
+}
+
+void crypto_pkcs7_signers_free(crypto_pkcs7_signers *signers)
+{
+	if (!signers)
+		return;
+	freeParsedSigners(signers->x509s, signers->keys, signers->count);
+	free(signers);
+}
+
+int crypto_pkcs7_generate_w_signers(unsigned char **pkcs7, size_t *pkcs7Size,
+				    const unsigned char *newHash,
+				    size_t newHashSize,
+				    crypto_pkcs7_signers *signers)
+{
+	return to_pkcs7_generate_signature_parsed(
+		pkcs7, pkcs7Size, newHash, newHashSize, signers->x509s,
+		signers->keys, signers->count, signers->hashFunct);
+}
+
 int crypto_pkcs7_generate_w_already_signed_data(
-	unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newData,
-	size_t newDataSize, const char **crtFiles, const char **sigFiles,
+	unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newHash,
+	size_t newHashSize, const char **crtFiles, const char **sigFiles,
 	int keyPairs, int hashFunct)
 {
-	return to_pkcs7_already_signed_data(pkcs7, pkcs7Size, newData,
-					    newDataSize, crtFiles, sigFiles,
+	return to_pkcs7_already_signed_data(pkcs7, pkcs7Size, newHash,
+					    newHashSize, crtFiles, sigFiles,
 					    keyPairs, hashFunct);
 }
 
@@ -157,6 +265,107 @@ int crypto_x509_get_long_desc(char *x509_info, size_t max_len, char *delim,
 	return mbedtls_x509_crt_info(x509_info, max_len, delim, x509);
 }
 
+/*
+ *appends size bytes of an attribute type or value to name as far as max_len allows, in values
+ *the characters RFC 4514 reserves are escaped, unprintable characters are written as '?'
+ */
+static void append_name_part(char *name, size_t max_len, size_t *len,
+			     const unsigned char *data, size_t size, int value)
+{
+	size_t i;
+
+	for (i = 0; i < size && *len + 1 < max_len; i++) {
+		if (value && data[i] && strchr(",+\"\\<>;", data[i])) {
+			if (*len + 2 >= max_len)
+				break;
+			name[(*len)++] = '\\';
+		}
+		name[(*len)++] = data[i] < 0x20 || data[i] == 0x7f ? '?' : data[i];
+	}
+	name[*len] = '\0';
+}
+
+int crypto_x509_get_name(crypto_x509 *x509, int issuer, char *name,
+			 size_t max_len)
+{
+	const mbedtls_x509_name *dn = issuer ? &x509->issuer : &x509->subject;
+	const char *type, *sep = NULL;
+	char oid[80];
+	size_t len = 0;
+
+	if (!max_len)
+		return CERT_FAIL;
+	name[0] = '\0';
+	//RDNs in certificate order, the attributes of a multi-valued RDN are joined by '+'
+	for (; dn; dn = dn->next) {
+		if (!dn->oid.p)
+			continue;
+		if (mbedtls_oid_get_attr_short_name(&dn->oid, &type)) {
+			if (mbedtls_oid_get_numeric_string(oid, sizeof(oid),
+							   &dn->oid) < 0) {
+				prlog(PR_ERR, "ERROR: could not get name of X509\n");
+				return CERT_FAIL;
+			}
+			type = oid;
+		}
+		if (sep)
+			append_name_part(name, max_len, &len,
+					 (const unsigned char *)sep, 1, 0);
+		sep = dn->next_merged ? "+" : ",";
+		append_name_part(name, max_len, &len, (const unsigned char *)type,
+				 strlen(type), 0);
+		append_name_part(name, max_len, &len, (const unsigned char *)"=", 1, 0);
+		append_name_part(name, max_len, &len, dn->val.p, dn->val.len, 1);
+	}
+
+	return len;
+}
+
+int crypto_x509_get_serial(crypto_x509 *x509, const unsigned char **serial,
+			   size_t *serial_len)
+{
+	*serial = x509->serial.p;
+	*serial_len = x509->serial.len;
+	//the DER integer has a zero byte in front when the top bit is set
+	if (*serial_len > 1 && **serial == 0) {
+		(*serial)++;
+		(*serial_len)--;
+	}
+
+	return SUCCESS;
+}
+
+int crypto_x509_get_pk_der(crypto_x509 *x509, const unsigned char **pk,
+			   size_t *pk_len)
+{
+	//the SubjectPublicKeyInfo, the bytes mbedtls_pkcs7_has_signer() compares
+	*pk = x509->pk_raw.p;
+	*pk_len = x509->pk_raw.len;
+
+	return *pk ? SUCCESS : CERT_FAIL;
+}
+
+//mbedtls_x509_time counts months from 1 and years from 0
+static void x509_time_to_tm(const mbedtls_x509_time *t, struct tm *out)
+{
+	memset(out, 0, sizeof(*out));
+	out->tm_year = t->year - 1900;
+	out->tm_mon = t->mon - 1;
+	out->tm_mday = t->day;
+	out->tm_hour = t->hour;
+	out->tm_min = t->min;
+	out->tm_sec = t->sec;
+}
+
+int crypto_x509_get_validity(crypto_x509 *x509, struct tm *not_before,
+			     struct tm *not_after)
+{
+	x509_time_to_tm(&x509->valid_from, not_before);
+	x509_time_to_tm(&x509->valid_to, not_after);
+
+	return SUCCESS;
+}
+
 crypto_x509 *crypto_x509_parse_der(const unsigned char *data, size_t data_len)
 {
 	int rc;
@@ -167,6 +376,7 @@ crypto_x509 *crypto_x509_parse_der(const unsigned char *data, size_t data_len)
 		return NULL;
 	}
 	mbedtls_x509_crt_init(x509);
+	statsAdd(STATS_X509_PARSES, 1);
 	rc = mbedtls_x509_crt_parse(x509, data, data_len);
 
 	if (rc) {
@@ -213,6 +423,7 @@ int crypto_md_ctx_init(crypto_md_ctx **ctx, int md_id)
 int crypto_md_update(crypto_md_ctx *ctx, const unsigned char *data,
 		     size_t data_len)
 {
+	statsAdd(STATS_BYTES_HASHED, data_len);
 	return mbedtls_md_update((mbedtls_md_context_t *)ctx, data, data_len);
 }
 
@@ -232,6 +443,7 @@ int crypto_md_generate_hash(const unsigned char *data, size_t size,
 			    int hashFunct, unsigned char **outHash,
 			    size_t *outHashSize)
 {
+	statsAdd(STATS_BYTES_HASHED, size);
 	//calls function in generate-pkcs7 (mbedtls specific)
 	return toHash(data, size, hashFunct, outHash, outHashSize);
 }
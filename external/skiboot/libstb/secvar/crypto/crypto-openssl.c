@@ -9,6 +9,7 @@
 #include "include/prlog.h"
 #include "include/err.h"
 #include "generic.h"
+#include "include/stats.h"
 
 #include <openssl/pkcs7.h>
 #include <openssl/x509.h>
@@ -104,14 +105,77 @@ crypto_x509 *crypto_pkcs7_get_signing_cert(crypto_pkcs7 *pkcs7, int cert_num)
 	return pkcs7_cert;
 }
 
+/*
+ *checks if the signer info names x509 by issuer and serial number, or if the signing
+ *certificate embedded in the pkcs7 for it carries the same public key as x509
+ *@return 1 if signer_info identifies x509, 0 otherwise
+ */
+static int signer_identifies_x509(crypto_pkcs7 *pkcs7, PKCS7_SIGNER_INFO *signer_info,
+				  crypto_x509 *x509)
+{
+	PKCS7_ISSUER_AND_SERIAL *ias = signer_info->issuer_and_serial;
+	X509 *signer_cert;
+
+	if (!ias)
+		return 0;
+	if (!X509_NAME_cmp(X509_get_issuer_name(x509), ias->issuer) &&
+	    !ASN1_INTEGER_cmp(X509_get_serialNumber(x509), ias->serial))
+		return 1;
+	// a reissued certificate keeps its key, so also match on the public key
+	signer_cert = X509_find_by_issuer_and_serial(pkcs7->d.sign->cert, ias->issuer,
+						     ias->serial);
+	if (!signer_cert)
+		return 0;
+
+	return !ASN1_STRING_cmp(X509_get0_pubkey_bitstr(signer_cert),
+				X509_get0_pubkey_bitstr(x509));
+}
+
+int crypto_pkcs7_signer_matches(crypto_pkcs7 *pkcs7, crypto_x509 *x509)
+{
+	int num_signers;
+	PKCS7_SIGNER_INFO *signer_info;
+
+	num_signers = sk_PKCS7_SIGNER_INFO_num(PKCS7_get_signer_info(pkcs7));
+	for (int s = 0; s < num_signers; s++) {
+		signer_info = sk_PKCS7_SIGNER_INFO_value(PKCS7_get_signer_info(pkcs7), s);
+		if (signer_info && signer_identifies_x509(pkcs7, signer_info, x509))
+			return 1;
+	}
+
+	return 0;
+}
+
+int crypto_pkcs7_get_signer(crypto_pkcs7 *pkcs7, int signer,
+			    const unsigned char **serial, size_t *serial_len,
+			    crypto_x509 **cert)
+{
+	PKCS7_SIGNER_INFO *signer_info;
+	PKCS7_ISSUER_AND_SERIAL *ias;
+
+	if (signer < 0 ||
+	    signer >= sk_PKCS7_SIGNER_INFO_num(PKCS7_get_signer_info(pkcs7)))
+		return PKCS7_FAIL;
+	signer_info = sk_PKCS7_SIGNER_INFO_value(PKCS7_get_signer_info(pkcs7), signer);
+	ias = signer_info ? signer_info->issuer_and_serial : NULL;
+	if (!ias)
+		return PKCS7_FAIL;
+	*serial = ASN1_STRING_get0_data(ias->serial);
+	*serial_len = ASN1_STRING_length(ias->serial);
+	*cert = X509_find_by_issuer_and_serial(pkcs7->d.sign->cert, ias->issuer,
+					       ias->serial);
+
+	return SUCCESS;
+}
+
 int crypto_pkcs7_signed_hash_verify(crypto_pkcs7 *pkcs7, crypto_x509 *x509,
 				    unsigned char *hash, int hash_len)
 {
 	//currently this function works and the mbedtls version currently perform the following steps
 	//  1. the hash, md context and given x509 are used to generated a signature
-	//  2. all of the signatures in the pkcs7 are compared to the signature generated by the x509
-	//  3. if any of the signatures in the pkcs7 match the genrated signature then return SUCCESS
-	int rc, exp_size, md_nid, num_signers;
+	//  2. the signatures of the signers identifying x509 are compared to the signature generated by the x509
+	//  3. if any of those signatures match the genrated signature then return SUCCESS
+	int rc = 0, exp_size, md_nid, num_signers;
 	unsigned char *exp_sig;
 	EVP_PKEY *pk;
 	EVP_PKEY_CTX *pk_ctx;
@@ -168,7 +232,7 @@ int crypto_pkcs7_signed_hash_verify(crypto_pkcs7 *pkcs7, crypto_x509 *x509,
 		hash_len = EVP_MD_size(evp_md);
 	}
 
-	//verify on all signatures in pkcs7
+	//verify on the signatures in pkcs7 that name this x509
 	num_signers = sk_PKCS7_SIGNER_INFO_num(PKCS7_get_signer_info(pkcs7));
 	for (int s = 0; s < num_signers; s++) {
 		//make sure we can get the signature data
@@ -182,6 +246,10 @@ int crypto_pkcs7_signed_hash_verify(crypto_pkcs7 *pkcs7, crypto_x509 *x509,
 			goto out;
 		}
 
+		// skip signers meant for other certificates, saves a pk operation each
+		if (!signer_identifies_x509(pkcs7, signer_info, x509))
+			continue;
+
 		exp_size = signer_info->enc_digest->length;
 		exp_sig = signer_info->enc_digest->data;
 
@@ -205,197 +273,322 @@ out:
 	return PKCS7_FAIL;
 }
 
-int crypto_pkcs7_generate_w_signature(unsigned char **pkcs7, size_t *pkcs7Size,
-				      const unsigned char *newData,
-				      size_t newDataSize, const char **crtFiles,
-				      const char **keyFiles, int keyPairs,
-				      int hashFunct)
+/*
+ *signs a precomputed digest with evp_pkey and stores the signature in the signer info,
+ *this is what PKCS7_final would do for a PKCS7_NOATTR signer without needing the data
+ *@return SUCCESS or err number
+ */
+static int sign_digest_for_signer(PKCS7_SIGNER_INFO *signer_info, EVP_PKEY *evp_pkey,
+				  const EVP_MD *evp_md, const unsigned char *hash,
+				  size_t hash_len)
+{
+	int rc = PKCS7_FAIL;
+	EVP_PKEY_CTX *pk_ctx;
+	unsigned char *sig = NULL;
+	size_t sig_len;
+
+	pk_ctx = EVP_PKEY_CTX_new(evp_pkey, NULL);
+	if (!pk_ctx || EVP_PKEY_sign_init(pk_ctx) <= 0 ||
+	    EVP_PKEY_CTX_set_rsa_padding(pk_ctx, RSA_PKCS1_PADDING) <= 0 ||
+	    EVP_PKEY_CTX_set_signature_md(pk_ctx, evp_md) <= 0) {
+		prlog(PR_ERR, "ERROR: Failed to setup pk context for signing\n");
+		goto out;
+	}
+	//first call only gets the signature length
+	if (EVP_PKEY_sign(pk_ctx, NULL, &sig_len, hash, hash_len) <= 0) {
+		prlog(PR_ERR, "ERROR: Failed to get signature length\n");
+		goto out;
+	}
+	sig = OPENSSL_malloc(sig_len);
+	if (!sig) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	if (EVP_PKEY_sign(pk_ctx, sig, &sig_len, hash, hash_len) <= 0) {
+		prlog(PR_ERR, "ERROR: Failed to sign digest\n");
+		goto out;
+	}
+	//signer info takes ownership of sig
+	ASN1_STRING_set0(signer_info->enc_digest, sig, sig_len);
+	sig = NULL;
+	rc = SUCCESS;
+out:
+	OPENSSL_free(sig);
+	EVP_PKEY_CTX_free(pk_ctx);
+
+	return rc;
+}
+
+struct crypto_pkcs7_signers {
+	int count;
+	const EVP_MD *evp_md;
+	EVP_PKEY **keys;
+	crypto_x509 **crts;
+};
+
+/*
+ *reads a PEM file and converts its contents to DER
+ *@param file, path to the PEM file
+ *@param der, the resulting DER buff, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param derSize, length of der
+ *@return SUCCESS or err number
+ */
+static int get_der_from_pem_file(const char *file, unsigned char **der,
+				 size_t *derSize)
 {
 	int rc;
-	PKCS7 *gen_pkcs7_struct = NULL;
-	BIO *bio = NULL, *out_bio = NULL;
-	EVP_PKEY *evp_pkey = NULL;
-	const EVP_MD *evp_md = NULL;
-	crypto_x509 *x509 = NULL;
-	size_t pkcs7_out_len;
-	unsigned char *keyPEM = NULL, *key = NULL, *keyTmp, *crtPEM = NULL,
-		      *crt = NULL, *out_bio_der = NULL;
-	size_t keySizePEM, keySize, crtSizePEM, crtSize;
+	unsigned char *pem;
+	size_t pemSize;
+
+	pem = (unsigned char *)getDataFromFile(file, &pemSize);
+	if (!pem) {
+		prlog(PR_ERR, "ERROR: failed to get data from file %s\n", file);
+		return INVALID_FILE;
+	}
+	rc = crypto_convert_pem_to_der(pem, pemSize, der, derSize);
+	if (rc)
+		prlog(PR_ERR, "Conversion for %s from PEM to DER failed\n",
+		      file);
+	free(pem);
+
+	return rc;
+}
+
+int crypto_pkcs7_signers_load(crypto_pkcs7_signers **signers,
+			      const char **crtFiles, const char **keyFiles,
+			      int keyPairs, int hashFunct)
+{
+	int rc;
+	crypto_pkcs7_signers *ret = NULL;
+	unsigned char *key = NULL, *crt = NULL;
+	const unsigned char *keyTmp;
+	size_t keySize, crtSize;
 
 	if (keyPairs == 0) {
 		prlog(PR_ERR,
 		      "ERROR: No signers given, cannot generate PKCS7\n");
 		return PKCS7_FAIL;
 	}
-
-	evp_md = EVP_get_digestbynid(hashFunct);
-	if (!evp_md) {
-		prlog(PR_ERR, "ERROR: Unknown NID (%d) for MD found in PKCS7\n",
-		      hashFunct);
-		return PKCS7_FAIL;
+	ret = calloc(1, sizeof(*ret));
+	if (!ret) {
+		prlog(PR_ERR, "ERROR: Failed to allocate memory\n");
+		return ALLOC_FAIL;
 	}
-
-	bio = BIO_new_mem_buf(newData, newDataSize);
-	if (!bio) {
-		prlog(PR_ERR,
-		      "ERROR: Failed to initialize new data BIO structure\n");
-		rc = PKCS7_FAIL;
+	ret->count = keyPairs;
+	ret->keys = calloc(keyPairs, sizeof(*ret->keys));
+	ret->crts = calloc(keyPairs, sizeof(*ret->crts));
+	if (!ret->keys || !ret->crts) {
+		prlog(PR_ERR, "ERROR: Failed to allocate memory\n");
+		rc = ALLOC_FAIL;
 		goto out;
 	}
-
-	gen_pkcs7_struct = PKCS7_sign(NULL, NULL, NULL, bio,
-				      PKCS7_PARTIAL | PKCS7_DETACHED);
-	if (!gen_pkcs7_struct) {
-		prlog(PR_ERR, "ERROR: Failed to initialize pkcs7 structure\n");
+	ret->evp_md = EVP_get_digestbynid(hashFunct);
+	if (!ret->evp_md) {
+		prlog(PR_ERR, "ERROR: Unknown NID (%d) for MD found in PKCS7\n",
+		      hashFunct);
 		rc = PKCS7_FAIL;
 		goto out;
 	}
-	//for every key pair get the data and add the signer to the pkcs7
 	for (int i = 0; i < keyPairs; i++) {
-		// get data of private keys
-		keyPEM = (unsigned char *)getDataFromFile(keyFiles[i],
-							  &keySizePEM);
-		if (!keyPEM) {
-			prlog(PR_ERR,
-			      "ERROR: failed to get data from priv key file %s\n",
-			      keyFiles[i]);
-			rc = INVALID_FILE;
-			goto out;
-		}
-		rc = crypto_convert_pem_to_der(
-			keyPEM, keySizePEM, (unsigned char **)&key, &keySize);
-		if (rc) {
-			prlog(PR_ERR,
-			      "Conversion for %s from PEM to DER failed\n",
-			      keyFiles[i]);
-			goto out;
-		}
-		//get data from crt
-		crtPEM = (unsigned char *)getDataFromFile(crtFiles[i],
-							  &crtSizePEM);
-		if (!keyPEM) {
-			prlog(PR_ERR,
-			      "ERROR: failed to get data from cert file %s\n",
-			      crtFiles[i]);
-			rc = INVALID_FILE;
-			goto out;
-		}
-		rc = crypto_convert_pem_to_der(
-			crtPEM, crtSizePEM, (unsigned char **)&crt, &crtSize);
-		if (rc) {
-			prlog(PR_ERR,
-			      "Conversion for %s from PEM to DER failed\n",
-			      crtFiles[i]);
-			goto out;
-		}
 		//get private key from private key DER buff
+		rc = get_der_from_pem_file(keyFiles[i], &key, &keySize);
+		if (rc)
+			goto out;
 		keyTmp = key;
-		evp_pkey = d2i_AutoPrivateKey(
-			NULL, (const unsigned char **)&keyTmp, keySize);
-		if (!evp_pkey) {
+		ret->keys[i] = d2i_AutoPrivateKey(NULL, &keyTmp, keySize);
+		if (!ret->keys[i]) {
 			prlog(PR_ERR,
 			      "ERROR: Failed to parse private key into EVP_PKEY openssl struct\n");
 			rc = INVALID_FILE;
 			goto out;
 		}
 		//get x509 from cert DER buff
-		x509 = crypto_x509_parse_der(crt, crtSize);
-		if (!x509) {
+		rc = get_der_from_pem_file(crtFiles[i], &crt, &crtSize);
+		if (rc)
+			goto out;
+		ret->crts[i] = crypto_x509_parse_der(crt, crtSize);
+		if (!ret->crts[i]) {
 			prlog(PR_ERR,
 			      "ERROR: Failed to parse certificate into x509 openssl struct\n");
 			rc = INVALID_FILE;
 			goto out;
 		}
-		//add the signature to the pkcs7
-		//returns NULL is failure
-		if (!PKCS7_sign_add_signer(gen_pkcs7_struct, x509, evp_pkey,
-					   evp_md, PKCS7_NOATTR)) {
+		//returns 1 if the key belongs to the certificate
+		if (X509_check_private_key(ret->crts[i], ret->keys[i]) != 1) {
 			prlog(PR_ERR,
-			      "ERROR: Failed to add signer to the pkcs7 structure\n");
-			rc = PKCS7_FAIL;
+			      "ERROR: Private key %s does not match certificate %s\n",
+			      keyFiles[i], crtFiles[i]);
+			rc = INVALID_FILE;
 			goto out;
 		}
-		//reset mem
-		free(keyPEM);
-		keyPEM = NULL;
 		free(key);
 		key = NULL;
-		free(crtPEM);
-		crtPEM = NULL;
-		EVP_PKEY_free(evp_pkey);
-		evp_pkey = NULL;
 		free(crt);
 		crt = NULL;
-		crypto_x509_free(x509);
-		x509 = NULL;
 	}
-	//finalize the struct, runs hashing and signatures
-	rc = PKCS7_final(gen_pkcs7_struct, bio, PKCS7_BINARY);
-	if (rc != 1) {
+	*signers = ret;
+	ret = NULL;
+	rc = SUCCESS;
+
+out:
+	free(key);
+	free(crt);
+	crypto_pkcs7_signers_free(ret);
+
+	return rc;
+}
+
+void crypto_pkcs7_signers_free(crypto_pkcs7_signers *signers)
+{
+	if (!signers)
+		return;
+	for (int i = 0; i < signers->count; i++) {
+		if (signers->keys)
+			EVP_PKEY_free(signers->keys[i]);
+		if (signers->crts)
+			crypto_x509_free(signers->crts[i]);
+	}
+	free(signers->keys);
+	free(signers->crts);
+	free(signers);
+}
+
+// the signatures of one PKCS7, made by sign_signer
+struct signer_jobs {
+	crypto_pkcs7_signers *signers;
+	const unsigned char *hash;
+	size_t hash_len;
+	PKCS7_SIGNER_INFO **signer_infos;
+	int *rcs;
+};
+
+//runInParallel callback, signs the digest for signer i
+static void sign_signer(void *ctx, int i)
+{
+	struct signer_jobs *jobs = ctx;
+
+	jobs->rcs[i] = sign_digest_for_signer(jobs->signer_infos[i],
+					      jobs->signers->keys[i],
+					      jobs->signers->evp_md, jobs->hash,
+					      jobs->hash_len);
+	if (!jobs->rcs[i])
+		statsAdd(STATS_RSA_SIGNS, 1);
+}
+
+int crypto_pkcs7_generate_w_signers(unsigned char **pkcs7, size_t *pkcs7Size,
+				    const unsigned char *newHash,
+				    size_t newHashSize,
+				    crypto_pkcs7_signers *signers)
+{
+	int rc, derSize;
+	PKCS7 *gen_pkcs7_struct = NULL;
+	unsigned char *der = NULL, *derTmp;
+	struct signer_jobs jobs = { .signers = signers,
+				    .hash = newHash,
+				    .hash_len = newHashSize };
+
+	if (newHashSize != EVP_MD_size(signers->evp_md)) {
 		prlog(PR_ERR,
-		      "ERROR: Failed to finalize openssl pkcs7 struct\n");
+		      "ERROR: Digest of %zd bytes does not match the hash function\n",
+		      newHashSize);
+		return PKCS7_FAIL;
+	}
+
+	//the data is not needed, only its digest is signed below
+	gen_pkcs7_struct = PKCS7_sign(NULL, NULL, NULL, NULL,
+				      PKCS7_PARTIAL | PKCS7_DETACHED);
+	if (!gen_pkcs7_struct) {
+		prlog(PR_ERR, "ERROR: Failed to initialize pkcs7 structure\n");
 		rc = PKCS7_FAIL;
 		goto out;
 	}
-	//convert to DER
-	out_bio = BIO_new(BIO_s_mem());
-	if (!out_bio) {
-		prlog(PR_ERR, "ERROR: Failed to initialize openssl BIO \n");
+	jobs.signer_infos = calloc(signers->count, sizeof(*jobs.signer_infos));
+	jobs.rcs = calloc(signers->count, sizeof(*jobs.rcs));
+	if (!jobs.signer_infos || !jobs.rcs) {
+		prlog(PR_ERR, "ERROR: Failed to allocate memory\n");
 		rc = ALLOC_FAIL;
 		goto out;
 	}
-	//returns 1 for success
-	rc = i2d_PKCS7_bio(out_bio, gen_pkcs7_struct);
-	if (!rc) {
-		prlog(PR_ERR, "ERROR: Failed to convert PKCS7 Struct to DER\n");
-		rc = PKCS7_FAIL;
-		goto out;
+	//add every signer to the pkcs7 first, this fixes their order, the keys and certs are only read
+	for (int i = 0; i < signers->count; i++) {
+		//returns NULL is failure
+		jobs.signer_infos[i] = PKCS7_sign_add_signer(gen_pkcs7_struct,
+							     signers->crts[i],
+							     signers->keys[i],
+							     signers->evp_md,
+							     PKCS7_NOATTR);
+		if (!jobs.signer_infos[i]) {
+			prlog(PR_ERR,
+			      "ERROR: Failed to add signer to the pkcs7 structure\n");
+			rc = PKCS7_FAIL;
+			goto out;
+		}
 	}
-	//get data out of BIO and into return values
-	pkcs7_out_len = BIO_get_mem_data(out_bio, &out_bio_der);
-	//returns number of bytes decoded or error
-	if (pkcs7_out_len <= 0) {
-		prlog(PR_ERR,
-		      "ERROR: Failed to extract PKCS7 DER data from openssl BIO\n");
+	//the private key operations are independent, do them all at once
+	runInParallel(signers->count, sign_signer, &jobs);
+	for (int i = 0; i < signers->count; i++) {
+		rc = jobs.rcs[i];
+		if (rc)
+			goto out;
+	}
+	//convert to DER, first call only gets the length
+	derSize = i2d_PKCS7(gen_pkcs7_struct, NULL);
+	if (derSize <= 0) {
+		prlog(PR_ERR, "ERROR: Failed to convert PKCS7 Struct to DER\n");
 		rc = PKCS7_FAIL;
 		goto out;
 	}
-	*pkcs7 = malloc(pkcs7_out_len);
-	if (!*pkcs7) {
+	der = malloc(derSize);
+	if (!der) {
 		prlog(PR_ERR, "ERROR: Failed to allocate memory\n");
 		rc = ALLOC_FAIL;
 		goto out;
 	}
-	*pkcs7Size = pkcs7_out_len;
-	//copy memory over so it is persistent
-	memcpy(*pkcs7, out_bio_der, *pkcs7Size);
+	derTmp = der;
+	if (i2d_PKCS7(gen_pkcs7_struct, &derTmp) != derSize) {
+		prlog(PR_ERR, "ERROR: Failed to convert PKCS7 Struct to DER\n");
+		rc = PKCS7_FAIL;
+		goto out;
+	}
+	*pkcs7 = der;
+	*pkcs7Size = derSize;
+	der = NULL;
 	//if here then successfull generation
 	rc = SUCCESS;
 
 out:
-	if (keyPEM)
-		free(keyPEM);
-	if (key)
-		free(key);
-	if (crtPEM)
-		free(crtPEM);
-	if (crt)
-		free(crt);
-	if (evp_pkey)
-		EVP_PKEY_free(evp_pkey);
-	if (x509)
-		crypto_x509_free(x509);
-	if (gen_pkcs7_struct)
-		PKCS7_free(gen_pkcs7_struct);
-	BIO_free(bio);
-	BIO_free(out_bio);
+	free(jobs.signer_infos);
+	free(jobs.rcs);
+	free(der);
+	PKCS7_free(gen_pkcs7_struct);
+
+	return rc;
+}
+
+int crypto_pkcs7_generate_w_signature(unsigned char **pkcs7, size_t *pkcs7Size,
+				      const unsigned char *newHash,
+				      size_t newHashSize, const char **crtFiles,
+				      const char **keyFiles, int keyPairs,
+				      int hashFunct)
+{
+	int rc;
+	crypto_pkcs7_signers *signers = NULL;
+
+	rc = crypto_pkcs7_signers_load(&signers, crtFiles, keyFiles, keyPairs,
+				       hashFunct);
+	if (rc)
+		return rc;
+	rc = crypto_pkcs7_generate_w_signers(pkcs7, pkcs7Size, newHash,
+					     newHashSize, signers);
+	crypto_pkcs7_signers_free(signers);
 
 	return rc;
 }
 
 int crypto_pkcs7_generate_w_already_signed_data(
-	unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newData,
-	size_t newDataSize, const char **crtFiles, const char **sigFiles,
+	unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newHash,
+	size_t newHashSize, const char **crtFiles, const char **sigFiles,
 	int keyPairs, int hashFunct)
 {
 	prlog(PR_ERR,
@@ -541,9 +734,113 @@ int crypto_x509_get_long_desc(char *x509_info, size_t max_len, char *delim,
 	return actual_mem_len;
 }
 
+/*
+ *appends size bytes of an attribute type or value to name as far as max_len allows, in values
+ *the characters RFC 4514 reserves are escaped, unprintable characters are written as '?'
+ */
+static void append_name_part(char *name, size_t max_len, size_t *len,
+			     const unsigned char *data, size_t size, int value)
+{
+	size_t i;
+
+	for (i = 0; i < size && *len + 1 < max_len; i++) {
+		if (value && data[i] && strchr(",+\"\\<>;", data[i])) {
+			if (*len + 2 >= max_len)
+				break;
+			name[(*len)++] = '\\';
+		}
+		name[(*len)++] = data[i] < 0x20 || data[i] == 0x7f ? '?' : data[i];
+	}
+	name[*len] = '\0';
+}
+
+int crypto_x509_get_name(crypto_x509 *x509, int issuer, char *name,
+			 size_t max_len)
+{
+	X509_NAME *dn = issuer ? X509_get_issuer_name(x509) :
+				 X509_get_subject_name(x509);
+	X509_NAME_ENTRY *entry;
+	const ASN1_STRING *value;
+	const char *sep;
+	char type[80];
+	size_t len = 0;
+	int i, nid, set = -1;
+
+	if (!dn || !max_len) {
+		prlog(PR_ERR, "ERROR: could not get name of X509\n");
+		return CERT_FAIL;
+	}
+	name[0] = '\0';
+	//RDNs in certificate order, the attributes of a multi-valued RDN are joined by '+'
+	for (i = 0; i < X509_NAME_entry_count(dn); i++) {
+		entry = X509_NAME_get_entry(dn, i);
+		nid = OBJ_obj2nid(X509_NAME_ENTRY_get_object(entry));
+		if (nid != NID_undef)
+			snprintf(type, sizeof(type), "%s", OBJ_nid2sn(nid));
+		else if (OBJ_obj2txt(type, sizeof(type),
+				     X509_NAME_ENTRY_get_object(entry), 1) < 0) {
+			prlog(PR_ERR, "ERROR: could not get name of X509\n");
+			return CERT_FAIL;
+		}
+		sep = X509_NAME_ENTRY_set(entry) == set ? "+" : ",";
+		if (i)
+			append_name_part(name, max_len, &len,
+					 (const unsigned char *)sep, 1, 0);
+		set = X509_NAME_ENTRY_set(entry);
+		append_name_part(name, max_len, &len, (const unsigned char *)type,
+				 strlen(type), 0);
+		append_name_part(name, max_len, &len, (const unsigned char *)"=", 1, 0);
+		value = X509_NAME_ENTRY_get_data(entry);
+		append_name_part(name, max_len, &len, ASN1_STRING_get0_data(value),
+				 ASN1_STRING_length(value), 1);
+	}
+
+	return len;
+}
+
+int crypto_x509_get_serial(crypto_x509 *x509, const unsigned char **serial,
+			   size_t *serial_len)
+{
+	const ASN1_INTEGER *sn = X509_get0_serialNumber(x509);
+
+	if (!sn)
+		return CERT_FAIL;
+	//ASN1_INTEGER holds the magnitude, big endian
+	*serial = ASN1_STRING_get0_data(sn);
+	*serial_len = ASN1_STRING_length(sn);
+
+	return SUCCESS;
+}
+
+int crypto_x509_get_pk_der(crypto_x509 *x509, const unsigned char **pk,
+			   size_t *pk_len)
+{
+	// the same bits signer_identifies_x509() compares
+	const ASN1_BIT_STRING *key = X509_get0_pubkey_bitstr(x509);
+
+	if (!key)
+		return CERT_FAIL;
+	*pk = ASN1_STRING_get0_data(key);
+	*pk_len = ASN1_STRING_length(key);
+
+	return SUCCESS;
+}
+
+int crypto_x509_get_validity(crypto_x509 *x509, struct tm *not_before,
+			     struct tm *not_after)
+{
+	//returns 1 on success and 0 for fail
+	if (!ASN1_TIME_to_tm(X509_get0_notBefore(x509), not_before) ||
+	    !ASN1_TIME_to_tm(X509_get0_notAfter(x509), not_after))
+		return CERT_FAIL;
+
+	return SUCCESS;
+}
+
 crypto_x509 *crypto_x509_parse_der(const unsigned char *data, size_t data_len)
 {
 	X509 *x509;
+	statsAdd(STATS_X509_PARSES, 1);
 	x509 = d2i_X509(NULL, &data, data_len);
 
 	if (!x509)
@@ -599,6 +896,7 @@ int crypto_md_ctx_init(crypto_md_ctx **ctx, int md_id)
 int crypto_md_update(crypto_md_ctx *ctx, const unsigned char *data,
 		     size_t data_len)
 {
+	statsAdd(STATS_BYTES_HASHED, data_len);
 	//returns 1 on success and 0 for fail
 	return !EVP_DigestUpdate(ctx, data, data_len);
 }
@@ -664,7 +962,7 @@ int crypto_md_generate_hash(const unsigned char *data, size_t size,
 	}
 	*outHashSize = hash_len;
 
-	if (verbose) {
+	if (logLevel() >= PR_WARNING) {
 		printf("Hash generation successful, %s: ",
 		       OBJ_nid2sn(hashFunct));
 		printHex(*outHash, *outHashSize);
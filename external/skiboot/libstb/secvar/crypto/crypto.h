@@ -3,6 +3,8 @@
 #ifndef SECVARCTL_CRYPTO_H
 #define SECVARCTL_CRYPTO_H
 
+#include <time.h>
+
 #ifdef OPENSSL
 
 #include <openssl/obj_mac.h>
@@ -68,8 +70,34 @@ crypto_pkcs7 *crypto_pkcs7_parse_der(const unsigned char *buf,
  */
 crypto_x509 *crypto_pkcs7_get_signing_cert(crypto_pkcs7 *pkcs7, int cert_num);
 
+/*
+ *checks if a signer of the pkcs7 identifies x509, either by issuer and serial number or through an embedded signing certificate with the same public key
+ *@param pkcs7 , a pointer to either an openssl or mbedtls pkcs7 struct
+ *@param x509 , a pointer to either an openssl or mbedtls x509 struct
+ *@return 1 if a signer matches x509, 0 otherwise
+ *NOTE: no signature is checked, use this to skip certificates before crypto_pkcs7_signed_hash_verify
+ */
+int crypto_pkcs7_signer_matches(crypto_pkcs7 *pkcs7, crypto_x509 *x509);
+
+/*
+ *gets how a signer of the pkcs7 names the certificate it signed with, so the certificates
+ *crypto_pkcs7_signer_matches() can accept are found by serial number or public key
+ *@param pkcs7 , a pointer to either an openssl or mbedtls pkcs7 struct
+ *@param signer , index of the signer, starting at 0
+ *@param serial , output, the serial number it names in the form of crypto_x509_get_serial(),
+ *		  points into pkcs7
+ *@param serial_len , output, length of serial
+ *@param cert , output, the signing certificate carried in the pkcs7 for the signer, NULL if
+ *		there is none
+ *@return SUCCESS or PKCS7_FAIL if the pkcs7 has no such signer
+ */
+int crypto_pkcs7_get_signer(crypto_pkcs7 *pkcs7, int signer,
+			    const unsigned char **serial, size_t *serial_len,
+			    crypto_x509 **cert);
+
 /*
  *determines if signed data in pkcs7 is correctly signed by x509 by signing the hash with the pk and comparing the resulting signature with that in the pkcs7
+ *only signers matching x509 (see crypto_pkcs7_signer_matches) are checked
  *@param pkcs7 , a pointer to either an openssl or mbedtls pkcs7 struct
  *@param x509 , a pinter to either an openssl or mbedtls x509 struct
  *@param hash , the expected hash
@@ -83,8 +111,8 @@ int crypto_pkcs7_signed_hash_verify(crypto_pkcs7 *pkcs7, crypto_x509 *x509,
  *generates a PKCS7 and create signature with private and public keys
  *@param pkcs7, the resulting PKCS7 DER buff, newData not appended, NOTE: REMEMBER TO UNALLOC THIS MEMORY
  *@param pkcs7Size, the length of pkcs7
- *@param newData, data to be added to be used in digest
- *@param dataSize , length of newData
+ *@param newHash, digest of the data to sign, made with hashFunct, the data itself is not needed
+ *@param newHashSize , length of newHash
  *@param crtFiles, array of file paths to public keys to sign with(PEM)
  *@param keyFiles, array of file paths to private keys to sign with
  *@param keyPairs, array length of key/crtFiles
@@ -92,17 +120,55 @@ int crypto_pkcs7_signed_hash_verify(crypto_pkcs7 *pkcs7, crypto_x509 *x509,
  *@return SUCCESS or err number 
  */
 int crypto_pkcs7_generate_w_signature(unsigned char **pkcs7, size_t *pkcs7Size,
-				      const unsigned char *newData,
-				      size_t newDataSize, const char **crtFiles,
+				      const unsigned char *newHash,
+				      size_t newHashSize, const char **crtFiles,
 				      const char **keyFiles, int keyPairs,
 				      int hashFunct);
 
+/*
+ *signing keys and certificates parsed once to sign many PKCS7's, see crypto_pkcs7_signers_load,
+ *they are only read while signing so several threads may sign with the same signers
+ */
+typedef struct crypto_pkcs7_signers crypto_pkcs7_signers;
+
+/*
+ *loads the private keys and certificates to sign with in crypto_pkcs7_generate_w_signers
+ *@param signers, the resulting signers, NOTE: REMEMBER TO FREE WITH crypto_pkcs7_signers_free
+ *@param crtFiles, array of file paths to public keys to sign with(PEM)
+ *@param keyFiles, array of file paths to private keys to sign with
+ *@param keyPairs, array length of key/crtFiles
+ *@param hashFunct, hash function to use in digest, see crypto_hash_funct for values
+ *@return SUCCESS or err number
+ */
+int crypto_pkcs7_signers_load(crypto_pkcs7_signers **signers,
+			      const char **crtFiles, const char **keyFiles,
+			      int keyPairs, int hashFunct);
+
+/*
+ *generates a PKCS7 signed by every signer, same as crypto_pkcs7_generate_w_signature without reading the keys again
+ *@param pkcs7, the resulting PKCS7 DER buff, newData not appended, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@param pkcs7Size, the length of pkcs7
+ *@param newHash, digest of the data to sign, made with the hashFunct given to crypto_pkcs7_signers_load
+ *@param newHashSize , length of newHash
+ *@param signers, keys and certificates from crypto_pkcs7_signers_load
+ *@return SUCCESS or err number
+ */
+int crypto_pkcs7_generate_w_signers(unsigned char **pkcs7, size_t *pkcs7Size,
+				    const unsigned char *newHash,
+				    size_t newHashSize,
+				    crypto_pkcs7_signers *signers);
+
+/*
+ *frees signers from crypto_pkcs7_signers_load, NULL is ignored
+ */
+void crypto_pkcs7_signers_free(crypto_pkcs7_signers *signers);
+
 /*
  *generates a PKCS7 with given signed data
  *@param pkcs7, the resulting PKCS7, newData not appended, NOTE: REMEMBER TO UNALLOC THIS MEMORY
  *@param pkcs7Size, the length of pkcs7
- *@param newData, data to be added to be used in digest
- *@param dataSize , length of newData
+ *@param newHash, digest of the signed data, made with hashFunct
+ *@param newHashSize , length of newHash
  *@param crtFiles, array of file paths to public keys that were used in signing with(PEM)
  *@param sigFiles, array of file paths to raw signed data files 
  *@param keyPairs, array length of crt/signatures
@@ -110,8 +176,8 @@ int crypto_pkcs7_generate_w_signature(unsigned char **pkcs7, size_t *pkcs7Size,
  *@return SUCCESS or err number 
  */
 int crypto_pkcs7_generate_w_already_signed_data(
-	unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newData,
-	size_t newDataSize, const char **crtFiles, const char **sigFiles,
+	unsigned char **pkcs7, size_t *pkcs7Size, const unsigned char *newHash,
+	size_t newHashSize, const char **crtFiles, const char **sigFiles,
 	int keyPairs, int hashFunct);
 
 /**====================X509 Functions ====================**/
@@ -149,6 +215,51 @@ void crypto_x509_get_short_info(crypto_x509 *x509, char *short_desc,
 int crypto_x509_get_long_desc(char *x509_info, size_t max_len, char *delim,
 			      crypto_x509 *x509);
 
+/*
+ *writes the subject or issuer distinguished name of the x509 on one line, the same with either
+ *crypto library: the RDNs in the order of the certificate joined by ',', the attributes of a
+ *multi-valued RDN joined by '+', each one the short name of its type (or the dotted OID if it has
+ *none), '=' and the value with ,+"\<>; escaped by a backslash and unprintable characters
+ *written as '?', ex: "C=US,O=IBM,CN=PK"
+ *@param x509 ,  a pointer to either an openssl or mbedtls x509 struct
+ *@param issuer , 1 for the issuer name, 0 for the subject name
+ *@param name , already alloc-d output string, always NULL terminated
+ *@param max_len , number of bytes allocated to name
+ *@return number of bytes written to name, not counting the NULL, or CERT_FAIL
+ */
+int crypto_x509_get_name(crypto_x509 *x509, int issuer, char *name,
+			 size_t max_len);
+
+/*
+ *gets the serial number of the x509 as big endian bytes, without a leading zero byte
+ *@param x509 ,  a pointer to either an openssl or mbedtls x509 struct
+ *@param serial , output, points into x509, valid until it is freed
+ *@param serial_len , output, length of serial
+ *@return SUCCESS or CERT_FAIL
+ */
+int crypto_x509_get_serial(crypto_x509 *x509, const unsigned char **serial,
+			   size_t *serial_len);
+
+/*
+ *gets the public key of the x509, certificates holding the same key give the same bytes
+ *@param x509 ,  a pointer to either an openssl or mbedtls x509 struct
+ *@param pk , output, points into x509, valid until it is freed
+ *@param pk_len , output, length of pk
+ *@return SUCCESS or CERT_FAIL
+ */
+int crypto_x509_get_pk_der(crypto_x509 *x509, const unsigned char **pk,
+			   size_t *pk_len);
+
+/*
+ *gets the validity period of the x509, in UTC
+ *@param x509 ,  a pointer to either an openssl or mbedtls x509 struct
+ *@param not_before , output, start of the validity period
+ *@param not_after , output, end of the validity period
+ *@return SUCCESS or CERT_FAIL
+ */
+int crypto_x509_get_validity(crypto_x509 *x509, struct tm *not_before,
+			     struct tm *not_after);
+
 /*
  *parses a data buffer into an x509 struct 
  *@param x509 , output, a pointer to either an openssl or mbedtls x509 struct, should have already been allocated
@@ -6,6 +6,7 @@
 
 #include <ccan/list/list.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <secvar.h>
 
 #define SECVAR_MAX_KEY_LEN		1024
@@ -19,6 +20,8 @@ enum {
 #define SECVAR_FLAG_VOLATILE	0x1 /* Instructs storage driver to ignore variable on writes */
 #define SECVAR_FLAG_PROTECTED	0x2 /* Instructs storage driver to store in lockable flash */
 
+struct secvar_arena;
+
 struct secvar {
 	struct list_node link;
 	uint64_t key_len;
@@ -26,6 +29,11 @@ struct secvar {
 	uint64_t flags;
 	char *key;
 	char *data;
+	struct secvar_arena *arena;	/* Allocated from this arena, if any */
+	char *data_buf;			/* Data held outside the secvar allocation */
+	struct secvar *origin;		/* Kept alive for data borrowed from it */
+	uint64_t refs;			/* bank + one per secvar borrowing from it */
+	bool shared;			/* data is read by other secvars, copy before writing */
 };
 
 extern struct list_head variable_bank;
@@ -38,11 +46,26 @@ extern struct secvar_backend_driver secvar_backend;
 // Helper functions
 void clear_bank_list(struct list_head *bank);
 int copy_bank_list(struct list_head *dst, struct list_head *src);
+void move_bank_list(struct list_head *dst, struct list_head *src);
 struct secvar *alloc_secvar(uint64_t key_len, uint64_t data_size);
 struct secvar *new_secvar(const char *key, uint64_t key_len,
 			       const char *data, uint64_t data_size,
 			       uint64_t flags);
+struct secvar *new_secvar_in(struct secvar_arena *arena,
+			     const char *key, uint64_t key_len,
+			     const char *data, uint64_t data_size,
+			     uint64_t flags);
+/* Like new_secvar, but takes over the malloc'd *data instead of copying it */
+struct secvar *new_secvar_move(struct secvar_arena *arena,
+			       const char *key, uint64_t key_len,
+			       char **data, uint64_t data_size,
+			       uint64_t flags);
+/* Arena for the secvars of one operation, freed with its last secvar */
+struct secvar_arena *new_secvar_arena(void);
+void put_secvar_arena(struct secvar_arena *arena);
 int realloc_secvar(struct secvar *node, uint64_t size);
+/* Give node data of its own, with room for size bytes, before writing to it */
+int unshare_secvar(struct secvar *node, uint64_t size, bool keep_data);
 void dealloc_secvar(struct secvar *node);
 struct secvar *find_secvar(const char *key, uint64_t key_len, struct list_head *bank);
 int is_key_empty(const char *key, uint64_t key_len);
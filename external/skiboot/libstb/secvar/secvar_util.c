@@ -6,6 +6,7 @@
 #endif
 
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 /*#include <skiboot.h>*/
 /*#include <opal.h>*/
@@ -14,6 +15,137 @@
 #include "external/skiboot/include/opal-api.h"
 #define zalloc(...) calloc(1,__VA_ARGS__)
 
+/*
+ * A secvar is a single allocation: the struct, then the key, then the data.
+ * The data can instead live in a buffer of its own (data_buf), either handed
+ * over by new_secvar_move() or made by realloc_secvar() when the data outgrows
+ * the allocation. Secvars can also be drawn from a secvar_arena, which is
+ * released in one go when its last secvar is deallocated.
+ *
+ * copy_bank_list() does not copy any data. The copy borrows the data of the
+ * original, which it keeps alive through origin/refs, and both are marked
+ * shared. Whoever writes to the data of a shared secvar first gets a private
+ * buffer with unshare_secvar(), so the other side never sees the change.
+ */
+
+/* Chunk size of an arena, larger secvars get a chunk of their own */
+#define SECVAR_ARENA_CHUNK_SIZE		(64 * 1024)
+
+struct secvar_arena_chunk {
+	struct secvar_arena_chunk *next;
+	uint64_t size;
+	uint64_t used;
+	char buf[];
+};
+
+struct secvar_arena {
+	struct secvar_arena_chunk *chunks;	/* the first is the one in use */
+	uint64_t refs;				/* owner + one per live secvar */
+};
+
+struct secvar_arena *new_secvar_arena(void)
+{
+	struct secvar_arena *arena;
+
+	arena = zalloc(sizeof(struct secvar_arena));
+	if (!arena)
+		return NULL;
+
+	arena->refs = 1;
+
+	return arena;
+}
+
+void put_secvar_arena(struct secvar_arena *arena)
+{
+	struct secvar_arena_chunk *chunk, *next;
+
+	if (!arena || --arena->refs)
+		return;
+
+	for (chunk = arena->chunks; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	free(arena);
+}
+
+static void *secvar_arena_zalloc(struct secvar_arena *arena, uint64_t size)
+{
+	struct secvar_arena_chunk *chunk = arena->chunks;
+	void *ret;
+
+	/* Keep every secvar struct aligned */
+	size = (size + 7) & ~7ULL;
+
+	if (size > SECVAR_ARENA_CHUNK_SIZE / 2) {
+		/* A chunk of its own, behind the one in use so that keeps filling */
+		chunk = zalloc(sizeof(struct secvar_arena_chunk) + size);
+		if (!chunk)
+			return NULL;
+		chunk->size = chunk->used = size;
+		if (arena->chunks) {
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		} else
+			arena->chunks = chunk;
+		return chunk->buf;
+	}
+
+	if (!chunk || chunk->size - chunk->used < size) {
+		chunk = zalloc(sizeof(struct secvar_arena_chunk)
+			       + SECVAR_ARENA_CHUNK_SIZE);
+		if (!chunk)
+			return NULL;
+		chunk->size = SECVAR_ARENA_CHUNK_SIZE;
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+	}
+
+	/* Chunks are zeroed and never reused */
+	ret = chunk->buf + chunk->used;
+	chunk->used += size;
+
+	return ret;
+}
+
+/* Allocate a secvar with room for key_len bytes of key and data_size of data */
+static struct secvar *alloc_secvar_in(struct secvar_arena *arena,
+				      uint64_t key_len, uint64_t data_size)
+{
+	struct secvar *ret;
+	uint64_t size = sizeof(struct secvar) + key_len + data_size;
+
+	if (arena) {
+		ret = secvar_arena_zalloc(arena, size);
+		if (!ret)
+			return NULL;
+		ret->arena = arena;
+		arena->refs++;
+	} else {
+		ret = zalloc(size);
+		if (!ret)
+			return NULL;
+	}
+
+	ret->key = (char *)(ret + 1);
+	ret->data = ret->key + key_len;
+	ret->key_len = key_len;
+	ret->data_size = data_size;
+	ret->refs = 1;
+
+	return ret;
+}
+
+/* Is the data of var its own, rather than borrowed from its origin */
+static bool secvar_owns_data(const struct secvar *var)
+{
+	if (var->data_buf)
+		return var->data == var->data_buf;
+
+	return var->data == var->key + var->key_len;
+}
+
 void clear_bank_list(struct list_head *bank)
 {
 	struct secvar *var, *next;
@@ -32,9 +164,21 @@ int copy_bank_list(struct list_head *dst, struct list_head *src)
 	struct secvar *var, *tmp;
 
 	list_for_each(src, var, link) {
-		/* Allocate new secvar using actual data size */
-		tmp = new_secvar(var->key, var->key_len, var->data,
-				 var->data_size, var->flags);
+		/* Allocate new secvar without data, next to the original */
+		tmp = alloc_secvar_in(var->arena, var->key_len, 0);
+		if (!tmp)
+			return OPAL_NO_MEM;
+
+		memcpy(tmp->key, var->key, var->key_len);
+		tmp->flags = var->flags;
+
+		/* Borrow the data until one of the two writes to it */
+		tmp->data = var->data;
+		tmp->data_size = var->data_size;
+		tmp->origin = var;
+		var->refs++;
+		tmp->shared = var->shared = true;
+
 		/* Append to new list */
 		list_add_tail(dst, &tmp->link);
 	}
@@ -42,29 +186,62 @@ int copy_bank_list(struct list_head *dst, struct list_head *src)
 	return OPAL_SUCCESS;
 }
 
+/* Move every secvar of src to the end of dst, leaving src empty */
+void move_bank_list(struct list_head *dst, struct list_head *src)
+{
+	struct list_node *first, *last;
+
+	if (list_empty(src))
+		return;
+
+	first = src->n.next;
+	last = src->n.prev;
+
+	first->prev = dst->n.prev;
+	dst->n.prev->next = first;
+	last->next = &dst->n;
+	dst->n.prev = last;
+
+	list_head_init(src);
+}
+
 struct secvar *alloc_secvar(uint64_t key_len, uint64_t data_size)
+{
+	return alloc_secvar_in(NULL, key_len, data_size);
+}
+
+static bool valid_secvar_args(const char *key, uint64_t key_len,
+			      const char *data, uint64_t data_size)
+{
+	if (!key)
+		return false;
+	if ((!key_len) || (key_len > SECVAR_MAX_KEY_LEN))
+		return false;
+	if ((!data) && (data_size))
+		return false;
+
+	return true;
+}
+
+struct secvar *new_secvar_in(struct secvar_arena *arena,
+			     const char *key, uint64_t key_len,
+			     const char *data, uint64_t data_size,
+			     uint64_t flags)
 {
 	struct secvar *ret;
 
-	ret = zalloc(sizeof(struct secvar));
-	if (!ret)
+	if (!valid_secvar_args(key, key_len, data, data_size))
 		return NULL;
 
-	ret->key = zalloc(key_len);
-	if (!ret->key) {
-		free(ret);
+	ret = alloc_secvar_in(arena, key_len, data_size);
+	if (!ret)
 		return NULL;
-	}
 
-	ret->data = zalloc(data_size);
-	if (!ret->data) {
-		free(ret->key);
-		free(ret);
-		return NULL;
-	}
+	memcpy(ret->key, key, key_len);
+	ret->flags = flags;
 
-	ret->key_len = key_len;
-	ret->data_size = data_size;
+	if (data)
+		memcpy(ret->data, data, data_size);
 
 	return ret;
 }
@@ -72,55 +249,106 @@ struct secvar *alloc_secvar(uint64_t key_len, uint64_t data_size)
 struct secvar *new_secvar(const char *key, uint64_t key_len,
 			       const char *data, uint64_t data_size,
 			       uint64_t flags)
+{
+	return new_secvar_in(NULL, key, key_len, data, data_size, flags);
+}
+
+struct secvar *new_secvar_move(struct secvar_arena *arena,
+			       const char *key, uint64_t key_len,
+			       char **data, uint64_t data_size,
+			       uint64_t flags)
 {
 	struct secvar *ret;
 
-	if (!key)
-		return NULL;
-	if ((!key_len) || (key_len > SECVAR_MAX_KEY_LEN))
-		return NULL;
-	if ((!data) && (data_size))
+	if (!data || !valid_secvar_args(key, key_len, *data, data_size))
 		return NULL;
 
-	ret = alloc_secvar(key_len, data_size);
+	ret = alloc_secvar_in(arena, key_len, 0);
 	if (!ret)
 		return NULL;
 
 	memcpy(ret->key, key, key_len);
 	ret->flags = flags;
 
-	if (data)
-		memcpy(ret->data, data, data_size);
+	/* The secvar owns the buffer from now on */
+	ret->data_buf = *data;
+	ret->data = *data;
+	ret->data_size = data_size;
+	*data = NULL;
 
 	return ret;
 }
 
-int realloc_secvar(struct secvar *var, uint64_t size)
+int unshare_secvar(struct secvar *var, uint64_t size, bool keep_data)
 {
-	void *tmp;
+	struct secvar *holder;
+	char *tmp;
 
-	if (var->data_size >= size)
+	if (var->shared && var->refs == 1 && secvar_owns_data(var))
+		var->shared = false; /* everyone borrowing from it is gone */
+
+	if (!var->shared && var->data_size >= size)
 		return 0;
 
-	tmp = zalloc(size);
+	if (keep_data && size < var->data_size)
+		size = var->data_size;
+
+	tmp = zalloc(size ? size : 1);
 	if (!tmp)
 		return -1;
 
-	memcpy(tmp, var->data, var->data_size);
-	free(var->data);
+	if (keep_data)
+		memcpy(tmp, var->data, var->data_size);
+
+	if (var->data_buf && var->shared && var->refs > 1) {
+		/* Borrowers still read the old buffer, hand it to a holder they keep alive */
+		holder = alloc_secvar_in(NULL, 0, 0);
+		if (!holder) {
+			free(tmp);
+			return -1;
+		}
+		holder->data_buf = var->data_buf;
+		holder->origin = var->origin;
+		var->origin = holder;
+	} else
+		free(var->data_buf);
+
+	/* Nothing reads the old data anymore, let go of where it came from */
+	if (var->refs == 1 && var->origin) {
+		dealloc_secvar(var->origin);
+		var->origin = NULL;
+	}
+
+	var->data_buf = tmp;
 	var->data = tmp;
+	var->shared = false;
 
 	return 0;
 }
 
+int realloc_secvar(struct secvar *var, uint64_t size)
+{
+	/* Data outgrowing the allocation moves to a buffer of its own */
+	return unshare_secvar(var, size, true);
+}
+
 void dealloc_secvar(struct secvar *var)
 {
 	if (!var)
 		return;
 
-	free(var->key);
-	free(var->data);
-	free(var);
+	/* Stays around while other secvars borrow its data */
+	if (--var->refs)
+		return;
+
+	free(var->data_buf);
+	dealloc_secvar(var->origin);
+
+	/* Key and inline data are part of the same allocation */
+	if (var->arena)
+		put_secvar_arena(var->arena);
+	else
+		free(var);
 }
 
 struct secvar *find_secvar(const char *key, uint64_t key_len, struct list_head *bank)
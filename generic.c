@@ -6,10 +6,19 @@
 #include <stdlib.h>
 #include <fcntl.h> // O_WRONLY
 #include <unistd.h> // has read/open funcitons
+#include <stdint.h> // SIZE_MAX
 #include <sys/stat.h> // needed for stat struct for file info
 #include <sys/types.h>
+#include <sys/mman.h> // mmap
+#include <sys/vfs.h> // fstatfs
+#include <linux/magic.h> // SYSFS_MAGIC
+#include <pthread.h>
 #include "err.h"
 #include "prlog.h"
+#include "generic.h"
+#include "stats.h"
+#include "output.h"
+#include "context.h"
 
 /**
  *determines if given file currently exists
@@ -38,11 +47,12 @@ size_t getLeadingWhitespace(unsigned char *data, size_t dataSize)
 
 	return whiteSpaceSize;
 }
-void printHex(unsigned char *data, size_t length)
+void printHex(const unsigned char *data, size_t length)
 {
-	for (int i = 0; i < length; i++)
-		printf("/%02x", data[i]);
-	printf("\n");
+	outHold();
+	outHex(data, length, '/');
+	outWrite("\n", 1);
+	outRelease();
 }
 
 /**
@@ -52,9 +62,58 @@ void printHex(unsigned char *data, size_t length)
  */
 void printRaw(const char *c, size_t size)
 {
-	for (int i = 0; i < size; i++)
-		printf("%c", *(c + i));
-	printf("\n\n");
+	outHold();
+	outWrite(c, size);
+	outWrite("\n\n", 2);
+	outRelease();
+}
+
+/*
+ *reads from fptr until end of file, used when the size of a file cannot be trusted
+ *(pipes, sysfs, files that change size while being read)
+ *@param fptr, open file descriptor
+ *@param sizeHint, expected size of the file, 0 if unknown
+ *@param size, returned number of bytes read
+ *@return allocated buffer holding all data with one extra '\0' after it, NULL on failure
+ */
+static char *readAll(int fptr, size_t sizeHint, size_t *size)
+{
+	char *c = NULL;
+	size_t allocated, used = 0;
+	ssize_t read_size;
+
+	// extra byte so the read that finds end of file does not need to grow the buffer
+	allocated = (sizeHint ? sizeHint : FILE_READ_CHUNK_SIZE) + 1;
+	c = malloc(allocated);
+	if (!c) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return NULL;
+	}
+	for (;;) {
+		if (used == allocated - 1) {
+			if (allocated > SIZE_MAX / 2 ||
+			    reallocArray((void **)&c, allocated * 2, sizeof(*c))) {
+				prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+				return NULL;
+			}
+			allocated *= 2;
+		}
+		read_size = read(fptr, c + used, allocated - 1 - used);
+		if (read_size < 0) {
+			if (errno == EINTR)
+				continue;
+			prlog(PR_ERR, "ERROR: failed to read file: %s\n", strerror(errno));
+			free(c);
+			return NULL;
+		}
+		if (read_size == 0)
+			break;
+		used += read_size;
+	}
+	c[used] = '\0';
+	*size = used;
+
+	return c;
 }
 
 /**
@@ -70,10 +129,11 @@ char *getDataFromFile(const char *fullPath, size_t *size)
 	int fptr;
 	char *c = NULL;
 	struct stat fileInfo;
-	ssize_t read_size;
+	uint64_t start = statsStart();
 	fptr = open(fullPath, O_RDONLY);
 	if (fptr < 0) {
 		prlog(PR_WARNING, "----opening %s failed : %s----\n", fullPath, strerror(errno));
+		statsEnd(STATS_FILE_IO, start);
 		return NULL;
 	}
 	if (fstat(fptr, &fileInfo) < 0) {
@@ -84,23 +144,320 @@ char *getDataFromFile(const char *fullPath, size_t *size)
 	}
 	prlog(PR_NOTICE, "----opening %s is success: reading %ld bytes----\n", fullPath,
 	      fileInfo.st_size);
-	c = malloc(fileInfo.st_size);
-	if (!c) {
-		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+	c = readAll(fptr, fileInfo.st_size > 0 ? fileInfo.st_size : 0, size);
+	if (!c)
+		prlog(PR_ERR, "ERROR: failed to read contents of %s\n", fullPath);
+out:
+	close(fptr);
+	statsEnd(STATS_FILE_IO, start);
+
+	return c;
+}
+
+/*
+ *determines if a file can be memory mapped, pseudo filesystems report sizes that
+ *do not match their contents so they are always read
+ *@param fptr, open file descriptor
+ *@param fileInfo, stat of fptr
+ *@return 1 if file should be mapped, 0 if it should be read
+ */
+static int canMapFile(int fptr, const struct stat *fileInfo)
+{
+	struct statfs fsInfo;
+
+	if (!S_ISREG(fileInfo->st_mode) || fileInfo->st_size <= 0)
+		return 0;
+	if (fstatfs(fptr, &fsInfo) < 0)
+		return 0;
+	if (fsInfo.f_type == SYSFS_MAGIC || fsInfo.f_type == PROC_SUPER_MAGIC)
+		return 0;
+
+	return 1;
+}
+
+/*
+ *a file mapped through a struct fileCache, found again by its inode as long as its size and
+ *times are the ones it had when it was mapped
+ */
+struct cachedFile {
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime, ctime;
+	// written through writeData()/createFile() since, views may still use it so it stays mapped
+	int stale;
+	void *data;
+};
+
+/*
+ *regular files mapped by openFileView() on the contexts it is set for, the jobs of a batch
+ *use the same mapping of a file instead of each mapping and reading it again
+ */
+struct fileCache {
+	pthread_mutex_t lock;
+	struct cachedFile *files;
+	size_t count;
+};
+
+// @return a new empty file cache, NULL if out of memory
+struct fileCache *newFileCache(void)
+{
+	struct fileCache *cache = calloc(1, sizeof(*cache));
+
+	if (cache)
+		pthread_mutex_init(&cache->lock, NULL);
+
+	return cache;
+}
+
+/*
+ *unmaps every file of the cache, no view opened from it may be used afterwards
+ *@param cache, cache to free, may be NULL
+ */
+void freeFileCache(struct fileCache *cache)
+{
+	if (!cache)
+		return;
+	for (size_t i = 0; i < cache->count; i++)
+		munmap(cache->files[i].data, cache->files[i].size);
+	free(cache->files);
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+}
+
+// @return the file cache of the context bound to the calling thread, NULL if none
+static struct fileCache *boundFileCache(void)
+{
+	struct secvarctl_ctx *ctx = boundCtx();
+
+	return ctx ? ctx->files : NULL;
+}
+
+static int sameInode(const struct cachedFile *file, const struct stat *fileInfo)
+{
+	return file->dev == fileInfo->st_dev && file->ino == fileInfo->st_ino;
+}
+
+/*
+ *maps a file once for every view opened on it while it does not change
+ *@param cache, file cache to look in and add to
+ *@param fptr, open file descriptor, canMapFile() is true for it
+ *@param fileInfo, stat of fptr
+ *@return the mapping of the whole file or MAP_FAILED
+ */
+static void *mapCachedFile(struct fileCache *cache, int fptr, const struct stat *fileInfo)
+{
+	struct cachedFile *file;
+	void *map = MAP_FAILED;
+
+	pthread_mutex_lock(&cache->lock);
+	for (size_t i = 0; i < cache->count; i++) {
+		file = &cache->files[i];
+		if (!file->stale && sameInode(file, fileInfo) && file->size == fileInfo->st_size &&
+		    file->mtime.tv_sec == fileInfo->st_mtim.tv_sec &&
+		    file->mtime.tv_nsec == fileInfo->st_mtim.tv_nsec &&
+		    file->ctime.tv_sec == fileInfo->st_ctim.tv_sec &&
+		    file->ctime.tv_nsec == fileInfo->st_ctim.tv_nsec) {
+			map = file->data;
+			goto out;
+		}
+	}
+	file = realloc(cache->files, (cache->count + 1) * sizeof(*file));
+	if (!file)
 		goto out;
+	cache->files = file;
+	map = mmap(NULL, fileInfo->st_size, PROT_READ, MAP_PRIVATE, fptr, 0);
+	if (map == MAP_FAILED)
+		goto out;
+	file = &cache->files[cache->count++];
+	file->dev = fileInfo->st_dev;
+	file->ino = fileInfo->st_ino;
+	file->size = fileInfo->st_size;
+	file->mtime = fileInfo->st_mtim;
+	file->ctime = fileInfo->st_ctim;
+	file->stale = 0;
+	file->data = map;
+out:
+	pthread_mutex_unlock(&cache->lock);
+
+	return map;
+}
+
+/*
+ *keeps the file cache from handing out the old contents of a file that is written, its times
+ *may not change if it is written again quickly
+ *@param fptr, file descriptor the file is about to be written through
+ */
+static void forgetCachedFile(int fptr)
+{
+	struct fileCache *cache = boundFileCache();
+	struct stat fileInfo;
+
+	if (!cache || fstat(fptr, &fileInfo) < 0)
+		return;
+	pthread_mutex_lock(&cache->lock);
+	for (size_t i = 0; i < cache->count; i++) {
+		if (sameInode(&cache->files[i], &fileInfo))
+			cache->files[i].stale = 1;
 	}
-	read_size = read(fptr, c, fileInfo.st_size);
-	if (read_size != fileInfo.st_size) {
-		prlog(PR_ERR, "ERROR: failed to read whole contents of %s in one go\n", fullPath);
-		free(c);
-		c = NULL;
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ *opens a read only view of the contents of a file, regular files are memory mapped so no
+ *copy of the data is made, anything else (pipes, sysfs) is read in chunks until end of file.
+ *If the bound context has a file cache the mapping comes from it and is shared
+ *@param view, filled with the file data and size, must be released with closeFileView()
+ *@param fullPath string of file with path
+ *@return SUCCESS or INVALID_FILE/ALLOC_FAIL
+ */
+int openFileView(struct fileView *view, const char *fullPath)
+{
+	int fptr, rc = SUCCESS;
+	struct stat fileInfo;
+	struct fileCache *cache = boundFileCache();
+	void *map;
+	// a mapped file is read as its pages are first touched, that time is not counted here
+	uint64_t start = statsStart();
+
+	view->data = NULL;
+	view->size = 0;
+	view->mapped = 0;
+	view->shared = 0;
+	fptr = open(fullPath, O_RDONLY);
+	if (fptr < 0) {
+		prlog(PR_WARNING, "----opening %s failed : %s----\n", fullPath, strerror(errno));
+		statsEnd(STATS_FILE_IO, start);
+		return INVALID_FILE;
+	}
+	if (fstat(fptr, &fileInfo) < 0) {
+		rc = INVALID_FILE;
+		goto out;
+	}
+	if (canMapFile(fptr, &fileInfo)) {
+		if (cache)
+			map = mapCachedFile(cache, fptr, &fileInfo);
+		else
+			map = mmap(NULL, fileInfo.st_size, PROT_READ, MAP_PRIVATE, fptr, 0);
+		if (map != MAP_FAILED) {
+			prlog(PR_NOTICE, "----opening %s is success: mapped %ld bytes----\n",
+			      fullPath, fileInfo.st_size);
+			view->data = map;
+			view->size = fileInfo.st_size;
+			view->mapped = 1;
+			view->shared = cache != NULL;
+			goto out;
+		}
+		prlog(PR_INFO, "Could not map %s, reading it instead\n", fullPath);
+	}
+	view->data = (unsigned char *)readAll(fptr, 0, &view->size);
+	if (!view->data) {
+		prlog(PR_ERR, "ERROR: failed to read contents of %s\n", fullPath);
+		rc = INVALID_FILE;
 		goto out;
 	}
-	*size = fileInfo.st_size;
+	if (view->size == 0)
+		prlog(PR_WARNING, "WARNING: file %s is empty\n", fullPath);
+	prlog(PR_NOTICE, "----opening %s is success: read %zd bytes----\n", fullPath, view->size);
 out:
 	close(fptr);
+	statsEnd(STATS_FILE_IO, start);
 
-	return c;
+	return rc;
+}
+
+/**
+ *releases the data of a view opened with openFileView()
+ *@param view, view to close, safe to call on a view that failed to open
+ */
+void closeFileView(struct fileView *view)
+{
+	if (!view->data)
+		return;
+	// a shared mapping belongs to the file cache
+	if (view->mapped && !view->shared)
+		munmap((void *)view->data, view->size);
+	else if (!view->mapped)
+		free((void *)view->data);
+	view->data = NULL;
+	view->size = 0;
+	view->mapped = 0;
+	view->shared = 0;
+}
+
+/**
+ *reads a file front to back in FILE_STREAM_CHUNK_SIZE pieces and hands each one to consume,
+ *so memory use does not depend on the size of the file. The kernel is told the access is
+ *sequential and is asked to read the next chunk ahead while the current one is consumed
+ *@param fullPath string of file with path
+ *@param consume, called with each chunk in order, a non zero return stops reading
+ *@param ctx, passed through to consume
+ *@param size, returned total number of bytes read, may be NULL
+ *@return SUCCESS, INVALID_FILE/ALLOC_FAIL or the non zero return of consume
+ */
+int streamFile(const char *fullPath, int (*consume)(const unsigned char *, size_t, void *),
+	       void *ctx, size_t *size)
+{
+	int fptr, rc = SUCCESS;
+	unsigned char *chunk;
+	size_t used, total = 0;
+	ssize_t read_size;
+	int eof = 0;
+	uint64_t start;
+
+	fptr = open(fullPath, O_RDONLY);
+	if (fptr < 0) {
+		prlog(PR_WARNING, "----opening %s failed : %s----\n", fullPath, strerror(errno));
+		return INVALID_FILE;
+	}
+	chunk = malloc(FILE_STREAM_CHUNK_SIZE);
+	if (!chunk) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		close(fptr);
+		return ALLOC_FAIL;
+	}
+	// only hints, pipes and pseudo files will refuse them
+	posix_fadvise(fptr, 0, 0, POSIX_FADV_SEQUENTIAL);
+	while (!eof) {
+		// start reading the chunk after this one while this one is being consumed
+		posix_fadvise(fptr, total + FILE_STREAM_CHUNK_SIZE, FILE_STREAM_CHUNK_SIZE,
+			      POSIX_FADV_WILLNEED);
+		// fill the whole chunk, read() may return less than asked for
+		start = statsStart();
+		for (used = 0; used < FILE_STREAM_CHUNK_SIZE; used += read_size) {
+			read_size = read(fptr, chunk + used, FILE_STREAM_CHUNK_SIZE - used);
+			if (read_size < 0) {
+				if (errno == EINTR) {
+					read_size = 0;
+					continue;
+				}
+				prlog(PR_ERR, "ERROR: failed to read %s: %s\n", fullPath,
+				      strerror(errno));
+				statsEnd(STATS_FILE_IO, start);
+				rc = INVALID_FILE;
+				goto out;
+			}
+			if (read_size == 0) {
+				eof = 1;
+				break;
+			}
+		}
+		statsEnd(STATS_FILE_IO, start);
+		if (!used)
+			break;
+		rc = consume(chunk, used, ctx);
+		if (rc)
+			goto out;
+		total += used;
+	}
+	prlog(PR_NOTICE, "----streaming %s is success: read %zd bytes----\n", fullPath, total);
+	if (size)
+		*size = total;
+out:
+	free(chunk);
+	close(fptr);
+
+	return rc;
 }
 
 /*
@@ -118,6 +475,7 @@ int writeData(const char *file, const char *buff, size_t size)
 		prlog(PR_ERR, "ERROR: Opening %s failed: %s\n", file, strerror(errno));
 		return INVALID_FILE;
 	}
+	forgetCachedFile(fptr);
 	rc = write(fptr, buff, size);
 	if (rc < 0) {
 		prlog(PR_ERR, "ERROR: Writing data to %s failed\n", file);
@@ -149,6 +507,7 @@ int createFile(const char *file, const char *buff, size_t size)
 		prlog(PR_ERR, "ERROR: Opening %s failed: %s\n", file, strerror(errno));
 		return INVALID_FILE;
 	}
+	forgetCachedFile(fptr);
 	rc = write(fptr, buff, size);
 	if (rc < 0) {
 		prlog(PR_ERR, "ERROR: Writing data to %s failed: %s\n", file, strerror(errno));
@@ -191,3 +550,79 @@ out:
 	free(old_arr);
 	return ALLOC_FAIL;
 }
+
+// set while the thread is one of several workers of a pool, see joinPool()
+static __thread int poolWorker;
+
+/*
+ *called by a worker of a thread pool before it takes jobs. The pool already keeps the cores
+ *busy, so on its workers runInParallel() makes every call on the calling thread
+ *@param parallel, 1 if the pool has more than one worker
+ *@return what to give leavePool() once the worker is done, pools may be nested
+ */
+int joinPool(int parallel)
+{
+	int prev = poolWorker;
+
+	poolWorker = prev || parallel;
+
+	return prev;
+}
+
+void leavePool(int prev)
+{
+	poolWorker = prev;
+}
+
+// one call made by runInParallel
+struct parallelCall {
+	void (*work)(void *, int);
+	void *ctx;
+	int index, started;
+	pthread_t thread;
+	// context of the calling thread, the call prints with its log level
+	struct secvarctl_ctx *owner;
+};
+
+static void *parallelCallMain(void *arg)
+{
+	struct parallelCall *call = arg;
+
+	bindCtx(call->owner);
+	call->work(call->ctx, call->index);
+
+	return NULL;
+}
+
+/**
+ *calls work(ctx, i) for every i in [0, count), each on a thread of its own, and waits for all
+ *of them. The calling thread takes i = 0, a call that cannot get a thread is made on the
+ *calling thread instead, so every call is made even if no thread can be started. At most
+ *MAX_WORKER_THREADS threads are used and none are started on a worker of a pool
+ *@param count, number of calls, meant for a handful of long calls such as one per signer
+ *@param work, called once per index, must be safe to run at the same time for different indexes
+ *@param ctx, passed through to work
+ */
+void runInParallel(int count, void (*work)(void *, int), void *ctx)
+{
+	struct parallelCall *calls = NULL;
+
+	if (count > 1 && !poolWorker)
+		calls = calloc(count, sizeof(*calls));
+	for (int i = 1; calls && i < count && i < MAX_WORKER_THREADS; i++) {
+		calls[i].work = work;
+		calls[i].ctx = ctx;
+		calls[i].index = i;
+		calls[i].owner = boundCtx();
+		calls[i].started = !pthread_create(&calls[i].thread, NULL, parallelCallMain, &calls[i]);
+	}
+	if (count > 0)
+		work(ctx, 0);
+	for (int i = 1; i < count; i++) {
+		if (calls && calls[i].started)
+			pthread_join(calls[i].thread, NULL);
+		else
+			work(ctx, i);
+	}
+	free(calls);
+}
@@ -0,0 +1,11 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stdint.h>
+
+// allocations counted by the wrappers of alloc.c, for --stats and secvarctl-bench
+void allocationCountStart(void);
+uint64_t allocationCount(void);
+#endif
@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <stdbool.h>
+#include <ccan/list/list.h>
+
+struct secvar_arena;
+struct fileCache;
+
+// receives what reportUpdateSigner() is given, see struct secvarctl_ctx
+typedef void (*updateSignerListener)(void *ctx, const char *key, const char *authority, int esl,
+				     bool append);
+
+/*
+ *everything a command or a libsecvarctl call changes while it runs. Nothing in here is shared
+ *but the file cache, which locks itself, so threads that each have a context of their own can
+ *verify updates at the same time.
+ *A context is used by one thread at a time, it is given to the backend and the processing of
+ *skiboot, prlog() finds the log level in the context bound to its thread with bindCtx()
+ */
+struct secvarctl_ctx {
+	// highest prlog() level that is printed
+	int verbose;
+	// stdout holds JSON, prlog() prints every level to stderr
+	bool log_to_stderr;
+	// the PK is empty, set by the backend's pre_process and process
+	bool setup_mode;
+	// working copy of the variable bank while process applies the updates
+	struct list_head staging_bank;
+	// secvars made for the banks are allocated from this arena, NULL for malloc()
+	struct secvar_arena *arena;
+	// authority certificates parsed while verifying updates, for cert_cache_bank
+	struct list_head cert_cache;
+	const struct list_head *cert_cache_bank;
+	// process keeps the certificates in cert_cache for later runs on this context
+	bool keep_cert_cache;
+	// files opened with openFileView() are mapped once through this cache, NULL for none
+	struct fileCache *files;
+	// gets the updates verified by process, they are printed if NULL
+	updateSignerListener signer_listener;
+	void *signer_listener_ctx;
+};
+
+void initCtx(struct secvarctl_ctx *ctx, int verbose);
+void clearCtx(struct secvarctl_ctx *ctx);
+struct secvarctl_ctx *bindCtx(struct secvarctl_ctx *ctx);
+struct secvarctl_ctx *boundCtx(void);
+#endif
@@ -3,17 +3,48 @@
 #ifndef GENERIC_H
 #define GENERIC_H
 
+#include <stddef.h>
+
+// size of each read() when the size of a file is not known ahead of time
+#define FILE_READ_CHUNK_SIZE 4096
+// size of each piece handed out by streamFile()
+#define FILE_STREAM_CHUNK_SIZE (1024 * 1024)
+// upper limit for -j on commands that use a thread pool, and for the threads of runInParallel()
+#define MAX_WORKER_THREADS 64
+
+struct secvarctl_ctx;
+
 struct command {
 	char name[32];
-	int (*func)(int, char **);
+	int (*func)(struct secvarctl_ctx *, int, char **);
 };
 
+// read only contents of a file, see openFileView()
+struct fileView {
+	const unsigned char *data;
+	size_t size;
+	int mapped;
+	// the mapping belongs to a struct fileCache and is not unmapped by closeFileView()
+	int shared;
+};
+
+struct fileCache;
+
 char *getDataFromFile(const char *file, size_t *size);
+int openFileView(struct fileView *view, const char *file);
+void closeFileView(struct fileView *view);
+struct fileCache *newFileCache(void);
+void freeFileCache(struct fileCache *cache);
+int streamFile(const char *file, int (*consume)(const unsigned char *, size_t, void *), void *ctx,
+	       size_t *size);
 int writeData(const char *file, const char *buff, size_t size);
 int createFile(const char *file, const char *buff, size_t size);
 void printRaw(const char *c, size_t size);
 int isFile(const char *path);
 size_t getLeadingWhitespace(unsigned char *data, size_t dataSize);
-void printHex(unsigned char *data, size_t length);
+void printHex(const unsigned char *data, size_t length);
 int reallocArray(void **arr, size_t new_length, size_t size_each);
+void runInParallel(int count, void (*work)(void *, int), void *ctx);
+int joinPool(int parallel);
+void leavePool(int prev);
 #endif
\ No newline at end of file
@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// deepest nesting of objects and arrays a jsonWriter keeps track of, going deeper aborts
+#define JSON_MAX_DEPTH 16
+
+// output of commands that take --output
+enum outputFormat { OUTPUT_TEXT = 0, OUTPUT_JSON };
+
+/*
+ *streaming JSON writer, every value is written to out as soon as it is added so nothing
+ *is held in memory. Values inside an object need a name, values inside an array are given NULL
+ */
+struct jsonWriter {
+	FILE *out;
+	int depth;
+	// values written so far in each open object or array, for the commas
+	int count[JSON_MAX_DEPTH];
+};
+
+int parseOutputFormat(const char *name, enum outputFormat *format);
+void jsonInit(struct jsonWriter *w, FILE *out);
+void jsonObjectStart(struct jsonWriter *w, const char *name);
+void jsonObjectEnd(struct jsonWriter *w);
+void jsonArrayStart(struct jsonWriter *w, const char *name);
+void jsonArrayEnd(struct jsonWriter *w);
+void jsonString(struct jsonWriter *w, const char *name, const char *value);
+void jsonInt(struct jsonWriter *w, const char *name, long long value);
+void jsonBool(struct jsonWriter *w, const char *name, int value);
+void jsonHex(struct jsonWriter *w, const char *name, const unsigned char *data, size_t size);
+void jsonResult(struct jsonWriter *w, int rc);
+#endif
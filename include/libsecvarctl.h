@@ -0,0 +1,196 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#ifndef LIBSECVARCTL_H
+#define LIBSECVARCTL_H
+
+/*
+ *libsecvarctl, the parsing, validation, verification and generation of secvarctl for programs
+ *that link to it rather than running the command. Everything works on buffers, nothing is
+ *printed and no file is read besides the keys given to secvarctl_signers_load().
+ *Calls share no state, they may run at the same time on different threads, only a
+ *secvarctl_signers must not be used by two calls at once.
+ *This header is all of the interface, it does not change within a major version
+ */
+#include <stddef.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SECVARCTL_API_VERSION 1
+
+// return values, the same numbers the secvarctl command exits with
+enum secvarctl_error {
+	SECVARCTL_SUCCESS = 0,
+	SECVARCTL_AUTH_FAIL = -1,
+	SECVARCTL_PKCS7_FAIL = -2,
+	SECVARCTL_ESL_FAIL = -3,
+	SECVARCTL_CERT_FAIL = -4,
+	SECVARCTL_ARG_PARSE_FAIL = -5,
+	SECVARCTL_INVALID_VAR_NAME = -6,
+	SECVARCTL_INVALID_FILE = -7,
+	SECVARCTL_FILE_WRITE_FAIL = -8,
+	SECVARCTL_INVALID_TIMESTAMP = -9,
+	SECVARCTL_HASH_FAIL = -10,
+	SECVARCTL_ALLOC_FAIL = -11,
+	SECVARCTL_UNKNOWN_COMMAND = -12,
+	SECVARCTL_HASH_REVOKED = -13
+};
+
+// what a buffer holds
+enum secvarctl_format {
+	SECVARCTL_FORMAT_AUTH = 0, // signed update, timestamp + PKCS7 + ESL's
+	SECVARCTL_FORMAT_ESL, // one or more EFI signature lists
+	SECVARCTL_FORMAT_PKCS7, // DER PKCS7 signed data
+	SECVARCTL_FORMAT_CERT // x509 certificate, DER or PEM
+};
+
+// a secure variable or an update of one
+struct secvarctl_var {
+	const char *name; // "PK", "KEK", "db", "dbx" or "TS"
+	const unsigned char *data;
+	size_t size;
+};
+
+// one entry of an ESL
+struct secvarctl_entry {
+	size_t esl; // index of the ESL holding the entry
+	unsigned char type[16]; // SignatureType GUID of the ESL
+	const char *type_name; // "X509", "SHA256", ... or "UNKNOWN", never freed
+	unsigned char owner[16]; // SignatureOwner GUID
+	const unsigned char *data; // certificate or hash, points into the parsed buffer
+	size_t size;
+};
+
+struct secvarctl_parse_result {
+	time_t timestamp; // of an auth, in seconds since the epoch, 0 for an ESL
+	size_t esl_count;
+	size_t entry_count;
+	struct secvarctl_entry *entries;
+};
+
+// an update that was verified
+struct secvarctl_signature {
+	char variable[8]; // variable the update is for
+	char signed_by[8]; // variable holding the certificate that signed it
+	int esl; // index of that certificate's ESL in signed_by
+	int append; // 1 if it was verified as an append write
+};
+
+struct secvarctl_verify_result {
+	// return of the edk2-compat processing, an OPAL error if it rejected the updates
+	int opal_rc;
+	size_t signature_count;
+	struct secvarctl_signature *signatures;
+	// every variable once the updates are applied, including TS, only set on success
+	size_t var_count;
+	struct secvarctl_var *vars;
+};
+
+// private keys and certificates to sign with, loaded once for many updates
+typedef struct secvarctl_signers secvarctl_signers;
+
+/*
+ *@param rc, return of any libsecvarctl function
+ *@return a short description of rc, never freed
+ */
+const char *secvarctl_strerror(int rc);
+
+/*
+ *finds every entry of the ESL's in an ESL or auth buffer without validating them
+ *@param format, SECVARCTL_FORMAT_ESL or SECVARCTL_FORMAT_AUTH
+ *@param data, the buffer, the result points into it
+ *@param size, length of data
+ *@param result, filled in, NOTE: FREE WITH secvarctl_parse_result_free()
+ *@return SECVARCTL_SUCCESS or error number
+ */
+int secvarctl_parse(enum secvarctl_format format, const unsigned char *data, size_t size,
+		    struct secvarctl_parse_result *result);
+void secvarctl_parse_result_free(struct secvarctl_parse_result *result);
+
+/*
+ *the checks of `secvarctl validate`
+ *@param format, what data holds
+ *@param name, variable data is for, changes the checks of ESL's and auths, may be NULL
+ *@param data, the buffer to validate
+ *@param size, length of data
+ *@return SECVARCTL_SUCCESS or error number
+ */
+int secvarctl_validate(enum secvarctl_format format, const char *name, const unsigned char *data,
+		       size_t size);
+
+/*
+ *the checks of `secvarctl verify`, applies updates to the current variables the way firmware
+ *would. current and updates are copied, they may be freed once this returns
+ *@param current, the current variables
+ *@param current_count, number of current variables, with no PK the updates are in setup mode
+ *@param updates, auths in the order they are applied
+ *@param update_count, number of updates
+ *@param result, filled in even on failure, NOTE: FREE WITH secvarctl_verify_result_free()
+ *@return SECVARCTL_SUCCESS, SECVARCTL_AUTH_FAIL if processing rejected the updates (see
+ *	  result->opal_rc) or another error number if the input is not valid
+ */
+int secvarctl_verify(const struct secvarctl_var *current, size_t current_count,
+		     const struct secvarctl_var *updates, size_t update_count,
+		     struct secvarctl_verify_result *result);
+void secvarctl_verify_result_free(struct secvarctl_verify_result *result);
+
+/*
+ *loads PEM private keys and their certificates to sign updates with
+ *@param signers, returned signers, NOTE: FREE WITH secvarctl_signers_free()
+ *@param crt_files, certificate of every signer
+ *@param key_files, private key of every signer
+ *@param count, number of signers
+ *@return SECVARCTL_SUCCESS or error number
+ */
+int secvarctl_signers_load(secvarctl_signers **signers, const char **crt_files,
+			   const char **key_files, int count);
+void secvarctl_signers_free(secvarctl_signers *signers);
+
+/*
+ *makes an ESL holding one x509 certificate
+ *@param cert, DER or PEM certificate
+ *@param size, length of cert
+ *@param esl, returned ESL, NOTE: FREE WITH secvarctl_free()
+ *@param esl_size, length of esl
+ *@return SECVARCTL_SUCCESS or error number
+ */
+int secvarctl_generate_esl(const unsigned char *cert, size_t size, unsigned char **esl,
+			   size_t *esl_size);
+
+/*
+ *makes an ESL of hashes, for dbx
+ *@param alg, "SHA1", "SHA224", "SHA256", "SHA384" or "SHA512"
+ *@param hashes, one or more hashes of alg one after the other
+ *@param size, length of hashes
+ *@param esl, returned ESL, NOTE: FREE WITH secvarctl_free()
+ *@param esl_size, length of esl
+ *@return SECVARCTL_SUCCESS or error number
+ */
+int secvarctl_generate_hash_esl(const char *alg, const unsigned char *hashes, size_t size,
+				unsigned char **esl, size_t *esl_size);
+
+/*
+ *signs an ESL into an auth for a variable
+ *@param name, variable the update is for, "PK", "KEK", "db" or "dbx"
+ *@param esl, new contents of the variable, may be empty to remove them
+ *@param esl_size, length of esl
+ *@param timestamp, time of the update in seconds since the epoch, must be later than the last
+ *@param append, 1 to add esl to the variable rather than replace it
+ *@param signers, from secvarctl_signers_load()
+ *@param auth, returned auth, NOTE: FREE WITH secvarctl_free()
+ *@param auth_size, length of auth
+ *@return SECVARCTL_SUCCESS or error number
+ */
+int secvarctl_generate_auth(const char *name, const unsigned char *esl, size_t esl_size,
+			    time_t timestamp, int append, secvarctl_signers *signers,
+			    unsigned char **auth, size_t *auth_size);
+
+// frees a buffer returned by libsecvarctl
+void secvarctl_free(void *buf);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,24 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+
+// size of the buffer that text printed to stdout is gathered in before it is written
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+/*
+ *buffered stdout for commands that print a lot of text, such as reading a large dbx.
+ *Between outHold() and outRelease() everything is gathered and written with a few large
+ *write() calls, outside of them every call is written right away. prlog() flushes the buffer
+ *before printing and outFlush() flushes stdio before writing, so both can be mixed freely.
+ *While stdout holds JSON, see logToStderr(), the text goes straight to stderr
+ */
+void outHold(void);
+void outRelease(void);
+void outFlush(void);
+void outWrite(const void *data, size_t size);
+void outPrintf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+void outHex(const unsigned char *data, size_t size, char separator);
+#endif
@@ -3,8 +3,10 @@
 #ifndef PRLOG_H
 #define PRLOG_H
 #include <stdio.h>
-extern int verbose;
-#define MAXLEVEL verbose
+#include "output.h"
+// log level of the context bound to the calling thread, see bindCtx()
+int logLevel(void);
+#define MAXLEVEL logLevel()
 #define PR_EMERG 0
 #define PR_ALERT 1
 #define PR_CRIT 2
@@ -14,9 +16,21 @@ extern int verbose;
 #define PR_PRINTF PR_NOTICE
 #define PR_INFO 6
 #define PR_DEBUG 7
+/*
+ *errors go to stderr so stdout only holds the output of a command, anything else is printed
+ *after the text output.c has gathered so far. While stdout holds JSON every level goes to
+ *stderr, see logToStderr()
+ */
+int logToStderr(void);
 #define prlog(l, ...)                                                                              \
 	do {                                                                                       \
-		if (l <= MAXLEVEL)                                                                 \
-			fprintf((l <= PR_ERR) ? stderr : stdout, ##__VA_ARGS__);                   \
+		if (l <= MAXLEVEL) {                                                               \
+			if (l <= PR_ERR || logToStderr())                                          \
+				fprintf(stderr, ##__VA_ARGS__);                                    \
+			else {                                                                     \
+				outFlush();                                                        \
+				fprintf(stdout, ##__VA_ARGS__);                                    \
+			}                                                                          \
+		}                                                                                  \
 	} while (0)
 #endif
\ No newline at end of file
@@ -15,6 +15,4 @@ struct backend {
 	struct command *commands;
 };
 
-extern int verbose;
-
 #endif
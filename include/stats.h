@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+// phases timed by --stats, a phase that runs inside another one is counted in both
+enum statsPhase {
+	STATS_FILE_IO = 0,
+	STATS_PARSE_X509,
+	STATS_VALIDATE_ESL,
+	STATS_HASH_TO_VERIFY,
+	STATS_PKCS7_VERIFY,
+	STATS_PROCESS,
+	STATS_PHASE_COUNT
+};
+
+// operations counted by --stats
+enum statsCounter {
+	STATS_BYTES_HASHED = 0,
+	STATS_X509_PARSES,
+	STATS_RSA_VERIFIES,
+	STATS_RSA_SIGNS,
+	STATS_ALLOCATIONS, // made by secvarctl's own code, not the crypto library, see alloc.c
+	STATS_COUNTER_COUNT
+};
+
+enum statsFormat { STATS_OFF = 0, STATS_TEXT, STATS_JSON };
+
+extern enum statsFormat statsFormat;
+
+void statsEnable(enum statsFormat format);
+uint64_t statsStart(void);
+void statsEnd(enum statsPhase phase, uint64_t start);
+void statsAdd(enum statsCounter counter, uint64_t count);
+void printStats(void);
+#endif
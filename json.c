@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "err.h"
+#include "prlog.h"
+#include "json.h"
+#include "context.h"
+
+/*
+ *gets the format given to --output
+ *@param name, argument of --output, "text" or "json"
+ *@param format, returned format
+ *@return SUCCESS or ARG_PARSE_FAIL if the format is unknown
+ */
+int parseOutputFormat(const char *name, enum outputFormat *format)
+{
+	if (!strcmp(name, "text"))
+		*format = OUTPUT_TEXT;
+	else if (!strcmp(name, "json"))
+		*format = OUTPUT_JSON;
+	else {
+		prlog(PR_ERR, "ERROR: unknown output format %s, expected 'text' or 'json'\n", name);
+		return ARG_PARSE_FAIL;
+	}
+
+	return SUCCESS;
+}
+
+/*
+ *sets up a writer, if it writes to stdout the messages of prlog() go to stderr from now on
+ *so they do not end up inside the JSON
+ *@param w, writer to set up
+ *@param out, stream the JSON is written to
+ */
+void jsonInit(struct jsonWriter *w, FILE *out)
+{
+	struct secvarctl_ctx *ctx = boundCtx();
+
+	if (out == stdout && ctx)
+		ctx->log_to_stderr = true;
+	w->out = out;
+	w->depth = 0;
+	w->count[0] = 0;
+}
+
+// writes str as a JSON string, escaping quotes, backslashes and control characters
+static void writeString(FILE *out, const char *str)
+{
+	const unsigned char *c = (const unsigned char *)str;
+
+	fputc('"', out);
+	for (; *c; c++) {
+		if (*c == '"' || *c == '\\')
+			fprintf(out, "\\%c", *c);
+		else if (*c < 0x20)
+			fprintf(out, "\\u%04x", *c);
+		else
+			fputc(*c, out);
+	}
+	fputc('"', out);
+}
+
+// writes the comma and name that come before every value
+static void writeName(struct jsonWriter *w, const char *name)
+{
+	if (w->count[w->depth]++)
+		fputc(',', w->out);
+	if (name) {
+		writeString(w->out, name);
+		fputc(':', w->out);
+	}
+}
+
+static void openNested(struct jsonWriter *w, const char *name, char bracket)
+{
+	// the nesting is fixed by the code writing the document, going deeper is a bug
+	if (w->depth >= JSON_MAX_DEPTH - 1) {
+		prlog(PR_EMERG, "BUG: JSON nested deeper than %d levels\n", JSON_MAX_DEPTH - 1);
+		abort();
+	}
+	writeName(w, name);
+	fputc(bracket, w->out);
+	w->depth++;
+	w->count[w->depth] = 0;
+}
+
+static void closeNested(struct jsonWriter *w, char bracket)
+{
+	if (w->depth == 0) {
+		prlog(PR_EMERG, "BUG: JSON closed more than it was opened\n");
+		abort();
+	}
+	fputc(bracket, w->out);
+	w->depth--;
+	// one line per document, handed over as soon as it is done
+	if (w->depth == 0) {
+		w->count[0] = 0;
+		fputc('\n', w->out);
+		fflush(w->out);
+	}
+}
+
+void jsonObjectStart(struct jsonWriter *w, const char *name)
+{
+	openNested(w, name, '{');
+}
+
+void jsonObjectEnd(struct jsonWriter *w)
+{
+	closeNested(w, '}');
+}
+
+void jsonArrayStart(struct jsonWriter *w, const char *name)
+{
+	openNested(w, name, '[');
+}
+
+void jsonArrayEnd(struct jsonWriter *w)
+{
+	closeNested(w, ']');
+}
+
+void jsonString(struct jsonWriter *w, const char *name, const char *value)
+{
+	writeName(w, name);
+	if (value)
+		writeString(w->out, value);
+	else
+		fputs("null", w->out);
+}
+
+void jsonInt(struct jsonWriter *w, const char *name, long long value)
+{
+	writeName(w, name);
+	fprintf(w->out, "%lld", value);
+}
+
+void jsonBool(struct jsonWriter *w, const char *name, int value)
+{
+	writeName(w, name);
+	fputs(value ? "true" : "false", w->out);
+}
+
+/*
+ *writes the verdict of a command or record as "result" and "rc"
+ *@param w, writer inside an object
+ *@param rc, SUCCESS or error number
+ */
+void jsonResult(struct jsonWriter *w, int rc)
+{
+	jsonString(w, "result", rc ? "FAILURE" : "SUCCESS");
+	jsonInt(w, "rc", rc);
+}
+
+/*
+ *writes data as a string of lower case hex digits
+ */
+void jsonHex(struct jsonWriter *w, const char *name, const unsigned char *data, size_t size)
+{
+	static const char digits[] = "0123456789abcdef";
+
+	writeName(w, name);
+	fputc('"', w->out);
+	for (size_t i = 0; i < size; i++) {
+		fputc(digits[data[i] >> 4], w->out);
+		fputc(digits[data[i] & 0xf], w->out);
+	}
+	fputc('"', w->out);
+}
@@ -0,0 +1,493 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "err.h"
+#include "prlog.h"
+#include "external/skiboot/include/opal-api.h"
+#include "external/skiboot/libstb/secvar/secvar.h"
+#include "backends/edk2-compat/include/edk2-svc.h"
+#include "libsecvarctl.h"
+
+// the library never prints, every prlog() is below this level
+#define LIB_LOG_LEVEL (PR_EMERG - 1)
+
+extern struct secvar_backend_driver edk2_compatible_v1;
+
+// the public return values are the ones of err.h under their own names
+_Static_assert((int)SECVARCTL_AUTH_FAIL == (int)AUTH_FAIL, "must match err.h");
+_Static_assert((int)SECVARCTL_ALLOC_FAIL == (int)ALLOC_FAIL, "must match err.h");
+_Static_assert((int)SECVARCTL_HASH_REVOKED == (int)HASH_REVOKED, "must match err.h");
+
+struct secvarctl_signers {
+	crypto_pkcs7_signers *signers;
+};
+
+/*
+ *every exported function that may reach prlog() runs in a context of its own, so calls on
+ *different threads share nothing and a thread without a context never prints
+ *@param ctx, context of the call, on its stack
+ *@return the context the thread had before, give it to endCall()
+ */
+static struct secvarctl_ctx *beginCall(struct secvarctl_ctx *ctx)
+{
+	initCtx(ctx, LIB_LOG_LEVEL);
+
+	return bindCtx(ctx);
+}
+
+static void endCall(struct secvarctl_ctx *ctx, struct secvarctl_ctx *prev)
+{
+	bindCtx(prev);
+	clearCtx(ctx);
+}
+
+const char *secvarctl_strerror(int rc)
+{
+	switch (rc) {
+	case SUCCESS:
+		return "success";
+	case AUTH_FAIL:
+		return "invalid auth";
+	case PKCS7_FAIL:
+		return "invalid PKCS7";
+	case ESL_FAIL:
+		return "invalid ESL";
+	case CERT_FAIL:
+		return "invalid certificate";
+	case ARG_PARSE_FAIL:
+		return "invalid argument";
+	case INVALID_VAR_NAME:
+		return "invalid variable name";
+	case INVALID_FILE:
+		return "invalid file";
+	case FILE_WRITE_FAIL:
+		return "failed to write file";
+	case INVALID_TIMESTAMP:
+		return "invalid timestamp";
+	case HASH_FAIL:
+		return "invalid hash";
+	case ALLOC_FAIL:
+		return "out of memory";
+	case UNKNOWN_COMMAND:
+		return "not supported by this build";
+	case HASH_REVOKED:
+		return "hash is revoked";
+	default:
+		return "unknown error";
+	}
+}
+
+/*
+ *finds the ESL's after the PKCS7 of an auth, the same way validateAuth() does
+ *@param data, auth buffer
+ *@param size, length of data
+ *@param offset, returned offset of the first ESL
+ *@return SUCCESS or AUTH_FAIL if the sizes in the header do not fit in the buffer
+ */
+static int getAuthESLOffset(const unsigned char *data, size_t size, size_t *offset)
+{
+	const struct efi_variable_authentication_2 *auth = (const void *)data;
+	size_t length;
+
+	if (size < sizeof(*auth))
+		return AUTH_FAIL;
+	length = auth->auth_info.hdr.dw_length;
+	if (length < sizeof(auth->auth_info.hdr) + sizeof(auth->auth_info.cert_type) ||
+	    length > size - sizeof(auth->timestamp))
+		return AUTH_FAIL;
+	*offset = sizeof(auth->timestamp) + length;
+
+	return SUCCESS;
+}
+
+int secvarctl_parse(enum secvarctl_format format, const unsigned char *data, size_t size,
+		    struct secvarctl_parse_result *result)
+{
+	int rc = SUCCESS;
+	size_t offset = 0, allocated = 0;
+	struct esl_iter iter;
+	struct esl_entry entry;
+	const EFI_SIGNATURE_LIST *list;
+	struct secvarctl_entry *out;
+	struct efi_time t;
+	struct tm tm = { 0 };
+	struct secvarctl_ctx ctx, *prev = beginCall(&ctx);
+
+	memset(result, 0, sizeof(*result));
+	if (format == SECVARCTL_FORMAT_AUTH) {
+		rc = getAuthESLOffset(data, size, &offset);
+		if (rc)
+			goto out;
+		memcpy(&t, data, sizeof(t));
+		tm.tm_year = t.year - 1900;
+		tm.tm_mon = t.month - 1;
+		tm.tm_mday = t.day;
+		tm.tm_hour = t.hour;
+		tm.tm_min = t.minute;
+		tm.tm_sec = t.second;
+		result->timestamp = timegm(&tm);
+	} else if (format != SECVARCTL_FORMAT_ESL) {
+		rc = ARG_PARSE_FAIL;
+		goto out;
+	}
+
+	esl_iter_init(&iter, (const char *)data + offset, size - offset);
+	while ((rc = esl_iter_next_list(&iter, &list)) == OPAL_SUCCESS) {
+		while (esl_iter_next_entry(&iter, &entry) == OPAL_SUCCESS) {
+			if (result->entry_count == allocated) {
+				allocated = allocated ? allocated * 2 : 16;
+				if (reallocArray((void **)&result->entries, allocated,
+						 sizeof(*result->entries))) {
+					result->entry_count = 0;
+					rc = ALLOC_FAIL;
+					goto out;
+				}
+			}
+			out = &result->entries[result->entry_count++];
+			out->esl = result->esl_count;
+			memcpy(out->type, entry.type, sizeof(out->type));
+			out->type_name = getSigType(*entry.type);
+			memcpy(out->owner, entry.owner, sizeof(out->owner));
+			out->data = entry.data;
+			out->size = entry.data_size;
+		}
+		result->esl_count++;
+	}
+	if (rc != OPAL_EMPTY) {
+		secvarctl_parse_result_free(result);
+		rc = ESL_FAIL;
+	} else
+		rc = SUCCESS;
+
+out:
+	endCall(&ctx, prev);
+
+	return rc;
+}
+
+void secvarctl_parse_result_free(struct secvarctl_parse_result *result)
+{
+	free(result->entries);
+	memset(result, 0, sizeof(*result));
+}
+
+int secvarctl_validate(enum secvarctl_format format, const char *name, const unsigned char *data,
+		       size_t size)
+{
+	int rc;
+	struct secvarctl_ctx ctx, *prev = beginCall(&ctx);
+
+	switch (format) {
+	case SECVARCTL_FORMAT_AUTH:
+		rc = validateAuth(data, size, name);
+		break;
+	case SECVARCTL_FORMAT_ESL:
+		rc = validateESL(data, size, name);
+		break;
+	case SECVARCTL_FORMAT_PKCS7:
+		rc = validatePKCS7(data, size);
+		break;
+	case SECVARCTL_FORMAT_CERT:
+		rc = validateCert(data, size, name);
+		break;
+	default:
+		rc = ARG_PARSE_FAIL;
+		break;
+	}
+	endCall(&ctx, prev);
+
+	return rc;
+}
+
+/*
+ *copies buffers into a bank of secvars
+ *@param arena, the secvars are allocated from
+ *@param bank, the secvars are added to
+ *@param vars, variables to add
+ *@param count, number of variables
+ *@return SUCCESS or error number
+ */
+static int fillBank(struct secvar_arena *arena, struct list_head *bank,
+		    const struct secvarctl_var *vars, size_t count)
+{
+	struct secvar *var;
+
+	for (size_t i = 0; i < count; i++) {
+		if (!vars[i].name || isVariable(vars[i].name))
+			return INVALID_VAR_NAME;
+		var = new_secvar_in(arena, vars[i].name, strlen(vars[i].name) + 1,
+				    (const char *)vars[i].data, vars[i].size, 0);
+		if (!var)
+			return ALLOC_FAIL;
+		list_add_tail(bank, &var->link);
+	}
+
+	return SUCCESS;
+}
+
+// updateSignerListener of secvarctl_verify(), ctx is the result
+static void addSignature(void *ctx, const char *key, const char *authority, int esl, bool append)
+{
+	struct secvarctl_verify_result *result = ctx;
+	struct secvarctl_signature *sig;
+
+	// at most one signature per update, the array was sized for all of them
+	sig = &result->signatures[result->signature_count++];
+	snprintf(sig->variable, sizeof(sig->variable), "%s", key);
+	snprintf(sig->signed_by, sizeof(sig->signed_by), "%s", authority);
+	sig->esl = esl;
+	sig->append = append;
+}
+
+/*
+ *copies the variables of bank into result
+ *@param result, gets the variables
+ *@param bank, variables after processing
+ *@return SUCCESS or ALLOC_FAIL
+ */
+static int copyBank(struct secvarctl_verify_result *result, struct list_head *bank)
+{
+	struct secvar *var;
+	unsigned char *data;
+	char *name;
+
+	// one more than needed so an empty bank is not a failed allocation
+	result->vars = calloc(list_length(bank) + 1, sizeof(*result->vars));
+	if (!result->vars)
+		return ALLOC_FAIL;
+	list_for_each (bank, var, link) {
+		name = strdup(var->key);
+		// malloc(0) may be NULL, give empty variables one byte
+		data = malloc(var->data_size ? var->data_size : 1);
+		if (!name || !data) {
+			free(name);
+			free(data);
+			return ALLOC_FAIL;
+		}
+		memcpy(data, var->data, var->data_size);
+		result->vars[result->var_count++] =
+			(struct secvarctl_var){ .name = name, .data = data, .size = var->data_size };
+	}
+
+	return SUCCESS;
+}
+
+int secvarctl_verify(const struct secvarctl_var *current, size_t current_count,
+		     const struct secvarctl_var *updates, size_t update_count,
+		     struct secvarctl_verify_result *result)
+{
+	int rc;
+	struct list_head variable_bank, update_bank;
+	struct secvarctl_ctx ctx, *prev = beginCall(&ctx);
+
+	memset(result, 0, sizeof(*result));
+	list_head_init(&variable_bank);
+	list_head_init(&update_bank);
+	result->signatures = calloc(update_count ? update_count : 1, sizeof(*result->signatures));
+	ctx.arena = new_secvar_arena();
+	if (!result->signatures || !ctx.arena) {
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	rc = fillBank(ctx.arena, &variable_bank, current, current_count);
+	if (!rc)
+		rc = fillBank(ctx.arena, &update_bank, updates, update_count);
+	if (rc)
+		goto out;
+	rc = validateBanks(&update_bank, &variable_bank);
+	if (rc)
+		goto out;
+	result->opal_rc = edk2_compatible_v1.pre_process(&ctx, &variable_bank, &update_bank);
+	if (result->opal_rc) {
+		rc = AUTH_FAIL;
+		goto out;
+	}
+	ctx.signer_listener = addSignature;
+	ctx.signer_listener_ctx = result;
+	result->opal_rc = edk2_compatible_v1.process(&ctx, &variable_bank, &update_bank);
+	if (result->opal_rc) {
+		rc = AUTH_FAIL;
+		goto out;
+	}
+	rc = copyBank(result, &variable_bank);
+
+out:
+	clear_bank_list(&variable_bank);
+	clear_bank_list(&update_bank);
+	// drops the certificate cache and the arena, the banks held it until now
+	endCall(&ctx, prev);
+
+	return rc;
+}
+
+void secvarctl_verify_result_free(struct secvarctl_verify_result *result)
+{
+	for (size_t i = 0; i < result->var_count; i++) {
+		free((void *)result->vars[i].name);
+		free((void *)result->vars[i].data);
+	}
+	free(result->vars);
+	free(result->signatures);
+	memset(result, 0, sizeof(*result));
+}
+
+#ifndef NO_CRYPTO
+int secvarctl_signers_load(secvarctl_signers **signers, const char **crt_files,
+			   const char **key_files, int count)
+{
+	int rc;
+	struct secvarctl_ctx ctx, *prev = beginCall(&ctx);
+
+	*signers = calloc(1, sizeof(**signers));
+	if (!*signers) {
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	rc = crypto_pkcs7_signers_load(&(*signers)->signers, crt_files, key_files, count,
+				       CRYPTO_MD_SHA256);
+	if (rc) {
+		free(*signers);
+		*signers = NULL;
+	}
+
+out:
+	endCall(&ctx, prev);
+
+	return rc;
+}
+
+void secvarctl_signers_free(secvarctl_signers *signers)
+{
+	struct secvarctl_ctx ctx, *prev;
+
+	if (!signers)
+		return;
+	prev = beginCall(&ctx);
+	crypto_pkcs7_signers_free(signers->signers);
+	free(signers);
+	endCall(&ctx, prev);
+}
+
+int secvarctl_generate_esl(const unsigned char *cert, size_t size, unsigned char **esl,
+			   size_t *esl_size)
+{
+	int rc;
+	unsigned char *der = NULL;
+	size_t derSize;
+	struct secvarctl_ctx ctx, *prev = beginCall(&ctx);
+
+	// a certificate that is not PEM is taken to be DER already
+	if (crypto_convert_pem_to_der(cert, size, &der, &derSize)) {
+		der = NULL;
+		derSize = size;
+	}
+	rc = validateCert(der ? der : cert, derSize, NULL);
+	if (!rc)
+		rc = toESL(der ? der : cert, derSize, EFI_CERT_X509_GUID, esl, esl_size);
+	if (der)
+		free(der);
+	endCall(&ctx, prev);
+
+	return rc;
+}
+
+int secvarctl_generate_hash_esl(const char *alg, const unsigned char *hashes, size_t size,
+				unsigned char **esl, size_t *esl_size)
+{
+	int rc = ARG_PARSE_FAIL;
+	struct secvarctl_ctx ctx, *prev = beginCall(&ctx);
+
+	for (int i = 0; i < ARRAY_SIZE(hash_functions); i++) {
+		if (strcmp(alg, hash_functions[i].name))
+			continue;
+		if (!size || size % hash_functions[i].size)
+			rc = HASH_FAIL;
+		else
+			rc = toHashESL(hashes, size, &hash_functions[i], esl, esl_size);
+		break;
+	}
+	endCall(&ctx, prev);
+
+	return rc;
+}
+
+int secvarctl_generate_auth(const char *name, const unsigned char *esl, size_t esl_size,
+			    time_t timestamp, int append, secvarctl_signers *signers,
+			    unsigned char **auth, size_t *auth_size)
+{
+	int rc;
+	struct efi_time time = { 0 };
+	struct tm tm;
+	struct secvarctl_ctx ctx, *prev = beginCall(&ctx);
+
+	if (!name || isVariable(name) || !strcmp(name, "TS")) {
+		rc = INVALID_VAR_NAME;
+		goto out;
+	}
+	if (!gmtime_r(&timestamp, &tm)) {
+		rc = INVALID_TIMESTAMP;
+		goto out;
+	}
+	time.year = 1900 + tm.tm_year;
+	time.month = tm.tm_mon + 1;
+	time.day = tm.tm_mday;
+	time.hour = tm.tm_hour;
+	time.minute = tm.tm_min;
+	time.second = tm.tm_sec;
+	rc = validateTime(&time);
+	if (rc)
+		goto out;
+	if (esl_size) {
+		rc = validateESL(esl, esl_size, name);
+		if (rc)
+			goto out;
+	}
+	rc = generateSignedAuth(esl, esl_size, name, &time,
+				SECVAR_ATTRIBUTES | (append ? EFI_VARIABLE_APPEND_WRITE : 0),
+				signers->signers, auth, auth_size);
+
+out:
+	endCall(&ctx, prev);
+
+	return rc;
+}
+#else
+int secvarctl_signers_load(secvarctl_signers **signers, const char **crt_files,
+			   const char **key_files, int count)
+{
+	*signers = NULL;
+
+	return UNKNOWN_COMMAND;
+}
+
+void secvarctl_signers_free(secvarctl_signers *signers)
+{
+}
+
+int secvarctl_generate_esl(const unsigned char *cert, size_t size, unsigned char **esl,
+			   size_t *esl_size)
+{
+	return UNKNOWN_COMMAND;
+}
+
+int secvarctl_generate_hash_esl(const char *alg, const unsigned char *hashes, size_t size,
+				unsigned char **esl, size_t *esl_size)
+{
+	return UNKNOWN_COMMAND;
+}
+
+int secvarctl_generate_auth(const char *name, const unsigned char *esl, size_t esl_size,
+			    time_t timestamp, int append, secvarctl_signers *signers,
+			    unsigned char **auth, size_t *auth_size)
+{
+	return UNKNOWN_COMMAND;
+}
+#endif
+
+void secvarctl_free(void *buf)
+{
+	free(buf);
+}
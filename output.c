@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h> // writev
+#include "prlog.h"
+#include "output.h"
+
+/*
+ *every call takes the lock of stdout, batch runs commands on several threads and this keeps
+ *their text from being mixed inside of a line, the same as printf() did
+ */
+static char buffer[OUTPUT_BUFFER_SIZE];
+static size_t used;
+static int holds;
+
+// the two hex digits of every byte, "000102...ff"
+#define HEX_ROW(h)                                                                                 \
+	h "0" h "1" h "2" h "3" h "4" h "5" h "6" h "7" h "8" h "9" h "a" h "b" h "c" h "d" h "e" h "f"
+static const char hexPairs[] = HEX_ROW("0") HEX_ROW("1") HEX_ROW("2") HEX_ROW("3") HEX_ROW("4")
+	HEX_ROW("5") HEX_ROW("6") HEX_ROW("7") HEX_ROW("8") HEX_ROW("9") HEX_ROW("a") HEX_ROW("b")
+	HEX_ROW("c") HEX_ROW("d") HEX_ROW("e") HEX_ROW("f");
+
+/*
+ *writes every byte of iov to stdout, retrying short writes
+ *@param iov, pieces to write, changed while writing
+ *@param count, number of pieces
+ */
+static void writeAll(struct iovec *iov, int count)
+{
+	ssize_t written;
+
+	while (count) {
+		written = writev(STDOUT_FILENO, iov, count);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			prlog(PR_ERR, "ERROR: failed to write to stdout: %s\n", strerror(errno));
+			return;
+		}
+		while (count && (size_t)written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count) {
+			iov->iov_base = (char *)iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+}
+
+/*
+ *writes the buffer and then data, anything printf() left in stdio goes first
+ *@param data, written after the buffer, NULL if there is none
+ *@param size, length of data
+ */
+static void writeOut(const void *data, size_t size)
+{
+	struct iovec iov[2];
+	int count = 0;
+
+	if (!used && !size)
+		return;
+	fflush(stdout);
+	if (used)
+		iov[count++] = (struct iovec){ .iov_base = buffer, .iov_len = used };
+	if (size)
+		iov[count++] = (struct iovec){ .iov_base = (void *)data, .iov_len = size };
+	writeAll(iov, count);
+	used = 0;
+}
+
+// ends every call, outside of outHold() text is written as soon as it is printed
+static void done(void)
+{
+	if (!holds)
+		writeOut(NULL, 0);
+	funlockfile(stdout);
+}
+
+/*
+ *starts gathering output, calls can be nested and the text is written when the last
+ *outRelease() is called or when the buffer is full
+ */
+void outHold(void)
+{
+	flockfile(stdout);
+	holds++;
+	funlockfile(stdout);
+}
+
+void outRelease(void)
+{
+	flockfile(stdout);
+	if (holds > 0)
+		holds--;
+	done();
+}
+
+// writes everything gathered so far
+void outFlush(void)
+{
+	flockfile(stdout);
+	writeOut(NULL, 0);
+	funlockfile(stdout);
+}
+
+/*
+ *@param data, bytes to print as they are
+ *@param size, length of data, data too large for the buffer is written without copying it
+ */
+void outWrite(const void *data, size_t size)
+{
+	if (logToStderr()) {
+		fwrite(data, 1, size, stderr);
+		return;
+	}
+	flockfile(stdout);
+	if (size > sizeof(buffer) - used) {
+		if (size >= sizeof(buffer) / 2) {
+			writeOut(data, size);
+			size = 0;
+		} else
+			writeOut(NULL, 0);
+	}
+	memcpy(buffer + used, data, size);
+	used += size;
+	done();
+}
+
+/*
+ *printf() into the buffer
+ *@param format, printf format string followed by its arguments
+ */
+void outPrintf(const char *format, ...)
+{
+	va_list ap;
+	int len;
+	char *large;
+
+	if (logToStderr()) {
+		va_start(ap, format);
+		vfprintf(stderr, format, ap);
+		va_end(ap);
+		return;
+	}
+	flockfile(stdout);
+	va_start(ap, format);
+	len = vsnprintf(buffer + used, sizeof(buffer) - used, format, ap);
+	va_end(ap);
+	if (len < 0)
+		goto out;
+	if ((size_t)len < sizeof(buffer) - used) {
+		used += len;
+		goto out;
+	}
+	// did not fit, the partial text is past used so it is simply printed again
+	writeOut(NULL, 0);
+	large = (size_t)len < sizeof(buffer) ? buffer : malloc(len + 1);
+	if (!large)
+		goto out;
+	va_start(ap, format);
+	vsnprintf(large, len + 1, format, ap);
+	va_end(ap);
+	if (large == buffer)
+		used = len;
+	else {
+		writeOut(large, len);
+		free(large);
+	}
+out:
+	done();
+}
+
+/*
+ *prints data as lower case hex digits, two for every byte
+ *@param data, bytes to print
+ *@param size, length of data
+ *@param separator, printed before every byte, '\0' for none
+ */
+void outHex(const unsigned char *data, size_t size, char separator)
+{
+	size_t perByte = separator ? 3 : 2, room;
+	char *p;
+
+	if (logToStderr()) {
+		for (size_t i = 0; i < size; i++) {
+			if (separator)
+				fputc(separator, stderr);
+			fwrite(hexPairs + 2 * data[i], 1, 2, stderr);
+		}
+		return;
+	}
+	flockfile(stdout);
+	while (size) {
+		room = (sizeof(buffer) - used) / perByte;
+		if (!room) {
+			writeOut(NULL, 0);
+			continue;
+		}
+		if (room > size)
+			room = size;
+		p = buffer + used;
+		for (size_t i = 0; i < room; i++) {
+			if (separator)
+				*p++ = separator;
+			memcpy(p, hexPairs + 2 * data[i], 2);
+			p += 2;
+		}
+		used = p - buffer;
+		data += room;
+		size -= room;
+	}
+	done();
+}
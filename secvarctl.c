@@ -5,9 +5,12 @@
 #include <stdlib.h>
 #include "prlog.h"
 #include "secvarctl.h"
+#include "stats.h"
+#include "alloc.h"
+#include "context.h"
 
-int verbose = PR_WARNING;
 static struct backend *getBackend();
+static bool writesJSON(int argc, char *argv[]);
 
 static struct backend backends[] = {
 	{ .name = "ibm,edk2-compat-v1",
@@ -17,9 +20,12 @@ static struct backend backends[] = {
 
 void usage()
 {
-	printf("USAGE: \n\t$ secvarctl [COMMAND]\n"
-	       "COMMANDs:\n"
+	printf("USAGE: \n\t$ secvarctl [OPTIONS] [COMMAND]\n"
+	       "OPTIONs:\n"
 	       "\t--help/--usage\n\t"
+	       "-v\t\tverbose, print process info\n\t"
+	       "--stats[=json]\tprint time spent per phase and operation counts to stderr\n"
+	       "COMMANDs:\n\t"
 	       "read\t\tprints info on secure variables,\n\t\t\t"
 	       "use 'secvarctl read --usage/help' for more information\n\t"
 	       "write\t\tupdates secure variable with new auth,\n\t\t\t"
@@ -27,7 +33,11 @@ void usage()
 	       "\n\tvalidate\tvalidates format of given esl/cert/auth,\n\t\t\t"
 	       "use 'secvarctl validate --usage/help' for more information\n\t"
 	       "verify\t\tcompares proposed variable to the current variables,\n\t\t\t"
-	       "use 'secvarctl verify --usage/help' for more information\n"
+	       "use 'secvarctl verify --usage/help' for more information\n\t"
+	       "batch\t\truns a manifest of commands in a single process,\n\t\t\t"
+	       "use 'secvarctl batch --usage/help' for more information\n\t"
+	       "query\t\tchecks if hashes or files are revoked by the dbx,\n\t\t\t"
+	       "use 'secvarctl query --usage/help' for more information\n"
 #ifndef NO_CRYPTO
 	       "\tgenerate\tcreates relevant files for secure variable management,\n\t\t\t"
 	       "use 'secvarctl generate --usage/help' for more information\n"
@@ -42,7 +52,9 @@ void help()
 	       "read - print out information on their current secure vaiables\n\t\t"
 	       "write - update the given variable's key value, committed upon reboot\n\t\t"
 	       "validate  -  checks format requirements are met for the given file type\n\t\t"
-	       "verify - checks that the given files are correctly signed by the current variables\n"
+	       "verify - checks that the given files are correctly signed by the current variables\n\t\t"
+	       "batch - runs a list of the above commands in one process\n\t\t"
+	       "query - checks if hashes or files are revoked by the dbx\n"
 #ifndef NO_CRYPTO
 	       "\t\tgenerate - create files that are relevant to the secure variable management process\n"
 #endif
@@ -55,6 +67,10 @@ int main(int argc, char *argv[])
 	int rc, i;
 	char *subcommand = NULL;
 	struct backend *backend = NULL;
+	struct secvarctl_ctx ctx;
+
+	initCtx(&ctx, PR_WARNING);
+	bindCtx(&ctx);
 
 	if (argc < 2) {
 		usage();
@@ -71,13 +87,22 @@ int main(int argc, char *argv[])
 			return SUCCESS;
 		}
 		if (!strcmp(*argv, "-v")) {
-			verbose = PR_DEBUG;
+			ctx.verbose = PR_DEBUG;
+		} else if (!strcmp(*argv, "--stats")) {
+			statsEnable(STATS_TEXT);
+		} else if (!strcmp(*argv, "--stats=json")) {
+			statsEnable(STATS_JSON);
 		}
 	}
+	// without --stats the allocation wrappers of alloc.c do not count
+	if (statsFormat)
+		allocationCountStart();
 	if (argc <= 0) {
 		prlog(PR_ERR, "ERROR: No command found\n");
 		return ARG_PARSE_FAIL;
 	}
+	// the warnings below are printed before the command parses --output
+	ctx.log_to_stderr = writesJSON(argc, argv);
 
 	// if backend is not edk2-compat print continuing despite some funtionality not working
 	backend = getBackend();
@@ -93,7 +118,7 @@ int main(int argc, char *argv[])
 	rc = UNKNOWN_COMMAND;
 	for (i = 0; i < backend->countCmds; i++) {
 		if (!strncmp(subcommand, backend->commands[i].name, 32)) {
-			rc = backend->commands[i].func(argc, argv);
+			rc = backend->commands[i].func(&ctx, argc, argv);
 			break;
 		}
 	}
@@ -101,10 +126,30 @@ int main(int argc, char *argv[])
 		prlog(PR_ERR, "ERROR:Unknown command %s\n", subcommand);
 		usage();
 	}
+	// counted by alloc.c the same way secvarctl-bench counts them, for the whole run
+	statsAdd(STATS_ALLOCATIONS, allocationCount());
+	printStats();
+	clearCtx(&ctx);
 
 	return rc;
 }
 
+/*
+ *@param argc, number of arguments of the command
+ *@param argv, the command and its arguments
+ *@return true if the command is given '--output json', stdout then only holds the JSON
+ */
+static bool writesJSON(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--output=json") ||
+		    (!strcmp(argv[i], "--output") && i + 1 < argc && !strcmp(argv[i + 1], "json")))
+			return true;
+	}
+
+	return false;
+}
+
 /*
  *Checks what backend the platform is running, CURRENTLY ONLY KNOWS EDK2
  *@return type of backend, or NULL if file could not be found or contained wrong contents,
@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "stats.h"
+
+/*
+ *counters of --stats, added to atomically since batch runs commands on several threads.
+ *Nothing is timed or counted unless statsEnable() was called
+ */
+enum statsFormat statsFormat = STATS_OFF;
+
+static struct {
+	uint64_t ns, calls;
+} phases[STATS_PHASE_COUNT];
+static uint64_t counters[STATS_COUNTER_COUNT];
+static uint64_t startTime;
+
+static const char *phaseNames[STATS_PHASE_COUNT] = {
+	[STATS_FILE_IO] = "file_io",
+	[STATS_PARSE_X509] = "parse_x509",
+	[STATS_VALIDATE_ESL] = "validate_esl",
+	[STATS_HASH_TO_VERIFY] = "hash_to_verify",
+	[STATS_PKCS7_VERIFY] = "pkcs7_verify",
+	[STATS_PROCESS] = "process",
+};
+
+static const char *counterNames[STATS_COUNTER_COUNT] = {
+	[STATS_BYTES_HASHED] = "bytes_hashed",
+	[STATS_X509_PARSES] = "x509_parses",
+	[STATS_RSA_VERIFIES] = "rsa_verifies",
+	[STATS_RSA_SIGNS] = "rsa_signs",
+	[STATS_ALLOCATIONS] = "allocations",
+};
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ *starts timing and counting, the summary is printed by printStats()
+ *@param format, STATS_TEXT or STATS_JSON
+ */
+void statsEnable(enum statsFormat format)
+{
+	startTime = now();
+	statsFormat = format;
+}
+
+/*
+ *@return the start time of a phase to give to statsEnd(), 0 if stats are off
+ */
+uint64_t statsStart(void)
+{
+	if (!statsFormat)
+		return 0;
+
+	return now();
+}
+
+/*
+ *adds the time since statsStart() to a phase
+ *@param phase, the phase that ran
+ *@param start, return of statsStart()
+ */
+void statsEnd(enum statsPhase phase, uint64_t start)
+{
+	if (!statsFormat)
+		return;
+	__atomic_add_fetch(&phases[phase].ns, now() - start, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&phases[phase].calls, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ *@param counter, the operation that was done
+ *@param count, how many times or how many bytes
+ */
+void statsAdd(enum statsCounter counter, uint64_t count)
+{
+	if (!statsFormat)
+		return;
+	__atomic_add_fetch(&counters[counter], count, __ATOMIC_RELAXED);
+}
+
+/*
+ *prints the summary to stderr, as text or JSON depending on the format given to statsEnable()
+ */
+void printStats(void)
+{
+	double totalMs;
+
+	if (!statsFormat)
+		return;
+	totalMs = (now() - startTime) / 1e6;
+	if (statsFormat == STATS_JSON) {
+		fprintf(stderr, "{ \"total_ms\": %.3f, \"phases\": {", totalMs);
+		for (int i = 0; i < STATS_PHASE_COUNT; i++)
+			fprintf(stderr, "%s \"%s\": { \"calls\": %lu, \"ms\": %.3f }", i ? "," : "",
+				phaseNames[i], (unsigned long)phases[i].calls, phases[i].ns / 1e6);
+		fprintf(stderr, " }, \"counters\": {");
+		for (int i = 0; i < STATS_COUNTER_COUNT; i++)
+			fprintf(stderr, "%s \"%s\": %lu", i ? "," : "", counterNames[i],
+				(unsigned long)counters[i]);
+		fprintf(stderr, " } }\n");
+		return;
+	}
+
+	fprintf(stderr, "STATS: %.3f ms total, phases that run inside others are counted in both\n",
+		totalMs);
+	fprintf(stderr, "\t%-16s %10s %12s\n", "phase", "calls", "ms");
+	for (int i = 0; i < STATS_PHASE_COUNT; i++)
+		fprintf(stderr, "\t%-16s %10lu %12.3f\n", phaseNames[i],
+			(unsigned long)phases[i].calls, phases[i].ns / 1e6);
+	for (int i = 0; i < STATS_COUNTER_COUNT; i++)
+		fprintf(stderr, "\t%-16s %10lu\n", counterNames[i], (unsigned long)counters[i]);
+}
@@ -0,0 +1,761 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+/*
+ *Microbenchmarks of the core parsing, validation and signing functions, run from the test
+ *directory with `make bench`. Every benchmark calls the function directly on a file in testdata/
+ *and the results are printed as JSON: nanoseconds and allocations per call, calls per second.
+ *Allocations are counted by alloc.c the same way --stats counts them, so the crypto library's
+ *own are not included
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <argp.h>
+#include "secvarctl.h"
+#include "external/skiboot/libstb/secvar/secvar.h"
+#include "external/skiboot/libstb/secvar/backend/edk2-compat-process.h"
+#include "backends/edk2-compat/include/edk2-svc.h"
+#include "external/skiboot/include/secvar.h"
+#include "test/keystore.h"
+#include "alloc.h"
+
+#ifdef OPENSSL
+#define CRYPTO_BACKEND "openssl"
+#else
+#define CRYPTO_BACKEND "mbedtls"
+#endif
+
+// each scaling benchmark is calibrated to run for about this long at every size
+#define SCALE_TARGET_NS 200000000.0
+
+// context every benchmark runs in, secvarctl.o holds main() and is left out of this binary
+static struct secvarctl_ctx ctx;
+
+// the functions print as they would for the command line, results are the only output
+static int stdoutFd = -1, devNull = -1;
+
+// files and banks shared by the benchmarks, loaded once before the timing starts
+static struct benchData {
+	struct fileView auth, esl, der;
+	struct list_head variable_bank, update_bank;
+#ifndef NO_CRYPTO
+	crypto_pkcs7_signers *signers;
+	unsigned char *hash;
+	size_t hashSize;
+#endif
+} data;
+
+struct benchmark {
+	const char *name;
+	// default number of calls, changed with --iterations
+	long iterations;
+	int (*run)(void);
+};
+
+static int benchValidateAuth(void)
+{
+	return validateAuth(data.auth.data, data.auth.size, "db");
+}
+
+static int benchValidateESL(void)
+{
+	return validateESL(data.esl.data, data.esl.size, "db");
+}
+
+static int benchParseX509(void)
+{
+	int rc;
+	crypto_x509 *x509 = NULL;
+
+	rc = parseX509(&x509, data.der.data, data.der.size);
+	if (x509)
+		crypto_x509_free(x509);
+
+	return rc;
+}
+
+static int benchPrintReadable(void)
+{
+	return printReadable((const char *)data.esl.data, data.esl.size, "db");
+}
+
+/*
+ *process changes the banks so it works on copies of them, the copies share the variable data
+ *until it is written so their cost is small next to the signature checks
+ *@param currentBank, current variables
+ *@param updateBank, updates to apply to them
+ *@return SUCCESS or error number
+ */
+static int processBanks(struct list_head *currentBank, struct list_head *updateBank)
+{
+	int rc;
+	struct list_head variable_bank, update_bank;
+
+	list_head_init(&variable_bank);
+	list_head_init(&update_bank);
+	rc = copy_bank_list(&variable_bank, currentBank);
+	if (rc)
+		goto out;
+	rc = copy_bank_list(&update_bank, updateBank);
+	if (rc)
+		goto out;
+	rc = edk2_compatible_v1.pre_process(&ctx, &variable_bank, &update_bank);
+	if (rc)
+		goto out;
+	rc = edk2_compatible_v1.process(&ctx, &variable_bank, &update_bank);
+
+out:
+	clear_bank_list(&variable_bank);
+	clear_bank_list(&update_bank);
+	clear_cert_cache(&ctx);
+
+	return rc;
+}
+
+static int benchProcess(void)
+{
+	return processBanks(&data.variable_bank, &data.update_bank);
+}
+
+#ifndef NO_CRYPTO
+// signs the ESL into an auth with the signers loaded up front, what generate does per update
+static int benchGenerateSignedAuth(void)
+{
+	int rc;
+	struct efi_time time = { .year = 2021, .month = 1, .day = 1, .hour = 1, .minute = 1,
+				 .second = 1 };
+	unsigned char *auth = NULL;
+	size_t authSize;
+
+	rc = generateSignedAuth(data.esl.data, data.esl.size, "db", &time, SECVAR_ATTRIBUTES,
+				data.signers, &auth, &authSize);
+	if (auth)
+		free(auth);
+
+	return rc;
+}
+
+static int benchPKCS7Sign(void)
+{
+	int rc;
+	unsigned char *pkcs7 = NULL;
+	size_t pkcs7Size;
+
+	rc = crypto_pkcs7_generate_w_signers(&pkcs7, &pkcs7Size, data.hash, data.hashSize,
+					     data.signers);
+	if (pkcs7)
+		free(pkcs7);
+
+	return rc;
+}
+
+static int benchHash(void)
+{
+	int rc;
+	unsigned char *hash = NULL;
+	size_t hashSize;
+
+	rc = crypto_md_generate_hash(data.auth.data, data.auth.size, CRYPTO_MD_SHA256, &hash,
+				     &hashSize);
+	if (hash)
+		free(hash);
+
+	return rc;
+}
+#endif
+
+static struct benchmark benchmarks[] = {
+	{ "validateAuth", 5000, benchValidateAuth },
+	{ "validateESL", 10000, benchValidateESL },
+	{ "parseX509", 10000, benchParseX509 },
+	{ "printReadable", 5000, benchPrintReadable },
+	{ "edk2_compatible_v1.process", 2000, benchProcess },
+#ifndef NO_CRYPTO
+	{ "generateSignedAuth", 200, benchGenerateSignedAuth },
+	{ "crypto_pkcs7_generate_w_signers", 200, benchPKCS7Sign },
+	{ "crypto_md_generate_hash", 100000, benchHash },
+#endif
+};
+
+// long only options
+#define ARGP_OPT_KEYSTORE_KEY 0x101
+#define ARGP_OPT_SCALE_KEY 0x102
+#define ARGP_OPT_MAX_KEY 0x103
+#define ARGP_OPT_MAX_CERTS_KEY 0x104
+
+struct Arguments {
+	long iterations;
+	const char *filter;
+#ifndef NO_CRYPTO
+	// --keystore writes a keystore of this size and exits, --scale runs the scaling benchmarks
+	const char *keystoreDir;
+	int scale;
+	long max, maxCerts;
+	struct keystoreSize size;
+#endif
+};
+
+/*
+ *parses a number option
+ *@param state, argp state, for the error message
+ *@param arg, option argument
+ *@param min, smallest value allowed
+ *@return the number, exits through argp_error if arg is not a number of at least min
+ */
+static long parseNumber(struct argp_state *state, const char *arg, long min)
+{
+	long ret;
+	char *end;
+
+	ret = strtol(arg, &end, 10);
+	if (!*arg || *end || ret < min || ret > INT32_MAX)
+		argp_error(state, "expected a number of at least %ld, not '%s'", min, arg);
+
+	return ret;
+}
+
+static int parse_opt(int key, char *arg, struct argp_state *state)
+{
+	struct Arguments *args = state->input;
+
+	switch (key) {
+	case 'i':
+		args->iterations = parseNumber(state, arg, 1);
+		break;
+	case 'f':
+		args->filter = arg;
+		break;
+#ifndef NO_CRYPTO
+	case ARGP_OPT_KEYSTORE_KEY:
+		args->keystoreDir = arg;
+		break;
+	case ARGP_OPT_SCALE_KEY:
+		args->scale = 1;
+		break;
+	case ARGP_OPT_MAX_KEY:
+		args->max = parseNumber(state, arg, 1);
+		break;
+	case ARGP_OPT_MAX_CERTS_KEY:
+		args->maxCerts = parseNumber(state, arg, 1);
+		break;
+	case 'n':
+		args->size.certs = parseNumber(state, arg, 0);
+		break;
+	case 'm':
+		args->size.hashes = parseNumber(state, arg, 0);
+		break;
+	case 'k':
+		args->size.signers = parseNumber(state, arg, 1);
+		if (args->size.signers > keystoreMaxSigners())
+			argp_error(state, "there are key pairs for at most %d signers",
+				   keystoreMaxSigners());
+		break;
+	case 'u':
+		args->size.updates = parseNumber(state, arg, 0);
+		if (args->size.updates >= 24 * 60 * 60)
+			argp_error(state, "updates are a second apart, at most one day of them");
+		break;
+	case ARGP_KEY_SUCCESS:
+		if (args->keystoreDir && args->scale)
+			argp_error(state, "--keystore and --scale can not be used together");
+		break;
+#endif
+	case ARGP_KEY_ARG:
+		argp_usage(state);
+		break;
+	}
+
+	return 0;
+}
+
+/*
+ *loads the files and banks the benchmarks work on, paths are relative to the test directory
+ *@return SUCCESS or error number
+ */
+static int setupData(void)
+{
+	int rc;
+	struct secvar *tmp;
+	struct secvar_arena *arena = NULL;
+	char path[64];
+
+	list_head_init(&data.variable_bank);
+	list_head_init(&data.update_bank);
+	rc = openFileView(&data.auth, "testdata/db_by_KEK.auth");
+	if (rc)
+		return rc;
+	rc = openFileView(&data.esl, "testdata/db_by_KEK.esl");
+	if (rc)
+		return rc;
+	rc = openFileView(&data.der, "testdata/KEK_by_PK.der");
+	if (rc)
+		return rc;
+
+	arena = new_secvar_arena();
+	if (!arena) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	for (int i = 0; i < ARRAY_SIZE(variables); i++) {
+		snprintf(path, sizeof(path), "testdata/goldenKeys/%s/data", variables[i]);
+		rc = getSecVar(&tmp, variables[i], path, arena);
+		if (rc)
+			goto out;
+		list_add_tail(&data.variable_bank, &tmp->link);
+	}
+	tmp = new_secvar_in(arena, "db", strlen("db") + 1, (const char *)data.auth.data,
+			    data.auth.size, 0);
+	if (!tmp) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	list_add_tail(&data.update_bank, &tmp->link);
+
+#ifndef NO_CRYPTO
+	rc = crypto_pkcs7_signers_load(
+		&data.signers, (const char *[]){ "testdata/goldenKeys/KEK/KEK.crt" },
+		(const char *[]){ "testdata/goldenKeys/KEK/KEK.key" }, 1, CRYPTO_MD_SHA256);
+	if (rc)
+		goto out;
+	rc = crypto_md_generate_hash(data.esl.data, data.esl.size, CRYPTO_MD_SHA256, &data.hash,
+				     &data.hashSize);
+#endif
+
+out:
+	// the banks hold the arena now
+	put_secvar_arena(arena);
+
+	return rc;
+}
+
+static void freeData(void)
+{
+	closeFileView(&data.auth);
+	closeFileView(&data.esl);
+	closeFileView(&data.der);
+	clear_bank_list(&data.variable_bank);
+	clear_bank_list(&data.update_bank);
+	clear_cert_cache(&ctx);
+#ifndef NO_CRYPTO
+	crypto_pkcs7_signers_free(data.signers);
+	if (data.hash)
+		free(data.hash);
+#endif
+}
+
+static double elapsedNs(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/*
+ *calls the benchmark once to warm caches up, then iterations more times under the clock
+ *@param bench, the benchmark to run
+ *@param iterations, number of timed calls
+ *@param nsPerOp, filled with the average time of one call
+ *@param allocsPerOp, filled with the average number of allocations made by one call
+ *@return SUCCESS or the error of the first failing call
+ */
+static int runBenchmark(const struct benchmark *bench, long iterations, double *nsPerOp,
+			double *allocsPerOp)
+{
+	int rc;
+	uint64_t allocs;
+	struct timespec start, end;
+
+	rc = bench->run();
+	if (rc)
+		return rc;
+	allocs = allocationCount();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (long i = 0; i < iterations; i++) {
+		rc = bench->run();
+		if (rc)
+			return rc;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	allocs = allocationCount() - allocs;
+
+	*nsPerOp = elapsedNs(&start, &end) / iterations;
+	*allocsPerOp = (double)allocs / iterations;
+
+	return SUCCESS;
+}
+
+/*
+ *sends stdout to /dev/null while the benchmarks run, or back to where it went
+ *@param silence, 1 to silence stdout, 0 to restore it
+ */
+static void silenceStdout(int silence)
+{
+	// printing is measured the way read uses it, gathered and written a buffer at a time
+	if (silence) {
+		outFlush();
+		outHold();
+	} else
+		outRelease();
+	fflush(stdout);
+	dup2(silence ? devNull : stdoutFd, STDOUT_FILENO);
+}
+
+/*
+ *runs every microbenchmark that matches the filter and prints the results
+ *@param args, command line options
+ *@return SUCCESS or error number
+ */
+static int runMicrobenchmarks(const struct Arguments *args)
+{
+	int rc = SUCCESS, first = 1;
+	long iterations;
+	double nsPerOp, allocsPerOp;
+
+	silenceStdout(1);
+	rc = setupData();
+	silenceStdout(0);
+	if (rc) {
+		prlog(PR_ERR, "ERROR: could not load test data, run from the test directory\n");
+		goto out;
+	}
+
+	printf("{\n\t\"backend\": \"%s\",\n\t\"benchmarks\": [", CRYPTO_BACKEND);
+	for (int i = 0; i < ARRAY_SIZE(benchmarks); i++) {
+		if (args->filter && !strstr(benchmarks[i].name, args->filter))
+			continue;
+		iterations = args->iterations ? args->iterations : benchmarks[i].iterations;
+		silenceStdout(1);
+		rc = runBenchmark(&benchmarks[i], iterations, &nsPerOp, &allocsPerOp);
+		silenceStdout(0);
+		if (rc) {
+			prlog(PR_ERR, "ERROR: benchmark %s failed with %d\n", benchmarks[i].name, rc);
+			break;
+		}
+		printf("%s\n\t\t{ \"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.1f, "
+		       "\"ops_per_sec\": %.1f, \"allocs_per_op\": %.2f }",
+		       first ? "" : ",", benchmarks[i].name, iterations, nsPerOp, 1e9 / nsPerOp,
+		       allocsPerOp);
+		first = 0;
+	}
+	printf("\n\t]\n}\n");
+
+out:
+	freeData();
+
+	return rc;
+}
+
+#ifndef NO_CRYPTO
+// keystore of the scaling benchmarks, regenerated for every size
+static struct scaleData {
+	struct keystore ks;
+	struct list_head variable_bank, update_bank;
+} scale;
+
+static int scaleReadDb(void)
+{
+	return printReadable((const char *)scale.ks.vars[KS_DB].data, scale.ks.vars[KS_DB].size,
+			     "db");
+}
+
+static int scaleReadDbx(void)
+{
+	return printReadable((const char *)scale.ks.vars[KS_DBX].data, scale.ks.vars[KS_DBX].size,
+			     "dbx");
+}
+
+static int scaleValidateDb(void)
+{
+	return validateESL(scale.ks.vars[KS_DB].data, scale.ks.vars[KS_DB].size, "db");
+}
+
+static int scaleValidateDbx(void)
+{
+	return validateESL(scale.ks.vars[KS_DBX].data, scale.ks.vars[KS_DBX].size, "dbx");
+}
+
+static int scaleVerify(void)
+{
+	return processBanks(&scale.variable_bank, &scale.update_bank);
+}
+
+// what the size of a scaling benchmark counts
+enum scaleCount { SCALE_CERTS, SCALE_HASHES, SCALE_ENTRIES };
+
+// read, validate and verify of a keystore, as the commands do them without the file reads
+static const struct scaleBenchmark {
+	struct benchmark bench;
+	enum scaleCount count;
+} scaleBenchmarks[] = {
+	{ { "read db", 0, scaleReadDb }, SCALE_CERTS },
+	{ { "read dbx", 0, scaleReadDbx }, SCALE_HASHES },
+	{ { "validate db", 0, scaleValidateDb }, SCALE_CERTS },
+	{ { "validate dbx", 0, scaleValidateDbx }, SCALE_HASHES },
+	{ { "verify", 0, scaleVerify }, SCALE_ENTRIES },
+};
+
+struct scalePoint {
+	long n;
+	double nsPerOp, allocsPerOp;
+};
+
+/*
+ *fills the banks of the scaling benchmarks from scale.ks
+ *@return SUCCESS or error number
+ */
+static int setupScaleBanks(void)
+{
+	int rc = SUCCESS;
+	struct secvar *tmp;
+	struct secvar_arena *arena;
+	const struct keystoreData *var;
+
+	list_head_init(&scale.variable_bank);
+	list_head_init(&scale.update_bank);
+	arena = new_secvar_arena();
+	if (!arena) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	for (int i = 0; i < KS_VAR_COUNT + scale.ks.updateCount; i++) {
+		var = i < KS_VAR_COUNT ? &scale.ks.vars[i] : &scale.ks.updates[i - KS_VAR_COUNT];
+		tmp = new_secvar_in(arena, var->name, strlen(var->name) + 1,
+				    (const char *)var->data, var->size, 0);
+		if (!tmp) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			break;
+		}
+		list_add_tail(i < KS_VAR_COUNT ? &scale.variable_bank : &scale.update_bank,
+			      &tmp->link);
+	}
+	// the banks hold the arena now
+	put_secvar_arena(arena);
+
+	return rc;
+}
+
+/*
+ *times a scaling benchmark, as many calls as fit in SCALE_TARGET_NS or at least one
+ *@param bench, the benchmark
+ *@param point, filled with the time and allocations of one call
+ *@return SUCCESS or error number
+ */
+static int runScalePoint(const struct benchmark *bench, struct scalePoint *point)
+{
+	int rc;
+	long iterations;
+
+	rc = runBenchmark(bench, 1, &point->nsPerOp, &point->allocsPerOp);
+	if (rc || point->nsPerOp >= SCALE_TARGET_NS / 2)
+		return rc;
+	iterations = SCALE_TARGET_NS / point->nsPerOp;
+
+	return runBenchmark(bench, iterations, &point->nsPerOp, &point->allocsPerOp);
+}
+
+/*
+ *prints the results of one scaling benchmark, with the exponent of its growth between its two
+ *largest sizes, 1 is linear and 2 quadratic
+ *@param bench, the benchmark
+ *@param points, its results
+ *@param count, length of points
+ *@param first, whether this is the first result printed
+ */
+static void printScaling(const struct benchmark *bench, const struct scalePoint *points,
+			 int count, int first)
+{
+	printf("%s\n\t\t{ \"name\": \"%s\", \"exponent\": ", first ? "" : ",", bench->name);
+	if (count < 2)
+		printf("null");
+	else
+		printf("%.2f", log(points[count - 1].nsPerOp / points[count - 2].nsPerOp) /
+				       log((double)points[count - 1].n / points[count - 2].n));
+	printf(", \"points\": [");
+	for (int i = 0; i < count; i++)
+		printf("%s\n\t\t\t{ \"n\": %ld, \"ns_per_op\": %.1f, \"allocs_per_op\": %.2f }",
+		       i ? "," : "", points[i].n, points[i].nsPerOp, points[i].allocsPerOp);
+	printf("\n\t\t] }");
+}
+
+/*
+ *runs read, validate and verify on keystores of 1, 10, 100... up to args->max entries, db has
+ *at most args->maxCerts of them, and prints how their time grows with the size
+ *@param args, command line options
+ *@return SUCCESS or error number
+ */
+static int runScaling(const struct Arguments *args)
+{
+	int rc = SUCCESS, sizes = 0, first = 1, *counts = NULL;
+	long n;
+	struct scalePoint *points = NULL, *point;
+	struct keystoreSize size = args->size;
+	const struct scaleBenchmark *bench;
+
+	for (n = 1; n <= args->max; n *= 10)
+		sizes++;
+	points = calloc(ARRAY_SIZE(scaleBenchmarks) * sizes, sizeof(*points));
+	counts = calloc(ARRAY_SIZE(scaleBenchmarks), sizeof(*counts));
+	if (!points || !counts) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	// one update of db and one of dbx, each adds an entry to the full variable
+	size.updates = 2;
+
+	silenceStdout(1);
+	for (n = 1; !rc && n <= args->max; n *= 10) {
+		size.certs = n < args->maxCerts ? n : args->maxCerts;
+		size.hashes = n;
+		rc = generateKeystore(&scale.ks, &size);
+		if (!rc)
+			rc = setupScaleBanks();
+		for (int i = 0; !rc && i < ARRAY_SIZE(scaleBenchmarks); i++) {
+			bench = &scaleBenchmarks[i];
+			if (args->filter && !strstr(bench->bench.name, args->filter))
+				continue;
+			point = &points[i * sizes + counts[i]];
+			point->n = bench->count == SCALE_CERTS	? size.certs :
+				   bench->count == SCALE_HASHES ? size.hashes :
+								  size.certs + size.hashes;
+			// db stops growing at maxCerts
+			if (counts[i] && point[-1].n == point->n)
+				continue;
+			rc = runScalePoint(&bench->bench, point);
+			if (rc)
+				prlog(PR_ERR, "ERROR: %s of %ld entries failed with %d\n",
+				      bench->bench.name, point->n, rc);
+			else
+				counts[i]++;
+		}
+		clear_bank_list(&scale.variable_bank);
+		clear_bank_list(&scale.update_bank);
+		freeKeystore(&scale.ks);
+	}
+	silenceStdout(0);
+	if (rc)
+		goto out;
+
+	printf("{\n\t\"backend\": \"%s\",\n\t\"signers\": %d,\n\t\"scaling\": [",
+	       CRYPTO_BACKEND, size.signers);
+	for (int i = 0; i < ARRAY_SIZE(scaleBenchmarks); i++) {
+		if (!counts[i])
+			continue;
+		printScaling(&scaleBenchmarks[i].bench, &points[i * sizes], counts[i], first);
+		first = 0;
+	}
+	printf("\n\t]\n}\n");
+
+out:
+	if (points)
+		free(points);
+	if (counts)
+		free(counts);
+	clear_cert_cache(&ctx);
+
+	return rc;
+}
+
+/*
+ *writes a synthetic keystore and its update chain, see writeKeystore()
+ *@param args, command line options, with the size and directory
+ *@return SUCCESS or error number
+ */
+static int makeKeystore(const struct Arguments *args)
+{
+	int rc;
+	struct keystore ks;
+
+	rc = generateKeystore(&ks, &args->size);
+	if (!rc)
+		rc = writeKeystore(&ks, args->keystoreDir);
+	if (!rc)
+		printf("Wrote a keystore with %d certificates in db, %d hashes in dbx, %d signers in KEK and %d updates to %s\n",
+		       args->size.certs, args->size.hashes, args->size.signers,
+		       args->size.updates, args->keystoreDir);
+	else
+		prlog(PR_ERR, "ERROR: could not generate the keystore, run from the test directory\n");
+	freeKeystore(&ks);
+
+	return rc;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	int rc;
+	struct Arguments args = { .iterations = 0,
+				  .filter = NULL,
+#ifndef NO_CRYPTO
+				  .keystoreDir = NULL,
+				  .scale = 0,
+				  .max = 100000,
+				  .maxCerts = 10000,
+				  .size = { .certs = 100, .hashes = 1000, .signers = 1, .updates = 2 }
+#endif
+	};
+	struct argp_option options[] = {
+		{ "iterations", 'i', "N", 0, "run every benchmark N times instead of its default" },
+		{ "filter", 'f', "NAME", 0, "only run the benchmarks whose name contains NAME" },
+#ifndef NO_CRYPTO
+		{ "scale", ARGP_OPT_SCALE_KEY, 0, 0,
+		  "run read, validate and verify on synthetic keystores of growing size instead" },
+		{ "max", ARGP_OPT_MAX_KEY, "N", 0,
+		  "largest keystore of --scale, in entries of dbx, default 100000" },
+		{ "max-certs", ARGP_OPT_MAX_CERTS_KEY, "N", 0,
+		  "largest number of certificates in db for --scale, default 10000" },
+		{ "keystore", ARGP_OPT_KEYSTORE_KEY, "DIR", 0,
+		  "write a synthetic keystore and update chain to DIR instead, <var>/data and updates/<number>-<var>.auth" },
+		{ "certs", 'n', "N", 0, "certificates in db of --keystore, default 100" },
+		{ "hashes", 'm', "M", 0, "hashes in dbx of --keystore, default 1000" },
+		{ "signers", 'k', "K", 0,
+		  "certificates in KEK, every update is signed by all of them, default 1" },
+		{ "updates", 'u', "U", 0,
+		  "updates in the chain of --keystore, alternating db and dbx appends, default 2" },
+#endif
+		{ 0 }
+	};
+	struct argp argp = {
+		options, parse_opt, NULL,
+		"microbenchmarks of secvarctl's core functions, results are printed as JSON.\n"
+		"Run from secvarctl's test directory, it reads the files in testdata/"
+	};
+
+	initCtx(&ctx, PR_WARNING);
+	bindCtx(&ctx);
+	argp_parse(&argp, argc, argv, 0, 0, &args);
+
+#ifndef NO_CRYPTO
+	if (args.keystoreDir)
+		return makeKeystore(&args);
+#endif
+	allocationCountStart();
+	fflush(stdout);
+	stdoutFd = dup(STDOUT_FILENO);
+	devNull = open("/dev/null", O_WRONLY);
+	if (stdoutFd < 0 || devNull < 0) {
+		prlog(PR_ERR, "ERROR: could not redirect stdout\n");
+		rc = INVALID_FILE;
+		goto out;
+	}
+#ifndef NO_CRYPTO
+	if (args.scale)
+		rc = runScaling(&args);
+	else
+#endif
+		rc = runMicrobenchmarks(&args);
+
+out:
+	if (devNull >= 0)
+		close(devNull);
+	if (stdoutFd >= 0)
+		close(stdoutFd);
+	clearCtx(&ctx);
+
+	return rc;
+}
@@ -0,0 +1,480 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+/*
+ *Synthetic keystores of any size, made with the generate command's ESL and auth code and the
+ *crypto layer, without calling out to openssl. db gets copies of a template certificate that
+ *only differ in their serial number, so their signatures do not verify, secvarctl only checks the
+ *format of db's certificates. KEK holds real certificates, the updates are signed with their keys.
+ */
+#ifndef NO_CRYPTO
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "secvarctl.h"
+#include "external/skiboot/libstb/secvar/backend/edk2.h"
+#include "test/keystore.h"
+
+// paths are relative to the test directory
+#define TEMPLATE_CERT "testdata/goldenKeys/db/db.der"
+#define PK_CERT "testdata/goldenKeys/PK/PK.der"
+
+// every update is later than the timestamps in TS
+#define KEYSTORE_YEAR 2021
+
+static const struct signerFiles {
+	const char *key, *crt, *der;
+} signerFiles[] = {
+	{ "testdata/goldenKeys/KEK/KEK.key", "testdata/goldenKeys/KEK/KEK.crt",
+	  "testdata/goldenKeys/KEK/KEK.der" },
+	{ "testdata/goldenKeys/PK/PK.key", "testdata/goldenKeys/PK/PK.crt",
+	  "testdata/goldenKeys/PK/PK.der" },
+	{ "testdata/goldenKeys/db/db.key", "testdata/goldenKeys/db/db.crt",
+	  "testdata/goldenKeys/db/db.der" },
+	{ "testdata/goldenKeys/dbx/dbx.key", "testdata/goldenKeys/dbx/dbx.crt",
+	  "testdata/goldenKeys/dbx/dbx.der" },
+	{ "testdata/KEK_by_PK.key", "testdata/KEK_by_PK.crt", "testdata/KEK_by_PK.der" },
+	{ "testdata/PK_by_PK.key", "testdata/PK_by_PK.crt", "testdata/PK_by_PK.der" },
+	{ "testdata/db_by_KEK.key", "testdata/db_by_KEK.crt", "testdata/db_by_KEK.der" },
+	{ "testdata/db_by_PK.key", "testdata/db_by_PK.crt", "testdata/db_by_PK.der" },
+	{ "testdata/dbx_by_KEK.key", "testdata/dbx_by_KEK.crt", "testdata/dbx_by_KEK.der" },
+	{ "testdata/dbx_by_PK.key", "testdata/dbx_by_PK.crt", "testdata/dbx_by_PK.der" },
+};
+
+// an ESL with one certificate, copied with a new serial number for every db entry
+struct certTemplate {
+	unsigned char *ESL;
+	size_t ESLSize, serialOffset, serialLen;
+};
+
+/*
+ *@return the largest number of signers a keystore can have, one per key pair in testdata
+ */
+int keystoreMaxSigners(void)
+{
+	return ARRAY_SIZE(signerFiles);
+}
+
+/*
+ *reads the tag and length of a DER element
+ *@param der, DER data
+ *@param size, length of der
+ *@param offset, offset of the element, moved to the start of its contents
+ *@param len, filled with the length of the contents
+ *@return the tag of the element or -1 if the header is not valid
+ */
+static int derHeader(const unsigned char *der, size_t size, size_t *offset, size_t *len)
+{
+	int tag, lenBytes;
+
+	if (*offset + 2 > size)
+		return -1;
+	tag = der[(*offset)++];
+	*len = der[(*offset)++];
+	if (*len & 0x80) {
+		lenBytes = *len & 0x7f;
+		if (lenBytes > sizeof(size_t) || *offset + lenBytes > size)
+			return -1;
+		for (*len = 0; lenBytes; lenBytes--)
+			*len = (*len << 8) | der[(*offset)++];
+	}
+	if (*len > size - *offset)
+		return -1;
+
+	return tag;
+}
+
+/*
+ *makes the ESL every db certificate is copied from and finds its serial number
+ *@param tmpl, filled with the ESL and where its serial number is, free tmpl->ESL when done
+ *@return SUCCESS or error number
+ */
+static int loadCertTemplate(struct certTemplate *tmpl)
+{
+	int rc;
+	size_t offset = 0, len, certOffset = sizeof(EFI_SIGNATURE_LIST) + sizeof(uuid_t);
+	struct fileView view;
+
+	rc = openFileView(&view, TEMPLATE_CERT);
+	if (rc)
+		return rc;
+	rc = toESL(view.data, view.size, EFI_CERT_X509_GUID, &tmpl->ESL, &tmpl->ESLSize);
+	if (rc)
+		goto out;
+
+	// Certificate ::= SEQUENCE { tbsCertificate SEQUENCE { [0] version OPTIONAL, serialNumber
+	if (derHeader(view.data, view.size, &offset, &len) != 0x30 ||
+	    derHeader(view.data, view.size, &offset, &len) != 0x30) {
+		rc = CERT_FAIL;
+		goto out;
+	}
+	if (offset < view.size && view.data[offset] == 0xa0) {
+		if (derHeader(view.data, view.size, &offset, &len) < 0) {
+			rc = CERT_FAIL;
+			goto out;
+		}
+		offset += len;
+	}
+	// the last 4 bytes are replaced, the first one has the sign and stays as it is
+	if (derHeader(view.data, view.size, &offset, &len) != 0x02 || len < 5) {
+		rc = CERT_FAIL;
+		goto out;
+	}
+	tmpl->serialOffset = certOffset + offset;
+	tmpl->serialLen = len;
+
+out:
+	if (rc) {
+		prlog(PR_ERR, "ERROR: could not use %s as a certificate template\n", TEMPLATE_CERT);
+		if (tmpl->ESL)
+			free(tmpl->ESL);
+		tmpl->ESL = NULL;
+	}
+	closeFileView(&view);
+
+	return rc;
+}
+
+/*
+ *copies the template ESL with serial number index
+ *@param tmpl, template from loadCertTemplate()
+ *@param index, number to put in the serial number
+ *@param out, at least tmpl->ESLSize bytes
+ */
+static void putCert(const struct certTemplate *tmpl, uint32_t index, unsigned char *out)
+{
+	unsigned char *serialEnd = out + tmpl->serialOffset + tmpl->serialLen;
+
+	memcpy(out, tmpl->ESL, tmpl->ESLSize);
+	for (int i = 1; i <= 4; i++, index >>= 8)
+		serialEnd[-i] = index & 0xff;
+}
+
+/*
+ *makes count distinct SHA256 hashes, the hashes of the numbers start to start + count - 1
+ *@param start, first number to hash
+ *@param count, number of hashes
+ *@param alg, filled with the hash function information
+ *@param out, filled with back to back hashes, NOTE: REMEMBER TO UNALLOC THIS MEMORY
+ *@return SUCCESS or error number
+ */
+static int makeHashes(uint64_t start, int count, const struct hash_funct **alg,
+		      unsigned char **out)
+{
+	int rc = SUCCESS;
+	crypto_md_ctx *ctx = NULL;
+
+	*alg = NULL;
+	for (int i = 0; i < ARRAY_SIZE(hash_functions); i++) {
+		if (hash_functions[i].crypto_md_funct == CRYPTO_MD_SHA256)
+			*alg = &hash_functions[i];
+	}
+	*out = malloc(count * (*alg)->size);
+	if (!*out) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	// crypto_md_generate_hash() prints every hash, that is too much for a dbx
+	for (uint64_t i = start; !rc && i < start + count; i++) {
+		rc = crypto_md_ctx_init(&ctx, CRYPTO_MD_SHA256);
+		if (!rc)
+			rc = crypto_md_update(ctx, (const unsigned char *)&i, sizeof(i));
+		if (!rc)
+			rc = crypto_md_finish(ctx, *out + (i - start) * (*alg)->size);
+		crypto_md_free(ctx);
+		ctx = NULL;
+	}
+	if (rc) {
+		free(*out);
+		*out = NULL;
+	}
+
+	return rc;
+}
+
+/*
+ *makes a dbx ESL of count hashes
+ *@param start, first number to hash, see makeHashes()
+ *@param count, number of hashes
+ *@param var, filled with the ESL, empty if count is 0
+ *@return SUCCESS or error number
+ */
+static int makeHashESL(uint64_t start, int count, struct keystoreData *var)
+{
+	int rc;
+	const struct hash_funct *alg;
+	unsigned char *hashes = NULL;
+
+	if (!count)
+		return SUCCESS;
+	rc = makeHashes(start, count, &alg, &hashes);
+	if (rc)
+		return rc;
+	rc = toHashESL(hashes, count * alg->size, alg, &var->data, &var->size);
+	free(hashes);
+
+	return rc;
+}
+
+/*
+ *makes a KEK of one ESL per signer certificate and the PK
+ *@param ks, keystore to fill
+ *@param signers, number of signers
+ *@return SUCCESS or error number
+ */
+static int makeKeys(struct keystore *ks, int signers)
+{
+	int rc;
+	unsigned char *ESL = NULL;
+	size_t ESLSize;
+	struct fileView view;
+
+	rc = openFileView(&view, PK_CERT);
+	if (rc)
+		return rc;
+	rc = toESL(view.data, view.size, EFI_CERT_X509_GUID, &ks->vars[KS_PK].data,
+		   &ks->vars[KS_PK].size);
+	closeFileView(&view);
+	if (rc)
+		return rc;
+
+	for (int i = 0; i < signers; i++) {
+		rc = openFileView(&view, signerFiles[i].der);
+		if (rc)
+			return rc;
+		rc = toESL(view.data, view.size, EFI_CERT_X509_GUID, &ESL, &ESLSize);
+		closeFileView(&view);
+		if (rc)
+			return rc;
+		rc = reallocArray((void **)&ks->vars[KS_KEK].data, ks->vars[KS_KEK].size + ESLSize,
+				  1);
+		if (rc) {
+			free(ESL);
+			return rc;
+		}
+		memcpy(ks->vars[KS_KEK].data + ks->vars[KS_KEK].size, ESL, ESLSize);
+		ks->vars[KS_KEK].size += ESLSize;
+		free(ESL);
+	}
+
+	return SUCCESS;
+}
+
+/*
+ *fills in the time of an update
+ *@param t, filled with the time
+ *@param seconds, seconds after the start of KEYSTORE_YEAR, less than a day
+ */
+static void setUpdateTime(struct efi_time *t, int seconds)
+{
+	memset(t, 0, sizeof(*t));
+	t->year = KEYSTORE_YEAR;
+	t->month = 1;
+	t->day = 1;
+	t->hour = seconds / 3600;
+	t->minute = seconds / 60 % 60;
+	t->second = seconds % 60;
+}
+
+/*
+ *makes the chain of signed updates, db and dbx append writes one after the other
+ *@param ks, keystore with its variables, the updates are added to it
+ *@param size, size of the keystore
+ *@param tmpl, template of the db certificates
+ *@return SUCCESS or error number
+ */
+static int makeUpdates(struct keystore *ks, const struct keystoreSize *size,
+		       const struct certTemplate *tmpl)
+{
+	int rc;
+	const char *crts[ARRAY_SIZE(signerFiles)], *keys[ARRAY_SIZE(signerFiles)];
+	crypto_pkcs7_signers *signers = NULL;
+	struct keystoreData ESL;
+	struct efi_time time;
+
+	if (!size->updates)
+		return SUCCESS;
+	ks->updates = calloc(size->updates, sizeof(*ks->updates));
+	if (!ks->updates) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		return ALLOC_FAIL;
+	}
+	for (int i = 0; i < size->signers; i++) {
+		crts[i] = signerFiles[i].crt;
+		keys[i] = signerFiles[i].key;
+	}
+	rc = crypto_pkcs7_signers_load(&signers, crts, keys, size->signers, CRYPTO_MD_SHA256);
+	if (rc)
+		return rc;
+
+	for (int i = 0; i < size->updates; i++) {
+		memset(&ESL, 0, sizeof(ESL));
+		// every update adds an entry that is not in the keystore yet
+		if (i % 2 == 0) {
+			ESL.name = "db";
+			ESL.size = tmpl->ESLSize;
+			ESL.data = malloc(ESL.size);
+			if (!ESL.data) {
+				prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+				rc = ALLOC_FAIL;
+				break;
+			}
+			putCert(tmpl, size->certs + i, ESL.data);
+		} else {
+			ESL.name = "dbx";
+			rc = makeHashESL(size->hashes + i, 1, &ESL);
+			if (rc)
+				break;
+		}
+		setUpdateTime(&time, i + 1);
+		ks->updates[i].name = ESL.name;
+		rc = generateSignedAuth(ESL.data, ESL.size, ESL.name, &time,
+					SECVAR_ATTRIBUTES | EFI_VARIABLE_APPEND_WRITE, signers,
+					&ks->updates[i].data, &ks->updates[i].size);
+		free(ESL.data);
+		if (rc)
+			break;
+		ks->updateCount++;
+	}
+	crypto_pkcs7_signers_free(signers);
+
+	return rc;
+}
+
+/*
+ *generates a keystore and a chain of updates for it in memory
+ *@param ks, filled with the keystore, free it with freeKeystore() even if this fails
+ *@param size, number of certificates, hashes, signers and updates
+ *@return SUCCESS or error number
+ */
+int generateKeystore(struct keystore *ks, const struct keystoreSize *size)
+{
+	int rc;
+	struct certTemplate tmpl = { 0 };
+	struct efi_time *ts;
+
+	memset(ks, 0, sizeof(*ks));
+	ks->vars[KS_PK].name = "PK";
+	ks->vars[KS_KEK].name = "KEK";
+	ks->vars[KS_DB].name = "db";
+	ks->vars[KS_DBX].name = "dbx";
+	ks->vars[KS_TS].name = "TS";
+	if (size->certs < 0 || size->hashes < 0 || size->updates < 0 || size->signers < 1 ||
+	    size->signers > keystoreMaxSigners()) {
+		prlog(PR_ERR, "ERROR: a keystore needs 1 to %d signers and no negative sizes\n",
+		      keystoreMaxSigners());
+		return ARG_PARSE_FAIL;
+	}
+
+	rc = makeKeys(ks, size->signers);
+	if (rc)
+		goto out;
+	rc = loadCertTemplate(&tmpl);
+	if (rc)
+		goto out;
+	if (size->certs) {
+		ks->vars[KS_DB].size = tmpl.ESLSize * size->certs;
+		ks->vars[KS_DB].data = malloc(ks->vars[KS_DB].size);
+		if (!ks->vars[KS_DB].data) {
+			prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+			rc = ALLOC_FAIL;
+			goto out;
+		}
+		for (int i = 0; i < size->certs; i++)
+			putCert(&tmpl, i, ks->vars[KS_DB].data + i * tmpl.ESLSize);
+	}
+	rc = makeHashESL(0, size->hashes, &ks->vars[KS_DBX]);
+	if (rc)
+		goto out;
+
+	// one timestamp for each of PK, KEK, db and dbx, all before the first update
+	ks->vars[KS_TS].size = 4 * sizeof(struct efi_time);
+	ks->vars[KS_TS].data = malloc(ks->vars[KS_TS].size);
+	if (!ks->vars[KS_TS].data) {
+		prlog(PR_ERR, "ERROR: failed to allocate memory\n");
+		rc = ALLOC_FAIL;
+		goto out;
+	}
+	ts = (struct efi_time *)ks->vars[KS_TS].data;
+	for (int i = 0; i < 4; i++)
+		setUpdateTime(&ts[i], 0);
+
+	rc = makeUpdates(ks, size, &tmpl);
+
+out:
+	if (tmpl.ESL)
+		free(tmpl.ESL);
+
+	return rc;
+}
+
+/*
+ *makes a directory, it is fine if it already exists
+ *@param path, directory to make
+ *@return SUCCESS or error number
+ */
+static int makeDir(const char *path)
+{
+	if (mkdir(path, 0755) && errno != EEXIST) {
+		prlog(PR_ERR, "ERROR: could not create %s: %s\n", path, strerror(errno));
+		return INVALID_FILE;
+	}
+
+	return SUCCESS;
+}
+
+/*
+ *writes a keystore the way the secvar sysfs lays variables out, <dir>/<var>/{data,size},
+ *so it can be used with the -p option of the read and verify commands. The updates go to
+ *<dir>/updates/<number>-<var>.auth, to be applied in order
+ *@param ks, keystore from generateKeystore()
+ *@param dir, directory to write to, created if it does not exist
+ *@return SUCCESS or error number
+ */
+int writeKeystore(const struct keystore *ks, const char *dir)
+{
+	int rc;
+	char path[4096], sizeStr[32];
+
+	rc = makeDir(dir);
+	for (int i = 0; !rc && i < KS_VAR_COUNT; i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, ks->vars[i].name);
+		rc = makeDir(path);
+		if (rc)
+			break;
+		snprintf(path, sizeof(path), "%s/%s/data", dir, ks->vars[i].name);
+		rc = createFile(path, (const char *)ks->vars[i].data, ks->vars[i].size);
+		if (rc)
+			break;
+		snprintf(path, sizeof(path), "%s/%s/size", dir, ks->vars[i].name);
+		snprintf(sizeStr, sizeof(sizeStr), "%zu", ks->vars[i].size);
+		rc = createFile(path, sizeStr, strlen(sizeStr));
+	}
+	if (rc || !ks->updateCount)
+		return rc;
+
+	snprintf(path, sizeof(path), "%s/updates", dir);
+	rc = makeDir(path);
+	for (int i = 0; !rc && i < ks->updateCount; i++) {
+		snprintf(path, sizeof(path), "%s/updates/%04d-%s.auth", dir, i + 1,
+			 ks->updates[i].name);
+		rc = createFile(path, (const char *)ks->updates[i].data, ks->updates[i].size);
+	}
+
+	return rc;
+}
+
+void freeKeystore(struct keystore *ks)
+{
+	for (int i = 0; i < KS_VAR_COUNT; i++) {
+		if (ks->vars[i].data)
+			free(ks->vars[i].data);
+	}
+	for (int i = 0; i < ks->updateCount; i++)
+		free(ks->updates[i].data);
+	if (ks->updates)
+		free(ks->updates);
+	memset(ks, 0, sizeof(*ks));
+}
+#endif
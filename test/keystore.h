@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2021 IBM Corp.*/
+#ifndef KEYSTORE_H
+#define KEYSTORE_H
+#include <stddef.h>
+
+// variables of a keystore, in the order of keystore.vars
+enum keystoreVar { KS_PK = 0, KS_KEK, KS_DB, KS_DBX, KS_TS, KS_VAR_COUNT };
+
+// size of a synthetic keystore, see generateKeystore()
+struct keystoreSize {
+	// certificates in db, SHA256 hashes in dbx
+	int certs, hashes;
+	// certificates in KEK, every update is signed by all of them
+	int signers;
+	// length of the update chain, alternating db and dbx append writes
+	int updates;
+};
+
+struct keystoreData {
+	const char *name;
+	unsigned char *data;
+	size_t size;
+};
+
+struct keystore {
+	struct keystoreData vars[KS_VAR_COUNT];
+	// signed updates, to be applied in order
+	struct keystoreData *updates;
+	int updateCount;
+};
+
+int keystoreMaxSigners(void);
+int generateKeystore(struct keystore *ks, const struct keystoreSize *size);
+int writeKeystore(const struct keystore *ks, const char *dir);
+void freeKeystore(struct keystore *ks);
+#endif
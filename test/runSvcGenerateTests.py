@@ -8,6 +8,7 @@ import sys
 import time
 import unittest
 import filecmp
+import hashlib
 
 MEM_ERR = 101
 SECTOOLS="../secvarctl-cov"
@@ -162,6 +163,20 @@ class Test(unittest.TestCase):
 			self.assertEqual( getCmdResult(cmd + ["f:e", "-i", "./testdata/" + efiGen + ".crt", "-o" ,eslMade], out, self), True) #assert the esl can be made from a file
 			self.assertEqual( getCmdResult([SECTOOLS ,"validate", "-e", "-x", eslMade], out, self), True) #assert the ESL is correctly formated
 			# self.assertEqual( compareFile(eslMade, eslDesired), True) #make sure the generated file is byte for byte the same as the one we know is correct
+		#several inputs share one ESL, entries are sorted and repeats dropped so input order does not matter
+		inputs = ["./testdata/" + efiGen + ".crt" for efiGen in dbxFiles]
+		forward = []
+		for inp in inputs + inputs[:1]:
+			forward += ["-i", inp]
+		backward = []
+		for inp in reversed(inputs):
+			backward += ["-i", inp]
+		self.assertEqual( getCmdResult(cmd + ["f:e", "-o", OUTDIR+"multiHash.esl"] + forward, out, self), True)
+		self.assertEqual( getCmdResult(cmd + ["f:e", "-o", OUTDIR+"multiHashRev.esl"] + backward, out, self), True)
+		self.assertEqual( compareFiles(OUTDIR+"multiHash.esl", OUTDIR+"multiHashRev.esl"), True)
+		self.assertEqual( os.path.getsize(OUTDIR+"multiHash.esl"), 28 + len(inputs) * (16 + 32)) #one header for all entries
+		self.assertEqual( getCmdResult([SECTOOLS ,"validate", "-e", "-x", OUTDIR+"multiHash.esl"], out, self), True)
+		self.assertEqual( getCmdResult(cmd + ["c:e", "-o", OUTDIR+"foo.esl"] + forward, out, self), False) #only hashes can share a list
 	def test_genEsl(self):
 			out = "genEslLog.txt"
 			cmd = GEN
@@ -181,6 +196,47 @@ class Test(unittest.TestCase):
 				self.assertEqual( compareFiles(eslMade, eslDesired), True) #make sure the generated file is byte for byte the same as the one we know is correct
 			for i in badESLcommands:
 				self.assertEqual( getCmdResult(cmd + i[0], out, self), i[1]) 
+	def test_compactEsl(self):
+		out = "genCompactLog.txt"
+		cmd = GEN
+		#duplicates and one list per entry, as years of appended updates leave them
+		hashes = ["./testdata/dbx_by_KEK.crt", "./testdata/dbx_by_PK.crt", "./testdata/goldenKeys/dbx/dbx.crt"]
+		for i, inp in enumerate(hashes):
+			self.assertEqual( getCmdResult(cmd + ["f:e", "-i", inp, "-o", OUTDIR+"single%d.esl" % i], out, self), True)
+		singles = []
+		for i in [0, 1, 0, 2, 1]:
+			with open(OUTDIR+"single%d.esl" % i, "rb") as f:
+				singles.append(f.read())
+		with open(OUTDIR+"messy.esl", "wb") as f:
+			f.write(b"".join(singles))
+		with open(OUTDIR+"messyRev.esl", "wb") as f:
+			f.write(b"".join(reversed(singles)))
+		self.assertEqual( getCmdResult(cmd + ["e:e", "--compact", "-n", "dbx", "-i", OUTDIR+"messy.esl", "-o", OUTDIR+"compact.esl"], out, self), True)
+		with open(out) as f:
+			self.assertIn("saved 208 bytes", f.read())
+		self.assertEqual( getCmdResult(cmd + ["e:e", "--compact", "-n", "dbx", "-i", OUTDIR+"messyRev.esl", "-o", OUTDIR+"compactRev.esl"], out, self), True)
+		self.assertEqual( compareFiles(OUTDIR+"compact.esl", OUTDIR+"compactRev.esl"), True) #order of the input does not matter
+		self.assertEqual( os.path.getsize(OUTDIR+"compact.esl"), 28 + len(hashes) * (16 + 32)) #one list, no repeats
+		self.assertEqual( getCmdResult([SECTOOLS ,"validate", "-e", "-x", OUTDIR+"compact.esl"], out, self), True)
+		#certificates of the same size share a list too
+		with open(OUTDIR+"messyDb.esl", "wb") as f:
+			for inp in ["db_by_PK.esl", "db_by_KEK.esl", "db_by_PK.esl"]:
+				with open("./testdata/"+inp, "rb") as esl:
+					f.write(esl.read())
+		self.assertEqual( getCmdResult(cmd + ["e:e", "--compact", "-n", "db", "-i", OUTDIR+"messyDb.esl", "-o", OUTDIR+"compactDb.esl"], out, self), True)
+		self.assertEqual( getCmdResult([SECTOOLS ,"validate", "-e", OUTDIR+"compactDb.esl"], out, self), True)
+		#a repeated PK is fixed, two different ones are still not a valid PK
+		with open(OUTDIR+"twoPK.esl", "wb") as f:
+			with open("./testdata/PK_by_PK.esl", "rb") as esl:
+				f.write(esl.read() * 2)
+		self.assertEqual( getCmdResult(cmd + ["e:e", "--compact", "-n", "PK", "-i", OUTDIR+"twoPK.esl", "-o", OUTDIR+"compactPK.esl"], out, self), True)
+		self.assertEqual( compareFiles(OUTDIR+"compactPK.esl", "./testdata/PK_by_PK.esl"), True)
+		self.assertEqual( getCmdResult(cmd + ["e:e", "--compact", "-n", "PK", "-i", OUTDIR+"messyDb.esl", "-o", OUTDIR+"foo.esl"], out, self), False)
+		#the ESL of an auth file can be compacted directly
+		self.assertEqual( getCmdResult(cmd + ["a:e", "--compact", "-n", "db", "-i", "./testdata/db_by_PK.auth", "-o", OUTDIR+"compactAuth.esl"], out, self), True)
+		self.assertEqual( compareFiles(OUTDIR+"compactAuth.esl", "./testdata/db_by_PK.esl"), True)
+		self.assertEqual( getCmdResult(cmd + ["e:e", "-n", "dbx", "-i", OUTDIR+"messy.esl", "-o", OUTDIR+"foo.esl"], out, self), False) #only with --compact
+		self.assertEqual( getCmdResult(cmd + ["e:a", "--compact", "-n", "dbx", "-i", OUTDIR+"messy.esl", "-o", OUTDIR+"foo.auth"], out, self), False)
 	def test_genSignedFilesGen(self):
 		out = "genSignedFilesLog.txt"
 		auths = [] #array of[filename, key being updated, key signing]
@@ -365,7 +421,79 @@ class Test(unittest.TestCase):
 		self.assertEqual(getCmdResult(GEN + ["c:a", "-n", "db", "-s", genSig, "-c", sigCrt, "-i", inpCrt, "-o", actualOutput] + timestamp, out, self), True)
 		#two files should be eqaul
 		self.assertEqual(compareFiles(expectedOutput, actualOutput), True)
-		
+
+	def test_genDeltaUpdate(self):
+		out = "genDeltaUpdateLog.txt"
+		timestamp = ["-t", "2021-1-1T1:1:1"]
+		signer = ["-k", "./testdata/goldenKeys/KEK/KEK.key", "-c", "./testdata/goldenKeys/KEK/KEK.crt"]
+		old = ["-i", "./testdata/dbx_by_KEK.crt", "-i", "./testdata/dbx_by_PK.crt"]
+		new = old + ["-i", "./testdata/goldenKeys/dbx/dbx.crt"]
+		self.assertEqual( getCmdResult(GEN + ["f:e", "-o", OUTDIR+"deltaCur.esl"] + old, out, self), True)
+		self.assertEqual( getCmdResult(GEN + ["f:e", "-o", OUTDIR+"deltaNew.esl"] + new, out, self), True)
+		#restore testenv even if an assertion below fails, later tests use it
+		self.addCleanup(setupTestEnv)
+		command(["cp", OUTDIR+"deltaCur.esl", "testenv/dbx/data"])
+		with open("testenv/dbx/size", "w") as f:
+			f.write(str(os.path.getsize(OUTDIR+"deltaCur.esl")))
+		#only the added hash is signed, as an append write
+		self.assertEqual( getCmdResult(GEN + ["e:a", "-n", "dbx", "-p", "testenv/", "-i", OUTDIR+"deltaNew.esl", "-o", OUTDIR+"delta.auth"] + signer + timestamp, out, self), True)
+		self.assertEqual( getCmdResult(GEN + ["e:a", "-n", "dbx", "--current", OUTDIR+"deltaCur.esl", "-i", OUTDIR+"deltaNew.esl", "-o", OUTDIR+"deltaFile.auth"] + signer + timestamp, out, self), True)
+		self.assertEqual( compareFiles(OUTDIR+"delta.auth", OUTDIR+"deltaFile.auth"), True)
+		self.assertEqual( getCmdResult(GEN + ["e:a", "-n", "dbx", "-i", OUTDIR+"deltaNew.esl", "-o", OUTDIR+"full.auth"] + signer + timestamp, out, self), True)
+		self.assertEqual( os.path.getsize(OUTDIR+"full.auth") - os.path.getsize(OUTDIR+"delta.auth"), 2 * (16 + 32))
+		self.assertEqual( getCmdResult([SECTOOLS, "verify", "-v", "-p", "testenv/", "-u", "dbx", OUTDIR+"delta.auth"], out, self), True)
+		with open(out) as f:
+			log = f.read()
+		self.assertIn("as an append write", log)
+		self.assertIn("dbx contains 200 bytes", log) #current 124 bytes + one more list of one hash
+		#an append write is not a replacing write, the signatures differ
+		self.assertEqual( getCmdResult([SECTOOLS, "verify", "-p", "testenv/", "-u", "dbx", OUTDIR+"full.auth"], out, self), True)
+		with open(out) as f:
+			self.assertNotIn("as an append write", f.read())
+		#nothing new to add
+		self.assertEqual( getCmdResult(GEN + ["e:a", "-n", "dbx", "-p", "testenv/", "-i", OUTDIR+"deltaCur.esl", "-o", OUTDIR+"foo.auth"] + signer, out, self), False)
+		#removing an entry needs the whole ESL
+		self.assertEqual( getCmdResult(GEN + ["f:a", "-n", "dbx", "-p", "testenv/", "-i", "./testdata/dbx_by_KEK.crt", "-o", OUTDIR+"shrink.auth"] + signer, out, self), True)
+		self.assertEqual( getCmdResult([SECTOOLS, "verify", "-p", "testenv/", "-u", "dbx", OUTDIR+"shrink.auth"], out, self), True)
+		with open(out) as f:
+			self.assertNotIn("as an append write", f.read())
+		#the current variable only makes sense for signed updates
+		self.assertEqual( getCmdResult(GEN + ["e:e", "-n", "dbx", "-p", "testenv/", "-i", OUTDIR+"deltaNew.esl", "-o", OUTDIR+"foo.esl"], out, self), False)
+
+	def test_genBatch(self):
+		out = "genBatchLog.txt"
+		signer = ["-k", "./testdata/goldenKeys/KEK/KEK.key", "-c", "./testdata/goldenKeys/KEK/KEK.crt"]
+		manifest = OUTDIR+"batch.txt"
+		with open(manifest, "w") as f:
+			f.write("# updates for db and dbx\n")
+			f.write("e:a -n db -i ./testdata/db_by_KEK.esl -o "+OUTDIR+"batch1.auth\n\n")
+			f.write("  e:a -n dbx -i ./testdata/dbx_by_KEK.esl -o "+OUTDIR+"batch2.auth\n")
+			f.write("c:a -n db -i ./testdata/db_by_PK.crt -o "+OUTDIR+"batch3.auth\n")
+			f.write("reset -n db -o "+OUTDIR+"batch4.auth\n")
+		self.assertEqual( getCmdResult(GEN + ["--batch", manifest, "-t", "2021-1-1T1:1:1", "-j", "3"] + signer, out, self), True)
+		#each update of a variable is one second after the one before it
+		stamps = []
+		for i in range(1, 5):
+			with open(OUTDIR+"batch%d.auth" % i, "rb") as f:
+				stamps.append(list(f.read(7)))
+		self.assertEqual( stamps[0], [229, 7, 1, 1, 1, 1, 1])
+		self.assertEqual( stamps[1], [229, 7, 1, 1, 1, 1, 1])
+		self.assertEqual( stamps[2], [229, 7, 1, 1, 1, 1, 2])
+		self.assertEqual( stamps[3], [229, 7, 1, 1, 1, 1, 3])
+		#same as generating on its own
+		self.assertEqual( getCmdResult(GEN + ["e:a", "-n", "db", "-t", "2021-1-1T1:1:1", "-i", "./testdata/db_by_KEK.esl", "-o", OUTDIR+"single.auth"] + signer, out, self), True)
+		self.assertEqual( compareFiles(OUTDIR+"batch1.auth", OUTDIR+"single.auth"), True)
+		#updates apply in manifest order, not the other way around
+		verifyCommand = [SECTOOLS, "verify", "-p", "./testdata/goldenKeys/", "-u"]
+		self.assertEqual( getCmdResult(verifyCommand + ["db", OUTDIR+"batch1.auth", "dbx", OUTDIR+"batch2.auth", "db", OUTDIR+"batch3.auth", "db", OUTDIR+"batch4.auth"], out, self), True)
+		self.assertEqual( getCmdResult(verifyCommand + ["db", OUTDIR+"batch3.auth", "db", OUTDIR+"batch1.auth"], out, self), False)
+		#signers are only given on the command line
+		with open(manifest, "w") as f:
+			f.write("e:a -n db -k ./testdata/goldenKeys/KEK/KEK.key -i ./testdata/db_by_KEK.esl -o "+OUTDIR+"foo.auth\n")
+		self.assertEqual( getCmdResult(GEN + ["--batch", manifest] + signer, out, self), False)
+		self.assertEqual( getCmdResult(GEN + ["--batch", manifest, "-i", "./testdata/db_by_KEK.esl"] + signer, out, self), False)
+		self.assertEqual( getCmdResult(GEN + ["e:e", "-j", "2", "-i", "./testdata/db_by_KEK.esl", "-o", OUTDIR+"foo.esl"], out, self), False)
+
 	def test_genHash(self):
 		out = "genHashLog.txt"
 		inpDir = "./testdata/"
@@ -378,6 +506,20 @@ class Test(unittest.TestCase):
 		]
 		#basic test, invalid inForm for generating hash 't'
 		self.assertEqual( getCmdResult(GEN + ["t:h", "-i", inpDir+"db_by_PK.auth", "-o", "foo.bar"], out, self), False)
+		#files are hashed in chunks, make sure one spanning several chunks still gets the right hash
+		bigFile = OUTDIR+"bigFile.bin"
+		with open(bigFile, "wb") as f:
+			f.write(os.urandom(5 * 1024 * 1024 + 123))
+		with open(bigFile, "rb") as f:
+			data = f.read()
+		expected = hashlib.sha512(data).digest()
+		self.assertEqual( getCmdResult(GEN + ["f:h", "-h", "SHA512", "-i", bigFile, "-o", OUTDIR+"bigFile.hash"], out, self), True)
+		with open(OUTDIR+"bigFile.hash", "rb") as f:
+			self.assertEqual(f.read(), expected)
+		#same file through a pipe, which cannot be mapped or sized up front
+		result = subprocess.run(GEN + ["f:h", "-h", "SHA512", "-i", "/dev/stdin", "-o", OUTDIR+"bigFilePipe.hash"], input=data, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+		self.assertEqual(result.returncode, 0)
+		self.assertEqual(compareFiles(OUTDIR+"bigFile.hash", OUTDIR+"bigFilePipe.hash"), True)
 		for function in hashes:
 			inpDir = "./testdata/"
 			for file in os.listdir(inpDir):
@@ -5,9 +5,15 @@ import subprocess
 import os
 import filecmp
 import sys
+import struct
+import json
+import ctypes
+import concurrent.futures
 MEM_ERR = 101
 SECTOOLS="../secvarctl-cov"
 SECVARPATH="/sys/firmware/secvar/vars/"
+LIBSECVARCTL="../libsecvarctl.so"
+LIBSECVARCTL_STATIC="../libsecvarctl.a"
 goodAuths=[]
 badAuths=[]
 goodESLs=[]
@@ -101,6 +107,33 @@ validateCommands=[
 [["-c"], False], # no crt
 [["-p"], False],#no pkcs7
 [["-p","./testdata/db_by_PK.auth"], False],#give auth as pkcs7
+[["--dir", "./testdata/brokenFiles/", "-j", "4"], False],#every file is broken
+[["--dir", "./foo/"], False],#nonexistent directory
+[["--dir", "./testdata/", "./testdata/db_by_PK.auth"], False],#directory and file given
+[["--dir", "./testdata/", "-j", "0"], False],#bad thread count
+]
+batchCommands=[ #[manifest contents, arr options for batch, expected result]
+["validate -e ./testdata/db_by_PK.esl\nvalidate -c ./testdata/db_by_PK.crt\nread -p ./testenv/ PK\n", [], True], #sequential jobs
+["# comment\n\nvalidate -e ./testdata/db_by_PK.esl\nvalidate ./testdata/KEK_by_PK.auth\nverify -p ./testenv/ -u db ./testdata/db_by_PK.auth\n", ["-j", "4"], True], #concurrent jobs
+["verify -p ./testenv/ -u db ./testdata/db_by_PK.auth\nverify -p ./testenv/ -u KEK ./testdata/KEK_by_PK.auth\nverify -p ./testenv/ -u dbx ./testdata/dbx_by_PK.auth\nverify -p ./testenv/ -u db ./testdata/db_by_PK.auth\n", ["-j", "4"], True], #verify jobs run side by side
+["verify -p ./testenv/ -u db ./testdata/db_by_PK.auth\nverify -p ./testenv/ -u db ./testdata/bad_db_by_db.auth\nverify -p ./testenv/ -u KEK ./testdata/KEK_by_PK.auth\n", ["-j", "4"], False], #one of them fails
+["verify -p ./testenv/ -u db ./testdata/db_by_PK.auth\nverify -p ./testenv/ -u dbx ./testdata/dbx_by_PK.auth\nwrite -p ./testenv/ KEK ./testdata/KEK_by_PK.auth\nverify -p ./testenv/ -u db ./testdata/db_by_PK.auth\n", ["-j", "4"], True], #write waits for the verify jobs above it
+["write -p ./testenv/ KEK ./testdata/KEK_by_PK.auth\nwait\nverify -p ./testenv/ -u db ./testdata/db_by_PK.auth\n", ["-j", "2"], True], #barrier between jobs
+["validate -e ./testdata/db_by_PK.esl\nvalidate -e ./testdata/db_by_PK.auth\n", ["-j", "2"], False], #one failed job fails batch
+["read -f ./testenv/batch.esl\ngenerate c:e -i ./testdata/db_by_PK.crt -o ./testenv/batch.esl\nvalidate -e ./testenv/batch.esl\n", ["-j", "4"], False], #read runs before the esl exists, generate waits for it
+["generate c:e -i ./testdata/db_by_PK.crt -o ./testenv/batch.esl\nvalidate -e ./testenv/batch.esl\ngenerate e:a -k ./testdata/goldenKeys/PK/PK.key -c ./testdata/goldenKeys/PK/PK.crt -n db -i ./testenv/batch.esl -o testenv//batch.esl\nvalidate -a ./testenv/batch.esl\n", ["-j", "4"], True], #the auth overwrites the esl once it has been validated
+["generate c:e -i ./testdata/db_by_PK.crt -o ./testenv/batch.esl\nvalidate -e ./testenv/batch.esl\nread -f ./testenv/batch.esl\n", ["-j", "4"], True], #jobs wait on generated input
+["generate c:e -i ./testdata/db_by_PK.esl -o ./testenv/batch.esl\nvalidate -e ./testenv/batch.esl\n", ["-j", "2"], False], #generate fails so validate is skipped
+["validate -e ./testdata/db_by_PK.esl\nfoobar\n", [], False], #unknown command
+["batch ./testenv/batch.txt\n", [], False], #no nested batch
+["\n# nothing\n", [], False], #no jobs
+["validate -e ./testdata/db_by_PK.esl\n", ["-j", "0"], False], #bad thread count
+["validate -e ./testdata/db_by_PK.esl\n", ["-j", "foo"], False], #bad thread count
+]
+batchArgCommands=[
+[["--usage"], True],[["--help"], True],
+[[], False], #no manifest
+[["foo.txt"], False], #nonexistent manifest
 ]
 
 badEnvCommands=[ #[arr command to skew env, output of first command, arr command for sectool, expected result]
@@ -220,6 +253,23 @@ class Test(unittest.TestCase):
 			self.assertEqual( getCmdResult(cmd+[ "-p", "testenv/","-u",fileInfo[1],file],out, self), False)#verify all bad auths are not signed correctly
 		for i in verifyCommands:
 			self.assertEqual( getCmdResult(cmd+i[0],out, self),i[1])
+		#one ESL holding two certificates, the signer is the second entry so every entry must be looked at
+		with open("./testdata/goldenKeys/KEK/data", "rb") as f:
+			x509Guid = f.read(16)
+		with open("./testdata/db_by_PK.der", "rb") as f:
+			first = f.read()
+		with open("./testdata/goldenKeys/KEK/KEK.der", "rb") as f:
+			second = f.read()
+		entries = bytes(16) + first + bytes(16) + second #same length certs, blank owner guids
+		packed = x509Guid + struct.pack("<III", 28 + len(entries), 0, 16 + len(first)) + entries
+		with open("testenv/KEK/data", "wb") as f:
+			f.write(packed)
+		with open("testenv/KEK/size", "w") as f:
+			f.write(str(len(packed)))
+		self.assertEqual( getCmdResult([SECTOOLS, "validate", "-e", "testenv/KEK/data"],out, self), True)
+		self.assertEqual( getCmdResult([SECTOOLS, "read", "-p", "testenv/", "KEK"],out, self), True)
+		self.assertEqual( getCmdResult(cmd+["-p", "testenv/","-u","db","./testdata/db_by_KEK.auth"],out, self), True)
+		setupTestEnv()
 	def test_validate(self):
 		out="validatelog.txt"
 		cmd=[SECTOOLS, "validate"]
@@ -250,6 +300,25 @@ class Test(unittest.TestCase):
 			self.assertEqual( getCmdResult(cmd+["-v", "-c", i],out, self), False)
 		for i in brokenPkcs7s:
 			self.assertEqual( getCmdResult(cmd+["-v", "-p", i],out, self), False)
+		#junk bytes after the last entry but inside the list size, the entries no longer fill the list
+		with open("./testdata/dbx_by_PK.esl", "rb") as f:
+			esl = f.read()
+		listSize = struct.unpack("<I", esl[16:20])[0]
+		junk = esl[:16] + struct.pack("<I", listSize + 5) + esl[20:listSize] + bytes(5) + esl[listSize:]
+		with open("testenv/junk.esl", "wb") as f:
+			f.write(junk)
+		self.assertEqual( getCmdResult(cmd+["-e", "./testdata/dbx_by_PK.esl", "-x"],out, self), True)
+		self.assertEqual( getCmdResult(cmd+["-e", "testenv/junk.esl", "-x"],out, self), False)
+		#copy all good files into one directory, types should be detected
+		validateDir="./testenv/validateDir/"
+		os.makedirs(validateDir, exist_ok=True)
+		for i in goodAuths+goodESLs+goodCRTs:
+			command(["cp", "./testdata/"+i[0], validateDir])
+		self.assertEqual( getCmdResult(cmd+["--dir", validateDir],out, self), True)
+		self.assertEqual( getCmdResult(cmd+["--dir", validateDir, "-j", "4"],out, self), True)
+		command(["cp", "./testdata/brokenFiles/1db_by_PK.auth", validateDir])
+		self.assertEqual( getCmdResult(cmd+["--dir", validateDir, "-j", "4"],out, self), False)#one broken file
+		command(["rm", "-r", validateDir])
 	def test_read(self):
 		out="readlog.txt"
 		cmd=[SECTOOLS, "read"]
@@ -262,6 +331,44 @@ class Test(unittest.TestCase):
 							self.assertEqual( getCmdResult(cmd+["-f", i],out, self), True) 
 			else:
 				self.assertEqual( getCmdResult(cmd+["-f", i],out, self), False) #all truncated esls should fail to print human readable info
+		#read esl from a pipe, where file size is not known ahead of time
+		with open(out, "a") as f:
+			cat = subprocess.Popen(["cat", "./testdata/db_by_PK.esl"], stdout=subprocess.PIPE)
+			self.assertEqual(subprocess.call(cmd+["-f", "/dev/stdin"], stdin=cat.stdout, stdout=f, stderr=f), 0)
+			cat.stdout.close()
+			cat.wait()
+		#a dbx far larger than the output buffer, every hash is printed whole and in order
+		with open("./testdata/dbx_by_PK.esl", "rb") as f:
+			esl = f.read()
+		header, owner = esl[:28], esl[28:44]
+		hashes = [struct.pack("<I", i) * 8 for i in range(5000)]
+		listSize = len(header) + len(hashes) * (len(owner) + 32)
+		with open("./testenv/dbx/data", "wb") as f:
+			f.write(header[:16] + struct.pack("<I", listSize) + header[20:])
+			for h in hashes:
+				f.write(owner + h)
+		command(["echo", str(listSize)], "./testenv/dbx/size")
+		result = subprocess.run(cmd+["-p", "./testenv/", "dbx"], stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+		printed = [l.split("Hash: ")[1] for l in result.stdout.decode().splitlines() if "Hash: " in l]
+		self.assertEqual(printed, ["".join("/%02x" % b for b in h) for h in hashes])
+		setupTestEnv()
+	def test_query(self):
+		out="querylog.txt"
+		cmd=[SECTOOLS, "query"]
+		#the dbx ESL's hold the hash of the certificate they are named after
+		self.assertEqual( getCmdResult(cmd+["-f", "./testdata/dbx_by_PK.esl", "dbx", "--file", "./testdata/dbx_by_PK.crt"],out, self), False)
+		self.assertEqual( getCmdResult(cmd+["-f", "./testdata/dbx_by_PK.esl", "dbx", "--file", "./testdata/db_by_PK.crt"],out, self), True)
+		self.assertEqual( getCmdResult(cmd+["-p", "./testenv/", "dbx", "--file", "./testdata/db_by_PK.crt", "--file", "./testdata/goldenKeys/dbx/dbx.crt"],out, self), False)
+		with open("./testdata/dbx_by_PK.esl", "rb") as f:
+			revokedHash = f.read()[44:76] #skip the 28 byte header and 16 byte owner
+		self.assertEqual( getCmdResult(cmd+["-f", "./testdata/dbx_by_PK.esl", "dbx", "--hash", revokedHash.hex()],out, self), False)
+		self.assertEqual( getCmdResult(cmd+["-f", "./testdata/dbx_by_PK.esl", "dbx", "--hash", "/".join("%02x" % b for b in revokedHash)],out, self), False) #format printed by read
+		self.assertEqual( getCmdResult(cmd+["-f", "./testdata/dbx_by_PK.esl", "dbx", "--hash", "00" * 32],out, self), True)
+		self.assertEqual( getCmdResult(cmd+["-f", "./testdata/dbx_by_PK.esl", "dbx", "--hash", "00" * 31 + "0"],out, self), False) #odd number of digits
+		self.assertEqual( getCmdResult(cmd+["-f", "./testdata/dbx_by_PK.esl", "dbx", "--hash", "00" * 33],out, self), False) #not a known hash size
+		self.assertEqual( getCmdResult(cmd+["-f", "./testdata/dbx_by_PK.esl", "dbx"],out, self), False) #nothing to look for
+		self.assertEqual( getCmdResult(cmd+["-f", "./testdata/dbx_by_PK.esl", "db", "--hash", "00" * 32],out, self), False) #only dbx
+		self.assertEqual( getCmdResult(cmd+["-f", "./testdata/brokenFiles/empty.esl", "dbx", "--hash", "00" * 32],out, self), True) #empty dbx revokes nothing
 	def test_write(self):
 		out="writelog.txt"
 		cmd=[SECTOOLS,"write"]
@@ -278,6 +385,198 @@ class Test(unittest.TestCase):
 			self.assertEqual( getCmdResult(cmd+["-p", path, "KEK",i],out, self), False)#broken auths should fail
 			self.assertEqual( getCmdResult(cmd+["-p", path ,"-f", "KEK",i],out, self), True)#if forced, they should work
 			self.assertEqual(compareFiles(i,path+"KEK/update"), True)
+	def test_batch(self):
+		out="batchlog.txt"
+		cmd=[SECTOOLS, "batch"]
+		manifest="./testenv/batch.txt"
+		for i in batchArgCommands:
+			self.assertEqual( getCmdResult(cmd+i[0],out, self),i[1])
+		for i in batchCommands:
+			setupTestEnv()
+			command(["rm", "-f", "./testenv/batch.esl"])
+			with open(manifest, "w") as f:
+				f.write(i[0])
+			self.assertEqual( getCmdResult(cmd+i[1]+[manifest],out, self),i[2])
+		#a file rewritten by a job is read again, not served from the mapping of the old one
+		command([SECTOOLS, "generate", "c:e", "-i", "./testdata/KEK_by_PK.crt", "-o", "./testenv/expected.esl"], out)
+		for j in [[], ["-j", "4"]]:
+			command(["rm", "-f", "./testenv/batch.esl", "./testenv/copy.esl"])
+			with open(manifest, "w") as f:
+				f.write("generate c:e -i ./testdata/db_by_PK.crt -o ./testenv/batch.esl\nvalidate -e ./testenv/batch.esl\ngenerate c:e -i ./testdata/KEK_by_PK.crt -o ./testenv/batch.esl\ngenerate e:e --compact -i ./testenv/batch.esl -o ./testenv/copy.esl\n")
+			self.assertEqual( getCmdResult(cmd+j+[manifest],out, self), True)
+			self.assertEqual(compareFiles("./testenv/copy.esl", "./testenv/expected.esl"), True)
+		#certificates kept from an earlier job are not used once the KEK changes
+		with open(manifest, "w") as f:
+			f.write("verify -p ./testenv/ -u db ./testdata/db_by_KEK.auth\nverify -p ./testenv/ -u KEK ./testdata/KEK_by_PK.auth db ./testdata/db_by_KEK.auth\n")
+		self.assertEqual( getCmdResult(cmd+[manifest],out, self), False)
+		with open(manifest, "w") as f:
+			f.write("verify -p ./testenv/ -u db ./testdata/db_by_KEK.auth\nverify -p ./testenv/ -u KEK ./testdata/KEK_by_PK.auth db ./testdata/db_by_PK.auth\nverify -p ./testenv/ -u db ./testdata/db_by_KEK.auth\n")
+		self.assertEqual( getCmdResult(cmd+[manifest],out, self), True)
+		setupTestEnv()
+	def test_json(self):
+		out="jsonlog.txt"
+		def getJSON(args):
+			self.assertEqual( getCmdResult([SECTOOLS]+args,out, self), True)
+			result = subprocess.run([SECTOOLS]+args, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+			return json.loads(result.stdout.decode())
+		doc = getJSON(["read", "--output", "json", "-p", "./testenv/"])
+		self.assertEqual([v["variable"] for v in doc["variables"]], ["PK", "KEK", "db", "dbx", "TS"])
+		cert = doc["variables"][0]["esls"][0]["entries"][0]["certificate"]
+		#names are the RDNs in certificate order, the same with either crypto library
+		self.assertEqual((cert["subject"], cert["issuer"]), ("C=NC,O=testing corp", "C=NC,O=testing corp"))
+		command(["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes", "-keyout", "./testenv/name.key", "-out", "./testenv/name.crt",
+			 "-subj", "/C=NC/O=testing, corp/CN=a+OU=b", "-multivalue-rdn", "-days", "1"], out)
+		named = getJSON(["validate", "-c", "./testenv/name.crt", "--output", "json"])["certificate"]
+		self.assertEqual(named["subject"], "C=NC,O=testing\\, corp,CN=a+OU=b")
+		self.assertEqual(len(doc["variables"][4]["timestamps"]), 4)
+		with open("./testdata/dbx_by_PK.esl", "rb") as f:
+			revokedHash = f.read()[44:76] #skip the 28 byte header and 16 byte owner
+		doc = getJSON(["read", "--output", "json", "-f", "./testdata/dbx_by_PK.esl"])
+		self.assertEqual(doc["variables"][0]["esls"][0]["entries"][0]["hash"], revokedHash.hex())
+		doc = getJSON(["validate", "--output", "json", "./testdata/db_by_PK.auth"])
+		self.assertEqual(doc["result"], "SUCCESS")
+		self.assertEqual(doc["signers"][0]["serial"], cert["serial"]) #signed by the PK
+		doc = getJSON(["verify", "--output", "json", "-p", "./testenv/", "-u", "db", "./testdata/db_by_PK.auth"])
+		self.assertEqual(doc["signatures"], [{"variable": "db", "signed_by": "PK", "esl": 0, "append": False}])
+		#with -v the messages go to stderr and stdout still only holds the JSON
+		doc = getJSON(["read", "-v", "--output", "json", "-p", "./testdata/goldenKeys/"])
+		self.assertEqual(doc["command"], "read")
+		doc = getJSON(["verify", "-v", "--output", "json", "-p", "./testenv/", "-u", "db", "./testdata/db_by_PK.auth"])
+		self.assertEqual(doc["result"], "SUCCESS")
+		doc = getJSON(["validate", "-v", "--output", "json", "./testdata/db_by_PK.auth"])
+		self.assertEqual(doc["result"], "SUCCESS")
+		self.assertEqual( getCmdResult([SECTOOLS, "validate", "--output", "json", "-c", brokenCrts[0]],out, self), False)
+		self.assertEqual( getCmdResult([SECTOOLS, "read", "--output", "xml"],out, self), False)
+		self.assertEqual( getCmdResult([SECTOOLS, "read", "-r", "--output", "json"],out, self), False)
+	@unittest.skipUnless(os.path.exists(LIBSECVARCTL), "libsecvarctl.so is not built, see 'make lib'")
+	def test_lib(self):
+		#the structs of include/libsecvarctl.h
+		class Var(ctypes.Structure):
+			_fields_ = [("name", ctypes.c_char_p), ("data", ctypes.c_void_p), ("size", ctypes.c_size_t)]
+		class Entry(ctypes.Structure):
+			_fields_ = [("esl", ctypes.c_size_t), ("type", ctypes.c_ubyte * 16), ("type_name", ctypes.c_char_p),
+				    ("owner", ctypes.c_ubyte * 16), ("data", ctypes.c_void_p), ("size", ctypes.c_size_t)]
+		class ParseResult(ctypes.Structure):
+			_fields_ = [("timestamp", ctypes.c_long), ("esl_count", ctypes.c_size_t),
+				    ("entry_count", ctypes.c_size_t), ("entries", ctypes.POINTER(Entry))]
+		class Signature(ctypes.Structure):
+			_fields_ = [("variable", ctypes.c_char * 8), ("signed_by", ctypes.c_char * 8),
+				    ("esl", ctypes.c_int), ("append", ctypes.c_int)]
+		class VerifyResult(ctypes.Structure):
+			_fields_ = [("opal_rc", ctypes.c_int), ("signature_count", ctypes.c_size_t),
+				    ("signatures", ctypes.POINTER(Signature)), ("var_count", ctypes.c_size_t),
+				    ("vars", ctypes.POINTER(Var))]
+		AUTH, ESL, PKCS7, CERT = range(4)
+		lib = ctypes.CDLL(LIBSECVARCTL)
+		lib.secvarctl_strerror.restype = ctypes.c_char_p
+		def read(file):
+			with open(file, "rb") as f:
+				return f.read()
+		def variables(names, data):
+			return (Var * len(data))(*[Var(n.encode(), ctypes.cast(ctypes.c_char_p(d), ctypes.c_void_p), len(d)) for n, d in zip(names, data)]), data
+		def verify(updateNames, updateData):
+			current, keep = variables(variables_, [read("./testenv/%s/data" % v) for v in variables_])
+			updates, keep2 = variables(updateNames, updateData)
+			result = VerifyResult()
+			rc = lib.secvarctl_verify(current, len(current), updates, len(updates), ctypes.byref(result))
+			sigs = [(s.variable.decode(), s.signed_by.decode()) for s in result.signatures[:result.signature_count]]
+			vars = {v.name.decode(): ctypes.string_at(v.data, v.size) for v in result.vars[:result.var_count]}
+			lib.secvarctl_verify_result_free(ctypes.byref(result))
+			return rc, sigs, vars
+		variables_ = ["PK", "KEK", "db", "dbx", "TS"]
+		auth = read("./testdata/db_by_PK.auth")
+		self.assertEqual(lib.secvarctl_validate(AUTH, b"db", auth, len(auth)), 0)
+		cert = read(brokenCrts[0])
+		self.assertNotEqual(lib.secvarctl_validate(CERT, b"db", cert, len(cert)), 0)
+		self.assertEqual(lib.secvarctl_strerror(-1), b"invalid auth")
+		#parse, entries point into the buffer given
+		esl = read("./testdata/dbx_by_PK.esl")
+		result = ParseResult()
+		self.assertEqual(lib.secvarctl_parse(ESL, esl, len(esl), ctypes.byref(result)), 0)
+		self.assertEqual((result.esl_count, result.entry_count), (1, 1))
+		self.assertEqual(result.entries[0].type_name, b"SHA256")
+		self.assertEqual(ctypes.string_at(result.entries[0].data, result.entries[0].size), esl[44:76])
+		lib.secvarctl_parse_result_free(ctypes.byref(result))
+		self.assertEqual(lib.secvarctl_parse(AUTH, auth, len(auth), ctypes.byref(result)), 0)
+		self.assertNotEqual(result.timestamp, 0)
+		lib.secvarctl_parse_result_free(ctypes.byref(result))
+		#nothing is printed, even for calls that fail
+		def quiet(call):
+			saved = os.dup(2)
+			with open("liblog.txt", "w+") as log:
+				os.dup2(log.fileno(), 2)
+				try:
+					rc = call()
+				finally:
+					os.dup2(saved, 2)
+					os.close(saved)
+				log.seek(0)
+				self.assertEqual(log.read(), "")
+			return rc
+		self.assertEqual(quiet(lambda: lib.secvarctl_parse(ESL, esl, 30, ctypes.byref(result))), -3)
+		truncated = esl[:16] + b"\xff\xff" + esl[18:64]
+		self.assertEqual(quiet(lambda: lib.secvarctl_parse(ESL, truncated, len(truncated), ctypes.byref(result))), -3)
+		#verify, the same as the verify command
+		rc, sigs, vars = verify(["db"], [auth])
+		self.assertEqual((rc, sigs), (0, [("db", "PK")]))
+		self.assertEqual(vars["db"], read("./testdata/db_by_PK.esl"))
+		rc, sigs, vars = verify(["db"], [read("./testdata/bad_db_by_db.auth")])
+		self.assertNotEqual(rc, 0)
+		#generate an update signed by the KEK and verify it
+		signers = ctypes.c_void_p()
+		crts = (ctypes.c_char_p * 1)(b"./testdata/goldenKeys/KEK/KEK.crt")
+		keys = (ctypes.c_char_p * 1)(b"./testdata/goldenKeys/KEK/KEK.key")
+		self.assertEqual(lib.secvarctl_signers_load(ctypes.byref(signers), crts, keys, 1), 0)
+		crt = read("./testdata/db_by_KEK.crt")
+		out, outSize = ctypes.c_void_p(), ctypes.c_size_t()
+		self.assertEqual(lib.secvarctl_generate_esl(crt, len(crt), ctypes.byref(out), ctypes.byref(outSize)), 0)
+		newESL = ctypes.string_at(out, outSize.value)
+		lib.secvarctl_free(out)
+		self.assertEqual(lib.secvarctl_generate_auth(b"db", newESL, len(newESL), ctypes.c_long(2000000000), 0, signers, ctypes.byref(out), ctypes.byref(outSize)), 0)
+		self.assertNotEqual(quiet(lambda: lib.secvarctl_generate_auth(b"foo", newESL, len(newESL), ctypes.c_long(2000000000), 0, signers, ctypes.byref(out), ctypes.byref(outSize))), 0)
+		lib.secvarctl_signers_free(signers)
+		newAuth = ctypes.string_at(out, outSize.value)
+		lib.secvarctl_free(out)
+		rc, sigs, vars = verify(["db"], [newAuth])
+		self.assertEqual((rc, sigs), (0, [("db", "KEK")]))
+		self.assertEqual(vars["db"], newESL)
+		#every call has a context of its own, verify from several threads at once
+		updates = [(newAuth, (0, [("db", "KEK")])), (auth, (0, [("db", "PK")]))]
+		updates.append((read("./testdata/bad_db_by_db.auth"), None))
+		with concurrent.futures.ThreadPoolExecutor(8) as pool:
+			results = list(pool.map(lambda u: verify(["db"], [u[0]])[:2], [updates[i % 3] for i in range(48)]))
+		for i, (rc, sigs) in enumerate(results):
+			expected = updates[i % 3][1]
+			if expected:
+				self.assertEqual((rc, sigs), expected)
+			else:
+				self.assertNotEqual(rc, 0)
+	@unittest.skipUnless(os.path.exists(LIBSECVARCTL_STATIC), "libsecvarctl.a is not built, see 'make lib'")
+	def test_lib_static(self):
+		#only the functions of include/libsecvarctl.h may be global, the rest would clash with the program
+		out = subprocess.run(["nm", "-g", "--defined-only", LIBSECVARCTL_STATIC], stdout=subprocess.PIPE, check=True).stdout
+		symbols = [l.split()[-1] for l in out.decode().splitlines() if len(l.split()) == 3]
+		self.assertIn("secvarctl_verify", symbols)
+		self.assertEqual([s for s in symbols if not s.startswith("secvarctl_")], [])
+	def test_stats(self):
+		out="statslog.txt"
+		cmd=[SECTOOLS, "--stats=json", "verify", "-p", "./testenv/", "-u", "db", "./testdata/db_by_PK.auth"]
+		self.assertEqual( getCmdResult(cmd,out, self), True)
+		#the summary is the last line written to stderr
+		result = subprocess.run(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+		stats = json.loads(result.stderr.decode().splitlines()[-1])
+		self.assertEqual(stats["phases"]["process"]["calls"], 1)
+		self.assertEqual(stats["counters"]["rsa_verifies"], 1)
+		self.assertGreater(stats["counters"]["bytes_hashed"], 0)
+		self.assertGreater(stats["counters"]["allocations"], 0)
+		self.assertEqual( getCmdResult([SECTOOLS, "--stats", "validate", "-c", "./testdata/db_by_PK.der"],out, self), True)
+		#only signatures that were made are counted
+		def signs(key):
+			gen = [SECTOOLS, "--stats=json", "generate", "c:a", "-k", key, "-c", "./testdata/goldenKeys/KEK/KEK.crt", "-n", "db", "-i", "./testdata/db_by_KEK.crt", "-o", "./testenv/stats.auth"]
+			result = subprocess.run(gen, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+			return json.loads(result.stderr.decode().splitlines()[-1])["counters"]["rsa_signs"]
+		self.assertEqual(signs("./testdata/goldenKeys/KEK/KEK.key"), 1)
+		self.assertEqual(signs("./testdata/goldenKeys/PK/PK.key"), 0) #does not match the certificate
 	def test_badenv(self):
 		out="badEnvLog.txt"
 		for i in badEnvCommands: